@@ -54,6 +54,7 @@ class Bench(object):
           "lut": "CPU_LUT_OpenMP",
           "lut_ocl": "%s_LUT_OpenCL",
           "csr": "CPU_CSR_OpenMP",
+          "csr_numa": "CPU_CSR_NUMA",
           "csr_ocl": "%s_CSR_OpenCL",
           }
 
@@ -245,6 +246,57 @@ data = fabio.open(r"%s").data
         self.results[label] = results
         self.update_mp()
 
+    def bench_numa(self):
+        """
+        Benchmark the NUMA-aware CSR integration and report the bandwidth
+        measured on each node
+        """
+        self.update_mp()
+        print("Working on processor: %s" % self.get_cpu())
+        topology = pyFAI.sparse_csr.numa_topology()
+        print("NUMA nodes: %s" % ", ".join("%s (%i CPUs)" % (node, len(cpus)) for node, cpus in sorted(topology.items())))
+        label = "1D_" + self.LABELS["csr_numa"]
+        results = {}
+        first = True
+        for param in ds_list:
+            self.update_mp()
+            fn = datasets[param]
+            exec self.setup_1d % (param, fn)
+            size = data.size / 1.0e6
+            print("1D integration of %s %.1f Mpixel -> %i bins" % (op.basename(fn), size, N))
+            try:
+                t0 = time.time()
+                ai.integrate1d(data, N, safe=False, unit=self.unit, method="csr_numa")
+                self.print_init(time.time() - t0)
+            except MemoryError as error:
+                print(error)
+                break
+            integr = ai._numa_integrator
+            tmin = None
+            bandwidth = {}
+            for i in range(self.nbr):
+                t0 = time.time()
+                integr.integrate(data)
+                t = time.time() - t0
+                if (tmin is None) or (t < tmin):
+                    tmin = t
+                    bandwidth = integr.bandwidth()
+            self.print_exec(tmin)
+            for node, partition in zip(integr.nodes, integr.partitions):
+                print(" * Node %s: %.1f MB of matrix, %.2f GB/s" % (node, partition["nbytes"] / 1e6, bandwidth[node] / 1e9))
+            del ai, data, integr
+            tmin *= 1000.0
+            results[size] = tmin
+            if first:
+                self.new_curve(results, label)
+                first = False
+            else:
+                self.new_point(size, tmin)
+        self.print_sep()
+        self.meth.append(label)
+        self.results[label] = results
+        self.update_mp()
+
     def bench_2d(self, method="splitBBox", check=False, opencl=None):
         self.update_mp()
         if opencl:
@@ -515,6 +567,9 @@ if __name__ == "__main__":
     parser.add_argument("-a", "--acc",
                         action="store_true", dest="opencl_acc", default=False,
                         help="perform benchmark using OpenCL on the Accelerator (like XeonPhi/MIC)")
+    parser.add_argument("--numa",
+                        action="store_true", dest="numa", default=False,
+                        help="Benchmark also the NUMA-aware CSR integration and report the bandwidth of each node")
     parser.add_argument("-s", "--small",
                         action="store_true", dest="small", default=False,
                         help="Limit the size of the dataset to 6 Mpixel images (for computer with limited memory)")
@@ -547,6 +602,8 @@ if __name__ == "__main__":
         bench.bench_1d("splitBBox")
         bench.bench_1d("lut", True)
         bench.bench_1d("csr", True)
+        if options.numa:
+            bench.bench_numa()
         if options.opencl_cpu:
             bench.bench_1d("lut_ocl", True, {"devicetype": "CPU"})
             bench.bench_1d("csr_ocl", True, {"devicetype": "CPU"})
@@ -0,0 +1,82 @@
+#!/usr/bin/python
+
+#Benchmark for the renumbering of pixels in CSR integration matrices:
+#execution time and, when the perf tool is available, cache and TLB misses
+
+from __future__ import print_function, division
+
+import sys, timeit, os, subprocess, gc, logging
+logging.basicConfig(level=logging.ERROR)
+import numpy
+
+import os.path as op
+sys.path.append(op.join(op.dirname(op.dirname(op.abspath(__file__))), "test"))
+import utilstest
+
+#We use the locally build version of PyFAI
+pyFAI = utilstest.UtilsTest.pyFAI
+
+here = op.dirname(op.abspath(__file__))
+ponis = ["Pilatus1M.poni", "Pilatus6M.poni"]
+orders = [None, "bin", "hilbert"]
+events = ["cache-misses", "dTLB-load-misses"]
+repeat = 3
+number = 10
+npt = 1000
+
+setup = """
+import sys
+sys.path.insert(0, %r)
+import pyFAI, numpy
+ai = pyFAI.load(%r)
+ai.csr_pixel_order = %r
+numpy.random.seed(0)
+data = numpy.random.randint(0, 65000, size=ai.detector.shape).astype(numpy.float32)
+ai.integrate1d(data, %i, method="csr", unit="2th_deg")
+"""
+stmt = "ai.integrate1d(data, %i, method='csr', unit='2th_deg', safe=False)" % npt
+
+
+def perf_stat(code):
+    """
+    Count the hardware events of the code with "perf stat"
+
+    @return: dict with the number of each event, empty if perf is not available
+    """
+    cmd = ["perf", "stat", "-x", ",", "-e", ",".join(events), sys.executable, "-c", code]
+    try:
+        proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    except OSError:
+        return {}
+    _, err = proc.communicate()
+    res = {}
+    for line in err.decode().split(os.linesep):
+        fields = line.split(",")
+        if len(fields) > 2 and fields[2] in events and fields[0].isdigit():
+            res[fields[2]] = int(fields[0])
+    return res
+
+
+print("Number of iteration: %s average over %s processing" % (repeat, number))
+pyFAI_path = op.dirname(op.dirname(pyFAI.__file__))
+for poni in ponis:
+    ref = None
+    for order in orders:
+        code = setup % (pyFAI_path, op.join(here, poni), order, npt)
+        t = timeit.Timer(stmt, code)
+        tmin = min([i / number for i in t.repeat(repeat=repeat, number=number)])
+        # the setup is counted as well: subtract it with a run without any integration
+        counters = perf_stat(code + os.linesep + "for i in range(%i): %s" % (number, stmt))
+        baseline = perf_stat(code)
+        line = "%s order=%-8s t=%.3fms" % (poni, order, tmin * 1000.0)
+        for event in events:
+            if event in counters and event in baseline:
+                misses = (counters[event] - baseline[event]) / number
+                line += " %s=%.3g" % (event, misses)
+                if ref is not None and ref.get(event):
+                    line += " (%+.0f%%)" % (100.0 * (misses / ref[event] - 1))
+                if order is None:
+                    ref = ref or {}
+                    ref[event] = misses
+        print(line)
+        gc.collect()
@@ -0,0 +1,337 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Azimuthal integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Automatic selection of the integration method and of the number of threads.
+
+Short timed trials of the candidate engines are run on a synthetic frame;
+the fastest engine whose result agrees with the reference (pixel splitting)
+is retained. Decisions are stored in a JSON file, keyed on the hardware and
+on the configuration of the integration, and re-used by method="auto".
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+__status__ = "development"
+
+import contextlib
+import hashlib
+import json
+import logging
+import os
+import platform
+import threading
+import time
+import numpy
+from . import units
+from ._version import version
+logger = logging.getLogger("pyFAI.autotune")
+try:
+    from . import isa
+except ImportError as error:
+    logger.warning("Unable to import pyFAI.isa: the number of threads will not be tuned: %s", error)
+    isa = None
+# number of threads available at import, before any decision is applied
+MAX_THREADS = isa.get_num_threads() if isa is not None else 1
+
+# "cython" is the plain histogram engine
+CANDIDATES = ("csr", "nosplit_csr", "full_csr", "lut", "splitbbox", "cython")
+REFERENCE = "full_csr"
+DEFAULT_FILE = os.path.join(os.path.expanduser("~"), ".pyFAI", "autotune.json")
+
+
+_cpu = None
+
+
+def get_cpu():
+    """
+    @return: description of the processor
+    """
+    global _cpu
+    if _cpu is not None:
+        return _cpu
+    cpu = None
+    if os.path.exists("/proc/cpuinfo"):
+        with open("/proc/cpuinfo") as cpuinfo:
+            for line in cpuinfo:
+                if line.startswith("model name"):
+                    cpu = line.split(":", 1)[1]
+                    break
+    if not cpu:
+        cpu = platform.processor() or platform.machine()
+    _cpu = " ".join(cpu.split())
+    return _cpu
+
+
+def thread_counts(max_threads):
+    """
+    @return: the number of threads to try: powers of two and the maximum
+    """
+    counts = [1]
+    while counts[-1] * 2 < max_threads:
+        counts.append(counts[-1] * 2)
+    if counts[-1] != max_threads:
+        counts.append(max_threads)
+    return counts
+
+
+def digest(value, dtype=numpy.float64):
+    """
+    @param value: array or sequence of numbers (range, mask ...)
+    @param dtype: type the values are converted to before hashing
+    @return: short hash of the values, to tell configurations apart in the keys
+    """
+    array = numpy.ascontiguousarray(value, dtype=dtype)
+    md5 = hashlib.md5(str(array.shape).encode())
+    md5.update(array.tobytes())
+    return md5.hexdigest()[:12]
+
+
+class Autotuner(object):
+    """
+    Times the integration engines for a given AzimuthalIntegrator and keeps
+    the fastest accurate one.
+
+    The geometry is not part of the key: it changes the content of the
+    matrices but hardly the relative speed of the engines.
+    """
+    def __init__(self, filename=None, candidates=CANDIDATES, rtol=1e-2, repeat=3, tune_threads=True):
+        """
+        @param filename: JSON file where decisions are persisted, PYFAI_AUTOTUNE or ~/.pyFAI/autotune.json by default
+        @param candidates: list of methods to try
+        @param rtol: maximum relative deviation from the reference result, as sum(|I-Iref|)/sum(|Iref|)
+        @param repeat: number of timed integrations per candidate (the best is kept)
+        @param tune_threads: also try fewer threads than available for the best engine
+        """
+        self.filename = filename or os.environ.get("PYFAI_AUTOTUNE") or DEFAULT_FILE
+        self.candidates = tuple(candidates)
+        self.rtol = rtol
+        self.repeat = max(1, int(repeat))
+        self.tune_threads = tune_threads and (isa is not None)
+        self._sem = threading.Semaphore()
+        self._decisions = None
+
+    def __repr__(self):
+        return "Autotuner of %s, decisions in %s" % (", ".join(self.candidates), self.filename)
+
+    @staticmethod
+    def hardware_key():
+        """
+        @return: string describing the processor and the kernels
+        """
+        key = [get_cpu(), platform.machine()]
+        if isa is not None:
+            key += ["%s threads" % MAX_THREADS, isa.selected()]
+        return "|".join(key)
+
+    @staticmethod
+    def config_key(ai, shape, npt, unit=units.Q, radial_range=None, azimuth_range=None, mask=None):
+        """
+        @return: string describing the integration
+        """
+        unit = units.to_unit(unit)
+        detector = ai.detector.name if ai.detector else "None"
+        key = [version, detector, "x".join(str(i) for i in shape), str(npt), str(unit),
+               "radial_range %s" % digest(radial_range) if radial_range is not None else "",
+               "azimuth_range %s" % digest(azimuth_range) if azimuth_range is not None else "",
+               "mask %s" % digest(numpy.asarray(mask) != 0, bool) if mask is not None else ""]
+        return "|".join(key)
+
+    def load(self):
+        """
+        Read the decisions from the file
+
+        @return: dictionary of decisions
+        """
+        with self._sem:
+            if self._decisions is None:
+                self._decisions = {}
+                if os.path.exists(self.filename):
+                    try:
+                        with open(self.filename) as infile:
+                            self._decisions = json.load(infile)
+                    except (IOError, ValueError) as error:
+                        logger.warning("Unable to read autotuning decisions from %s: %s", self.filename, error)
+            return self._decisions
+
+    def save(self):
+        """
+        Write the decisions to the file, atomically
+        """
+        decisions = self.load()
+        with self._sem:
+            dirname = os.path.dirname(os.path.abspath(self.filename))
+            try:
+                if not os.path.isdir(dirname):
+                    os.makedirs(dirname)
+                tmp = "%s.%s" % (self.filename, os.getpid())
+                with open(tmp, "w") as outfile:
+                    json.dump(decisions, outfile, indent=2, sort_keys=True)
+                os.rename(tmp, self.filename)
+            except (IOError, OSError) as error:
+                logger.warning("Unable to save autotuning decisions in %s: %s", self.filename, error)
+
+    def synthetic_frame(self, ai, shape, unit=units.Q):
+        """
+        Smooth image with rings, as seen by the detector
+
+        @return: 2D array of float32
+        """
+        pos = ai.__getattribute__(units.to_unit(unit).center)(shape)
+        pos = (pos - pos.min()) / max(pos.max() - pos.min(), 1e-10)
+        frame = 1000.0 * (1.0 + numpy.exp(-pos * 3.0)) + 200.0 * numpy.cos(40.0 * pos) ** 2
+        return frame.astype(numpy.float32)
+
+    def _time(self, ai, data, kwargs, method):
+        """
+        @return: best execution time in seconds and the integrated pattern, None if the engine failed
+        """
+        try:
+            result = ai.integrate1d(data, method=method, **kwargs)  # builds the matrices, not timed
+            best = None
+            for i in range(self.repeat):
+                t0 = time.time()
+                ai.integrate1d(data, method=method, **kwargs)
+                elapsed = time.time() - t0
+                best = elapsed if best is None else min(best, elapsed)
+        except (MemoryError, RuntimeError, ValueError, AssertionError) as error:
+            logger.warning("Autotuning: method %s failed: %s", method, error)
+            return None
+        return best, result[0], result[1]
+
+    @staticmethod
+    def deviation(result, reference):
+        """
+        Relative deviation of a pattern from the reference, on the positions
+        of the reference covered by both (engines do not have the same bins)
+
+        @return: sum(|I-Iref|)/sum(|Iref|)
+        """
+        pos, intensity = result[1:3]
+        ref_pos, ref_intensity = reference[1:3]
+        valid = (ref_pos >= pos[0]) & (ref_pos <= pos[-1])
+        norm = abs(ref_intensity[valid]).sum()
+        if norm == 0:
+            return 0.0
+        interpolated = numpy.interp(ref_pos[valid], pos, intensity)
+        return float(abs(interpolated - ref_intensity[valid]).sum() / norm)
+
+    def tune(self, ai, shape, npt, unit=units.Q, radial_range=None, azimuth_range=None, mask=None, force=False):
+        """
+        Decide on the method and the number of threads for a 1D integration
+
+        @param ai: AzimuthalIntegrator instance, neither its caches nor its locks are used
+        @param shape: shape of the images
+        @param npt: number of bins
+        @param unit: radial unit
+        @param radial_range: radial range in unit
+        @param azimuth_range: azimuthal range in degrees
+        @param mask: mask of the images
+        @param force: re-run the trials even if a decision exists
+        @return: dict with "method", "threads", "timings" and "errors"
+        """
+        shape = tuple(shape)
+        key = self.hardware_key() + "||" + self.config_key(ai, shape, npt, unit, radial_range, azimuth_range, mask)
+        decisions = self.load()
+        if (not force) and (key in decisions):
+            return decisions[key]
+
+        # trials are run on a new integrator with the same geometry: the matrices of the candidates
+        # do not stay in memory and the semaphores and caches of ai are not shared
+        from .azimuthalIntegrator import AzimuthalIntegrator
+        trial = AzimuthalIntegrator(dist=ai.dist, poni1=ai.poni1, poni2=ai.poni2,
+                                    rot1=ai.rot1, rot2=ai.rot2, rot3=ai.rot3,
+                                    detector=ai.detector, wavelength=ai._wavelength)
+        trial.chiDiscAtPi = ai.chiDiscAtPi
+        data = self.synthetic_frame(trial, shape, unit)
+        kwargs = {"npt": npt, "unit": unit, "radial_range": radial_range, "azimuth_range": azimuth_range,
+                  "mask": mask, "correctSolidAngle": True, "safe": True}
+        max_threads = MAX_THREADS
+        timings = {}
+        errors = {}
+        reference = self._time(trial, data, kwargs, REFERENCE)
+        if reference is None:
+            raise RuntimeError("Autotuning: the reference method %s failed" % REFERENCE)
+        for method in self.candidates:
+            res = reference if method == REFERENCE else self._time(trial, data, kwargs, method)
+            if res is None:
+                continue
+            timings[method] = res[0]
+            errors[method] = self.deviation(res, reference)
+            logger.debug("Autotuning: %s took %.3fms, relative error %.2e", method, 1000 * res[0], errors[method])
+        accurate = [m for m in timings if errors[m] <= self.rtol]
+        if accurate:
+            method = min(accurate, key=lambda m: timings[m])
+        else:
+            logger.warning("Autotuning: no candidate within rtol=%s, falling back on %s", self.rtol, REFERENCE)
+            method = REFERENCE
+            timings[method] = reference[0]
+            errors[method] = 0.0
+
+        threads = max_threads
+        if self.tune_threads and max_threads > 1:
+            times = {max_threads: timings[method]}
+            try:
+                for count in thread_counts(max_threads)[:-1]:
+                    isa.set_num_threads(count)
+                    res = self._time(trial, data, kwargs, method)
+                    if res is not None:
+                        times[count] = res[0]
+            finally:
+                isa.set_num_threads(max_threads)
+            threads = min(times, key=lambda c: times[c])
+        del trial
+
+        decision = {"method": method, "threads": threads, "timings": timings, "errors": errors,
+                    "date": time.strftime("%Y-%m-%d %H:%M:%S")}
+        logger.info("Autotuning: %s with %s threads for %s", method, threads, key)
+        with self._sem:
+            decisions[key] = decision
+        self.save()
+        return decision
+
+    @contextlib.contextmanager
+    def apply(self, decision):
+        """
+        Context in which the calling thread uses the number of threads of a
+        decision, the previous number is restored on exit:
+
+        with tuner.apply(decision) as method:
+            ai.integrate1d(data, npt, method=method)
+
+        @return: context manager giving the method of the decision
+        """
+        threads = decision.get("threads")
+        previous = isa.get_num_threads() if isa is not None else None
+        change = bool(threads) and (isa is not None) and (threads != previous)
+        if change:
+            isa.set_num_threads(threads)
+        try:
+            yield decision["method"]
+        finally:
+            if change:
+                isa.set_num_threads(previous)
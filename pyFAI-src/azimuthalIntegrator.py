@@ -105,7 +105,22 @@ except ImportError as error:
                  " CSR based azimuthal integration: %s" % error)
     splitPixelFullCSR = None
 
+try:
+    from . import sparse_csr  # IGNORE:F0401
+except ImportError as error:
+    logger.error("Unable to import pyFAI.sparse_csr"
+                 " CSR matrix transformations: %s" % error)
+    sparse_csr = None
+
+try:
+    from . import preproc  # IGNORE:F0401
+except ImportError as error:
+    logger.warning("Unable to import pyFAI.preproc,"
+                   " masks are assembled with numpy: %s" % error)
+    preproc = None
+
 from .opencl import ocl
+from . import autotune
 if ocl:
     try:
         from . import ocl_azim  # IGNORE:F0401
@@ -128,6 +143,10 @@ if ocl:
 else:
     ocl_azim = ocl_azim_csr = ocl_azim_lut = None
 
+# splitPixelFullCSR.FullSplitCSR_2d exists but drops about 1% of the area of
+# the pixels (those crossing bins in both directions), so 2D CSR matrices,
+# tiled or not, are only built without splitting or with bounding boxes.
+FULL_SPLIT_2D_MISSING = "Full pixel splitting using CSR is not yet available in 2D, use split='bbox'"
 
 class AzimuthalIntegrator(Geometry):
     """
@@ -143,6 +162,7 @@ class AzimuthalIntegrator(Geometry):
         >>> regrouped = ai.integrate2d(data, npt_rad, npt_azim, unit="q_nm^-1")[0]
     """
     DEFAULT_METHOD = "splitbbox"
+    CSR_TILE_PIXELS = 1 << 20  # approximate number of pixels per tile of a tiled CSR matrix
 
     def __init__(self, dist=1, poni1=0, poni2=0,
                  rot1=0, rot2=0, rot3=0,
@@ -186,12 +206,29 @@ class AzimuthalIntegrator(Geometry):
         self.darkfiles = None
 
         self.header = None
+        # when set, 1D CSR integrators are derived from a master CSR with this number of bins
+        self.csr_master_bins = None
+        # when set ("bin" or "hilbert"), pixels are renumbered in 1D CSR integration for a better locality
+        self.csr_pixel_order = None
+        # pyFAI.autotune.Autotuner deciding on method="auto", created on first use
+        self.autotuner = None
 
         self._ocl_integrator = None
         self._ocl_lut_integr = None
         self._ocl_csr_integr = None
         self._lut_integrator = None
         self._csr_integrator = None
+        self._csr2d_integrator = None
+        self._csr2d_mapping = None
+        self._sector_integrator = None
+        self._edges_integrator = None
+        self._roi_integrator = None
+        self._sparse_integrator = None
+        self._csr_master = None
+        self._numa_integrator = None
+        self._renumbered_integrator = None
+        self._preview_integrator = None
+        self._peak_finder = None
         self._ocl_sem = threading.Semaphore()
         self._lut_sem = threading.Semaphore()
         self._csr_sem = threading.Semaphore()
@@ -210,6 +247,16 @@ class AzimuthalIntegrator(Geometry):
         with self._lut_sem:
             self._lut_integrator = None
             self._csr_integrator = None
+            self._csr2d_integrator = None
+            self._sector_integrator = None
+            self._edges_integrator = None
+            self._roi_integrator = None
+            self._sparse_integrator = None
+            self._csr_master = None
+            self._numa_integrator = None
+            self._renumbered_integrator = None
+            self._preview_integrator = None
+            self._peak_finder = None
 
     def create_mask(self, data, mask=None,
                  dummy=None, delta_dummy=None, mode="normal"):
@@ -249,6 +296,15 @@ class AzimuthalIntegrator(Geometry):
         #       ^^^^   this is why data is mandatory !
         if mask is None:
             mask = self.mask
+        if preproc is not None:
+            if (mask is not None) and (mask.shape != shape):
+                mask = self._crop_mask(mask, shape)
+            # single pass over the mask and the data
+            mask, inverted = preproc.create_mask(data, mask, dummy, delta_dummy, mode)
+            if inverted:
+                logger.warning("Mask likely to be inverted as more"
+                               " than half pixel are masked !!!")
+            return mask
         if mask is None:
             mask = numpy.zeros(shape, dtype=bool)
         elif mask.min() < 0 and mask.max() == 0:  # 0 is valid, <0 is invalid
@@ -260,13 +316,7 @@ class AzimuthalIntegrator(Geometry):
                          " than half pixel are masked !!!")
             numpy.logical_not(mask, mask)
         if (mask.shape != shape):
-            try:
-                mask = mask[:shape[0], :shape[1]]
-            except Exception as error:  # IGNORE:W0703
-                logger.error("Mask provided has wrong shape:"
-                             " expected: %s, got %s, error: %s" %
-                             (shape, mask.shape, error))
-                mask = numpy.zeros(shape, dtype=bool)
+            mask = self._crop_mask(mask, shape)
         if dummy is not None:
             if delta_dummy is None:
                 numpy.logical_or(mask, (data == dummy), mask)
@@ -280,6 +330,24 @@ class AzimuthalIntegrator(Geometry):
             mask = numpy.where(numpy.logical_not(mask))
         return mask
 
+    @staticmethod
+    def _crop_mask(mask, shape):
+        """
+        @return: the mask cropped to shape, or an empty mask if it cannot be
+        """
+        try:
+            mask = mask[:shape[0], :shape[1]]
+        except Exception as error:  # IGNORE:W0703
+            logger.error("Mask provided has wrong shape:"
+                         " expected: %s, got %s, error: %s" %
+                         (shape, mask.shape, error))
+            return numpy.zeros(shape, dtype=bool)
+        if mask.shape != shape:
+            logger.error("Mask provided has wrong shape:"
+                         " expected: %s, got %s" % (shape, mask.shape))
+            return numpy.zeros(shape, dtype=bool)
+        return mask
+
     def dark_correction(self, data, dark=None):
         """
         Correct for Dark-current effects.
@@ -1149,7 +1217,7 @@ class AzimuthalIntegrator(Geometry):
         if split == "full":
 
             if int2d:
-                raise NotImplementedError("Full pixel splitting using CSR is not yet available in 2D")
+                raise NotImplementedError(FULL_SPLIT_2D_MISSING)
 #                return splitBBoxCSR.HistoBBox2d(pos0, dpos0, pos1, dpos1,
 #                                                bins=npt,
 #                                                pos0Range=pos0Range,
@@ -1188,6 +1256,608 @@ class AzimuthalIntegrator(Geometry):
                                                 unit=unit,
                                                 )
 
+    def setup_tiled_CSR(self, shape, npt, mask=None, pos0_range=None, pos1_range=None, mask_checksum=None,
+                        unit=units.TTH, split="bbox", filename=None, tile_pixels=None):
+        """
+        Prepare an integration matrix made of tiles, each of them holding
+        the contribution of a band of detector rows.
+
+        Unlike setup_CSR, the number of elements of the matrix is not limited
+        by 32 bits indices and, if a *filename* is provided, tiles are written
+        to this file and memory-mapped so the matrix does not need to fit in
+        memory: this is meant for very large cakes (many azimuthal bins on
+        large detectors).
+
+        Ranges are common to all tiles: when not provided they are calculated
+        over the whole image.
+
+        @param shape: shape of the dataset
+        @type shape: (int, int)
+        @param npt: number of points in the the output pattern
+        @type npt: int or (int, int)
+        @param mask: array with masked pixel (1=masked)
+        @type mask: ndarray
+        @param pos0_range: range in radial dimension
+        @type pos0_range: (float, float)
+        @param pos1_range: range in azimuthal dimension
+        @type pos1_range: (float, float)
+        @param mask_checksum: checksum of the mask buffer
+        @type mask_checksum: int (or anything else ...)
+        @param unit: use to propagate the LUT object for further checkings
+        @type unit: pyFAI.units.Enum
+        @param split: Splitting scheme: valid options are "no", "bbox", "full" (1D only)
+        @param filename: file where the tiles are stored, None to keep them in memory
+        @type filename: str
+        @param tile_pixels: approximate number of pixels per tile, CSR_TILE_PIXELS by default
+        @type tile_pixels: int
+        @return: sparse_csr.TiledCsrIntegrator instance
+        """
+        if sparse_csr is None:
+            raise RuntimeError("pyFAI.sparse_csr is not available")
+        if "__len__" in dir(npt) and len(npt) == 2:
+            int2d = True
+            npt = tuple(npt)
+        else:
+            int2d = False
+        if split == "full" and int2d:
+            raise NotImplementedError(FULL_SPLIT_2D_MISSING)
+        if mask is None:
+            mask_checksum = None
+            valid = numpy.ones(shape, dtype=bool)
+        else:
+            assert mask.shape == shape
+            valid = (mask == 0)
+        if ("__len__" in dir(pos0_range)) and (len(pos0_range) > 1):
+            pos0Range = (min(pos0_range), max(pos0_range) * EPS32)
+        else:
+            pos0Range = None
+        if ("__len__" in dir(pos1_range)) and (len(pos1_range) > 1):
+            pos1Range = (min(pos1_range), max(pos1_range) * EPS32)
+        else:
+            pos1Range = None
+
+        pos = pos0 = dpos0 = pos1 = dpos1 = None
+        if split == "full":
+            pos = self.array_from_unit(shape, "corner", unit)
+            lower0 = upper0 = pos[..., 0][valid]
+        else:
+            pos0 = self.array_from_unit(shape, "center", unit)
+            if split == "no":
+                lower0 = upper0 = pos0[valid]
+            else:
+                dpos0 = self.array_from_unit(shape, "delta", unit)
+                lower0 = (pos0 - dpos0)[valid]
+                upper0 = (pos0 + dpos0)[valid]
+            if int2d or (pos1Range is not None):
+                pos1 = self.chiArray(shape)
+                if split == "no":
+                    lower1 = upper1 = pos1[valid]
+                else:
+                    dpos1 = self.deltaChi(shape)
+                    lower1 = (pos1 - dpos1)[valid]
+                    upper1 = (pos1 + dpos1)[valid]
+        # the same ranges have to be used for all tiles
+        if pos0Range is not None:
+            tile_pos0Range = pos0Range
+        elif valid.any():
+            tile_pos0Range = (max(0.0, float(lower0.min())), float(upper0.max()))
+        else:
+            tile_pos0Range = (0.0, 1.0)
+        tile_pos1Range = pos1Range
+        if int2d and (pos1Range is None):
+            if valid.any():
+                tile_pos1Range = (max(-pi, float(lower1.min())), min(pi, float(upper1.max())))
+            else:
+                tile_pos1Range = (-pi, pi)
+
+        tile_pixels = tile_pixels or self.CSR_TILE_PIXELS
+        rows_per_tile = max(1, tile_pixels // shape[1])
+        integr = sparse_csr.TiledCsrIntegrator(shape[0] * shape[1], npt, filename=filename, unit=unit)
+        for start in range(0, shape[0], rows_per_tile):
+            band = slice(start, min(start + rows_per_tile, shape[0]))
+            tile_mask = None if mask is None else numpy.ascontiguousarray(mask[band])
+            if split == "full":
+                tile = splitPixelFullCSR.FullSplitCSR_1d(numpy.ascontiguousarray(pos[band]),
+                                                         bins=npt,
+                                                         pos0Range=tile_pos0Range,
+                                                         pos1Range=tile_pos1Range,
+                                                         mask=tile_mask,
+                                                         allow_pos0_neg=False,
+                                                         unit=unit)
+            else:
+                args = (pos0[band],
+                        None if dpos0 is None else dpos0[band],
+                        None if pos1 is None else pos1[band],
+                        None if dpos1 is None else dpos1[band])
+                builder = splitBBoxCSR.HistoBBox2d if int2d else splitBBoxCSR.HistoBBox1d
+                tile = builder(*args,
+                               bins=npt,
+                               pos0Range=tile_pos0Range,
+                               pos1Range=tile_pos1Range,
+                               mask=tile_mask,
+                               allow_pos0_neg=False,
+                               unit=unit)
+            integr.add_tile(band.start * shape[1], band.stop * shape[1], tile.data, tile.indices, tile.indptr)
+            if int2d:
+                integr.outPos0 = tile.outPos0
+                integr.outPos1 = tile.outPos1
+            else:
+                integr.outPos = tile.outPos
+            del tile
+        integr.finalize()
+        integr.check_mask = mask is not None
+        integr.mask_checksum = mask_checksum
+        integr.pos0Range = pos0Range
+        integr.pos1Range = pos1Range
+        integr.split = split
+        return integr
+
+    def _get_csr_integrator(self, shape, npt, mask=None, radial_range=None,
+                            azimuth_range=None, unit=units.TTH, method="csr", safe=True):
+        """
+        Return the CSR integrator for 1D integration, re-building it only if needed.
+
+        Must be called with the self._csr_sem semaphore held.
+        Ranges are given in internal units (radians for the azimuthal range)
+
+        @param shape: shape of the dataset
+        @param npt: number of points in the output pattern
+        @param mask: array with masked pixel (1=masked), None for the detector mask
+        @param radial_range: range in radial dimension
+        @param azimuth_range: range in azimuthal dimension
+        @param unit: radial unit
+        @param method: "csr", "nosplit_csr" or "full_csr"
+        @param safe: check that the integrator is still valid
+        @return: CSR integrator or None if the matrix does not fit in memory
+        """
+        mask_crc = None
+        reset = None
+        if "no" in method:
+            split = "no"
+        elif "full" in method:
+            split = "full"
+        else:
+            split = "bbox"
+        if mask is None:
+            mask = self.detector.mask
+            mask_crc = self.detector._mask_crc
+        else:
+            mask_crc = crc32(mask)
+        if self._csr_integrator is None:
+            reset = "init"
+        elif safe:
+            if (sparse_csr is not None) and isinstance(self._csr_integrator, sparse_csr.DerivedCsrIntegrator):
+                previous_split = self._csr_integrator.split
+            elif (splitPixelFullCSR is not None) and isinstance(self._csr_integrator, splitPixelFullCSR.FullSplitCSR_1d):
+                previous_split = "full"
+            elif "dpos0" in dir(self._csr_integrator):
+                previous_split = "bbox"
+            else:
+                previous_split = "no"
+            if previous_split != split:
+                reset = "pixel splitting scheme changed"
+            derived = (sparse_csr is not None) and isinstance(self._csr_integrator, sparse_csr.DerivedCsrIntegrator)
+            if bool(self.csr_master_bins) != derived:
+                reset = "derivation from a master CSR was switched"
+            elif derived and (self._csr_integrator.master_bins != self.csr_master_bins):
+                reset = "number of bins of the master CSR changed"
+            if self._csr_integrator.unit != unit:
+                reset = "unit changed"
+            if self._csr_integrator.bins != npt:
+                reset = "number of points changed"
+            if self._csr_integrator.size != numpy.prod(shape):
+                reset = "input image size changed"
+            if (mask is not None) and (not self._csr_integrator.check_mask):
+                reset = "mask but CSR was without mask"
+            elif (mask is None) and (self._csr_integrator.check_mask):
+                reset = "no mask but CSR has mask"
+            elif (mask is not None) and (self._csr_integrator.mask_checksum != mask_crc):
+                reset = "mask changed"
+            if (radial_range is None) and (self._csr_integrator.pos0Range is not None):
+                reset = "radial_range was defined in CSR"
+            elif (radial_range is not None) and self._csr_integrator.pos0Range != (min(radial_range), max(radial_range) * EPS32):
+                reset = "radial_range is defined but not the same as in CSR"
+            if (azimuth_range is None) and (self._csr_integrator.pos1Range is not None):
+                reset = "azimuth_range not defined and CSR had azimuth_range defined"
+            elif (azimuth_range is not None) and self._csr_integrator.pos1Range != (min(azimuth_range), max(azimuth_range) * EPS32):
+                reset = "azimuth_range requested and CSR's azimuth_range don't match"
+        if reset:
+            logger.info("AI._get_csr_integrator: Resetting integrator because %s" % reset)
+            try:
+                if self.csr_master_bins and (sparse_csr is not None):
+                    self._csr_integrator = self._derive_csr_integrator(shape, npt, mask, mask_crc,
+                                                                       radial_range, azimuth_range,
+                                                                       unit=unit, split=split)
+                else:
+                    self._csr_integrator = self.setup_CSR(shape, npt, mask,
+                                                          radial_range, azimuth_range,
+                                                          mask_checksum=mask_crc,
+                                                          unit=unit, split=split)
+            except MemoryError:
+                logger.warning("MemoryError: unable to build the CSR matrix")
+                self._ocl_csr_integr = None
+                self._csr_integrator = None
+                gc.collect()
+        return self._csr_integrator
+
+    def _derive_csr_integrator(self, shape, npt, mask, mask_crc, radial_range=None,
+                               azimuth_range=None, unit=units.TTH, split="bbox"):
+        """
+        Derive a 1D CSR integrator from the master CSR integrator with
+        self.csr_master_bins bins, built once for a given geometry, mask,
+        unit, azimuthal range and pixel splitting.
+
+        Must be called with the self._csr_sem semaphore held.
+        See sparse_csr.DerivedCsrIntegrator for the accuracy.
+
+        @param shape: shape of the dataset
+        @param npt: number of points in the output pattern
+        @param mask: array with masked pixel (1=masked)
+        @param mask_crc: checksum of the mask
+        @param radial_range: range in radial dimension
+        @param azimuth_range: range in azimuthal dimension
+        @param unit: radial unit
+        @param split: "no", "bbox" or "full"
+        @return: DerivedCsrIntegrator instance
+        """
+        key = (tuple(shape), self.csr_master_bins, str(unit), split, mask_crc,
+               None if azimuth_range is None else tuple(azimuth_range))
+        if (self._csr_master is None) or (self._csr_master[0] != key):
+            logger.info("AI._derive_csr_integrator: building master CSR with %s bins" % self.csr_master_bins)
+            master = self.setup_CSR(shape, self.csr_master_bins, mask, None, azimuth_range,
+                                    mask_checksum=mask_crc, unit=unit, split=split)
+            self._csr_master = (key, master)
+        master = self._csr_master[1]
+        if radial_range is not None:
+            pos0Range = (min(radial_range), max(radial_range) * EPS32)
+        else:
+            pos0Range = None
+        return sparse_csr.DerivedCsrIntegrator(master, npt, pos0Range, split=split)
+
+    def _get_csr2d_integrator(self, shape, npt, mask=None, radial_range=None,
+                              azimuth_range=None, unit=units.TTH, method="csr", safe=True):
+        """
+        Return the CSR integrator for 2D integration, re-building it only if needed.
+
+        It is kept apart from the 1D one so that alternating 1D and 2D
+        integrations does not rebuild the matrices each time.
+        Must be called with the self._lut_sem semaphore held.
+        Ranges are given in internal units (radians for the azimuthal range)
+
+        @param shape: shape of the dataset
+        @param npt: number of points in the output image (radial, azimuthal)
+        @param mask: array with masked pixel (1=masked), None for the detector mask
+        @param radial_range: range in radial dimension
+        @param azimuth_range: range in azimuthal dimension
+        @param unit: radial unit
+        @param method: "csr" or "nosplit_csr" ("full_csr" raises NotImplementedError, see FULL_SPLIT_2D_MISSING), "tiled" in the name requests the out-of-core tiled matrix
+        @param safe: check that the integrator is still valid
+        @return: CSR integrator (tiled if the matrix does not fit in memory) or None
+        """
+        reset = None
+        if "no" in method:
+            split = "no"
+        elif "full" in method:
+            split = "full"  # not available in 2D: setup_CSR raises NotImplementedError
+        else:
+            split = "bbox"
+        if mask is None:
+            mask = self.detector.mask
+            mask_crc = self.detector._mask_crc
+        else:
+            mask_crc = crc32(mask)
+        integr = self._csr2d_integrator
+        if integr is None:
+            reset = "init"
+        elif safe:
+            if integr.split != split:
+                reset = "pixel splitting scheme changed"
+            if integr.unit != unit:
+                reset = "unit changed"
+            if integr.bins != tuple(npt):
+                reset = "number of points changed"
+            if integr.size != numpy.prod(shape):
+                reset = "input image size changed"
+            if (mask is not None) and (not integr.check_mask):
+                reset = "mask but CSR was without mask"
+            elif (mask is None) and (integr.check_mask):
+                reset = "no mask but CSR has mask"
+            elif (mask is not None) and (integr.mask_checksum != mask_crc):
+                reset = "mask changed"
+            if (radial_range is None) and (integr.pos0Range is not None):
+                reset = "radial_range was defined in CSR"
+            elif (radial_range is not None) and integr.pos0Range != (min(radial_range), max(radial_range) * EPS32):
+                reset = "radial_range is defined but not the same as in CSR"
+            if (azimuth_range is None) and (integr.pos1Range is not None):
+                reset = "azimuth_range not defined and CSR had azimuth_range defined"
+            elif (azimuth_range is not None) and integr.pos1Range != (min(azimuth_range), max(azimuth_range) * EPS32):
+                reset = "azimuth_range requested and CSR's azimuth_range don't match"
+            if ("tiled" in method) and not ((sparse_csr is not None) and isinstance(integr, sparse_csr.TiledCsrIntegrator)):
+                reset = "tiled CSR matrix requested"
+        if reset:
+            logger.info("AI._get_csr2d_integrator: Resetting integrator because %s" % reset)
+            self._csr2d_integrator = None
+            if "tiled" not in method:
+                try:
+                    self._csr2d_integrator = self.setup_CSR(shape, npt, mask,
+                                                            radial_range, azimuth_range,
+                                                            mask_checksum=mask_crc,
+                                                            unit=unit, split=split)
+                except MemoryError as error:
+                    logger.warning("MemoryError: unable to build the 2D CSR matrix (%s), trying the out-of-core tiled one", error)
+                    self._ocl_csr_integr = None
+                    gc.collect()
+            if (self._csr2d_integrator is None) and (sparse_csr is not None):
+                fd, filename = tempfile.mkstemp(".csr", "pyfai-")
+                os.close(fd)
+                try:
+                    self._csr2d_integrator = self.setup_tiled_CSR(shape, npt, mask,
+                                                                  radial_range, azimuth_range,
+                                                                  mask_checksum=mask_crc,
+                                                                  unit=unit, split=split,
+                                                                  filename=filename)
+                    self._csr2d_integrator.temporary = True
+                except (MemoryError, IOError, OSError) as error:
+                    logger.warning("Unable to build the tiled 2D CSR matrix: %s", error)
+                    os.unlink(filename)
+                    self._csr2d_integrator = None
+                    gc.collect()
+            if self._csr2d_integrator is not None:
+                # the matrices do not tell how pixels were split
+                self._csr2d_integrator.split = split
+        return self._csr2d_integrator
+
+    def _get_numa_integrator(self):
+        """
+        Return the NUMA-aware copy of the 1D CSR integrator, re-building it
+        only when the latter changed.
+
+        Must be called with the self._csr_sem semaphore held.
+
+        @return: sparse_csr.NumaCsrIntegrator instance
+        """
+        if (self._numa_integrator is None) or (self._numa_integrator.integrator is not self._csr_integrator):
+            self._numa_integrator = None
+            self._numa_integrator = sparse_csr.NumaCsrIntegrator(self._csr_integrator)
+        return self._numa_integrator
+
+    def _get_renumbered_integrator(self, shape):
+        """
+        Return the copy of the 1D CSR integrator with pixels renumbered in
+        the order csr_pixel_order, re-building it only when needed.
+
+        Must be called with the self._csr_sem semaphore held.
+
+        @param shape: shape of the dataset
+        @return: sparse_csr.RenumberedCsrIntegrator instance
+        """
+        integr = self._renumbered_integrator
+        if (integr is None) or (integr.integrator is not self._csr_integrator) or (integr.order != self.csr_pixel_order):
+            self._renumbered_integrator = None
+            self._renumbered_integrator = sparse_csr.RenumberedCsrIntegrator(self._csr_integrator,
+                                                                             self.csr_pixel_order, shape)
+        return self._renumbered_integrator
+
+    def autotune(self, shape, npt, unit=units.Q, radial_range=None, azimuth_range=None, mask=None, force=False):
+        """
+        Select the fastest method of integrate1d for this configuration which
+        gives accurate results, as well as the number of threads.
+
+        Trials are run once per hardware and configuration, the decision is
+        then read from the file of the autotuner (see pyFAI.autotune). The
+        number of threads is only used by integrate1d(method="auto"), for the
+        duration of the integration.
+
+        @param shape: shape of the images
+        @param npt: number of points in the output pattern
+        @param unit: radial unit
+        @param radial_range: radial range in unit
+        @param azimuth_range: azimuthal range in degrees
+        @param mask: mask of the images, by default the one of the detector
+        @param force: run the trials again
+        @return: name of the method
+        """
+        return self._autotune(shape, npt, unit, radial_range, azimuth_range, mask, force)["method"]
+
+    def _autotune(self, shape, npt, unit=units.Q, radial_range=None, azimuth_range=None, mask=None, force=False):
+        """
+        Decision of the autotuner for this configuration, see autotune()
+
+        @return: dict with the "method" and the number of "threads"
+        """
+        if mask is None:
+            mask = self.mask
+        if self.autotuner is None:
+            self.autotuner = autotune.Autotuner()
+        return self.autotuner.tune(self, shape, npt, unit, radial_range, azimuth_range, mask, force)
+
+    def _radial_edges(self, shape, npt, mask=None, radial_range=None, unit=units.TTH, scale="linear"):
+        """
+        Calculate the edges of npt non uniform radial bins
+
+        @param shape: shape of the dataset
+        @param npt: number of bins
+        @param mask: array with masked pixel (1=masked), None for the detector mask
+        @param radial_range: range in radial dimension (internal units), by default the one of the unmasked pixels
+        @param unit: radial unit
+        @param scale: "linear", "log" or "sqrt"
+        @return: array of npt+1 edges, in internal units
+        """
+        if radial_range is not None:
+            lower, upper = min(radial_range), max(radial_range)
+        else:
+            pos0 = self.array_from_unit(shape, "center", unit)
+            if mask is None:
+                mask = self.detector.mask
+            if mask is not None:
+                pos0 = pos0[numpy.logical_not(mask)]
+            lower = max(pos0.min(), 0)
+            upper = pos0.max() * EPS32
+            if scale == "log":
+                lower = pos0[pos0 > 0].min()
+        if scale == "log":
+            if lower <= 0:
+                raise ValueError("Logarithmic bins need a positive radial range")
+            return numpy.logspace(numpy.log10(lower), numpy.log10(upper), npt + 1)
+        elif scale == "sqrt":
+            return numpy.linspace(numpy.sqrt(lower), numpy.sqrt(upper), npt + 1) ** 2
+        elif scale == "linear":
+            return numpy.linspace(lower, upper, npt + 1)
+        else:
+            raise ValueError("Unknown radial scale: %s" % scale)
+
+    def _get_edges_integrator(self, shape, edges, mask=None, azimuth_range=None,
+                              unit=units.TTH, method="csr", safe=True):
+        """
+        Return the CSR integrator with non uniform radial bins, re-building it only if needed.
+
+        Must be called with the self._csr_sem semaphore held.
+
+        @param shape: shape of the dataset
+        @param edges: radial bin edges (internal units)
+        @param mask: array with masked pixel (1=masked), None for the detector mask
+        @param azimuth_range: range in azimuthal dimension (radians)
+        @param unit: radial unit
+        @param method: "csr" or "nosplit_csr"
+        @param safe: check that the integrator is still valid
+        @return: CSR integrator or None if the matrix does not fit in memory
+        """
+        split = "no" if "no" in method else "bbox"
+        if mask is None:
+            mask = self.detector.mask
+            mask_crc = self.detector._mask_crc
+        else:
+            mask_crc = crc32(mask)
+        if azimuth_range is not None:
+            azimuth_range = (min(azimuth_range), max(azimuth_range) * EPS32)
+        reset = None
+        integr = self._edges_integrator
+        if integr is None:
+            reset = "init"
+        elif (integr.edges.shape != edges.shape) or (abs(integr.edges - edges) > 1e-6 * abs(edges).max()).any():
+            reset = "bin edges changed"
+        elif safe:
+            if ("dpos0" in dir(integr)) != (split == "bbox"):
+                reset = "pixel splitting scheme changed"
+            if integr.unit != unit:
+                reset = "unit changed"
+            if integr.size != numpy.prod(shape):
+                reset = "input image size changed"
+            if (mask is not None) and (not integr.check_mask):
+                reset = "mask but CSR was without mask"
+            elif (mask is None) and (integr.check_mask):
+                reset = "no mask but CSR has mask"
+            elif (mask is not None) and (integr.mask_checksum != mask_crc):
+                reset = "mask changed"
+            if integr.pos1Range != azimuth_range:
+                reset = "azimuth_range changed"
+        if reset:
+            logger.info("AI._get_edges_integrator: Resetting integrator because %s" % reset)
+            pos0 = self.array_from_unit(shape, "center", unit)
+            dpos0 = None if split == "no" else self.array_from_unit(shape, "delta", unit)
+            if azimuth_range is None:
+                pos1 = dpos1 = None
+            else:
+                pos1 = self.chiArray(shape)
+                dpos1 = None if split == "no" else self.deltaChi(shape)
+            try:
+                self._edges_integrator = splitBBoxCSR.HistoBBox1dEdges(pos0, dpos0, edges, pos1, dpos1,
+                                                                       pos1Range=azimuth_range,
+                                                                       mask=mask,
+                                                                       mask_checksum=mask_crc,
+                                                                       allow_pos0_neg=False,
+                                                                       unit=unit)
+            except MemoryError:
+                logger.warning("MemoryError: unable to build the CSR matrix")
+                self._edges_integrator = None
+                gc.collect()
+        return self._edges_integrator
+
+    def _get_sector_integrator(self, shape, npt, sectors=8, mask=None, radial_range=None,
+                               azimuth_range=None, unit=units.TTH, method="csr", safe=True):
+        """
+        Return the multi-sector CSR integrator, re-building it only if needed.
+
+        Must be called with the self._csr_sem semaphore held.
+        Ranges are given in internal units (radians for the azimuthal range and the sectors)
+
+        @param shape: shape of the dataset
+        @param npt: number of radial points in each sector
+        @param sectors: number of equal sectors or list of (chi_min, chi_max) for each sector
+        @param mask: array with masked pixel (1=masked), None for the detector mask
+        @param radial_range: range in radial dimension
+        @param azimuth_range: range in azimuthal dimension, cut into equal sectors
+        @param unit: radial unit
+        @param method: "csr" or "nosplit_csr"
+        @param safe: check that the integrator is still valid
+        @return: multi-sector CSR integrator or None if the matrix does not fit in memory
+        """
+        if "__len__" in dir(sectors):
+            sectors = [(min(sector), max(sector)) for sector in sectors]
+        else:
+            if azimuth_range is None:
+                chi = self.chiArray(shape)
+                azimuth_range = (chi.min(), chi.max())
+            edges = numpy.linspace(min(azimuth_range), max(azimuth_range), int(sectors) + 1)
+            sectors = [(edges[i], edges[i + 1]) for i in range(int(sectors))]
+        split = "no" if "no" in method else "bbox"
+        if mask is None:
+            mask = self.detector.mask
+            mask_crc = self.detector._mask_crc
+        else:
+            mask_crc = crc32(mask)
+        if radial_range is not None:
+            radial_range = (min(radial_range), max(radial_range) * EPS32)
+
+        reset = None
+        integr = self._sector_integrator
+        if integr is None:
+            reset = "init"
+        elif integr.sectors != sectors:
+            reset = "sectors changed"
+        elif safe:
+            if integr.split != split:
+                reset = "pixel splitting scheme changed"
+            if integr.unit != unit:
+                reset = "unit changed"
+            if integr.bins != npt:
+                reset = "number of points changed"
+            if integr.size != numpy.prod(shape):
+                reset = "input image size changed"
+            if (mask is not None) and (not integr.check_mask):
+                reset = "mask but CSR was without mask"
+            elif (mask is None) and (integr.check_mask):
+                reset = "no mask but CSR has mask"
+            elif (mask is not None) and (integr.mask_checksum != mask_crc):
+                reset = "mask changed"
+            if (radial_range is None) and (integr.pos0Range is not None):
+                reset = "radial_range was defined in CSR"
+            elif (radial_range is not None) and (integr.pos0Range != radial_range):
+                reset = "radial_range changed"
+        if reset:
+            logger.info("AI._get_sector_integrator: Resetting integrator because %s" % reset)
+            pos0 = self.array_from_unit(shape, "center", unit)
+            pos1 = self.chiArray(shape)
+            if split == "no":
+                dpos0 = dpos1 = None
+            else:
+                dpos0 = self.array_from_unit(shape, "delta", unit)
+                dpos1 = self.deltaChi(shape)
+            try:
+                self._sector_integrator = splitBBoxCSR.HistoBBoxSectors(pos0, dpos0, pos1, dpos1,
+                                                                        bins=npt,
+                                                                        sectors=sectors,
+                                                                        pos0Range=radial_range,
+                                                                        mask=mask,
+                                                                        mask_checksum=mask_crc,
+                                                                        allow_pos0_neg=False,
+                                                                        unit=unit)
+            except MemoryError:
+                logger.warning("MemoryError: unable to build the multi-sector CSR matrix")
+                self._sector_integrator = None
+                gc.collect()
+        return self._sector_integrator
+
     @deprecated
     def xrpd_LUT(self, data, npt, filename=None, correctSolidAngle=True,
                  tthRange=None, chiRange=None, mask=None,
@@ -2127,7 +2797,8 @@ class AzimuthalIntegrator(Geometry):
                     mask=None, dummy=None, delta_dummy=None,
                     polarization_factor=None, dark=None, flat=None,
                     method="lut", unit=units.Q, safe=True, normalization_factor=None,
-                    block_size=32, profile=False, all=False):
+                    block_size=32, profile=False, all=False,
+                    radial_scale="linear", radial_edges=None):
         """
         Calculate the azimuthal integrated Saxs curve in q(nm^-1) by default
 
@@ -2145,7 +2816,10 @@ class AzimuthalIntegrator(Geometry):
         @type correctSolidAngle: bool
         @param variance: array containing the variance of the data. If not available, no error propagation is done
         @type variance: ndarray
-        @param error_model: When the variance is unknown, an error model can be given: "poisson" (variance = I), "azimuthal" (variance = (I-<I>)^2)
+        @param error_model: When the variance is unknown, an error model can be given: "poisson" (variance = I), "azimuthal" (variance = (I-<I>)^2).
+                            With the CSR and LUT methods, the azimuthal error is calculated in a single pass from the spread of the corrected
+                            intensities around the mean of their bin. The other methods (OpenCL, histograms, pixel splitting) integrate the
+                            squared deviation of each pixel from the profile interpolated at its position, so both estimates differ.
         @type error_model: str
         @param radial_range: The lower and upper range of the radial unit. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
         @type radial_range: (float, float), optional
@@ -2163,7 +2837,7 @@ class AzimuthalIntegrator(Geometry):
         @type dark: ndarray
         @param flat: flat field image
         @type flat: ndarray
-        @param method: can be "numpy", "cython", "BBox" or "splitpixel", "lut", "csr", "nosplit_csr", "full_csr", "lut_ocl" and "csr_ocl" if you want to go on GPU. To Specify the device: "csr_ocl_1,2"
+        @param method: can be "numpy", "cython", "BBox" or "splitpixel", "lut", "csr", "nosplit_csr", "full_csr", "lut_ocl" and "csr_ocl" if you want to go on GPU. To Specify the device: "csr_ocl_1,2". "csr_numa" partitions the CSR matrix over the NUMA nodes. "auto" uses the fastest accurate method, see autotune()
         @type method: str
         @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
         @type unit: pyFAI.units.Enum
@@ -2174,6 +2848,10 @@ class AzimuthalIntegrator(Geometry):
         @param block_size: size of the block for OpenCL integration (unused?)
         @param profile: set to True to enable profiling in OpenCL
         @param all: if true return a dictionary with many more parameters
+        @param radial_scale: spacing of the npt radial bins: "linear" (default), "log" or "sqrt". Non linear bins use the CSR engine.
+        @type radial_scale: str
+        @param radial_edges: user defined bin edges in the output unit (npt+1 increasing values), npt and radial_scale are then ignored, radial_range must be None. Uses the CSR engine.
+        @type radial_edges: ndarray
 
 
         @return: q/2th/r bins center positions and regrouped intensity (and error array if variance or variance model provided), uneless all==True.
@@ -2182,11 +2860,22 @@ class AzimuthalIntegrator(Geometry):
         method = method.lower()
         unit = units.to_unit(unit)
         pos0_scale = 1.0  # nota we need anyway to make a copy !
+        if (radial_edges is not None) and (radial_range is not None):
+            raise ValueError("radial_range and radial_edges are exclusive: the edges define the radial range")
 
         if mask is None:
             mask = self.mask
 
         shape = data.shape
+        if method == "auto":
+            decision = self._autotune(shape, npt, unit, radial_range, azimuth_range, mask)
+            # the number of threads of the decision only applies to this integration
+            with self.autotuner.apply(decision) as method:
+                return self.integrate1d(data, npt, filename, correctSolidAngle, variance, error_model,
+                                        radial_range, azimuth_range, mask, dummy, delta_dummy,
+                                        polarization_factor, dark, flat, method, unit, safe,
+                                        normalization_factor, block_size, profile, all,
+                                        radial_scale, radial_edges)
         pos0_scale = unit.scale
 
         if radial_range:
@@ -2203,6 +2892,7 @@ class AzimuthalIntegrator(Geometry):
             azimuth_range = tuple(deg2rad(azimuth_range[i]) for i in (0, -1))
             if azimuth_range[1] <= azimuth_range[0]:
                 azimuth_range = (azimuth_range[0], azimuth_range[1] + 2 * pi)
+            self.check_chi_disc(azimuth_range)
             chi = self.chiArray(shape)
         else:
             chi = None
@@ -2228,7 +2918,38 @@ class AzimuthalIntegrator(Geometry):
         count = None
         sum = None
 
-
+        if (radial_edges is not None) or (radial_scale != "linear"):
+            if ("csr" not in method) or ("full" in method) or ("ocl" in method):
+                logger.warning("Non uniform radial bins are only implemented with bounding-box CSR, not %s" % method)
+                method = "nosplit_csr" if "nosplit" in method else "csr"
+            if radial_edges is not None:
+                edges = numpy.array(radial_edges, dtype=numpy.float64) / pos0_scale
+            else:
+                edges = self._radial_edges(shape, npt, mask, radial_range, unit, radial_scale)
+            with self._csr_sem:
+                integr = self._get_edges_integrator(shape, edges, mask, azimuth_range,
+                                                    unit=unit, method=method, safe=safe)
+                if integr is None:
+                    raise MemoryError("Unable to build the CSR matrix with non uniform bins")
+                if error_model == "azimuthal":
+                    qAxis, I, sum, count, M2 = integr.integrate_variance(data, dark=dark, flat=flat,
+                                                                         solidAngle=solidangle,
+                                                                         dummy=dummy,
+                                                                         delta_dummy=delta_dummy,
+                                                                         polarization=polarization)
+                    sigma = numpy.sqrt(M2) / numpy.maximum(count, 1)
+                else:
+                    qAxis, I, sum, count = integr.integrate(data, dark=dark, flat=flat,
+                                                            solidAngle=solidangle,
+                                                            dummy=dummy,
+                                                            delta_dummy=delta_dummy,
+                                                            polarization=polarization)
+                    if variance is not None:
+                        _, var1d, a, b = integr.integrate(variance,
+                                                          solidAngle=None,
+                                                          dummy=dummy,
+                                                          delta_dummy=delta_dummy)
+                        sigma = numpy.sqrt(a) / numpy.maximum(b, 1)
 
         if (I is None) and ("lut" in method):
             mask_crc = None
@@ -2342,88 +3063,34 @@ class AzimuthalIntegrator(Geometry):
                                                                                  delta_dummy=delta_dummy)
                                     sigma = numpy.sqrt(a) / numpy.maximum(b, 1)
                     else:
-                        qAxis, I, sum, count = self._lut_integrator.integrate(data, dark=dark, flat=flat,
-                                                                              solidAngle=solidangle,
-                                                                              dummy=dummy,
-                                                                              delta_dummy=delta_dummy,
-                                                                              polarization=polarization)
-
                         if error_model == "azimuthal":
-                            variance = (data - self.calcfrom1d(qAxis * pos0_scale, I, dim1_unit=unit)) ** 2
-                        if variance is not None:
-                            _, var1d, a, b = self._lut_integrator.integrate(variance,
-                                                               solidAngle=None,
-                                                               dummy=dummy,
-                                                               delta_dummy=delta_dummy)
-                            sigma = numpy.sqrt(a) / numpy.maximum(b, 1)
+                            # single pass: the variance within each bin is calculated by the integrator
+                            qAxis, I, sum, count, M2 = self._lut_integrator.integrate_variance(data, dark=dark, flat=flat,
+                                                                                               solidAngle=solidangle,
+                                                                                               dummy=dummy,
+                                                                                               delta_dummy=delta_dummy,
+                                                                                               polarization=polarization)
+                            sigma = numpy.sqrt(M2) / numpy.maximum(count, 1)
+                        else:
+                            qAxis, I, sum, count = self._lut_integrator.integrate(data, dark=dark, flat=flat,
+                                                                                  solidAngle=solidangle,
+                                                                                  dummy=dummy,
+                                                                                  delta_dummy=delta_dummy,
+                                                                                  polarization=polarization)
+                            if variance is not None:
+                                _, var1d, a, b = self._lut_integrator.integrate(variance,
+                                                                                solidAngle=None,
+                                                                                dummy=dummy,
+                                                                                delta_dummy=delta_dummy)
+                                sigma = numpy.sqrt(a) / numpy.maximum(b, 1)
 
         if (I is None) and ("csr" in method):
-            mask_crc = None
             with self._csr_sem:
-                reset = None
-                if self._csr_integrator is None:
-                    reset = "init"
-                    if mask is None:
-                        mask = self.detector.mask
-                        mask_crc = self.detector._mask_crc
-                    else:
-                        mask_crc = crc32(mask)
-                if (not reset) and safe:
-                    if mask is None:
-                        mask = self.detector.mask
-                        mask_crc = self.detector._mask_crc
-                    else:
-                        mask_crc = crc32(mask)
-                    if self._csr_integrator.unit != unit:
-                        reset = "unit changed"
-                    if self._csr_integrator.bins != npt:
-                        reset = "number of points changed"
-                    if self._csr_integrator.size != data.size:
-                        reset = "input image size changed"
-                    if (mask is not None) and\
-                            (not self._csr_integrator.check_mask):
-                        reset = "mask but CSR was without mask"
-                    elif (mask is None) and (self._csr_integrator.check_mask):
-                        reset = "no mask but CSR has mask"
-                    elif (mask is not None) and\
-                            (self._csr_integrator.mask_checksum != mask_crc):
-                        reset = "mask changed"
-                    if (radial_range is None) and\
-                            (self._csr_integrator.pos0Range is not None):
-                        reset = "radial_range was defined in CSR"
-                    elif (radial_range is not None) and\
-                            (self._csr_integrator.pos0Range !=
-                             (min(radial_range), max(radial_range) * EPS32)):
-                        reset = ("radial_range is defined"
-                                 " but not the same as in CSR")
-                    if (azimuth_range is None) and\
-                            (self._csr_integrator.pos1Range is not None):
-                        reset = ("azimuth_range not defined and"
-                                 " CSR had azimuth_range defined")
-                    elif (azimuth_range is not None) and\
-                            (self._csr_integrator.pos1Range !=
-                             (min(azimuth_range), max(azimuth_range) * EPS32)):
-                        reset = ("azimuth_range requested and"
-                                 " CSR's azimuth_range don't match")
-                if reset:
-                    logger.info("AI.integrate1d: Resetting integrator because %s" % reset)
-                    if "no" in method:
-                        split = "no"
-                    elif "full" in method:
-                        split = "full"
-                    else:
-                        split = "bbox"
-                    try:
-                        self._csr_integrator = self.setup_CSR(shape, npt, mask,
-                                                              radial_range, azimuth_range,
-                                                              mask_checksum=mask_crc,
-                                                              unit=unit, split=split)
-                    except MemoryError:  # CSR method is hungry...
-                        logger.warning("MemoryError: falling back on forward implementation")
-                        self._ocl_csr_integr = None
-                        self._csr_integrator = None
-                        gc.collect()
-                        method = self.DEFAULT_METHOD
+                if self._get_csr_integrator(shape, npt, mask, radial_range, azimuth_range,
+                                            unit=unit, method=method, safe=safe) is None:
+                    # CSR method is hungry...
+                    logger.warning("MemoryError: falling back on forward implementation")
+                    method = self.DEFAULT_METHOD
                 if self._csr_integrator:
                     if ("ocl" in method) and ocl_azim_csr:
                         with self._ocl_csr_sem:
@@ -2471,20 +3138,32 @@ class AzimuthalIntegrator(Geometry):
                                                                              delta_dummy=delta_dummy)
                                 sigma = numpy.sqrt(a) / numpy.maximum(b, 1)
                     else:
-                        qAxis, I, sum, count = self._csr_integrator.integrate(data, dark=dark, flat=flat,
-                                                           solidAngle=solidangle,
-                                                           dummy=dummy,
-                                                           delta_dummy=delta_dummy,
-                                                           polarization=polarization)
-
+                        if self.csr_pixel_order and (sparse_csr is not None):
+                            integr = self._get_renumbered_integrator(shape)
+                        else:
+                            integr = self._csr_integrator
                         if error_model == "azimuthal":
-                            variance = (data - self.calcfrom1d(qAxis * pos0_scale, I, dim1_unit=unit)) ** 2
-                        if variance is not None:
-                            _, var1d, a, b = self._csr_integrator.integrate(variance,
-                                                               solidAngle=None,
-                                                               dummy=dummy,
-                                                               delta_dummy=delta_dummy)
-                            sigma = numpy.sqrt(a) / numpy.maximum(b, 1)
+                            # single pass: the variance within each bin is calculated by the integrator
+                            qAxis, I, sum, count, M2 = integr.integrate_variance(data, dark=dark, flat=flat,
+                                                                                 solidAngle=solidangle,
+                                                                                 dummy=dummy,
+                                                                                 delta_dummy=delta_dummy,
+                                                                                 polarization=polarization)
+                            sigma = numpy.sqrt(M2) / numpy.maximum(count, 1)
+                        else:
+                            if ("numa" in method) and (sparse_csr is not None):
+                                integr = self._get_numa_integrator()
+                            qAxis, I, sum, count = integr.integrate(data, dark=dark, flat=flat,
+                                                                    solidAngle=solidangle,
+                                                                    dummy=dummy,
+                                                                    delta_dummy=delta_dummy,
+                                                                    polarization=polarization)
+                            if variance is not None:
+                                _, var1d, a, b = self._csr_integrator.integrate(variance,
+                                                                                solidAngle=None,
+                                                                                dummy=dummy,
+                                                                                delta_dummy=delta_dummy)
+                                sigma = numpy.sqrt(a) / numpy.maximum(b, 1)
 
 
         if (I is None) and ("splitpix" in method):
@@ -2739,7 +3418,7 @@ class AzimuthalIntegrator(Geometry):
         @type dark: ndarray
         @param flat: flat field image
         @type flat: ndarray
-        @param method: can be "numpy", "cython", "BBox" or "splitpixel", "lut", "csr; "lut_ocl" and "csr_ocl" if you want to go on GPU. To Specify the device: "csr_ocl_1,2"
+        @param method: can be "numpy", "cython", "BBox" or "splitpixel", "lut", "csr; "lut_ocl" and "csr_ocl" if you want to go on GPU. To Specify the device: "csr_ocl_1,2". "tiled_csr" uses an out-of-core tiled matrix for very large cakes
         @type method: str
         @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
         @type unit: pyFAI.units.Enum
@@ -2903,65 +3582,15 @@ class AzimuthalIntegrator(Geometry):
 
         if (I is None) and ("csr" in method):
             logger.debug("in csr")
-            mask_crc = None
             with self._lut_sem:
-                reset = None
-                if self._csr_integrator is None:
-                    reset = "init"
-                    if mask is None:
-                        mask = self.detector.mask
-                        mask_crc = self.detector._mask_crc
-                    else:
-                        mask_crc = crc32(mask)
-                if (not reset) and safe:
-                    if mask is None:
-                        mask = self.detector.mask
-                        mask_crc = self.detector._mask_crc
-                    else:
-                        mask_crc = crc32(mask)
-                    if self._csr_integrator.unit != unit:
-                        reset = "unit changed"
-                    if self._csr_integrator.bins != npt:
-                        reset = "number of points changed"
-                    if self._csr_integrator.size != data.size:
-                        reset = "input image size changed"
-                    if (mask is not None) and (not self._csr_integrator.check_mask):
-                        reset = "mask but CSR was without mask"
-                    elif (mask is None) and (self._csr_integrator.check_mask):
-                        reset = "no mask but CSR has mask"
-                    elif (mask is not None) and (self._csr_integrator.mask_checksum != mask_crc):
-                        reset = "mask changed"
-                    if (radial_range is None) and (self._csr_integrator.pos0Range is not None):
-                        reset = "radial_range was defined in CSR"
-                    elif (radial_range is not None) and self._csr_integrator.pos0Range != (min(radial_range), max(radial_range) * EPS32):
-                        reset = "radial_range is defined but not the same as in CSR"
-                    if (azimuth_range is None) and (self._csr_integrator.pos1Range is not None):
-                        reset = "azimuth_range not defined and CSR had azimuth_range defined"
-                    elif (azimuth_range is not None) and self._csr_integrator.pos1Range != (min(azimuth_range), max(azimuth_range) * EPS32):
-                        reset = "azimuth_range requested and CSR's azimuth_range don't match"
-                error = False
-                if reset:
-                    logger.info("AI.integrate2d: Resetting integrator because %s" % reset)
-                    if "no" in method:
-                        split = "no"
-                    elif "full" in method:
-                        split = "full"
-                    else:
-                        split = "bbox"
-                    try:
-                        self._csr_integrator = self.setup_CSR(shape, npt, mask,
-                                                              radial_range, azimuth_range,
-                                                              mask_checksum=mask_crc,
-                                                              unit=unit, split=split)
-                        error = False
-                    except MemoryError:
-                        logger.warning("MemoryError: falling back on default forward implementation")
-                        self._ocl_csr_integr = None
-                        gc.collect()
-                        method = self.DEFAULT_METHOD
-                        error = True
+                error = self._get_csr2d_integrator(shape, npt, mask, radial_range, azimuth_range,
+                                                   unit=unit, method=method, safe=safe) is None
+                if error:
+                    logger.warning("MemoryError: falling back on default forward implementation")
+                    method = self.DEFAULT_METHOD
                 if not error:  # not yet implemented...
-                    if  ("ocl" in method) and ocl_azim_lut:
+                    tiled = (sparse_csr is not None) and isinstance(self._csr2d_integrator, sparse_csr.TiledCsrIntegrator)
+                    if  ("ocl" in method) and ocl_azim_lut and not tiled:
                         with self._ocl_lut_sem:
                             if "," in method:
                                 c = method.index(",")
@@ -2980,17 +3609,17 @@ class AzimuthalIntegrator(Geometry):
                                 platformid = None
                                 deviceid = None
                                 devicetype = "all"
-                            if (self._ocl_csr_integr is None) or (self._ocl_csr_integr.on_device["data"] != self._csr_integrator.lut_checksum):
+                            if (self._ocl_csr_integr is None) or (self._ocl_csr_integr.on_device["data"] != self._csr2d_integrator.lut_checksum):
 #                                 try:
-                                self._ocl_csr_integr = ocl_azim_csr.OCL_CSR_Integrator(self._csr_integrator.lut,
-                                                                                           self._csr_integrator.size,
+                                self._ocl_csr_integr = ocl_azim_csr.OCL_CSR_Integrator(self._csr2d_integrator.lut,
+                                                                                           self._csr2d_integrator.size,
                                                                                            devicetype=devicetype,
                                                                                            platformid=platformid,
                                                                                            deviceid=deviceid,
-                                                                                           checksum=self._csr_integrator.lut_checksum)
+                                                                                           checksum=self._csr2d_integrator.lut_checksum)
 #                                 except (MemoryError, RuntimeError) as err:  # LUT method is hungry...
 #                                     logger.warning("Error: %s, falling back on forward implementation" % err)
-#                                     self._csr_integrator = None
+#                                     self._csr2d_integrator = None
 #                                     self._ocl_csr_integr = None
 #                                     gc.collect()
 #                                     method = self.DEFAULT_METHOD
@@ -3006,10 +3635,10 @@ class AzimuthalIntegrator(Geometry):
                                                                                safe=safe)
                                 I.shape = npt
                                 I = I.T
-                                bins_rad = self._csr_integrator.outPos0  # this will be copied later
-                                bins_azim = self._csr_integrator.outPos1
+                                bins_rad = self._csr2d_integrator.outPos0  # this will be copied later
+                                bins_azim = self._csr2d_integrator.outPos1
                     else:
-                        I, bins_rad, bins_azim, sum, count = self._csr_integrator.integrate(data, dark=dark, flat=flat,
+                        I, bins_rad, bins_azim, sum, count = self._csr2d_integrator.integrate(data, dark=dark, flat=flat,
                                                                                             solidAngle=solidangle,
                                                                                             dummy=dummy,
                                                                                             delta_dummy=delta_dummy,
@@ -3146,6 +3775,951 @@ class AzimuthalIntegrator(Geometry):
                 res = I, bins_rad, bins_azim
         return res
 
+    def _csr_reduce(self, reduction, data, npt, correctSolidAngle=True,
+                    radial_range=None, azimuth_range=None,
+                    mask=None, dummy=None, delta_dummy=None,
+                    polarization_factor=None, dark=None, flat=None,
+                    method="csr", unit=units.Q, safe=True, **kwargs):
+        """
+        Apply one of the statistical reductions of the CSR integrator
+        (sigma_clip, percentile, ...) or of the peak finder (find_peaks) to an image.
+
+        All parameters are the same as for integrate1d, the extra keyword
+        arguments are passed to the reduction of the integrator.
+
+        @param reduction: name of the method of the CSR integrator to call
+        @return: the result of the reduction with the radial positions scaled to the unit
+        """
+        method = method.lower()
+        if "csr" not in method:
+            logger.warning("%s is only implemented with CSR matrices, not %s" % (reduction, method))
+            method = "csr"
+        unit = units.to_unit(unit)
+        pos0_scale = unit.scale
+        if mask is None:
+            mask = self.mask
+        shape = data.shape
+
+        if radial_range:
+            radial_range = tuple([i / pos0_scale for i in radial_range])
+        if azimuth_range is not None:
+            azimuth_range = tuple(deg2rad(azimuth_range[i]) for i in (0, -1))
+            if azimuth_range[1] <= azimuth_range[0]:
+                azimuth_range = (azimuth_range[0], azimuth_range[1] + 2 * pi)
+
+        if correctSolidAngle:
+            solidangle = self.solidAngleArray(shape, correctSolidAngle)
+        else:
+            solidangle = None
+        if polarization_factor is None:
+            polarization = None
+        else:
+            polarization = self.polarization(shape, float(polarization_factor))
+        if dark is None:
+            dark = self.darkcurrent
+        if flat is None:
+            flat = self.flatfield
+
+        with self._csr_sem:
+            integr = self._get_csr_integrator(shape, npt, mask, radial_range, azimuth_range,
+                                              unit=unit, method=method, safe=safe)
+            if integr is None:
+                raise MemoryError("Unable to build the CSR matrix for %s" % reduction)
+            if reduction == "find_peaks":
+                finder = self._peak_finder
+                if (finder is None) or (finder.integrator is not integr) or (finder.shape != shape) or \
+                        (finder.parent_checksum != integr.lut_checksum):
+                    finder = self._peak_finder = sparse_csr.CsrPeakFinder(integr, shape)
+                integr = finder
+            res = getattr(integr, reduction)(data, dark=dark, flat=flat,
+                                             solidAngle=solidangle,
+                                             polarization=polarization,
+                                             dummy=dummy, delta_dummy=delta_dummy,
+                                             **kwargs)
+        return (res[0] * pos0_scale,) + tuple(res[1:])
+
+    def integrate1d2d(self, data, npt_rad, npt_azim=360, npt_1d=None, correctSolidAngle=True,
+                      radial_range=None, azimuth_range=None,
+                      mask=None, dummy=None, delta_dummy=None,
+                      polarization_factor=None, dark=None, flat=None,
+                      method="csr", unit=units.Q, safe=True,
+                      normalization_factor=None):
+        """
+        Calculate both the 2D regrouped image and the 1D pattern from a single
+        pass over the image: the 1D pattern is obtained by summing the
+        (unnormalized) histograms of the 2D integration along the azimuthal axis.
+
+        @param data: 2D array from the Detector/CCD camera
+        @type data: ndarray
+        @param npt_rad: number of points in the radial direction
+        @type npt_rad: int
+        @param npt_azim: number of points in the azimuthal direction
+        @type npt_azim: int
+        @param npt_1d: number of points of the 1D pattern, by default npt_rad. It can differ from npt_rad at the expense of a small matrix product.
+        @type npt_1d: int
+        @param correctSolidAngle: correct for solid angle of each pixel if True
+        @type correctSolidAngle: bool
+        @param radial_range: The lower and upper range of the radial unit. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type radial_range: (float, float), optional
+        @param azimuth_range: The lower and upper range of the azimuthal angle in degree. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type azimuth_range: (float, float), optional
+        @param mask: array (same size as image) with 1 for masked pixels, and 0 for valid pixels
+        @type mask: ndarray
+        @param dummy: value for dead/masked pixels
+        @type dummy: float
+        @param delta_dummy: precision for dummy value
+        @type delta_dummy: float
+        @param polarization_factor: polarization factor between -1 (vertical) and +1 (horizontal). 0 for circular polarization or random, None for no correction
+        @type polarization_factor: float
+        @param dark: dark noise image
+        @type dark: ndarray
+        @param flat: flat field image
+        @type flat: ndarray
+        @param method: can be "csr" or "nosplit_csr"
+        @type method: str
+        @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
+        @type unit: pyFAI.units.Enum
+        @param safe: Do some extra checks to ensure CSR is still valid. False is faster.
+        @type safe: bool
+        @param normalization_factor: Value of a normalization monitor
+        @type normalization_factor: float
+        @return: (radial, I) for the 1D pattern and (I, radial, azimuthal) for the 2D image
+        @rtype: 2-tuple of tuples of ndarrays
+        """
+        method = method.lower()
+        if ("csr" not in method) or ("full" in method) or ("ocl" in method):
+            logger.warning("integrate1d2d is only implemented with bounding-box CSR matrices, not %s" % method)
+            method = "csr"
+        unit = units.to_unit(unit)
+        pos0_scale = unit.scale
+        if mask is None:
+            mask = self.mask
+        shape = data.shape
+        npt = (npt_rad, npt_azim)
+
+        if radial_range:
+            radial_range = tuple([i / pos0_scale for i in radial_range])
+        if azimuth_range is not None:
+            azimuth_range = tuple(deg2rad(azimuth_range[i]) for i in (0, -1))
+            if azimuth_range[1] <= azimuth_range[0]:
+                azimuth_range = (azimuth_range[0], azimuth_range[1] + 2 * pi)
+
+        if correctSolidAngle:
+            solidangle = self.solidAngleArray(shape, correctSolidAngle)
+        else:
+            solidangle = None
+        if polarization_factor is None:
+            polarization = None
+        else:
+            polarization = self.polarization(shape, float(polarization_factor))
+        if dark is None:
+            dark = self.darkcurrent
+        if flat is None:
+            flat = self.flatfield
+
+        with self._lut_sem:
+            integr = self._get_csr2d_integrator(shape, npt, mask, radial_range, azimuth_range,
+                                                unit=unit, method=method, safe=safe)
+            if integr is None:
+                raise MemoryError("Unable to build the 2D CSR matrix")
+            mapping = None
+            if npt_1d and npt_1d != npt_rad:
+                key = (integr.lut_checksum, integr.pos0_min, integr.pos0_max, npt_1d)
+                if (self._csr2d_mapping is None) or (self._csr2d_mapping[0] != key):
+                    self._csr2d_mapping = (key, integr.radial_mapping(npt_1d))
+                mapping = self._csr2d_mapping[1]
+            res1d, res2d = integr.integrate_1d2d(data, dark=dark, flat=flat,
+                                                 solidAngle=solidangle,
+                                                 polarization=polarization,
+                                                 dummy=dummy, delta_dummy=delta_dummy,
+                                                 mapping=mapping)
+        radial1d, I1d = res1d[:2]
+        I2d, bins_rad, bins_azim = res2d[:3]
+        radial1d = radial1d * pos0_scale
+        bins_rad = bins_rad * pos0_scale
+        bins_azim = bins_azim * 180.0 / pi
+        if normalization_factor:
+            I1d /= normalization_factor
+            I2d /= normalization_factor
+        return (radial1d, I1d), (I2d, bins_rad, bins_azim)
+
+    def integrate_roi(self, data, npt, roi, correctSolidAngle=True,
+                      radial_range=None, azimuth_range=None,
+                      mask=None, dummy=None, delta_dummy=None,
+                      polarization_factor=None, dark=None, flat=None,
+                      method="csr", unit=units.Q, safe=True,
+                      normalization_factor=None, all=False):
+        """
+        Calculate the azimuthal integrated pattern of a rectangular region of
+        interest of the detector only.
+
+        The matrix of the region is extracted from the CSR matrix of the full
+        detector (built once, with npt points over the full radial range),
+        so changing the region of interest does not recalculate any geometry.
+        Only the pixels of the region are read from the image.
+
+        @param data: 2D array from the Detector/CCD camera, full frame or region of interest only
+        @type data: ndarray
+        @param npt: number of points of the pattern of the full detector
+        @type npt: int
+        @param roi: region of interest: 2-tuple of slices (rows, columns) or 4-tuple (row_min, row_max, column_min, column_max)
+        @type roi: tuple
+        @param correctSolidAngle: correct for solid angle of each pixel if True
+        @type correctSolidAngle: bool
+        @param radial_range: only the bins of the full pattern within this range are kept
+        @type radial_range: (float, float), optional
+        @param azimuth_range: The lower and upper range of the azimuthal angle in degree. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type azimuth_range: (float, float), optional
+        @param mask: array (same size as the full image) with 1 for masked pixels, and 0 for valid pixels
+        @type mask: ndarray
+        @param dummy: value for dead/masked pixels
+        @type dummy: float
+        @param delta_dummy: precision for dummy value
+        @type delta_dummy: float
+        @param polarization_factor: polarization factor between -1 (vertical) and +1 (horizontal). 0 for circular polarization or random, None for no correction
+        @type polarization_factor: float
+        @param dark: dark noise image (full frame or region of interest)
+        @type dark: ndarray
+        @param flat: flat field image (full frame or region of interest)
+        @type flat: ndarray
+        @param method: can be "csr", "nosplit_csr" or "full_csr"
+        @type method: str
+        @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
+        @type unit: pyFAI.units.Enum
+        @param safe: Do some extra checks to ensure CSR is still valid. False is faster.
+        @type safe: bool
+        @param normalization_factor: Value of a normalization monitor
+        @type normalization_factor: float
+        @param all: if true return a dictionary with the sum and the count as well
+        @return: q/2th/r bins center positions and regrouped intensity
+        @rtype: 2-tuple of ndarrays
+        """
+        method = method.lower()
+        if "csr" not in method:
+            logger.warning("integrate_roi is only implemented with CSR matrices, not %s" % method)
+            method = "csr"
+        unit = units.to_unit(unit)
+        pos0_scale = unit.scale
+        if mask is None:
+            mask = self.mask
+        # the data may be the region of interest only: rely on the detector for the full shape
+        shape = tuple(self.detector.shape) if self.detector.shape else data.shape
+
+        if azimuth_range is not None:
+            azimuth_range = tuple(deg2rad(azimuth_range[i]) for i in (0, -1))
+            if azimuth_range[1] <= azimuth_range[0]:
+                azimuth_range = (azimuth_range[0], azimuth_range[1] + 2 * pi)
+
+        if correctSolidAngle:
+            solidangle = self.solidAngleArray(shape, correctSolidAngle)
+        else:
+            solidangle = None
+        if polarization_factor is None:
+            polarization = None
+        else:
+            polarization = self.polarization(shape, float(polarization_factor))
+        if dark is None:
+            dark = self.darkcurrent
+        if flat is None:
+            flat = self.flatfield
+
+        with self._csr_sem:
+            master = self._get_csr_integrator(shape, npt, mask, None, azimuth_range,
+                                              unit=unit, method=method, safe=safe)
+            if master is None:
+                raise MemoryError("Unable to build the CSR matrix")
+            if radial_range:
+                pos = master.outPos * pos0_scale
+                valid = numpy.where((pos >= min(radial_range)) & (pos <= max(radial_range)))[0]
+                rows = slice(valid[0], valid[-1] + 1) if valid.size else slice(0, 0)
+            else:
+                rows = slice(0, master.bins)
+            integr = self._roi_integrator
+            if (integr is None) or (integr.parent_checksum != master.lut_checksum) or \
+                    (integr.full_shape != shape) or (integr.roi != sparse_csr._normalize_roi(roi, shape)) or \
+                    (integr.rows != rows):
+                integr = self._roi_integrator = sparse_csr.CsrRoiIntegrator(master, shape, roi, rows)
+            qAxis, I, sum, count = integr.integrate(data, dark=dark, flat=flat,
+                                                    solidAngle=solidangle,
+                                                    polarization=polarization,
+                                                    dummy=dummy, delta_dummy=delta_dummy)
+        qAxis = qAxis * pos0_scale
+        if normalization_factor:
+            I /= normalization_factor
+        if all:
+            return {"radial": qAxis,
+                    "unit": unit,
+                    "roi": integr.roi,
+                    "I": I,
+                    "sum": sum,
+                    "count": count}
+        return qAxis, I
+
+    def integrate_sparse(self, data, npt, correctSolidAngle=True,
+                         radial_range=None, azimuth_range=None,
+                         mask=None, dummy=None, delta_dummy=None,
+                         polarization_factor=None, dark=None, flat=None,
+                         method="csr", unit=units.Q, safe=True,
+                         normalization_factor=None, threshold=None,
+                         shape=None, all=False):
+        """
+        Calculate the azimuthal integrated pattern of sparse frames, like
+        low-flux frames of photon counting detectors which are mostly zeros.
+
+        The transposed (pixel-major) CSR matrix is used to scatter only the
+        non-zero pixels into the bins, the normalization being the coverage
+        of each bin, precomputed once.
+
+        Frames can be provided either in sparse form as a 2-tuple
+        (flat pixel indices, values) or as dense images: those are compacted
+        in parallel and integrated with the sparse path if the fraction of
+        non-zero pixels is small enough (see
+        sparse_csr.SparseFrameIntegrator.max_density), with the dense CSR
+        integrator otherwise.
+
+        @param data: 2D array from the Detector/CCD camera or 2-tuple (indices, values)
+        @type data: ndarray or tuple
+        @param npt: number of points in the output pattern
+        @type npt: int
+        @param correctSolidAngle: correct for solid angle of each pixel if True
+        @type correctSolidAngle: bool
+        @param radial_range: The lower and upper range of the radial unit. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type radial_range: (float, float), optional
+        @param azimuth_range: The lower and upper range of the azimuthal angle in degree. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type azimuth_range: (float, float), optional
+        @param mask: array (same size as image) with 1 for masked pixels, and 0 for valid pixels
+        @type mask: ndarray
+        @param dummy: value for dead/masked pixels (dense frames only, disables the sparse path)
+        @type dummy: float
+        @param delta_dummy: precision for dummy value
+        @type delta_dummy: float
+        @param polarization_factor: polarization factor between -1 (vertical) and +1 (horizontal). 0 for circular polarization or random, None for no correction
+        @type polarization_factor: float
+        @param dark: dark noise image (dense frames only, disables the sparse path)
+        @type dark: ndarray
+        @param flat: flat field image
+        @type flat: ndarray
+        @param method: can be "csr", "nosplit_csr" or "full_csr"
+        @type method: str
+        @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
+        @type unit: pyFAI.units.Enum
+        @param safe: Do some extra checks to ensure CSR is still valid. False is faster.
+        @type safe: bool
+        @param normalization_factor: Value of a normalization monitor
+        @type normalization_factor: float
+        @param threshold: dense frames are compacted keeping only values above this threshold
+        @type threshold: float
+        @param shape: shape of the image, needed for sparse input only if the detector has no shape
+        @type shape: 2-tuple of int
+        @param all: if true return a dictionary with the sum, the count and the density as well
+        @return: q/2th/r bins center positions and regrouped intensity
+        @rtype: 2-tuple of ndarrays
+        """
+        method = method.lower()
+        if "csr" not in method:
+            logger.warning("integrate_sparse is only implemented with CSR matrices, not %s" % method)
+            method = "csr"
+        unit = units.to_unit(unit)
+        pos0_scale = unit.scale
+        if mask is None:
+            mask = self.mask
+        sparse = isinstance(data, (tuple, list))
+        if shape is None:
+            if self.detector.shape:
+                shape = tuple(self.detector.shape)
+            elif sparse:
+                raise RuntimeError("integrate_sparse: the shape of the image is needed for sparse frames")
+            else:
+                shape = data.shape
+
+        if radial_range:
+            radial_range = tuple([i / pos0_scale for i in radial_range])
+        if azimuth_range is not None:
+            azimuth_range = tuple(deg2rad(azimuth_range[i]) for i in (0, -1))
+            if azimuth_range[1] <= azimuth_range[0]:
+                azimuth_range = (azimuth_range[0], azimuth_range[1] + 2 * pi)
+
+        if correctSolidAngle:
+            solidangle = self.solidAngleArray(shape, correctSolidAngle)
+        else:
+            solidangle = None
+        if polarization_factor is None:
+            polarization = None
+        else:
+            polarization = self.polarization(shape, float(polarization_factor))
+        if flat is None:
+            flat = self.flatfield
+
+        with self._csr_sem:
+            master = self._get_csr_integrator(shape, npt, mask, radial_range, azimuth_range,
+                                              unit=unit, method=method, safe=safe)
+            if master is None:
+                raise MemoryError("Unable to build the CSR matrix")
+            integr = self._sparse_integrator
+            if (integr is None) or (integr.parent_checksum != master.lut_checksum) or \
+                    (integr.integrator is not master):
+                integr = self._sparse_integrator = sparse_csr.SparseFrameIntegrator(master)
+            if sparse:
+                qAxis, I, sum, count = integr.integrate_sparse(data[0], data[1], flat=flat,
+                                                               solidAngle=solidangle,
+                                                               polarization=polarization)
+                density = len(data[0]) / float(integr.size)
+            else:
+                if dark is None:
+                    dark = self.darkcurrent
+                qAxis, I, sum, count = integr.integrate(data, dummy=dummy, delta_dummy=delta_dummy,
+                                                        dark=dark, flat=flat, solidAngle=solidangle,
+                                                        polarization=polarization, threshold=threshold)
+                density = integr.density
+        qAxis = qAxis * pos0_scale
+        if normalization_factor:
+            I /= normalization_factor
+        if all:
+            return {"radial": qAxis,
+                    "unit": unit,
+                    "I": I,
+                    "sum": sum,
+                    "count": count,
+                    "density": density}
+        return qAxis, I
+
+    def integrate_preview(self, data, npt, correctSolidAngle=True,
+                          radial_range=None, azimuth_range=None,
+                          mask=None, dummy=None, delta_dummy=None,
+                          polarization_factor=None, dark=None, flat=None,
+                          method="csr", unit=units.Q, safe=True,
+                          normalization_factor=None, factor=16, budget=None,
+                          all=False):
+        """
+        Calculate a fast approximation of the azimuthal integrated pattern,
+        for live display, with an estimate of its uncertainty.
+
+        Only a deterministic stratified subset of the pixels of each bin is
+        read (1 out of factor), reweighted so that the normalization of each
+        bin is the one of the full integration (see
+        sparse_csr.PreviewCsrIntegrator). The subset is derived from the CSR
+        matrix of the full integration, which is built once.
+
+        @param data: 2D array from the Detector/CCD camera
+        @type data: ndarray
+        @param npt: number of points in the output pattern
+        @type npt: int
+        @param correctSolidAngle: correct for solid angle of each pixel if True
+        @type correctSolidAngle: bool
+        @param radial_range: The lower and upper range of the radial unit. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type radial_range: (float, float), optional
+        @param azimuth_range: The lower and upper range of the azimuthal angle in degree. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type azimuth_range: (float, float), optional
+        @param mask: array (same size as image) with 1 for masked pixels, and 0 for valid pixels
+        @type mask: ndarray
+        @param dummy: value for dead/masked pixels
+        @type dummy: float
+        @param delta_dummy: precision for dummy value
+        @type delta_dummy: float
+        @param polarization_factor: polarization factor between -1 (vertical) and +1 (horizontal). 0 for circular polarization or random, None for no correction
+        @type polarization_factor: float
+        @param dark: dark noise image
+        @type dark: ndarray
+        @param flat: flat field image
+        @type flat: ndarray
+        @param method: can be "csr", "nosplit_csr" or "full_csr"
+        @type method: str
+        @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
+        @type unit: pyFAI.units.Enum
+        @param safe: Do some extra checks to ensure CSR is still valid. False is faster.
+        @type safe: bool
+        @param normalization_factor: Value of a normalization monitor
+        @type normalization_factor: float
+        @param factor: subsampling factor, 1 reads all pixels
+        @type factor: int
+        @param budget: time budget per frame in seconds: the factor is then adapted from frame to frame
+        @type budget: float
+        @param all: if true return a dictionary with the sum, the count and the factor used as well
+        @return: q/2th/r bins center positions, regrouped intensity and its uncertainty
+        @rtype: 3-tuple of ndarrays
+        """
+        method = method.lower()
+        if "csr" not in method:
+            logger.warning("integrate_preview is only implemented with CSR matrices, not %s" % method)
+            method = "csr"
+        unit = units.to_unit(unit)
+        pos0_scale = unit.scale
+        if mask is None:
+            mask = self.mask
+        shape = data.shape
+
+        if radial_range:
+            radial_range = tuple([i / pos0_scale for i in radial_range])
+        if azimuth_range is not None:
+            azimuth_range = tuple(deg2rad(azimuth_range[i]) for i in (0, -1))
+            if azimuth_range[1] <= azimuth_range[0]:
+                azimuth_range = (azimuth_range[0], azimuth_range[1] + 2 * pi)
+            self.check_chi_disc(azimuth_range)
+
+        if correctSolidAngle:
+            solidangle = self.solidAngleArray(shape, correctSolidAngle)
+        else:
+            solidangle = None
+        if polarization_factor is None:
+            polarization = None
+        else:
+            polarization = self.polarization(shape, float(polarization_factor))
+        if dark is None:
+            dark = self.darkcurrent
+        if flat is None:
+            flat = self.flatfield
+
+        with self._csr_sem:
+            master = self._get_csr_integrator(shape, npt, mask, radial_range, azimuth_range,
+                                              unit=unit, method=method, safe=safe)
+            if master is None:
+                raise MemoryError("Unable to build the CSR matrix")
+            integr = self._preview_integrator
+            if (integr is None) or (integr.integrator is not master) or \
+                    (integr.parent_checksum != master.lut_checksum):
+                integr = self._preview_integrator = sparse_csr.PreviewCsrIntegrator(master, factor)
+            if budget is None:
+                integr.factor = factor
+            qAxis, I, sigma, sum, count = integr.integrate(data, dark=dark, flat=flat,
+                                                           solidAngle=solidangle,
+                                                           polarization=polarization,
+                                                           dummy=dummy, delta_dummy=delta_dummy,
+                                                           budget=budget)
+            used = integr.factor
+        qAxis = qAxis * pos0_scale
+        if normalization_factor:
+            I /= normalization_factor
+            sigma /= normalization_factor
+        if all:
+            return {"radial": qAxis,
+                    "unit": unit,
+                    "I": I,
+                    "sigma": sigma,
+                    "sum": sum,
+                    "count": count,
+                    "factor": used}
+        return qAxis, I, sigma
+
+    def setup_stream(self, npt, shape=None, correctSolidAngle=True,
+                     radial_range=None, azimuth_range=None,
+                     mask=None, dummy=None, delta_dummy=None,
+                     polarization_factor=None, dark=None, flat=None,
+                     method="csr", unit=units.Q, safe=True):
+        """
+        Prepare a streaming integrator which integrates frames provided as
+        bands of rows, in any order, as they are read out from the detector.
+
+        Usage::
+
+            stream = ai.setup_stream(1000, unit="2th_deg")
+            for start, band in readout():
+                stream.add_band(band, start)
+            radial, I, sum, count = stream.finalize()
+
+        The returned integrator applies the corrections given here and is
+        started for the first frame: start() has to be called for each new
+        frame.
+
+        @param npt: number of points in the output pattern
+        @type npt: int
+        @param shape: shape of the full frame, the one of the detector by default
+        @type shape: 2-tuple of int
+        @param correctSolidAngle: correct for solid angle of each pixel if True
+        @type correctSolidAngle: bool
+        @param radial_range: The lower and upper range of the radial unit. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type radial_range: (float, float), optional
+        @param azimuth_range: The lower and upper range of the azimuthal angle in degree. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type azimuth_range: (float, float), optional
+        @param mask: array (same size as image) with 1 for masked pixels, and 0 for valid pixels
+        @type mask: ndarray
+        @param dummy: value for dead/masked pixels
+        @type dummy: float
+        @param delta_dummy: precision for dummy value
+        @type delta_dummy: float
+        @param polarization_factor: polarization factor between -1 (vertical) and +1 (horizontal). 0 for circular polarization or random, None for no correction
+        @type polarization_factor: float
+        @param dark: dark noise image
+        @type dark: ndarray
+        @param flat: flat field image
+        @type flat: ndarray
+        @param method: can be "csr", "nosplit_csr" or "full_csr"
+        @type method: str
+        @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
+        @type unit: pyFAI.units.Enum
+        @param safe: Do some extra checks to ensure CSR is still valid. False is faster.
+        @type safe: bool
+        @return: streaming integrator, already started
+        @rtype: sparse_csr.StreamingIntegrator
+        """
+        method = method.lower()
+        if "csr" not in method:
+            logger.warning("setup_stream is only implemented with CSR matrices, not %s" % method)
+            method = "csr"
+        unit = units.to_unit(unit)
+        if shape is None:
+            shape = self.detector.shape
+        if not shape:
+            raise RuntimeError("setup_stream: the shape of the frame is needed")
+        shape = tuple(shape)
+        if mask is None:
+            mask = self.mask
+        if radial_range:
+            radial_range = tuple([i / unit.scale for i in radial_range])
+        if azimuth_range is not None:
+            azimuth_range = tuple(deg2rad(azimuth_range[i]) for i in (0, -1))
+            if azimuth_range[1] <= azimuth_range[0]:
+                azimuth_range = (azimuth_range[0], azimuth_range[1] + 2 * pi)
+        if correctSolidAngle:
+            solidangle = self.solidAngleArray(shape, correctSolidAngle)
+        else:
+            solidangle = None
+        if polarization_factor is None:
+            polarization = None
+        else:
+            polarization = self.polarization(shape, float(polarization_factor))
+        if dark is None:
+            dark = self.darkcurrent
+        if flat is None:
+            flat = self.flatfield
+
+        with self._csr_sem:
+            master = self._get_csr_integrator(shape, npt, mask, radial_range, azimuth_range,
+                                              unit=unit, method=method, safe=safe)
+        if master is None:
+            raise MemoryError("Unable to build the CSR matrix")
+        stream = sparse_csr.StreamingIntegrator(master, shape, unit.scale)
+        stream.set_corrections(dummy=dummy, delta_dummy=delta_dummy, dark=dark, flat=flat,
+                               solidAngle=solidangle, polarization=polarization)
+        stream.start()
+        return stream
+
+    def sigma_clip(self, data, npt, correctSolidAngle=True,
+                   radial_range=None, azimuth_range=None,
+                   mask=None, dummy=None, delta_dummy=None,
+                   polarization_factor=None, dark=None, flat=None,
+                   method="csr", unit=units.Q, thres=3, max_iter=5,
+                   safe=True, normalization_factor=None, all=False):
+        """
+        Perform the 1D azimuthal integration with an iterative sigma-clipping
+        of the pixels within each ring: outliers like Bragg spots or zingers
+        are discarded before averaging.
+
+        The clipping is performed on the actual pixels using the CSR matrix of
+        the integrator, entirely in parallel compiled code.
+
+        @param data: 2D array from the Detector/CCD camera
+        @type data: ndarray
+        @param npt: number of points in the output pattern
+        @type npt: int
+        @param correctSolidAngle: correct for solid angle of each pixel if True
+        @type correctSolidAngle: bool
+        @param radial_range: The lower and upper range of the radial unit. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type radial_range: (float, float), optional
+        @param azimuth_range: The lower and upper range of the azimuthal angle in degree. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type azimuth_range: (float, float), optional
+        @param mask: array (same size as image) with 1 for masked pixels, and 0 for valid pixels
+        @type mask: ndarray
+        @param dummy: value for dead/masked pixels
+        @type dummy: float
+        @param delta_dummy: precision for dummy value
+        @type delta_dummy: float
+        @param polarization_factor: polarization factor between -1 (vertical) and +1 (horizontal). 0 for circular polarization or random, None for no correction
+        @type polarization_factor: float
+        @param dark: dark noise image
+        @type dark: ndarray
+        @param flat: flat field image
+        @type flat: ndarray
+        @param method: can be "csr", "nosplit_csr" or "full_csr"
+        @type method: str
+        @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
+        @type unit: pyFAI.units.Enum
+        @param thres: cut-off for n*sigma: discard any pixel with |I-<I>| > thres*std
+        @type thres: float
+        @param max_iter: maximum number of clipping passes
+        @type max_iter: int
+        @param safe: Do some extra checks to ensure CSR is still valid. False is faster.
+        @type safe: bool
+        @param normalization_factor: Value of a normalization monitor
+        @type normalization_factor: float
+        @param all: if true return a dictionary with the number of rejected pixels per bin as well
+        @return: q/2th/r bins center positions, clipped mean intensity and standard deviation
+        @rtype: 3-tuple of ndarrays
+        """
+        unit = units.to_unit(unit)
+        qAxis, I, sigma, rejected = self._csr_reduce("sigma_clip", data, npt, correctSolidAngle=correctSolidAngle,
+                                                     radial_range=radial_range, azimuth_range=azimuth_range,
+                                                     mask=mask, dummy=dummy, delta_dummy=delta_dummy,
+                                                     polarization_factor=polarization_factor,
+                                                     dark=dark, flat=flat, method=method, unit=unit,
+                                                     safe=safe, thres=thres, max_iter=max_iter)
+        if normalization_factor:
+            I /= normalization_factor
+            sigma /= normalization_factor
+        if all:
+            return {"radial": qAxis,
+                    "unit": unit,
+                    "I": I,
+                    "sigma": sigma,
+                    "rejected": rejected}
+        return qAxis, I, sigma
+
+    def medfilt1d(self, data, npt, correctSolidAngle=True,
+                  radial_range=None, azimuth_range=None,
+                  mask=None, dummy=None, delta_dummy=None,
+                  polarization_factor=None, dark=None, flat=None,
+                  method="csr", unit=units.Q, percentile=50,
+                  safe=True, normalization_factor=None, all=False):
+        """
+        Perform the 1D azimuthal integration with a median (or any percentile)
+        filter of the pixels within each ring instead of the mean: Bragg
+        spots, zingers and gaps have little influence on the result.
+
+        The percentile is calculated on the actual pixels using the CSR matrix
+        of the integrator, weighted by the coefficients of the matrix.
+
+        @param data: 2D array from the Detector/CCD camera
+        @type data: ndarray
+        @param npt: number of points in the output pattern
+        @type npt: int
+        @param correctSolidAngle: correct for solid angle of each pixel if True
+        @type correctSolidAngle: bool
+        @param radial_range: The lower and upper range of the radial unit. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type radial_range: (float, float), optional
+        @param azimuth_range: The lower and upper range of the azimuthal angle in degree. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type azimuth_range: (float, float), optional
+        @param mask: array (same size as image) with 1 for masked pixels, and 0 for valid pixels
+        @type mask: ndarray
+        @param dummy: value for dead/masked pixels
+        @type dummy: float
+        @param delta_dummy: precision for dummy value
+        @type delta_dummy: float
+        @param polarization_factor: polarization factor between -1 (vertical) and +1 (horizontal). 0 for circular polarization or random, None for no correction
+        @type polarization_factor: float
+        @param dark: dark noise image
+        @type dark: ndarray
+        @param flat: flat field image
+        @type flat: ndarray
+        @param method: can be "csr", "nosplit_csr" or "full_csr"
+        @type method: str
+        @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
+        @type unit: pyFAI.units.Enum
+        @param percentile: which percentile to extract (50 for the median). With a 2-tuple like (10, 90), the mean of the pixels between both percentiles is calculated (trimmed mean).
+        @type percentile: float or 2-tuple of floats
+        @param safe: Do some extra checks to ensure CSR is still valid. False is faster.
+        @type safe: bool
+        @param normalization_factor: Value of a normalization monitor
+        @type normalization_factor: float
+        @param all: if true return a dictionary with the number of pixels per bin as well
+        @return: q/2th/r bins center positions, filtered intensity
+        @rtype: 2-tuple of ndarrays
+        """
+        unit = units.to_unit(unit)
+        qAxis, I, count = self._csr_reduce("percentile", data, npt, correctSolidAngle=correctSolidAngle,
+                                           radial_range=radial_range, azimuth_range=azimuth_range,
+                                           mask=mask, dummy=dummy, delta_dummy=delta_dummy,
+                                           polarization_factor=polarization_factor,
+                                           dark=dark, flat=flat, method=method, unit=unit,
+                                           safe=safe, percentile=percentile)
+        if normalization_factor:
+            I /= normalization_factor
+        if all:
+            return {"radial": qAxis,
+                    "unit": unit,
+                    "I": I,
+                    "count": count,
+                    "percentile": percentile}
+        return qAxis, I
+
+    def find_peaks(self, data, npt, correctSolidAngle=True,
+                   radial_range=None, azimuth_range=None,
+                   mask=None, dummy=None, delta_dummy=None,
+                   polarization_factor=None, dark=None, flat=None,
+                   method="csr", unit=units.Q, thres=3, max_iter=5,
+                   snr=3, noise=0, min_pixels=1, connectivity=8,
+                   safe=True, all=False):
+        """
+        Find the Bragg peaks standing above the radial background, for
+        serial crystallography hit-finding.
+
+        The background of each ring is its sigma-clipped mean, projected back
+        on the pixels together with its standard deviation within the
+        thresholding pass; pixels above background + snr*std are then grouped
+        in connected components. Everything runs in compiled code, see
+        sparse_csr.CsrPeakFinder.
+
+        @param data: 2D array from the Detector/CCD camera
+        @type data: ndarray
+        @param npt: number of rings of the background
+        @type npt: int
+        @param correctSolidAngle: correct for solid angle of each pixel if True
+        @type correctSolidAngle: bool
+        @param radial_range: The lower and upper range of the radial unit. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type radial_range: (float, float), optional
+        @param azimuth_range: The lower and upper range of the azimuthal angle in degree. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type azimuth_range: (float, float), optional
+        @param mask: array (same size as image) with 1 for masked pixels, and 0 for valid pixels
+        @type mask: ndarray
+        @param dummy: value for dead/masked pixels
+        @type dummy: float
+        @param delta_dummy: precision for dummy value
+        @type delta_dummy: float
+        @param polarization_factor: polarization factor between -1 (vertical) and +1 (horizontal). 0 for circular polarization or random, None for no correction
+        @type polarization_factor: float
+        @param dark: dark noise image
+        @type dark: ndarray
+        @param flat: flat field image
+        @type flat: ndarray
+        @param method: can be "csr", "nosplit_csr" or "full_csr"
+        @type method: str
+        @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
+        @type unit: pyFAI.units.Enum
+        @param thres: cut-off of the sigma-clipping of the background
+        @type thres: float
+        @param max_iter: maximum number of clipping passes
+        @type max_iter: int
+        @param snr: minimum signal to noise ratio of a peak pixel
+        @type snr: float
+        @param noise: minimum excess over the background of a peak pixel (corrected intensity)
+        @type noise: float
+        @param min_pixels: minimum number of pixels of a peak
+        @type min_pixels: int
+        @param connectivity: 4 or 8 connected pixels
+        @type connectivity: int
+        @param safe: Do some extra checks to ensure CSR is still valid. False is faster.
+        @type safe: bool
+        @param all: if true return a dictionary with the background and its deviation as well
+        @return: centroids (row, column) of the peaks, their intensity above the background and their number of pixels
+        @rtype: 3-tuple of ndarrays
+        """
+        unit = units.to_unit(unit)
+        qAxis, centroid, intensity, count, background, sigma = \
+            self._csr_reduce("find_peaks", data, npt, correctSolidAngle=correctSolidAngle,
+                             radial_range=radial_range, azimuth_range=azimuth_range,
+                             mask=mask, dummy=dummy, delta_dummy=delta_dummy,
+                             polarization_factor=polarization_factor,
+                             dark=dark, flat=flat, method=method, unit=unit, safe=safe,
+                             thres=thres, max_iter=max_iter, snr=snr, noise=noise,
+                             min_pixels=min_pixels, connectivity=connectivity)
+        if all:
+            return {"centroid": centroid,
+                    "intensity": intensity,
+                    "count": count,
+                    "radial": qAxis,
+                    "unit": unit,
+                    "background": background,
+                    "sigma": sigma}
+        return centroid, intensity, count
+
+    def integrate_sectors(self, data, npt, sectors=8, correctSolidAngle=True,
+                          radial_range=None, azimuth_range=None,
+                          mask=None, dummy=None, delta_dummy=None,
+                          polarization_factor=None, dark=None, flat=None,
+                          method="csr", unit=units.Q, safe=True,
+                          normalization_factor=None, all=False):
+        """
+        Calculate the radial profiles of several azimuthal sectors in a single
+        pass over the image, all sectors sharing the same radial bins.
+
+        This is equivalent to calling integrate1d with the azimuth_range of
+        each sector, but the matrix of all sectors is built only once and the
+        image is read once.
+
+        @param data: 2D array from the Detector/CCD camera
+        @type data: ndarray
+        @param npt: number of radial points in each sector
+        @type npt: int
+        @param sectors: number of equal sectors within azimuth_range, or list of (chi_min, chi_max) in degrees for each sector (they may overlap)
+        @type sectors: int or list of 2-tuple
+        @param correctSolidAngle: correct for solid angle of each pixel if True
+        @type correctSolidAngle: bool
+        @param radial_range: The lower and upper range of the radial unit. If not provided, range is simply (data.min(), data.max()). Values outside the range are ignored.
+        @type radial_range: (float, float), optional
+        @param azimuth_range: The lower and upper range of the azimuthal angle in degree, cut into sectors. If not provided, the whole azimuthal range of the detector.
+        @type azimuth_range: (float, float), optional
+        @param mask: array (same size as image) with 1 for masked pixels, and 0 for valid pixels
+        @type mask: ndarray
+        @param dummy: value for dead/masked pixels
+        @type dummy: float
+        @param delta_dummy: precision for dummy value
+        @type delta_dummy: float
+        @param polarization_factor: polarization factor between -1 (vertical) and +1 (horizontal). 0 for circular polarization or random, None for no correction
+        @type polarization_factor: float
+        @param dark: dark noise image
+        @type dark: ndarray
+        @param flat: flat field image
+        @type flat: ndarray
+        @param method: can be "csr" or "nosplit_csr"
+        @type method: str
+        @param unit: Output units, can be "q_nm^-1", "q_A^-1", "2th_deg", "2th_rad", "r_mm" for now
+        @type unit: pyFAI.units.Enum
+        @param safe: Do some extra checks to ensure CSR is still valid. False is faster.
+        @type safe: bool
+        @param normalization_factor: Value of a normalization monitor
+        @type normalization_factor: float
+        @param all: if true return a dictionary with the limits of the sectors, the sum and the count as well
+        @return: q/2th/r bins center positions and regrouped intensity with shape (number of sectors, npt)
+        @rtype: 2-tuple of ndarrays
+        """
+        method = method.lower()
+        if ("csr" not in method) or ("full" in method):
+            logger.warning("integrate_sectors is only implemented with bounding-box CSR matrices, not %s" % method)
+            method = "csr"
+        unit = units.to_unit(unit)
+        pos0_scale = unit.scale
+        if mask is None:
+            mask = self.mask
+        shape = data.shape
+
+        if radial_range:
+            radial_range = tuple([i / pos0_scale for i in radial_range])
+        if azimuth_range is not None:
+            azimuth_range = tuple(deg2rad(azimuth_range[i]) for i in (0, -1))
+            if azimuth_range[1] <= azimuth_range[0]:
+                azimuth_range = (azimuth_range[0], azimuth_range[1] + 2 * pi)
+        if "__len__" in dir(sectors):
+            limits = []
+            for sector in sectors:
+                sector = tuple(deg2rad(sector[i]) for i in (0, -1))
+                if sector[1] <= sector[0]:
+                    sector = (sector[0], sector[1] + 2 * pi)
+                limits.append(sector)
+            sectors = limits
+
+        if correctSolidAngle:
+            solidangle = self.solidAngleArray(shape, correctSolidAngle)
+        else:
+            solidangle = None
+        if polarization_factor is None:
+            polarization = None
+        else:
+            polarization = self.polarization(shape, float(polarization_factor))
+        if dark is None:
+            dark = self.darkcurrent
+        if flat is None:
+            flat = self.flatfield
+
+        with self._csr_sem:
+            integr = self._get_sector_integrator(shape, npt, sectors, mask, radial_range, azimuth_range,
+                                                 unit=unit, method=method, safe=safe)
+            if integr is None:
+                raise MemoryError("Unable to build the multi-sector CSR matrix")
+            qAxis, I, sum, count = integr.integrate(data, dark=dark, flat=flat,
+                                                    solidAngle=solidangle,
+                                                    polarization=polarization,
+                                                    dummy=dummy, delta_dummy=delta_dummy)
+            limits = rad2deg(numpy.array(integr.sectors))
+        qAxis = qAxis * pos0_scale
+        if normalization_factor:
+            I /= normalization_factor
+        if all:
+            return {"radial": qAxis,
+                    "unit": unit,
+                    "sectors": limits,
+                    "I": I,
+                    "sum": sum,
+                    "count": count}
+        return qAxis, I
+
     @deprecated
     def saxs(self, data, npt, filename=None,
              correctSolidAngle=True, variance=None,
@@ -3389,39 +4963,31 @@ class AzimuthalIntegrator(Geometry):
         except IOError:
             logger.error("IOError while writing %s" % filename)
 
-    def separate(self, data, npt_rad=1024, npt_azim=512, unit="2th_deg", percentile=50, mask=None, restore_mask=True):
+    def separate(self, data, npt_rad=1024, npt_azim=None, unit="2th_deg", percentile=50, mask=None, restore_mask=True):
         """
         Separate bragg signal from powder/amorphous signal using azimuthal integration,
         median filering and projected back before subtraction.
 
         @param data: input image as numpy array
         @param npt_rad: number of radial points
-        @param npt_azim: number of azimuthal points
+        @param npt_azim: deprecated and ignored: the percentile is calculated on the pixels of each ring, not on a 2D cake
         @param unit: unit to be used for integration
-        @param percentile: which percentile use for cutting out
+        @param percentile: which percentile use for cutting out (or a 2-tuple for a trimmed mean)
         @param mask: masked out pixels array
         @param restore_mask: masked pixels have the same value as input data provided
         @return: bragg, amorphous
         """
+        if npt_azim is not None:
+            logger.warning("separate: npt_azim is Deprecated and ignored, the percentile is calculated on the pixels")
         if mask is None:
             mask = self.mask
-        dummy = numpy.int(data.min() - 1234)
-        integ2d, radial, azimuthal = self.integrate2d(data, npt_rad, npt_azim, mask=mask,
-                                                      unit=unit, method="splitpixel",
-                                                      dummy=dummy, correctSolidAngle=True)
-        dummies = (integ2d == dummy).sum(axis=0)
-        # add a line of zeros at the end (along npt_azim) so that the value for no valid pixel is 0
-        sorted = numpy.zeros((npt_azim + 1, npt_rad))
-        sorted[:npt_azim, :] = numpy.sort(integ2d, axis=0)
-        pos = (dummies + (percentile / 100.) * (npt_azim - dummies)).astype(int)  # .clip(0, npt_azim - 1)
-        assert (pos >= 0).all()
-        assert (pos <= npt_azim).all()
-
-        spectrum = sorted[(pos, numpy.arange(npt_rad))]
+        radial, spectrum = self.medfilt1d(data, npt_rad, mask=mask, unit=unit,
+                                          method="full_csr", percentile=percentile,
+                                          correctSolidAngle=True)
         amorphous = self.calcfrom1d(radial, spectrum, data.shape, mask=None,
                    dim1_unit=unit, correctSolidAngle=True)
         bragg = data - amorphous
-        if restore_mask:
+        if restore_mask and mask is not None:
             wmask = numpy.where(mask)
             maskdata = data[wmask]
             bragg[wmask] = maskdata
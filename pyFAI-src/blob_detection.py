@@ -777,7 +777,8 @@ class BlobDetection(object):
         if refine:
             if self.bilinear is None:
                 self.bilinear = Bilinear(self.raw)
-            return [self.bilinear.local_maxi((i.y, i.x)) for i in good_kp]
+            seeds = numpy.array([(i.y, i.x) for i in good_kp], dtype=numpy.float64).reshape(-1, 2)
+            return [tuple(i) for i in self.bilinear.local_maxi_batch(seeds)]
         else:
             return [(i.y, i.x) for i in good_kp]
 
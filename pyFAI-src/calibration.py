@@ -77,7 +77,7 @@ except ImportError:
 else:
     pyFAI_morphology = True
 
-from .marchingsquares import isocontour
+from .ring_index import RingIndex, contour_pixels
 
 
 def get_detector(detector, datafiles=None):
@@ -650,34 +650,39 @@ class AbstractCalibration(object):
         self.peakPicker.sync_init()
         if self.max_rings is None:
             self.max_rings = tth.size
+        data = self.peakPicker.data
+        shape = data.shape
+        # pixels of each ring window, sorted in one pass over the image
+        index = RingIndex(ttha, tth_min, tth_max, data, self.mask)
+        flat_data = numpy.ascontiguousarray(data).ravel()
+        flat_tth = numpy.ascontiguousarray(ttha).ravel()
+        flat_chi = numpy.ascontiguousarray(chia).ravel()
+        area = numpy.zeros(shape, dtype=bool)  # re-used for the candidates of each ring
         for i in range(tth.size):
             if rings >= self.max_rings:
                 break
-            mask = numpy.logical_and(ttha >= tth_min[i], ttha < tth_max[i])
-            if self.mask is not None:
-                mask = numpy.logical_and(mask, numpy.logical_not(self.mask))
-            size = mask.sum(dtype=int)
+            pixels = index[i]
+            size = pixels.size
             if (size > 0):
                 rings += 1
-                self.peakPicker.massif_contour(mask)
-                if self.gui:
-                    update_fig(self.peakPicker.fig)
-                sub_data = self.peakPicker.data.ravel()[numpy.where(mask.ravel())]
-                mean = sub_data.mean(dtype=numpy.float64)
-                std = sub_data.std(dtype=numpy.float64)
+                if self.peakPicker.fig is not None:
+                    self.peakPicker.massif_contour(index.mask(i))
+                    if self.gui:
+                        update_fig(self.peakPicker.fig)
+                mean = index.mean[i]
+                std = index.std[i]
+                values = flat_data[pixels]
                 upper_limit = mean + std
-                mask2 = numpy.logical_and(self.peakPicker.data > upper_limit, mask)
-                size2 = mask2.sum(dtype=int)
-                if size2 < 1000:
+                candidates = pixels[values > upper_limit]
+                if candidates.size < 1000:
                     upper_limit = mean
-                    mask2 = numpy.logical_and(self.peakPicker.data > upper_limit, mask)
-                    size2 = mask2.sum()
+                    candidates = pixels[values > upper_limit]
+                size2 = candidates.size
                 # length of the arc:
-                points = isocontour(ttha, tth[i]).round().astype(int)
-                seeds = set((i[1], i[0]) for i in points)
+                arc = contour_pixels(pixels, flat_tth, tth[i], shape)
+                seeds = set(zip(*numpy.unravel_index(arc, shape)))
                 # max number of points: 360 points for a full circle
-                azimuthal = chia[points[:, 1].clip(0, self.peakPicker.data.shape[0]), points[:, 0].clip(0, self.peakPicker.data.shape[1])]
-                nb_deg_azim = numpy.unique(numpy.rad2deg(azimuthal).round()).size
+                nb_deg_azim = numpy.unique(numpy.rad2deg(flat_chi[arc]).round()).size
                 keep = int(nb_deg_azim * pts_per_deg)
                 if keep == 0:
                     continue
@@ -687,7 +692,11 @@ class AbstractCalibration(object):
                 logger.info("Extracting datapoint for ring %s (2theta = %.2f deg); "\
                             "searching for %i pts out of %i with I>%.1f, dmin=%.1f" %
                             (i, numpy.degrees(tth[i]), keep, size2, upper_limit, dist_min))
-                res = self.peakPicker.peaks_from_area(mask=mask2, Imin=upper_limit, keep=keep, method=method, ring=i, dmin=dist_min, seed=seeds)
+                area.ravel()[candidates] = True
+                points = numpy.vstack(numpy.unravel_index(candidates, shape)).T
+                res = self.peakPicker.peaks_from_area(mask=area, Imin=upper_limit, keep=keep, method=method, ring=i,
+                                                      dmin=dist_min, seed=seeds, points=points)
+                area.ravel()[candidates] = False
 
         self.peakPicker.points.save(self.basename + ".npt")
         if self.weighted:
@@ -40,6 +40,7 @@ import types
 
 from . import detectors
 from . import units
+from . import memory
 from .third_party import six
 StringTypes = (six.binary_type, six.text_type)
 
@@ -63,6 +64,24 @@ except ImportError:
     from zlib import crc32
 
 
+def interp_weights(pos, nodes):
+    """
+    Weights of the linear interpolation on increasing nodes, numpy version
+    of _geometry.calc_interp_weights (constant beyond the end nodes)
+
+    @param pos: position of each pixel
+    @param nodes: increasing positions of the nodes of the profile
+    @return: index of the lower node and weight of the upper node, as 1D arrays
+    """
+    pos = numpy.ravel(pos)
+    size = len(nodes)
+    if size < 2:
+        return numpy.zeros(pos.size, dtype=numpy.int32), numpy.zeros(pos.size, dtype=numpy.float64)
+    idx = numpy.clip(numpy.searchsorted(nodes, pos, side="right") - 1, 0, size - 2)
+    frac = numpy.clip((pos - nodes[idx]) / (nodes[idx + 1] - nodes[idx]), 0, 1)
+    return idx.astype(numpy.int32), frac.astype(numpy.float64)
+
+
 class Geometry(object):
     """
     This class is an azimuthal integrator based on P. Boesecke's geometry and
@@ -224,6 +243,7 @@ class Geometry(object):
         self._transmission_normal = None
         self._transmission_corr = None
         self._transmission_crc = None
+        self._interp_weights = {}  # key: (unit, shape, nodes), value: interpolation weights for back-projection
 
         if detector:
             if isinstance(detector, StringTypes):
@@ -887,8 +907,9 @@ class Geometry(object):
                 self._dssa_order = 3.0
             else:
                 self._dssa_order = float(order)
-            self._dssa = numpy.fromfunction(self.diffSolidAngle,
-                                            shape, dtype=numpy.float32)
+            # read at every frame by the integrators: kept in aligned memory
+            self._dssa = memory.copy(numpy.fromfunction(self.diffSolidAngle,
+                                                        shape, dtype=numpy.float32))
             self._dssa_crc = crc32(self._dssa)
         if absolute:
             return self._dssa * self.pixel1 * self.pixel2 / self._dist / self._dist
@@ -1231,6 +1252,7 @@ class Geometry(object):
         self._corner4Da = None
         self._corner4Dqa = None
         self._corner4Dra = None
+        self._interp_weights = {}
 
     def setChiDiscAtPi(self):
         """
@@ -1242,6 +1264,29 @@ class Geometry(object):
         self._corner4Da = None
         self._corner4Dqa = None
         self._corner4Dra = None
+        self._interp_weights = {}
+
+    def check_chi_disc(self, azimuth_range):
+        """
+        Check that an azimuthal range does not cross the discontinuity of chi,
+        otherwise the pixels beyond the discontinuity are silently ignored.
+
+        @param azimuth_range: lower and upper bound of chi, in radians
+        @return: True if the range crosses the discontinuity (a warning is logged)
+        """
+        lower, upper = azimuth_range[0], azimuth_range[-1]
+        if self.chiDiscAtPi:
+            valid = (-numpy.pi, numpy.pi)
+            name = "setChiDiscAtZero"
+        else:
+            valid = (0, 2 * numpy.pi)
+            name = "setChiDiscAtPi"
+        if (lower < valid[0]) or (upper > valid[1]):
+            logger.warning("Azimuthal range [%.1f, %.1f] deg crosses the chi discontinuity, valid range is "
+                           "[%.0f, %.0f] deg: use %s() to integrate it",
+                           degrees(lower), degrees(upper), degrees(valid[0]), degrees(valid[1]), name)
+            return True
+        return False
 
     def setOversampling(self, iOversampling):
         """
@@ -1315,7 +1360,7 @@ class Geometry(object):
         chi = self.chiArray(shape) + axis_offset
         with self._sem:
                 cos2_tth = numpy.cos(tth) ** 2
-                self._polarization = ((1 + cos2_tth - factor * numpy.cos(2 * chi) * (1 - cos2_tth)) / 2.0)  # .astype(numpy.float32)
+                self._polarization = memory.copy((1 + cos2_tth - factor * numpy.cos(2 * chi) * (1 - cos2_tth)) / 2.0)  # .astype(numpy.float32)
                 self._polarization_factor = factor
                 self._polarization_axis_offset = axis_offset
                 self._polarization_crc = crc32(self._polarization)
@@ -1391,6 +1436,7 @@ class Geometry(object):
         self._transmission_corr = None
         self._transmission_crc = None
         self._cosa = None
+        self._interp_weights = {}
 
 
     def calcfrom1d(self, tth, I, shape=None, mask=None,
@@ -1400,14 +1446,23 @@ class Geometry(object):
 
         @param tth: 1D array with 2theta in degrees
         @param I: scattering intensity
-        @return: 2D image reconstructed
+        @return: 2D image reconstructed, float64
 
         """
         dim1_unit = units.to_unit(dim1_unit)
         tth = tth.copy() / dim1_unit.scale
+        assert len(I) == len(tth), "one intensity per radial position"
 
         if shape is None:
             shape = self.detector.max_shape
+        if mask is not None:
+            assert mask.shape == tuple(shape)
+        if _geometry is not None:
+            idx, frac = self._get_interp_weights(dim1_unit.center, shape, tth)
+            solid_angle = self.solidAngleArray(shape) if correctSolidAngle else None
+            calcimage = _geometry.back_project(I, idx, frac, solid_angle=solid_angle, mask=mask)
+            calcimage.shape = shape
+            return calcimage
         try:
             ttha = self.__getattribute__(dim1_unit.center)(shape)
         except:
@@ -1417,11 +1472,80 @@ class Geometry(object):
         calcimage.shape = shape
         if correctSolidAngle:
             calcimage *= self.solidAngleArray(shape)
+        if mask is not None:
+            calcimage[numpy.where(mask)] = 0
+        return calcimage
+
+    def calcfrom2d(self, I, tth, chi, shape=None, mask=None,
+                   dim1_unit=units.TTH, correctSolidAngle=True):
+        """
+        Computes a 2D image from a 2D regrouped image (as given by integrate2d)
+
+        Values are interpolated bilinearly in the radial and azimuthal
+        directions, and are constant beyond the first and last bins.
+
+        @param I: scattering intensity, array of shape (chi.size, tth.size)
+        @param tth: 1D array with the radial position of the bins, in dim1_unit
+        @param chi: 1D array with the azimuthal angle of the bins in degrees
+        @return: 2D image reconstructed, float64
+        """
+        dim1_unit = units.to_unit(dim1_unit)
+        tth = numpy.ascontiguousarray(tth, dtype=numpy.float64) / dim1_unit.scale
+        chi = numpy.deg2rad(chi)
+        assert I.shape == (len(chi), len(tth)), "I has one row per azimuthal and one column per radial position"
+        if shape is None:
+            shape = self.detector.max_shape
         if mask is not None:
             assert mask.shape == tuple(shape)
+        idx0, frac0 = self._get_interp_weights(dim1_unit.center, shape, tth)
+        idx1, frac1 = self._get_interp_weights("chiArray", shape, chi)
+        if _geometry is not None:
+            solid_angle = self.solidAngleArray(shape) if correctSolidAngle else None
+            calcimage = _geometry.back_project(I, idx0, frac0, idx1, frac1, solid_angle=solid_angle, mask=mask)
+            calcimage.shape = shape
+            return calcimage
+        next0 = numpy.minimum(idx0 + 1, len(tth) - 1)
+        next1 = numpy.minimum(idx1 + 1, len(chi) - 1)
+        lower = I[idx1, idx0] * (1 - frac0) + I[idx1, next0] * frac0
+        upper = I[next1, idx0] * (1 - frac0) + I[next1, next0] * frac0
+        calcimage = (lower * (1 - frac1) + upper * frac1).astype(numpy.float64)
+        calcimage.shape = shape
+        if correctSolidAngle:
+            calcimage *= self.solidAngleArray(shape)
+        if mask is not None:
             calcimage[numpy.where(mask)] = 0
         return calcimage
 
+    def _get_interp_weights(self, array, shape, nodes):
+        """
+        Interpolation weights of the pixels for a profile, cached as long as
+        the geometry and the nodes of the profile do not change: they
+        usually are the bins of the same integrator from frame to frame.
+
+        @param array: name of the method giving the position of the pixels (like "twoThetaArray")
+        @param shape: shape of the image
+        @param nodes: position of the nodes of the profile, in the internal unit
+        @return: index of the lower node, weight of the upper node for each pixel
+        """
+        nodes = numpy.ascontiguousarray(nodes, dtype=numpy.float64)
+        key = (array, tuple(shape), nodes.tobytes())
+        weights = self._interp_weights.get(key)
+        if weights is None:
+            try:
+                pos = self.__getattribute__(array)(shape)
+            except AttributeError:
+                raise RuntimeError("in pyFAI.Geometry.calcfrom1d: " + \
+                                   str(array) + " not (yet?) Implemented")
+            if _geometry is not None:
+                weights = _geometry.calc_interp_weights(pos, nodes)
+            else:
+                weights = interp_weights(pos, nodes)
+            with self._sem:
+                if len(self._interp_weights) >= 4:
+                    self._interp_weights.clear()
+                self._interp_weights[key] = weights
+        return weights
+
     def __copy__(self):
         """return a shallow copy of itself.
         """
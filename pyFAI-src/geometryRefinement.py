@@ -28,24 +28,35 @@ __author__ = "Jerome Kieffer"
 __contact__ = "Jerome.Kieffer@ESRF.eu"
 __license__ = "GPLv3+"
 __copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
-__date__ = "12/11/2014"
+__date__ = "18/10/2015"
 __status__ = "development"
 
 import os
 import tempfile
 import subprocess
 import logging
+import multiprocessing
+import threading
+import time
 import numpy
 import types
 from math import pi
 from . import azimuthalIntegrator
 from .calibrant import Calibrant, ALL_CALIBRANTS
 AzimuthalIntegrator = azimuthalIntegrator.AzimuthalIntegrator
-from scipy.optimize import fmin, leastsq, fmin_slsqp, anneal
+from scipy.optimize import fmin, leastsq, fmin_slsqp
+try:
+    from scipy.optimize import anneal
+except ImportError:
+    anneal = None
 try:
     from scipy.optimize import curve_fit
 except ImportError:
     curve_fit = None
+try:
+    from . import _geometry
+except ImportError:
+    _geometry = None
 
 from .utils import timeit
 
@@ -55,6 +66,17 @@ if os.name != "nt":
 logger = logging.getLogger("pyFAI.geometryRefinement")
 # logger.setLevel(logging.DEBUG)
 ROCA = "/opt/saxs/roca"
+# The Fortran SLSQP of scipy keeps its state in SAVE variables between the
+# steps of an optimization: only one may run at a time in the process.
+_slsqp_lock = threading.Lock()
+
+
+class _Abandon(Exception):
+    """
+    Raised by the cost function of a multi-start refinement to stop one of
+    the optimizations
+    """
+    pass
 
 ####################
 # GeometryRefinement
@@ -395,6 +417,8 @@ class GeometryRefinement(AzimuthalIntegrator):
             return oldDeltaSq
 
     def anneal(self, maxiter=1000000):
+        if anneal is None:
+            raise RuntimeError("anneal is not available in this version of scipy")
         self.param = [self.dist, self.poni1, self.poni2,
                       self.rot1, self.rot2, self.rot3]
         result = anneal(self.residu2, self.param,
@@ -430,6 +454,193 @@ class GeometryRefinement(AzimuthalIntegrator):
         else:
             return oldDeltaSq
 
+    def multistart_geometries(self, starts=8, fix=["wavelength"], spread=1.0, seed=0):
+        """
+        Design the initial geometries of a multi-start refinement: the current
+        geometry, then a latin hypercube sampling of the box of the free
+        parameters, so that each parameter covers its range evenly.
+
+        The box is limited by the min/max bounds (see set_tolerance),
+        shrunk towards the current geometry by spread.
+
+        @param starts: number of geometries
+        @param fix: parameters which are not perturbed
+        @param spread: fraction of the distance between the current value and each bound to sample
+        @param seed: seed of the random generator, for reproducibility
+        @return: array of shape (starts, 6) with dist, poni1, poni2, rot1, rot2, rot3
+        """
+        d = ["dist", "poni1", "poni2", "rot1", "rot2", "rot3"]
+        center = numpy.array([getattr(self, i) for i in d], dtype=numpy.float64)
+        geometries = numpy.empty((max(1, starts), len(d)), dtype=numpy.float64)
+        geometries[:] = center
+        count = geometries.shape[0] - 1
+        if count == 0:
+            return geometries
+        rng = numpy.random.RandomState(seed)
+        for j, name in enumerate(d):
+            if name in fix:
+                continue
+            low = center[j] + spread * (getattr(self, "_%s_min" % name) - center[j])
+            high = center[j] + spread * (getattr(self, "_%s_max" % name) - center[j])
+            # one point per stratum, strata shuffled independently for each parameter
+            strata = (rng.permutation(count) + rng.uniform(size=count)) / count
+            geometries[1:, j] = low + strata * (high - low)
+        return geometries
+
+    def refine_multistart(self, starts=8, method="simplex", fix=["wavelength"], spread=1.0,
+                          maxiter=1000, threads=None, ratio=10.0, margin=1e-10, target=None, seed=0):
+        """
+        Refine the geometry from several initial geometries and keep the best
+        solution.
+
+        The optimizations are distributed over a pool of threads. The
+        "simplex" runs (the default) are interleaved. SLSQP is not reentrant
+        (its Fortran code keeps its state between steps): the "slsqp" runs
+        are serialized by a lock and take as long as sequential ones, only
+        their abandon saves time.
+
+        Once an optimization has converged, the others are abandoned as soon
+        as their best chi2 is still more than ratio times the best converged
+        one and above margin (after a few evaluations): runs which did not
+        converge never abandon the others. If target is given, all
+        optimizations stop once one reaches it.
+
+        @param starts: number of optimizations, see multistart_geometries
+        @param method: "simplex" or "slsqp" (constrained least squares, like refine2, sequential)
+        @param fix: parameters which are not refined, must include "wavelength"
+        @param spread: extent of the sampling of the initial geometries within the bounds
+        @param maxiter: maximum number of iterations of each optimization
+        @param threads: number of threads running the optimizations, the number of cores by default
+        @param ratio: an optimization is abandoned when its chi2 exceeds ratio times the best converged one
+        @param margin: chi2 per point below which an optimization is never abandoned
+        @param target: chi2 per point below which all optimizations are stopped
+        @param seed: seed of the random generator for the initial geometries
+        @return: dict with the best "chi2" (per point), its "param", the index of the "best" run
+                 and the list of the statistics of each run in "runs"
+        """
+        if method not in ("slsqp", "simplex"):
+            raise RuntimeError("Unknown method for multi-start refinement: %s" % method)
+        if "wavelength" not in fix:
+            raise ValueError("Multi-start refinement does not refine the wavelength: it must be in fix")
+        d = ["dist", "poni1", "poni2", "rot1", "rot2", "rot3"]
+        free = [j for j, name in enumerate(d) if name not in fix]
+        bounds = [(getattr(self, "_%s_min" % d[j]), getattr(self, "_%s_max" % d[j])) for j in free]
+        geometries = self.multistart_geometries(starts, fix, spread, seed)
+        npt = self.data.shape[0]
+        # everything which does not depend on the geometry is calculated once
+        pos1, pos2, pos3 = self.detector.calc_cartesian_positions(self.data[:, 0], self.data[:, 1])
+        ring = self.data[:, 2].astype(numpy.int32)
+        tth_ref = self.calc_2th(ring, self.wavelength)
+        weight = self.data[:, 3] if self.data.shape[-1] == 4 else None
+        if _geometry is not None:
+            def residu2(param):
+                return _geometry.calc_residu2(param[0], param[1], param[2], param[3], param[4], param[5],
+                                              pos1, pos2, tth_ref, pos3, weight)
+        else:
+            def residu2(param):
+                t = self.tth(self.data[:, 0], self.data[:, 1], param) - tth_ref
+                if weight is not None:
+                    t = weight * t
+                return numpy.dot(t, t)
+
+        # an optimization is given a few gradients or simplex steps before being abandoned
+        patience = 4 * (len(free) + 1)
+        lock = threading.Lock()
+        stop = threading.Event()
+        shared = {"next": 0, "best": None}
+        runs = [None] * geometries.shape[0]
+
+        def optimize(k):
+            start = geometries[k]
+            state = {"nfev": 0, "chi2": residu2(start), "param": start.copy()}
+
+            def cost(x):
+                if stop.is_set():
+                    raise _Abandon()
+                param = start.copy()
+                param[free] = x
+                value = residu2(param)
+                state["nfev"] += 1
+                if value < state["chi2"]:
+                    state["chi2"] = value
+                    state["param"] = param
+                best = shared["best"]
+                if (best is not None) and (state["nfev"] >= patience) and \
+                        (state["chi2"] > max(ratio * best, margin * npt)):
+                    raise _Abandon()
+                return value
+
+            t0 = time.time()
+            nit = None
+            converged = False
+            abandoned = False
+            try:
+                if method == "slsqp":
+                    with _slsqp_lock:
+                        res = fmin_slsqp(cost, start[free], bounds=bounds, iter=maxiter, acc=1.0e-12,
+                                         iprint=0, full_output=True)
+                    nit = res[2]
+                    converged = (res[3] == 0)
+                else:
+                    res = fmin(cost, start[free], maxiter=maxiter, xtol=1.0e-12,
+                               full_output=True, disp=False)
+                    nit = res[2]
+                    converged = (res[4] == 0)
+            except _Abandon:
+                abandoned = True
+            chi2 = state["chi2"] / npt
+            if converged and not abandoned:
+                # only a converged solution is a reliable reference to abandon the other runs
+                with lock:
+                    if (shared["best"] is None) or (state["chi2"] < shared["best"]):
+                        shared["best"] = state["chi2"]
+                if (target is not None) and (chi2 <= target):
+                    stop.set()
+            return {"start": start, "param": state["param"], "chi2": chi2, "nfev": state["nfev"],
+                    "nit": nit, "converged": converged, "abandoned": abandoned,
+                    "time": time.time() - t0}
+
+        def worker():
+            while True:
+                with lock:
+                    k = shared["next"]
+                    shared["next"] = k + 1
+                if k >= len(runs):
+                    return
+                try:
+                    runs[k] = optimize(k)
+                except Exception as error:
+                    logger.error("Multi-start refinement: run %s failed: %s", k, error)
+                    runs[k] = {"start": geometries[k], "param": None, "chi2": numpy.inf, "nfev": 0,
+                               "nit": None, "converged": False, "abandoned": False, "time": 0.0,
+                               "error": str(error)}
+
+        if threads is None:
+            threads = multiprocessing.cpu_count()
+        pool = [threading.Thread(target=worker) for i in range(max(1, min(threads, len(runs))))]
+        for thread in pool:
+            thread.start()
+        for thread in pool:
+            thread.join()
+
+        best = min(range(len(runs)), key=lambda k: runs[k]["chi2"])
+        if runs[best]["param"] is None:
+            raise RuntimeError("Multi-start refinement: all runs failed")
+        newParam = runs[best]["param"]
+        newDeltaSq = runs[best]["chi2"]
+        oldDeltaSq = residu2(geometries[0]) / npt
+        logger.info("Multi-start %s from %s geometries: %s --> %s (run %s, %s abandoned)",
+                    method, len(runs), oldDeltaSq, newDeltaSq, best,
+                    sum(1 for run in runs if run["abandoned"]))
+        if newDeltaSq < oldDeltaSq:
+            self.param = newParam
+            self.dist, self.poni1, self.poni2, \
+                self.rot1, self.rot2, self.rot3 = tuple(newParam)
+        else:
+            newDeltaSq = oldDeltaSq
+            newParam = geometries[0]
+        return {"chi2": newDeltaSq, "param": newParam, "best": best, "runs": runs}
+
     def chi2(self, param=None):
         if param is None:
             param = self.param[:]
@@ -36,10 +36,11 @@ logger = logging.getLogger("pyFAI.massif")
 import numpy
 import fabio
 from scipy.ndimage import label
-from scipy.ndimage.filters  import median_filter
 
 from .bilinear import Bilinear
-from .utils import gaussian_filter, binning, unBinning, relabel, is_far_from_group
+from .rank_filter import median_filter
+from .relabel import label_components
+from .utils import gaussian_filter, binning, unBinning, relabel
 from .third_party import six
 
 if os.name != "nt":
@@ -146,23 +147,17 @@ class Massif(object):
                 massif_contour(region)
             except (WindowsError, MemoryError) as error:
                 logger.error("Error in plotting region: %s", error)
-        nbFailure = 0
-        for j in idx:
-            xopt = self.nearest_peak(j)
-            if xopt is None:
-                nbFailure += 1
-                continue
-            if (region2[xopt[0], xopt[1]]) and not (xopt in listpeaks):
-                stdout.write("[ %4i, %4i ] --> [ %5.1f, %5.1f ] after %3i iterations %s" % (tuple(j) + tuple(xopt) + (nbFailure, os.linesep)))
-                listpeaks.append(xopt)
-                nbFailure = 0
-            else:
-                nbFailure += 1
-            if (len(listpeaks) > nmax) or (nbFailure > 2 * nmax):
-                break
+        # seeds are climbed in parallel, peaks are selected in the order of the seeds
+        peaks, origin = self._bilin.nearest_peaks(idx, keep=nmax + 1, region=region2,
+                                                  patience=2 * nmax, peaks=[xinit])
+        previous = -1
+        for xopt, i in zip(peaks, origin):
+            stdout.write("[ %4i, %4i ] --> [ %5.1f, %5.1f ] after %3i iterations %s" % (tuple(idx[i]) + tuple(xopt) + (i - previous - 1, os.linesep)))
+            listpeaks.append(tuple(xopt))
+            previous = i
         return listpeaks
 
-    def peaks_from_area(self, mask, Imin=None, keep=1000, dmin=0.0, seed=None, **kwarg):
+    def peaks_from_area(self, mask, Imin=None, keep=1000, dmin=0.0, seed=None, points=None, **kwarg):
         """
         Return the list of peaks within an area
 
@@ -172,33 +167,22 @@ class Massif(object):
         @param kwarg: ignored parameters
         @param dmin: minimum distance to another peak
         @param seed: list of good guesses to start with
+        @param points: array with the coordinates [y, x] of the pixels of the mask, if known (saves a pass over the mask)
         @return: list of peaks [y,x], [y,x], ...]
         """
-        all_points = numpy.vstack(numpy.where(mask)).T
-        res = []
-        cnt = 0
-        dmin2 = dmin * dmin
+        if points is None:
+            all_points = numpy.vstack(numpy.where(mask)).T
+        else:
+            all_points = numpy.array(points, dtype=int).reshape(-1, 2)
         numpy.random.shuffle(all_points)
         if seed:
             seeds = numpy.array(list(seed))
             numpy.random.shuffle(seeds)
             all_points = numpy.concatenate((seeds, all_points))
-        for idx in all_points:
-            out = self.nearest_peak(idx)
-            if out is not None:
-                logger.debug("[ %3i, %3i ] -> [ %.1f, %.1f ]" %
-                      (idx[1], idx[0], out[1], out[0]))
-                p0, p1 = int(round(out[0])), int(round(out[1]))
-                if mask[p0, p1]:
-
-                    if (self.data[p0, p1] > Imin) and \
-                        is_far_from_group(out, res, dmin2):
-                        res.append(out)
-                        cnt = 0
-            if len(res) >= keep or cnt > keep:
-                break
-            else:
-                cnt += 1
+        # seeds are climbed in parallel, peaks are selected in the order of the seeds
+        peaks, origin = self._bilin.nearest_peaks(all_points, dmin=dmin, keep=keep, region=mask,
+                                                  Imin=Imin, patience=keep)
+        res = [tuple(i) for i in peaks]
         return res
 
     def initValleySize(self):
@@ -283,11 +267,26 @@ class Massif(object):
                     if pattern is None:
                         pattern = [[1] * 3] * 3  # [[0, 1, 0], [1, 1, 1], [0, 1, 0]]#[[1] * 3] * 3
                     logger.debug("Labeling all massifs. This takes some time !!!")
-                    labeled_massif, self._number_massif = label((self.getBinnedData() > self.getBluredData()), pattern)
+                    binned = self.getBinnedData()
+                    blured = self.getBluredData()
+                    structure = numpy.array(pattern, dtype=bool)
+                    if structure.all() and structure.shape == (3, 3):
+                        connectivity = 8
+                    elif (structure == numpy.array([[0, 1, 0], [1, 1, 1], [0, 1, 0]], dtype=bool)).all():
+                        connectivity = 4
+                    else:
+                        connectivity = None
+                    if connectivity:
+                        # labels and the statistics used by relabel in a single parallel pass
+                        labeled_massif, self._number_massif, stats = label_components(binned > blured, binned, blured, connectivity)
+                        delta = stats["delta"]
+                    else:
+                        labeled_massif, self._number_massif = label((binned > blured), pattern)
+                        delta = None
                     logger.info("Labeling found %s massifs." % self._number_massif)
                     if logger.getEffectiveLevel() == logging.DEBUG:
                         fabio.edfimage.edfimage(data=labeled_massif).write("labeled_massif_small.edf")
-                    relabeled = relabel(labeled_massif, self.getBinnedData(), self.getBluredData())
+                    relabeled = relabel(labeled_massif, binned, blured, delta=delta)
                     if logger.getEffectiveLevel() == logging.DEBUG:
                         fabio.edfimage.edfimage(data=relabeled).write("relabeled_massif_small.edf")
                     self._labeled_massif = unBinning(relabeled, self.binning, False)
@@ -0,0 +1,197 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Azimuthal integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Allocation of large arrays: cache-line aligned and, where available,
+backed by huge pages to limit the TLB pressure of the integration kernels.
+
+Arrays are regular numpy arrays which own (through their base) the memory
+they point to: it is released when the last view disappears.
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+__status__ = "development"
+
+import logging
+import mmap
+import threading
+import numpy
+logger = logging.getLogger("pyFAI.memory")
+
+ALIGNMENT = 64  # size of a cache line
+HUGE_PAGE_SIZE = 2 << 20  # arrays larger than this are allocated with mmap
+# MAP_HUGETLB and MADV_HUGEPAGE are Linux-only, not exposed by all versions of python.
+# The value of MAP_HUGETLB depends on the architecture: without it, no huge pages are reserved
+MAP_HUGETLB = getattr(mmap, "MAP_HUGETLB", 0)
+MADV_HUGEPAGE = getattr(mmap, "MADV_HUGEPAGE", None)
+
+# huge pages reserved with MAP_HUGETLB are tried only as long as they work
+use_hugetlb = bool(MAP_HUGETLB)
+# transparent huge pages are requested with madvise on other large arrays
+use_thp = (MADV_HUGEPAGE is not None)
+
+
+def _mmap(nbytes):
+    """
+    Allocate an anonymous memory map of nbytes bytes, backed by huge pages if possible
+
+    @return: mmap object, None if anonymous maps are not available
+    """
+    global use_hugetlb
+    if "MAP_ANONYMOUS" not in dir(mmap):
+        return None
+    flags = mmap.MAP_PRIVATE | mmap.MAP_ANONYMOUS
+    size = (nbytes + HUGE_PAGE_SIZE - 1) // HUGE_PAGE_SIZE * HUGE_PAGE_SIZE
+    if use_hugetlb:
+        try:
+            return mmap.mmap(-1, size, flags=flags | MAP_HUGETLB)
+        except (OSError, mmap.error, ValueError) as error:
+            logger.debug("No huge pages available (%s): switching to transparent huge pages", error)
+            use_hugetlb = False
+    try:
+        buf = mmap.mmap(-1, size, flags=flags)
+    except (OSError, mmap.error, ValueError) as error:
+        logger.debug("Anonymous mmap failed: %s", error)
+        return None
+    if use_thp:
+        try:
+            buf.madvise(MADV_HUGEPAGE)
+        except (OSError, AttributeError):
+            pass
+    return buf
+
+
+def empty(shape, dtype=numpy.float64, alignment=ALIGNMENT, huge_pages=True):
+    """
+    Equivalent of numpy.empty returning aligned memory
+
+    Large arrays come from a memory map backed by huge pages (MAP_HUGETLB or
+    transparent huge pages) when the system provides them.
+
+    @param shape: shape of the array
+    @param dtype: data type of the array
+    @param alignment: alignment of the first element in bytes
+    @param huge_pages: set to False to avoid the memory map for large arrays
+    @return: C-contiguous numpy array
+    """
+    return _allocate(shape, dtype, alignment, huge_pages)[0]
+
+
+def zeros(shape, dtype=numpy.float64, alignment=ALIGNMENT, huge_pages=True):
+    """
+    Equivalent of numpy.zeros returning aligned memory, see empty()
+    """
+    ary, zeroed = _allocate(shape, dtype, alignment, huge_pages)
+    if not zeroed:
+        ary.fill(0)
+    return ary
+
+
+def copy(ary, dtype=None):
+    """
+    Aligned (and possibly huge-page backed) copy of an array, see empty()
+
+    @param ary: array to copy
+    @param dtype: data type of the copy, the one of ary by default
+    @return: C-contiguous numpy array
+    """
+    ary = numpy.asarray(ary)
+    res = empty(ary.shape, dtype or ary.dtype)
+    res[...] = ary
+    return res
+
+
+def _allocate(shape, dtype, alignment, huge_pages):
+    """
+    @return: array, True if its memory is known to be zeroed
+    """
+    dtype = numpy.dtype(dtype)
+    count = int(numpy.prod(shape))
+    nbytes = count * dtype.itemsize
+    if huge_pages and (nbytes >= HUGE_PAGE_SIZE):
+        buf = _mmap(nbytes)
+        if buf is not None:
+            # anonymous memory maps are page aligned and zeroed
+            return numpy.frombuffer(buf, dtype=dtype, count=count).reshape(shape), True
+    raw = numpy.empty(nbytes + alignment, dtype=numpy.uint8)
+    offset = (-raw.ctypes.data) % alignment
+    return raw[offset:offset + nbytes].view(dtype).reshape(shape), False
+
+
+def is_aligned(ary, alignment=ALIGNMENT):
+    """
+    @return: True if the first element of the array is aligned
+    """
+    return ary.ctypes.data % alignment == 0
+
+
+class Arena(object):
+    """
+    Pool of scratch buffers, recycled from one frame to the next.
+
+    Each thread has its own buffers. A buffer obtained with a given key is
+    returned again at the next call with the same key, shape and dtype: its
+    content is only valid until then.
+    """
+    def __init__(self):
+        self._local = threading.local()
+
+    def empty(self, key, shape, dtype=numpy.float64):
+        """
+        @param key: name of the buffer
+        @param shape: shape of the buffer
+        @param dtype: data type of the buffer
+        @return: a recycled aligned buffer, uninitialized
+        """
+        dtype = numpy.dtype(dtype)
+        buffers = self._local.__dict__.setdefault("buffers", {})
+        ary = buffers.get(key)
+        if (ary is None) or (ary.shape != tuple(numpy.atleast_1d(shape))) or (ary.dtype != dtype):
+            ary = buffers[key] = empty(shape, dtype)
+        return ary
+
+    def zeros(self, key, shape, dtype=numpy.float64):
+        """
+        @return: a recycled aligned buffer, filled with zeros
+        """
+        ary = self.empty(key, shape, dtype)
+        ary.fill(0)
+        return ary
+
+    def clear(self):
+        """
+        Release the buffers of the calling thread
+        """
+        self._local.__dict__.pop("buffers", None)
+
+    @property
+    def nbytes(self):
+        """
+        Size of the buffers of the calling thread
+        """
+        return sum(i.nbytes for i in self._local.__dict__.get("buffers", {}).values())
@@ -451,7 +451,7 @@ def expand(input_img, sigma, mode="constant", cval=0.0):
     return output
 
 
-def relabel(label, data, blured, max_size=None):
+def relabel(label, data, blured, max_size=None, delta=None):
     """
     Relabel limits the number of region in the label array.
     They are ranked relatively to their max(I0)-max(blur(I0)
@@ -460,12 +460,21 @@ def relabel(label, data, blured, max_size=None):
     @param data: an array containing the raw data
     @param blured: an array containing the blured data
     @param max_size: the max number of label wanted
+    @param delta: data-blured where data is max, per label, if already known (see relabel.label_components)
     @return array like label
     """
     if _relabel:
         max_label = label.max()
-        a, b, c, d = _relabel.countThem(label, data, blured)
-        count = d
+        if delta is None:
+            # labels of scipy.ndimage.label are found again by the parallel labelling, with delta
+            for connectivity in (8, 4):
+                labels, nlabel, stats = _relabel.label_components(label != 0, data, blured, connectivity)
+                if (nlabel == max_label) and (labels == label).all():
+                    delta = stats["delta"]
+                    break
+            else:
+                a, b, c, delta = _relabel.countThem(label, data, blured)
+        count = delta
         sortCount = count.argsort()
         invSortCount = sortCount[-1::-1]
         invCutInvSortCount = numpy.zeros(max_label + 1, dtype=int)
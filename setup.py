@@ -184,6 +184,9 @@ def Extension(name, source=None, can_use_openmp=False, extra_sources=None, **kwa
 ext_modules = [
     Extension("_geometry", can_use_openmp=True),
     Extension("reconstruct", can_use_openmp=True),
+    Extension("preproc", can_use_openmp=True),
+    Extension("ring_index", can_use_openmp=True),
+    Extension("rank_filter", can_use_openmp=True),
     Extension('splitPixel'),
     Extension('splitPixelFull'),
     Extension('splitPixelFullLUT'),
@@ -192,7 +195,8 @@ ext_modules = [
     Extension('splitBBoxLUT', can_use_openmp=True),
     Extension('splitBBoxCSR', can_use_openmp=True),
     Extension('splitPixelFullCSR', can_use_openmp=True),
-    Extension('relabel'),
+    Extension('sparse_csr', can_use_openmp=True),
+    Extension('relabel', can_use_openmp=True),
     Extension("bilinear", can_use_openmp=True),
     Extension('_distortion', can_use_openmp=True),
     Extension('_distortionCSR', can_use_openmp=True),
@@ -202,7 +206,8 @@ ext_modules = [
     Extension('morphology'),
     Extension('marchingsquares'),
     Extension('watershed'),
-    Extension('histogram', can_use_openmp=True)
+    Extension('histogram', can_use_openmp=True),
+    Extension('isa', can_use_openmp=True, extra_sources=[os.path.join("src", "isa_kernels.c")])
 ]
 
 if (os.name == "posix") and ("x86" in platform.machine()):
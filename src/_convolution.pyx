@@ -25,109 +25,43 @@
 """Implementation of a separable 2D convolution"""
 __authors__ = ["Pierre Paleo", "Jerome Kieffer"]
 __contact__ = "Jerome.kieffer@esrf.fr"
-__date__ = "20/10/2014"
+__date__ = "18/10/2015"
 __status__ = "stable"
 __license__ = "GPLv3+"
 import cython
 import numpy
 cimport numpy
-from cython.parallel import prange
+from . import isa
 
 
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-def horizontal_convolution(float[:, :] img, float[:] filter):
+def horizontal_convolution(img, filter):
     """
     Implements a 1D horizontal convolution with a filter.
     The only implemented mode is "reflect" (default in scipy.ndimage.filter)
 
+    The kernel, with Kahan summation, is the one of the instruction set
+    selected in pyFAI.isa.
+
     @param img: input image
     @param filter: 1D array with the coefficients of the array
     @return: array of the same shape as image with
     """
-    cdef:
-        int FILTER_SIZE, HALF_FILTER_SIZE
-        int IMAGE_H, IMAGE_W
-        int x, y, pos, fIndex, newpos, c 
-        float sum, err, val, tmp
-        numpy.ndarray[numpy.float32_t, ndim = 2] output
-
-    FILTER_SIZE = filter.shape[0]
-    if FILTER_SIZE % 2 == 1:
-        HALF_FILTER_SIZE = (FILTER_SIZE) // 2
-    else:
-        HALF_FILTER_SIZE = (FILTER_SIZE + 1) // 2
-
-    IMAGE_H = img.shape[0]
-    IMAGE_W = img.shape[1]
-    output = numpy.zeros((IMAGE_H, IMAGE_W), dtype=numpy.float32)
-    for y in prange(IMAGE_H, nogil=True):
-        for x in range(IMAGE_W):
-            sum = 0.0
-            err = 0.0
-            for fIndex in range(FILTER_SIZE):
-                newpos = x + fIndex - HALF_FILTER_SIZE
-                if newpos < 0:
-                    newpos = - newpos - 1
-                elif newpos >= IMAGE_W:
-                    newpos = 2 * IMAGE_W - newpos - 1
-                # sum += img[y,newpos] * filter[fIndex]
-                # implement Kahan summation
-                val = img[y, newpos] * filter[fIndex] - err
-                tmp = sum + val
-                err = (tmp - sum) - val 
-                sum = tmp  
-            output[y, x] += sum
-    return output
-
-
-@cython.cdivision(True)
-@cython.boundscheck(False)
-@cython.wraparound(False)
-def vertical_convolution(float[:, :] img, float[:] filter):
+    return isa.convolve(img, filter, vertical=False)
+
+
+def vertical_convolution(img, filter):
     """
     Implements a 1D vertical convolution with a filter.
     The only implemented mode is "reflect" (default in scipy.ndimage.filter)
 
+    The kernel, with Kahan summation, is the one of the instruction set
+    selected in pyFAI.isa.
+
     @param img: input image
     @param filter: 1D array with the coefficients of the array
     @return: array of the same shape as image with
     """
-    cdef:
-        int FILTER_SIZE, HALF_FILTER_SIZE
-        int IMAGE_H, IMAGE_W
-        int x, y, pos, fIndex, newpos, c 
-        float sum, err, val, tmp
-        numpy.ndarray[numpy.float32_t, ndim=2] output
-
-    FILTER_SIZE = filter.shape[0]
-    if FILTER_SIZE % 2 == 1:
-        HALF_FILTER_SIZE = (FILTER_SIZE) // 2
-    else:
-        HALF_FILTER_SIZE = (FILTER_SIZE + 1) // 2
-
-    IMAGE_H = img.shape[0]
-    IMAGE_W = img.shape[1]
-    output = numpy.zeros((IMAGE_H, IMAGE_W), dtype=numpy.float32)
-    for y in prange(IMAGE_H, nogil=True):
-        for x in range(IMAGE_W):
-            sum = 0.0
-            err = 0.0
-            for fIndex in range(FILTER_SIZE):
-                newpos = y + fIndex - HALF_FILTER_SIZE
-                if newpos < 0:
-                    newpos = - newpos - 1
-                elif newpos >= IMAGE_H:
-                    newpos = 2 * IMAGE_H - newpos - 1
-                # sum += img[y,newpos] * filter[fIndex]
-                # implement Kahan summation
-                val = img[newpos, x] * filter[fIndex] - err
-                tmp = sum + val
-                err = (tmp - sum) - val 
-                sum = tmp  
-            output[y, x] += sum
-    return output
+    return isa.convolve(img, filter, vertical=True)
 
 
 def gaussian(sigma, width=None):
@@ -161,6 +161,59 @@ def calc_tth(double L, double rot1, double rot2, double rot3,
         return out
 
 
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def calc_residu2(double L, double poni1, double poni2, double rot1, double rot2, double rot3,
+                 pos1 not None, pos2 not None, tth_ref not None, pos3=None, weight=None):
+    """
+    Calculate the sum of the squared deviations of 2theta from the expected
+    value of each control point, in a single pass without the GIL.
+
+    The loop is sequential: it is meant to be called from several threads
+    at once (one per optimization), which then run concurrently.
+
+    @param L: distance sample - PONI
+    @param poni1, poni2: coordinates of the PONI in meter
+    @param rot1, rot2, rot3: angles
+    @param pos1: numpy array with distances in meter along dim1 from the origin of the detector (Y)
+    @param pos2: numpy array with distances in meter along dim2 from the origin of the detector (X)
+    @param tth_ref: expected 2theta of each point
+    @param pos3: numpy array with distances in meter along Sample->PONI (Z), positive behind the detector
+    @param weight: weight of each point, multiplied to the deviation before squaring
+    @return: sum of the (weighted) squared deviations
+    """
+    cdef:
+        double sinRot1 = sin(rot1)
+        double cosRot1 = cos(rot1)
+        double sinRot2 = sin(rot2)
+        double cosRot2 = cos(rot2)
+        double sinRot3 = sin(rot3)
+        double cosRot3 = cos(rot3)
+        double[::1] c1 = numpy.ascontiguousarray(pos1, dtype=numpy.float64).ravel()
+        double[::1] c2 = numpy.ascontiguousarray(pos2, dtype=numpy.float64).ravel()
+        double[::1] cref = numpy.ascontiguousarray(tth_ref, dtype=numpy.float64).ravel()
+        double[::1] c3, cw
+        ssize_t size = c1.shape[0], i
+        bint do_z = pos3 is not None, do_weight = weight is not None
+        double d, z = 0.0, s = 0.0
+    assert c2.shape[0] == size and cref.shape[0] == size
+    if do_z:
+        c3 = numpy.ascontiguousarray(pos3, dtype=numpy.float64).ravel()
+        assert c3.shape[0] == size
+    if do_weight:
+        cw = numpy.ascontiguousarray(weight, dtype=numpy.float64).ravel()
+        assert cw.shape[0] == size
+    with nogil:
+        for i in range(size):
+            if do_z:
+                z = c3[i]
+            d = tth(c1[i] - poni1, c2[i] - poni2, L + z, sinRot1, cosRot1, sinRot2, cosRot2, sinRot3, cosRot3) - cref[i]
+            if do_weight:
+                d = d * cw[i]
+            s += d * d
+    return s
+
+
 @cython.boundscheck(False)
 @cython.wraparound(False)
 def calc_chi(double L, double rot1, double rot2, double rot3,
@@ -353,3 +406,117 @@ def calc_cosa(double L,
         return out.reshape(pos1.shape[0], pos1.shape[1])
     else:
         return out
+
+
+@cython.cdivision(True)
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def calc_interp_weights(numpy.ndarray pos not None, xp not None):
+    """
+    Calculate in parallel the weights of the linear interpolation of a
+    profile defined on increasing nodes xp at the positions pos, with the
+    same conventions as numpy.interp (constant beyond the end nodes).
+
+    @param pos: numpy array with the position of each pixel
+    @param xp: increasing positions of the nodes of the profile
+    @return: index of the lower node (int32) and weight of the upper node (float64), as 1D arrays
+    """
+    cdef:
+        double[::1] cpos = numpy.ascontiguousarray(pos.ravel(), dtype=numpy.float64)
+        double[::1] cxp = numpy.ascontiguousarray(xp, dtype=numpy.float64)
+        ssize_t size = cpos.shape[0], n = cxp.shape[0], i = 0, b, block = 4096, lo, hi, mid
+        double x
+        numpy.int32_t[::1] idx = numpy.zeros(size, dtype=numpy.int32)
+        double[::1] frac = numpy.zeros(size, dtype=numpy.float64)
+    assert n > 0
+    if n > 1:
+        for b in prange((size + block - 1) // block, nogil=True, schedule="static"):
+            for i in range(b * block, min((b + 1) * block, size)):
+                x = cpos[i]
+                if x <= cxp[0]:
+                    continue
+                if x >= cxp[n - 1]:
+                    idx[i] = n - 2
+                    frac[i] = 1.0
+                    continue
+                lo = 0
+                hi = n - 1
+                while hi - lo > 1:
+                    mid = (lo + hi) // 2
+                    if cxp[mid] <= x:
+                        lo = mid
+                    else:
+                        hi = mid
+                idx[i] = lo
+                frac[i] = (x - cxp[lo]) / (cxp[hi] - cxp[lo])
+    return numpy.asarray(idx), numpy.asarray(frac)
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def back_project(I not None, idx0 not None, frac0 not None, idx1=None, frac1=None,
+                 solid_angle=None, mask=None):
+    """
+    Calculate in parallel an image from a 1D or 2D profile, with the
+    interpolation weights of calc_interp_weights, in a single pass which
+    also applies the solid angle and the mask.
+
+    @param I: profile, 1D (radial) or 2D (azimuthal, radial)
+    @param idx0, frac0: interpolation weights along the radial dimension
+    @param idx1, frac1: interpolation weights along the azimuthal dimension (2D profiles only)
+    @param solid_angle: array with the solid angle of each pixel to be multiplied by (if any)
+    @param mask: array with 1 for masked pixels, set to 0 (if any)
+    @return: 1D array of float64 with the value of each pixel, like numpy.interp
+    """
+    cdef:
+        double[:, ::1] cI = numpy.ascontiguousarray(I, dtype=numpy.float64).reshape(-1, I.shape[I.ndim - 1])
+        numpy.int32_t[::1] cidx0 = numpy.ascontiguousarray(idx0, dtype=numpy.int32), cidx1
+        double[::1] cfrac0 = numpy.ascontiguousarray(frac0, dtype=numpy.float64), cfrac1, csa
+        numpy.int8_t[::1] cmask
+        ssize_t size = cidx0.shape[0], i = 0, b, block = 4096
+        numpy.int32_t j, k
+        double f, g, v, w
+        bint do_2d = idx1 is not None, do_sa = solid_angle is not None, do_mask = mask is not None
+        double[::1] out = numpy.empty(size, dtype=numpy.float64)
+    assert cfrac0.shape[0] == size
+    if do_2d:
+        assert I.ndim == 2
+        cidx1 = numpy.ascontiguousarray(idx1, dtype=numpy.int32)
+        cfrac1 = numpy.ascontiguousarray(frac1, dtype=numpy.float64)
+        assert cidx1.shape[0] == size and cfrac1.shape[0] == size
+    if do_sa:
+        csa = numpy.ascontiguousarray(solid_angle.ravel(), dtype=numpy.float64)
+        assert csa.shape[0] == size
+    if do_mask:
+        mask = numpy.ascontiguousarray(mask.ravel())
+        if mask.dtype.itemsize == 1:
+            cmask = mask.view(numpy.int8)
+        else:
+            cmask = (mask != 0).view(numpy.int8)
+        assert cmask.shape[0] == size
+
+    # blocks of pixels: the bookkeeping of prange is paid once per block, not once per pixel
+    for b in prange((size + block - 1) // block, nogil=True, schedule="static"):
+        for i in range(b * block, min((b + 1) * block, size)):
+            if do_mask and cmask[i]:
+                out[i] = 0.0
+                continue
+            j = cidx0[i]
+            f = cfrac0[i]
+            k = 0
+            g = 0.0
+            if do_2d:
+                k = cidx1[i]
+                g = cfrac1[i]
+            v = cI[k, j]
+            if f != 0.0:
+                v = v + f * (cI[k, j + 1] - v)
+            if g != 0.0:
+                w = cI[k + 1, j]
+                if f != 0.0:
+                    w = w + f * (cI[k + 1, j + 1] - w)
+                v = v + g * (w - v)
+            if do_sa:
+                v = v * csa[i]
+            out[i] = v
+    return numpy.asarray(out)
@@ -21,7 +21,84 @@
 #   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #
 
-from libc.math cimport floor, ceil
+from libc.math cimport floor, ceil, rint, fabs, NAN
+
+cdef class _PeakHash:
+    """
+    Spatial hash of peaks: cells of size dmin, in an open addressing table
+    of cells, each with a linked list of peaks.
+    """
+    cdef:
+        double cell, d2
+        ssize_t mask
+        numpy.int64_t[::1] key0, key1
+        numpy.int32_t[::1] head, next
+
+    def __cinit__(self, ssize_t npeak, double dmin):
+        cdef ssize_t size = 16
+        while size < 2 * npeak:
+            size *= 2
+        self.mask = size - 1
+        self.cell = max(dmin, 1.0)
+        self.d2 = dmin * dmin
+        self.key0 = numpy.zeros(size, dtype=numpy.int64)
+        self.key1 = numpy.zeros(size, dtype=numpy.int64)
+        self.head = numpy.zeros(size, dtype=numpy.int32) - 1
+        self.next = numpy.zeros(max(npeak, 1), dtype=numpy.int32) - 1
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cdef ssize_t slot(self, numpy.int64_t c0, numpy.int64_t c1, bint create) nogil:
+        """
+        @return: position of the cell in the table, -1 if absent and not created
+        """
+        cdef ssize_t pos = <ssize_t> ((c0 * 73856093) ^ (c1 * 19349663)) & self.mask
+        while self.head[pos] >= 0:
+            if (self.key0[pos] == c0) and (self.key1[pos] == c1):
+                return pos
+            pos = (pos + 1) & self.mask
+        if create:
+            self.key0[pos] = c0
+            self.key1[pos] = c1
+            return pos
+        return -1
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cdef void add(self, double[:, ::1] peaks, ssize_t idx) nogil:
+        """
+        Insert peak idx (its index in peaks) in the hash
+        """
+        cdef ssize_t pos = self.slot(<numpy.int64_t> floor(peaks[idx, 0] / self.cell),
+                                     <numpy.int64_t> floor(peaks[idx, 1] / self.cell), True)
+        self.next[idx] = self.head[pos]
+        self.head[pos] = idx
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cdef bint is_far(self, double[:, ::1] peaks, ssize_t idx) nogil:
+        """
+        @return: True if peak idx is farther than dmin from all the peaks of the hash
+        """
+        cdef:
+            numpy.int64_t c0 = <numpy.int64_t> floor(peaks[idx, 0] / self.cell)
+            numpy.int64_t c1 = <numpy.int64_t> floor(peaks[idx, 1] / self.cell)
+            ssize_t d0, d1, pos, other
+            double delta0, delta1
+        for d0 in range(-1, 2):
+            for d1 in range(-1, 2):
+                pos = self.slot(c0 + d0, c1 + d1, False)
+                if pos < 0:
+                    continue
+                other = self.head[pos]
+                while other >= 0:
+                    delta0 = peaks[other, 0] - peaks[idx, 0]
+                    delta1 = peaks[other, 1] - peaks[idx, 1]
+                    if delta0 * delta0 + delta1 * delta1 <= self.d2:
+                        return False
+                    other = self.next[other]
+        return True
+
 
 cdef class Bilinear:
     """Bilinear interpolator for finding max.
@@ -35,6 +112,8 @@ cdef class Bilinear:
 
     cpdef size_t cp_local_maxi(self, size_t)
     cdef size_t c_local_maxi(self, size_t) nogil
+    cdef int c_refine(self, size_t, double *, double *) nogil
+    cdef void _climb(self, double[:, ::1], double[:, ::1], ssize_t, ssize_t) nogil
 
     def __cinit__(self, data not None):
         assert data.ndim == 2
@@ -111,16 +190,35 @@ cdef class Bilinear:
 
         """
         cdef:
-            int res, current0, current1
-            int i0, i1
+            double res0, res1
+            int status
+        status = self.c_refine(self.c_local_maxi(round(x[0]) * self.width + round(x[1])), &res0, &res1)
+        if status == 1:
+            logger.debug("Singular determinant, Hessian undefined")
+        elif status == 2:
+            logger.debug("Failed to find root using second order expansion")
+        return (res0, res1)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    @cython.cdivision(True)
+    cdef int c_refine(self, size_t index, double *res0, double *res1) nogil:
+        """
+        Sub-pixel position of the local maximum at index, see local_maxi
+
+        @param index: index of the local maximum
+        @param res0, res1: output position
+        @return: 0 if the Taylor expansion is valid, 1 if the Hessian is singular,
+                 2 if the expansion is too far, 3 on the border of the image
+        """
+        cdef:
+            int current0 = index // self.width
+            int current1 = index % self.width
+            int i0, i1, status
             float tmp, sum0 = 0, sum1 = 0, sum = 0
             float a00, a01, a02, a10, a11, a12, a20, a21, a22
             float d00, d11, d01, denom, delta0, delta1
-            
-        res = self.c_local_maxi(round(x[0]) * self.width + round(x[1]))
 
-        current0 = res // self.width
-        current1 = res % self.width
         if (current0 > 0) and (current0 < self.height - 1) and (current1 > 0) and (current1 < self.width - 1):
             # Use second order polynomial Taylor expansion
             a00 = self.data[current0 - 1, current1 - 1]
@@ -136,27 +234,150 @@ cdef class Bilinear:
             d11 = a21 - 2.0 * a11 + a01
             d01 = (a00 - a02 - a20 + a22) / 4.0
             denom = 2.0 * (d00 * d11 - d01 * d01)
-            if abs(denom) < 1e-10:
-                logger.debug("Singular determinant, Hessian undefined")
+            if fabs(denom) < 1e-10:
+                status = 1
             else:
                 delta0 = ((a12 - a10) * d01 + (a01 - a21) * d11) / denom
                 delta1 = ((a10 - a12) * d00 + (a21 - a01) * d01) / denom
-                if abs(delta0) <= 1.0 and abs(delta1) <= 1.0:
+                if fabs(delta0) <= 1.0 and fabs(delta1) <= 1.0:
                     # Result is OK if lower than 0.5.
-                    return (delta0 + float(current0), delta1 + float(current1))
+                    res0[0] = delta0 + <double> current0
+                    res1[0] = delta1 + <double> current1
+                    return 0
                 else:
-                    logger.debug("Failed to find root using second order expansion")
+                    status = 2
             # refinement of the position by a simple center of mass of the last valid region used
             for i0 in range(current0 - 1, current0 + 2):
                 for i1 in range(current1 - 1, current1 + 2):
                     tmp = self.data[i0, i1]
-                    sum0 += tmp * i0
-                    sum1 += tmp * i1
-                    sum += tmp
+                    sum0 = sum0 + tmp * i0
+                    sum1 = sum1 + tmp * i1
+                    sum = sum + tmp
             if sum > 0:
-                return (sum0 / sum, sum1 / sum)
-                
-        return (float(current0), float(current1))
+                res0[0] = sum0 / sum
+                res1[0] = sum1 / sum
+                return status
+        else:
+            status = 3
+        res0[0] = <double> current0
+        res1[0] = <double> current1
+        return status
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def local_maxi_batch(self, seeds):
+        """
+        Nearest local maximum of many seeds, climbed in parallel, with the
+        sub-pixel refinement of local_maxi
+
+        @param seeds: array of shape (N, 2) with the coordinates (y, x) of the seeds
+        @return: array of shape (N, 2) with the position of the maxima, NaN for seeds outside of the image
+        """
+        cdef:
+            double[:, ::1] cseeds = numpy.ascontiguousarray(seeds, dtype=numpy.float64).reshape(-1, 2)
+            numpy.ndarray[numpy.float64_t, ndim=2] out = numpy.empty((cseeds.shape[0], 2), dtype=numpy.float64)
+        self._climb(cseeds, out, 0, cseeds.shape[0])
+        return out
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cdef void _climb(self, double[:, ::1] seeds, double[:, ::1] out, ssize_t start, ssize_t stop) nogil:
+        """
+        Climb the seeds start to stop in parallel, results in out
+        """
+        cdef:
+            ssize_t i
+            double s0, s1
+        for i in prange(start, stop, schedule="guided"):
+            s0 = rint(seeds[i, 0])
+            s1 = rint(seeds[i, 1])
+            if (s0 >= 0) and (s0 < self.height) and (s1 >= 0) and (s1 < self.width):
+                self.c_refine(self.c_local_maxi(<size_t> s0 * self.width + <size_t> s1), &out[i, 0], &out[i, 1])
+            else:
+                out[i, 0] = out[i, 1] = NAN
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def nearest_peaks(self, seeds, double dmin=0.0, ssize_t keep=0, region=None, Imin=None,
+                      ssize_t patience=-1, peaks=None, ssize_t block=1024):
+        """
+        Peaks reached from a list of seeds, selected in the order of the
+        seeds like a loop over local_maxi would do. Seeds are climbed in
+        parallel, by blocks, and the selection uses a spatial hash.
+
+        A peak is kept if the pixel it falls in is in the region, above
+        Imin, and farther than dmin from every peak kept before (so the
+        same peak is never kept twice).
+
+        @param seeds: array of shape (N, 2) with the coordinates (y, x) of the seeds
+        @param dmin: minimum distance between two peaks
+        @param keep: stop when this number of peaks is reached (including peaks), 0 for no limit
+        @param region: 2D array, non-zero where peaks are accepted
+        @param Imin: minimum intensity of the pixel of a peak
+        @param patience: stop after this number of seeds in a row without a new peak, -1 for no limit
+        @param peaks: positions of the peaks already known
+        @param block: number of seeds climbed at once
+        @return: array (M, 2) with the new peaks, array with the index of the seed of each of them
+        """
+        cdef:
+            double[:, ::1] cseeds = numpy.ascontiguousarray(seeds, dtype=numpy.float64).reshape(-1, 2)
+            double[:, ::1] cpeaks = numpy.ascontiguousarray(peaks if peaks is not None else numpy.zeros((0, 2)),
+                                                            dtype=numpy.float64).reshape(-1, 2)
+            double[:, ::1] climbed
+            double[:, ::1] found
+            numpy.int8_t[:, ::1] cregion
+            ssize_t nseed = cseeds.shape[0], nknown = cpeaks.shape[0], nfound = 0, failures = 0
+            ssize_t i, j, start, stop, p0, p1
+            double r0, r1
+            numpy.int32_t[::1] origin
+            float threshold = Imin if Imin is not None else 0.0
+            bint do_region = region is not None, do_imin = Imin is not None, done = False
+            _PeakHash table
+
+        if do_region:
+            region = numpy.ascontiguousarray(region)
+            assert region.shape == (self.height, self.width)
+            if region.dtype.itemsize != 1:
+                region = (region != 0)
+            cregion = region.view(numpy.int8)
+        found = numpy.empty((nknown + nseed, 2), dtype=numpy.float64)
+        origin = numpy.empty(nseed, dtype=numpy.int32)
+        climbed = numpy.empty((min(block, nseed), 2), dtype=numpy.float64)
+        table = _PeakHash(nknown + (min(keep, nseed) if keep > 0 else nseed), dmin)
+        for j in range(nknown):
+            found[j, 0] = cpeaks[j, 0]
+            found[j, 1] = cpeaks[j, 1]
+            table.add(found, j)
+
+        start = 0
+        while (start < nseed) and not done:
+            stop = min(start + block, nseed)
+            self._climb(cseeds[start:stop], climbed, 0, stop - start)
+            with nogil:
+                for i in range(start, stop):
+                    failures = failures + 1
+                    # bounds tested before the cast: seeds outside of the image climb to NaN
+                    r0 = rint(climbed[i - start, 0])
+                    r1 = rint(climbed[i - start, 1])
+                    if not ((r0 >= 0) and (r0 < self.height) and (r1 >= 0) and (r1 < self.width)):
+                        r0 = r1 = -1
+                    p0 = <ssize_t> r0
+                    p1 = <ssize_t> r1
+                    if (p0 >= 0) and \
+                       ((not do_region) or cregion[p0, p1]) and ((not do_imin) or (self.data[p0, p1] > threshold)):
+                        j = nknown + nfound
+                        found[j, 0] = climbed[i - start, 0]
+                        found[j, 1] = climbed[i - start, 1]
+                        if table.is_far(found, j):
+                            table.add(found, j)
+                            origin[nfound] = i
+                            nfound = nfound + 1
+                            failures = 0
+                    if ((keep > 0) and (nknown + nfound >= keep)) or ((patience >= 0) and (failures > patience)):
+                        done = True
+                        break
+            start = stop
+        return numpy.array(found[nknown:nknown + nfound]), numpy.array(origin[:nfound])
 
     cpdef size_t cp_local_maxi(self, size_t x):
         return self.c_local_maxi(x)
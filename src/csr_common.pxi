@@ -0,0 +1,524 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Common statistics on top of a CSR matrix (data, indices, indptr)
+
+This file is meant to be included after "regrid_common.pxi" by any module
+providing integrators with a CSR representation.
+"""
+__author__ = "Jerome Kieffer"
+__contact__ = "Jerome.kieffer@esrf.fr"
+__date__ = "18/10/2015"
+__status__ = "stable"
+__license__ = "GPLv3+"
+
+from libc.math cimport sqrt
+from libc.stdlib cimport malloc, free
+from cython.parallel cimport parallel
+from . import memory
+from . import isa
+
+
+def calc_indptr(outMax):
+    """
+    Row pointers of a CSR matrix from the number of elements per row
+
+    @param outMax: number of elements in each row (any shape, C-order)
+    @return: cumulative sum as int32, to be stored in indptr[1:]
+    @raise MemoryError: if the matrix has more elements than int32 indices can address
+    """
+    cumsum = numpy.asarray(outMax).ravel().cumsum(dtype=numpy.int64)
+    if cumsum.size and cumsum[-1] > numpy.iinfo(numpy.int32).max:
+        raise MemoryError("CSR matrix has %s elements, more than int32 indices can address: use a tiled matrix" % cumsum[-1])
+    return cumsum.astype(numpy.int32)
+
+
+cdef struct value_coef_t:
+    float value
+    float coef
+
+
+@cython.boundscheck(False)
+cdef inline void sort_value_coef(value_coef_t *array, int size) nogil:
+    """
+    In-place heap-sort of (value, coef) pairs by increasing value
+
+    @param array: pointer to the first element
+    @param size: number of elements
+    """
+    cdef:
+        int start, end, root, child
+        value_coef_t tmp
+    start = size // 2 - 1
+    end = size - 1
+    while end > 0:
+        if start >= 0:
+            root = start
+            start = start - 1
+        else:
+            tmp = array[end]
+            array[end] = array[0]
+            array[0] = tmp
+            end = end - 1
+            root = 0
+        # sift down
+        while 2 * root + 1 <= end:
+            child = 2 * root + 1
+            if child < end and array[child].value < array[child + 1].value:
+                child = child + 1
+            if array[root].value < array[child].value:
+                tmp = array[root]
+                array[root] = array[child]
+                array[child] = tmp
+                root = child
+            else:
+                break
+
+
+class CsrIntegratorMixin(object):
+    """
+    Statistical reductions performed on top of the sparse matrix of an integrator.
+
+    The class using this mixin needs to provide the attributes:
+    * data, indices, indptr: the CSR representation of the matrix
+    * size: the number of pixels of the input image
+    * outPos: the position of the bins
+    * empty: the value for bins without contributing pixels
+
+    If permutation is set, the columns of the matrix are renumbered pixels:
+    column i corresponds to the pixel permutation[i] of the image and
+    preprocess() returns the image in that order.
+
+    The working copies of the image are recycled from one frame to the next
+    by arena (a pyFAI.memory.Arena), created with the first buffer.
+    """
+    permutation = None
+    arena = None
+
+    def get_buffer(self, key, shape, dtype=numpy.float32, zeros=False, exclude=None):
+        """
+        Scratch buffer for the processing of a frame, aligned and recycled
+
+        @param key: name of the buffer
+        @param shape: shape of the buffer
+        @param dtype: data type of the buffer
+        @param zeros: fill the buffer with zeros
+        @param exclude: array the buffer is computed from, like a former
+            result fed back: a new buffer is allocated if they overlap
+        @return: numpy array, valid until the next call with the same key
+        """
+        if self.arena is None:
+            self.arena = memory.Arena()
+        ary = self.arena.empty(key, shape, dtype)
+        if (exclude is not None) and numpy.may_share_memory(ary, exclude):
+            ary = memory.empty(shape, dtype)
+        if zeros:
+            ary.fill(0)
+        return ary
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def preprocess(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None):
+        """
+        Prepare the float32 image used by all CSR kernels: dark subtraction,
+        flat, polarization and solid angle division, in a single parallel pass.
+
+        Pixels matching the dummy value are all set to exactly the dummy value
+        which simplifies further processing. Pixels are reordered on the fly
+        when the matrix uses a permutation.
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @return: 3-tuple: preprocessed data (float32, 1D), do_dummy, value of dummy
+        """
+        cdef:
+            numpy.int32_t i, k, size = self.size
+            float data = 0, cdummy = 0, cddummy = 0
+            bint do_dummy = False, do_dark = False, do_flat = False, do_polarization = False, do_solidAngle = False
+            bint do_permutation = False
+            float[:] cdata, tdata, cflat, cdark, csolidAngle, cpolarization
+            numpy.int32_t[:] cpermutation
+
+        assert size == weights.size
+        if dummy is not None:
+            do_dummy = True
+            cdummy = <float> float(dummy)
+            if delta_dummy is None:
+                cddummy = <float> 0.0
+            else:
+                cddummy = <float> float(delta_dummy)
+        else:
+            cdummy = <float> float(self.empty)
+
+        if flat is not None:
+            do_flat = True
+            assert flat.size == size
+            cflat = numpy.ascontiguousarray(flat.ravel(), dtype=numpy.float32)
+        if dark is not None:
+            do_dark = True
+            assert dark.size == size
+            cdark = numpy.ascontiguousarray(dark.ravel(), dtype=numpy.float32)
+        if solidAngle is not None:
+            do_solidAngle = True
+            assert solidAngle.size == size
+            csolidAngle = numpy.ascontiguousarray(solidAngle.ravel(), dtype=numpy.float32)
+        if polarization is not None:
+            do_polarization = True
+            assert polarization.size == size
+            cpolarization = numpy.ascontiguousarray(polarization.ravel(), dtype=numpy.float32)
+
+        if self.permutation is not None:
+            do_permutation = True
+            cpermutation = self.permutation
+
+        if not (do_dark or do_flat or do_polarization or do_solidAngle or do_dummy or do_permutation):
+            return numpy.ascontiguousarray(weights.ravel(), dtype=numpy.float32), do_dummy, cdummy
+
+        tdata = numpy.ascontiguousarray(weights.ravel(), dtype=numpy.float32)
+        cdata = self.get_buffer("preprocess", size, exclude=tdata)
+        for i in prange(size, nogil=True, schedule="static"):
+            if do_permutation:
+                k = cpermutation[i]
+            else:
+                k = i
+            data = tdata[k]
+            if do_dummy and (((cddummy != 0) and (fabs(data - cdummy) <= cddummy)) or ((cddummy == 0) and (data == cdummy))):
+                data = cdummy
+            else:
+                if do_dark:
+                    data = data - cdark[k]
+                if do_flat:
+                    data = data / cflat[k]
+                if do_polarization:
+                    data = data / cpolarization[k]
+                if do_solidAngle:
+                    data = data / csolidAngle[k]
+            cdata[i] = data
+        return numpy.asarray(cdata), do_dummy, cdummy
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def integrate(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None):
+        """
+        Generic integration as a sparse matrix-vector product, for classes
+        which do not provide their own kernel.
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @return: positions, pattern, weighted_histogram and unweighted_histogram
+        @rtype: 4-tuple of ndarrays
+        """
+        cdata, do_dummy, cdummy = self.preprocess(weights, dummy=dummy, delta_dummy=delta_dummy, dark=dark,
+                                                  flat=flat, solidAngle=solidAngle, polarization=polarization)
+        # matrix-vector product with the kernel of the best instruction set
+        outData, outCount, outMerge = isa.csr_integrate(self.data, self.indices, self.indptr, cdata,
+                                                        do_dummy, cdummy)
+        return self.outPos, outMerge, outData, outCount
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def sigma_clip(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None,
+                   thres=3.0, max_iter=5):
+        """
+        Perform a sigma-clipping iterative filter within each bin.
+
+        At each pass the weighted mean and standard deviation are calculated
+        for every bin (using the coefficients of the matrix as weights), then
+        all pixels further than thres*std from the mean of any bin they
+        contribute to are flagged and discarded from the next passes.
+        The process stops when no more pixels are rejected or after max_iter passes.
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @param thres: cut-off for n*sigma: discard any pixel with |I-<I>| > thres*std
+        @param max_iter: maximum number of passes
+        @return: positions, clipped mean, standard deviation, number of rejected pixels per bin
+        @rtype: 4-tuple of ndarrays
+        """
+        cdef:
+            numpy.int32_t i, j, idx, nbins = self.indptr.size - 1, size = self.size, it
+            numpy.int32_t[:] indices = self.indices, indptr = self.indptr
+            float[:] ccoef = self.data, cdata
+            numpy.int8_t[:] flag = numpy.zeros(size, dtype=numpy.int8)
+            numpy.int8_t[:] outlier = numpy.zeros(size, dtype=numpy.int8)
+            numpy.ndarray[numpy.float32_t, ndim = 1] outMean = numpy.zeros(nbins, dtype=numpy.float32)
+            numpy.ndarray[numpy.float32_t, ndim = 1] outStd = numpy.zeros(nbins, dtype=numpy.float32)
+            numpy.ndarray[numpy.int32_t, ndim = 1] outReject = numpy.zeros(nbins, dtype=numpy.int32)
+            double sum_data, sum_count, sum_var, mean, delta, epsilon = 1e-10
+            float data, coef, cdummy, cthres = thres, std
+            bint do_dummy
+            int rejected = 1
+
+        cdata, do_dummy, cdummy = self.preprocess(weights, dummy=dummy, delta_dummy=delta_dummy, dark=dark,
+                                                  flat=flat, solidAngle=solidAngle, polarization=polarization)
+        it = 0
+        while (it <= max_iter) and (rejected > 0):
+            # Statistics on the pixels which are not yet flagged
+            for i in prange(nbins, nogil=True, schedule="guided"):
+                sum_data = 0.0
+                sum_count = 0.0
+                for j in range(indptr[i], indptr[i + 1]):
+                    idx = indices[j]
+                    coef = ccoef[j]
+                    data = cdata[idx]
+                    if (coef == 0.0) or flag[idx] or (do_dummy and data == cdummy):
+                        continue
+                    sum_data = sum_data + coef * data
+                    sum_count = sum_count + coef
+                if sum_count > epsilon:
+                    mean = sum_data / sum_count
+                    sum_var = 0.0
+                    for j in range(indptr[i], indptr[i + 1]):
+                        idx = indices[j]
+                        coef = ccoef[j]
+                        data = cdata[idx]
+                        if (coef == 0.0) or flag[idx] or (do_dummy and data == cdummy):
+                            continue
+                        delta = data - mean
+                        sum_var = sum_var + coef * delta * delta
+                    outMean[i] = mean
+                    outStd[i] = sqrt(sum_var / sum_count)
+                else:
+                    outMean[i] = cdummy
+                    outStd[i] = 0.0
+            if it == max_iter:
+                break
+            # Mark outliers in a separate mask: flag is only read during this pass
+            # for the result not to depend on the scheduling
+            for i in prange(nbins, nogil=True, schedule="guided"):
+                std = outStd[i]
+                if std <= 0.0:
+                    continue
+                mean = outMean[i]
+                for j in range(indptr[i], indptr[i + 1]):
+                    idx = indices[j]
+                    data = cdata[idx]
+                    if (ccoef[j] == 0.0) or flag[idx] or (do_dummy and data == cdummy):
+                        continue
+                    if fabs(data - mean) > cthres * std:
+                        # Concurrent writes store the same value: harmless
+                        outlier[idx] = 1
+            # Merge the outliers of this pass into flag, counting each pixel once
+            rejected = 0
+            for idx in prange(size, nogil=True, schedule="static"):
+                if outlier[idx]:
+                    outlier[idx] = 0
+                    flag[idx] = 1
+                    rejected += 1
+            it = it + 1
+
+        for i in prange(nbins, nogil=True, schedule="guided"):
+            for j in range(indptr[i], indptr[i + 1]):
+                if flag[indices[j]] and (ccoef[j] != 0.0):
+                    outReject[i] += 1
+        return self.outPos, outMean, outStd, outReject
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def percentile(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None,
+                   percentile=50):
+        """
+        Calculate the weighted percentile of the pixel values within each bin.
+
+        Each bin gathers the (value, coefficient) pairs of its pixels which are
+        sorted by value; the coefficients of the matrix are the weights.
+        Sorting is done in parallel over the bins using one scratch buffer per
+        thread, sized after the longest row of the matrix.
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @param percentile: which percentile to extract (50 for the median).
+                           If a 2-tuple (lower, upper) is provided, the trimmed mean
+                           of the pixels between these two percentiles is calculated.
+        @return: positions, percentile (or trimmed mean), number of contributing pixels
+        @rtype: 3-tuple of ndarrays
+        """
+        cdef:
+            numpy.int32_t i, j, k, idx, npix, nbins = self.indptr.size - 1, max_row
+            numpy.int32_t[:] indices = self.indices, indptr = self.indptr
+            float[:] ccoef = self.data, cdata
+            numpy.ndarray[numpy.float32_t, ndim = 1] outValue = numpy.zeros(nbins, dtype=numpy.float32)
+            numpy.ndarray[numpy.int32_t, ndim = 1] outCount = numpy.zeros(nbins, dtype=numpy.int32)
+            double q_lower, q_upper, total, cumsum, previous, target, lower, upper, overlap, sum_data, sum_count
+            float data, coef, cdummy
+            bint do_dummy
+            value_coef_t *buffer
+
+        if "__len__" in dir(percentile):
+            q_lower = min(percentile) / 100.0
+            q_upper = max(percentile) / 100.0
+        else:
+            q_lower = q_upper = float(percentile) / 100.0
+        if q_lower < 0.0 or q_upper > 1.0:
+            raise ValueError("percentile should be within [0, 100], got %s" % (percentile,))
+        max_row = numpy.diff(self.indptr).max() if nbins else 0
+
+        cdata, do_dummy, cdummy = self.preprocess(weights, dummy=dummy, delta_dummy=delta_dummy, dark=dark,
+                                                  flat=flat, solidAngle=solidAngle, polarization=polarization)
+        with nogil, parallel():
+            buffer = <value_coef_t*> malloc(max(max_row, 1) * sizeof(value_coef_t))
+            for i in prange(nbins, schedule="dynamic"):
+                if buffer == NULL:
+                    # the scratch buffer of this thread could not be allocated
+                    outCount[i] = -1
+                    continue
+                npix = 0
+                total = 0.0
+                for j in range(indptr[i], indptr[i + 1]):
+                    coef = ccoef[j]
+                    data = cdata[indices[j]]
+                    if (coef <= 0.0) or (do_dummy and data == cdummy):
+                        continue
+                    buffer[npix].value = data
+                    buffer[npix].coef = coef
+                    total = total + coef
+                    npix = npix + 1
+                outCount[i] = npix
+                if npix == 0:
+                    outValue[i] = cdummy
+                    continue
+                sort_value_coef(buffer, npix)
+                if q_lower == q_upper:
+                    # first element where the cumulated weight reaches the target
+                    target = q_lower * total
+                    cumsum = 0.0
+                    k = 0
+                    while k < npix - 1:
+                        cumsum = cumsum + buffer[k].coef
+                        if cumsum >= target:
+                            break
+                        k = k + 1
+                    outValue[i] = buffer[k].value
+                else:
+                    # trimmed mean: weighted average of the fraction of each
+                    # element falling within [q_lower, q_upper]
+                    lower = q_lower * total
+                    upper = q_upper * total
+                    cumsum = 0.0
+                    sum_data = 0.0
+                    sum_count = 0.0
+                    for k in range(npix):
+                        previous = cumsum
+                        cumsum = cumsum + buffer[k].coef
+                        if cumsum <= lower:
+                            continue
+                        if previous >= upper:
+                            break
+                        overlap = min(cumsum, upper) - max(previous, lower)
+                        sum_data = sum_data + overlap * buffer[k].value
+                        sum_count = sum_count + overlap
+                    if sum_count > 0.0:
+                        outValue[i] = sum_data / sum_count
+                    else:
+                        outValue[i] = cdummy
+            free(buffer)
+        if nbins and outCount.min() < 0:
+            raise MemoryError("Unable to allocate the scratch buffers of the percentile (%s values per thread)" % max_row)
+        return self.outPos, outValue, outCount
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def integrate_variance(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None):
+        """
+        Perform the integration and calculate, in the same pass, the weighted
+        sum of squared deviations to the mean within each bin.
+
+        The variance is accumulated with the weighted incremental algorithm of
+        West (1979), which is numerically stable in single pass.
+        The azimuthal error is then sqrt(M2)/count.
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @return: positions, pattern, weighted_histogram, unweighted_histogram and sum of weighted squared deviations
+        @rtype: 5-tuple of ndarrays
+        """
+        cdef:
+            numpy.int32_t i, j, nbins = self.indptr.size - 1
+            numpy.int32_t[:] indices = self.indices, indptr = self.indptr
+            float[:] ccoef = self.data, cdata
+            numpy.ndarray[numpy.float64_t, ndim = 1] outData = numpy.zeros(nbins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float64_t, ndim = 1] outCount = numpy.zeros(nbins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float64_t, ndim = 1] outM2 = numpy.zeros(nbins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float32_t, ndim = 1] outMerge = numpy.zeros(nbins, dtype=numpy.float32)
+            double sum_data, sum_count, mean, M2, delta, epsilon = 1e-10
+            float data, coef, cdummy
+            bint do_dummy
+
+        cdata, do_dummy, cdummy = self.preprocess(weights, dummy=dummy, delta_dummy=delta_dummy, dark=dark,
+                                                  flat=flat, solidAngle=solidAngle, polarization=polarization)
+        for i in prange(nbins, nogil=True, schedule="guided"):
+            sum_data = 0.0
+            sum_count = 0.0
+            mean = 0.0
+            M2 = 0.0
+            for j in range(indptr[i], indptr[i + 1]):
+                coef = ccoef[j]
+                if coef == 0.0:
+                    continue
+                data = cdata[indices[j]]
+                if do_dummy and (data == cdummy):
+                    continue
+                sum_data = sum_data + coef * data
+                sum_count = sum_count + coef
+                delta = data - mean
+                mean = mean + delta * coef / sum_count
+                M2 = M2 + coef * delta * (data - mean)
+            outData[i] = sum_data
+            outCount[i] = sum_count
+            outM2[i] = M2
+            if sum_count > epsilon:
+                outMerge[i] = sum_data / sum_count
+            else:
+                outMerge[i] = cdummy
+        return self.outPos, outMerge, outData, outCount, outM2
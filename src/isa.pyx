@@ -0,0 +1,189 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+# 
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+# 
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Run-time selection of the instruction set used by the hot kernels.
+
+Kernels are compiled for several instruction set levels in one package
+("generic", "avx2", "avx512"); the best level supported by the processor is
+selected at import. The level can be forced with the PYFAI_ISA environment
+variable, for testing or to work around a faulty processor.
+"""
+__author__ = "Jerome Kieffer"
+__date__ = "17/10/2015"
+__contact__ = "Jerome.kieffer@esrf.fr"
+__license__ = "GPLv3+"
+
+import cython
+cimport numpy
+import numpy
+import os
+import logging
+logger = logging.getLogger("pyFAI.isa")
+from libc.stdint cimport int32_t
+from openmp cimport omp_get_max_threads, omp_set_num_threads
+from isa_kernels cimport ISA_NLEVELS, isa_name, isa_compiled, isa_supported, isa_select, isa_selected, \
+                         isa_csr_integrate, isa_convolve
+
+
+def _names(check):
+    return [isa_name(i).decode() for i in range(ISA_NLEVELS) if check(i)]
+
+
+def compiled():
+    """
+    @return: list of the instruction set levels available in this build
+    """
+    return _names(isa_compiled)
+
+
+def supported():
+    """
+    @return: list of the instruction set levels supported by the processor
+    """
+    return _names(isa_supported)
+
+
+def selected():
+    """
+    @return: name of the instruction set level used by the kernels
+    """
+    return isa_name(isa_selected()).decode()
+
+
+def select(level=None):
+    """
+    Select the instruction set level used by the kernels
+
+    @param level: name of the level, None for the best supported one
+    @return: name of the selected level
+    @raise RuntimeError: if the level is not supported by this build or processor
+    """
+    cdef int idx = -1
+    if level is not None:
+        names = [isa_name(i).decode() for i in range(ISA_NLEVELS)]
+        if level.lower() not in names:
+            raise RuntimeError("Unknown instruction set %s, valid ones are %s" % (level, ", ".join(names)))
+        idx = names.index(level.lower())
+    if isa_select(idx) < 0:
+        raise RuntimeError("Instruction set %s is not supported, available: %s" % (level, ", ".join(supported())))
+    return selected()
+
+
+def get_num_threads():
+    """
+    @return: number of threads used by the parallel kernels
+    """
+    return omp_get_max_threads()
+
+
+def set_num_threads(num_threads):
+    """
+    Set the number of threads used by the parallel kernels called from this thread
+
+    @param num_threads: number of threads, at least 1
+    """
+    omp_set_num_threads(max(1, int(num_threads)))
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def csr_integrate(data, indices, indptr, image, do_dummy=False, dummy=0.0):
+    """
+    Weighted and unweighted histograms of the CSR matrix-vector product,
+    with the kernel of the selected instruction set
+
+    @param data: coefficients of the CSR matrix (float32)
+    @param indices: column index of each coefficient (int32)
+    @param indptr: row pointer of the CSR matrix (int32)
+    @param image: preprocessed image (float32, 1D)
+    @param do_dummy: skip pixels with the dummy value
+    @param dummy: value of dummy pixels, also used for empty bins
+    @return: weighted histogram, unweighted histogram, their ratio
+    """
+    cdef:
+        float[::1] cdata = numpy.ascontiguousarray(data, dtype=numpy.float32)
+        int32_t[::1] cindices = numpy.ascontiguousarray(indices, dtype=numpy.int32)
+        int32_t[::1] cindptr = numpy.ascontiguousarray(indptr, dtype=numpy.int32)
+        float[::1] cimage = numpy.ascontiguousarray(image, dtype=numpy.float32)
+        int32_t nbins = cindptr.shape[0] - 1
+        int cdo_dummy = do_dummy
+        float cdummy = dummy
+        double[::1] out_data, out_count
+        float[::1] out_merge
+    outData = numpy.empty(nbins, dtype=numpy.float64)
+    outCount = numpy.empty(nbins, dtype=numpy.float64)
+    outMerge = numpy.empty(nbins, dtype=numpy.float32)
+    out_data = outData
+    out_count = outCount
+    out_merge = outMerge
+    if nbins > 0 and cdata.shape[0] > 0:
+        with nogil:
+            isa_csr_integrate(&cdata[0], &cindices[0], &cindptr[0], nbins, &cimage[0], cdo_dummy, cdummy,
+                              &out_data[0], &out_count[0], &out_merge[0])
+    else:
+        outData[:] = 0
+        outCount[:] = 0
+        outMerge[:] = cdummy
+    return outData, outCount, outMerge
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def convolve(img, filter, vertical=False):
+    """
+    1D convolution of an image along its rows (or columns), "reflect" mode,
+    with the kernel of the selected instruction set
+
+    @param img: 2D image
+    @param filter: 1D array with the coefficients of the filter
+    @param vertical: convolve along the columns instead of the rows
+    @return: convolved image (float32)
+    """
+    cdef:
+        float[:, ::1] cimg = numpy.ascontiguousarray(img, dtype=numpy.float32)
+        float[::1] cfilter = numpy.ascontiguousarray(filter, dtype=numpy.float32).ravel()
+        int height = cimg.shape[0], width = cimg.shape[1], size = cfilter.shape[0]
+        int cvertical = vertical, status = 0
+        float[:, ::1] out
+    output = numpy.zeros((height, width), dtype=numpy.float32)
+    if height == 0 or width == 0 or size == 0:
+        return output
+    out = output
+    with nogil:
+        status = isa_convolve(&cimg[0, 0], height, width, &cfilter[0], size, cvertical, &out[0, 0])
+    if status != 0:
+        raise MemoryError("Unable to allocate the work buffers of the convolution")
+    return output
+
+
+_forced = os.environ.get("PYFAI_ISA")
+if _forced:
+    try:
+        select(_forced)
+    except RuntimeError as error:
+        logger.warning("PYFAI_ISA=%s ignored: %s", _forced, error)
+        select()
+else:
+    select()
+logger.info("Kernels use the %s instruction set (supported: %s)", selected(), ", ".join(supported()))
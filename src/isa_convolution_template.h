@@ -0,0 +1,138 @@
+/*
+ *    Project: Fast Azimuthal integration
+ *             https://github.com/pyFAI/pyFAI
+ *
+ *    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+ *
+ *    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Body of the separable convolution kernels ("reflect" mode, as in
+ * scipy.ndimage), included once per instruction set level by isa_kernels.c
+ * with KERNEL and TARGET defined.
+ *
+ * Each output row is accumulated one filter coefficient at a time, with
+ * Kahan compensation, so that the innermost loop runs over contiguous
+ * pixels and is vectorized. The order of the additions is the one of the
+ * former pixel-by-pixel loop.
+ *
+ * Both return 0 on success, -1 if a work buffer could not be allocated.
+ */
+TARGET int KERNEL(convolve_rows)(const float *img, int height, int width,
+                                 const float *filter, int size, float *output)
+{
+    int half = (size % 2) ? size / 2 : (size + 1) / 2;
+    int status = 0;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        float *err = (float *) malloc(((size_t) width + 1) * sizeof(float));
+        int y;
+        if (err == NULL) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+            status = -1;
+        }
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (y = 0; y < height; y++) {
+            const float *src = img + (size_t) y * width;
+            float *dst = output + (size_t) y * width;
+            int x, f;
+            if (err == NULL)
+                continue;
+            for (x = 0; x < width; x++) {
+                dst[x] = 0.0f;
+                err[x] = 0.0f;
+            }
+            for (f = 0; f < size; f++) {
+                int shift = f - half;
+                int lo = (shift < 0) ? ((-shift < width) ? -shift : width) : 0;
+                int hi = (shift > 0) ? ((shift < width) ? width - shift : 0) : width;
+                float coef = filter[f];
+                if (hi < lo)
+                    hi = lo;
+                for (x = 0; x < lo; x++)
+                    kahan_add(dst + x, err + x, src[reflect(x + shift, width)] * coef);
+#if defined(_OPENMP) && (_OPENMP >= 201307)
+#pragma omp simd
+#endif
+                for (x = lo; x < hi; x++) {
+                    float val = src[x + shift] * coef - err[x];
+                    float tmp = dst[x] + val;
+                    err[x] = (tmp - dst[x]) - val;
+                    dst[x] = tmp;
+                }
+                for (x = hi; x < width; x++)
+                    kahan_add(dst + x, err + x, src[reflect(x + shift, width)] * coef);
+            }
+        }
+        free(err);
+    }
+    return status;
+}
+
+TARGET int KERNEL(convolve_columns)(const float *img, int height, int width,
+                                    const float *filter, int size, float *output)
+{
+    int half = (size % 2) ? size / 2 : (size + 1) / 2;
+    int status = 0;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        float *err = (float *) malloc(((size_t) width + 1) * sizeof(float));
+        int y;
+        if (err == NULL) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+            status = -1;
+        }
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (y = 0; y < height; y++) {
+            float *dst = output + (size_t) y * width;
+            int x, f;
+            if (err == NULL)
+                continue;
+            for (x = 0; x < width; x++) {
+                dst[x] = 0.0f;
+                err[x] = 0.0f;
+            }
+            for (f = 0; f < size; f++) {
+                const float *src = img + (size_t) reflect(y + f - half, height) * width;
+                float coef = filter[f];
+#if defined(_OPENMP) && (_OPENMP >= 201307)
+#pragma omp simd
+#endif
+                for (x = 0; x < width; x++) {
+                    float val = src[x] * coef - err[x];
+                    float tmp = dst[x] + val;
+                    err[x] = (tmp - dst[x]) - val;
+                    dst[x] = tmp;
+                }
+            }
+        }
+        free(err);
+    }
+    return status;
+}
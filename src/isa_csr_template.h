@@ -0,0 +1,53 @@
+/*
+ *    Project: Fast Azimuthal integration
+ *             https://github.com/pyFAI/pyFAI
+ *
+ *    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+ *
+ *    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Body of the CSR integration kernel, included once per instruction set
+ * level by isa_kernels.c with KERNEL and TARGET defined.
+ */
+TARGET void KERNEL(csr_integrate)(const float *data, const int32_t *indices, const int32_t *indptr, int32_t nbins,
+                                  const float *image, int do_dummy, float dummy,
+                                  double *out_data, double *out_count, float *out_merge)
+{
+    int32_t i;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(guided)
+#endif
+    for (i = 0; i < nbins; i++) {
+        double sum_data = 0.0, sum_count = 0.0;
+        int32_t j;
+#if defined(_OPENMP) && (_OPENMP >= 201307)
+#pragma omp simd reduction(+:sum_data, sum_count)
+#endif
+        for (j = indptr[i]; j < indptr[i + 1]; j++) {
+            float coef = data[j];
+            float value = image[indices[j]];
+            /* select after the product: masked values may be NaN */
+            int keep = (coef != 0.0f) && !(do_dummy && (value == dummy));
+            sum_data += keep ? (double) coef * value : 0.0;
+            sum_count += keep ? (double) coef : 0.0;
+        }
+        out_data[i] = sum_data;
+        out_count[i] = sum_count;
+        out_merge[i] = (sum_count > 1e-10) ? (float) (sum_data / sum_count) : dummy;
+    }
+}
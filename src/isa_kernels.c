@@ -0,0 +1,169 @@
+/*
+ *    Project: Fast Azimuthal integration
+ *             https://github.com/pyFAI/pyFAI
+ *
+ *    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+ *
+ *    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Run-time dispatch of hot kernels between instruction set levels.
+ *
+ * With GCC or Clang on x86, every kernel is compiled for the baseline of the
+ * build (SSE2 on x86_64) and, thanks to function target attributes, for
+ * AVX2+FMA and AVX-512, without any special compiler flag. Other compilers
+ * and architectures only get the generic version.
+ *
+ * Only the kernels limited by arithmetic on contiguous data are dispatched
+ * (CSR integration and convolution): the histograms scatter into random
+ * bins and the geometry spends its time in libm (atan2, acos, sqrt), neither
+ * gains anything from wider vectors.
+ */
+#include <stdlib.h>
+#include "isa_kernels.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && !defined(__INTEL_COMPILER)
+#define ISA_MULTIVERSION 1
+#else
+#define ISA_MULTIVERSION 0
+#endif
+
+typedef void (*csr_integrate_t)(const float *, const int32_t *, const int32_t *, int32_t,
+                                const float *, int, float, double *, double *, float *);
+typedef int (*convolve_t)(const float *, int, int, const float *, int, float *);
+
+/* one entry per level, NULL when the level is not compiled */
+typedef struct {
+    csr_integrate_t csr_integrate;
+    convolve_t convolve_rows;
+    convolve_t convolve_columns;
+} isa_kernels_t;
+
+/* index of pos mirrored into [0, n), as the "reflect" mode of scipy.ndimage */
+static inline int reflect(int pos, int n) {
+    int period = 2 * n;
+    pos %= period;
+    if (pos < 0)
+        pos += period;
+    return (pos < n) ? pos : period - pos - 1;
+}
+
+/* compensated (Kahan) summation of value into *sum */
+static inline void kahan_add(float *sum, float *err, float value) {
+    float val = value - *err;
+    float tmp = *sum + val;
+    *err = (tmp - *sum) - val;
+    *sum = tmp;
+}
+
+#define TARGET
+#define KERNEL(name) name##_generic
+#include "isa_csr_template.h"
+#include "isa_convolution_template.h"
+#undef KERNEL
+#undef TARGET
+
+#if ISA_MULTIVERSION
+#define TARGET __attribute__((target("avx2,fma")))
+#define KERNEL(name) name##_avx2
+#include "isa_csr_template.h"
+#include "isa_convolution_template.h"
+#undef KERNEL
+#undef TARGET
+
+#define TARGET __attribute__((target("avx512f,avx2,fma")))
+#define KERNEL(name) name##_avx512
+#include "isa_csr_template.h"
+#include "isa_convolution_template.h"
+#undef KERNEL
+#undef TARGET
+
+static const isa_kernels_t isa_table[ISA_NLEVELS] = {
+    {csr_integrate_generic, convolve_rows_generic, convolve_columns_generic},
+    {csr_integrate_avx2, convolve_rows_avx2, convolve_columns_avx2},
+    {csr_integrate_avx512, convolve_rows_avx512, convolve_columns_avx512}};
+#else
+static const isa_kernels_t isa_table[ISA_NLEVELS] = {
+    {csr_integrate_generic, convolve_rows_generic, convolve_columns_generic},
+    {NULL, NULL, NULL},
+    {NULL, NULL, NULL}};
+#endif
+
+static const char *isa_names[ISA_NLEVELS] = {"generic", "avx2", "avx512"};
+static int isa_level = -1;
+static const isa_kernels_t *isa_current = &isa_table[ISA_GENERIC];
+
+const char *isa_name(int level) {
+    if ((level < 0) || (level >= ISA_NLEVELS))
+        return "unknown";
+    return isa_names[level];
+}
+
+int isa_compiled(int level) {
+    return (level >= 0) && (level < ISA_NLEVELS) && (isa_table[level].csr_integrate != NULL);
+}
+
+int isa_supported(int level) {
+    if (!isa_compiled(level))
+        return 0;
+#if ISA_MULTIVERSION
+    __builtin_cpu_init();
+    switch (level) {
+    case ISA_AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case ISA_AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+#endif
+    return level == ISA_GENERIC;
+}
+
+int isa_select(int level) {
+    if (level < 0) {
+        for (level = ISA_NLEVELS - 1; level > ISA_GENERIC; level--)
+            if (isa_supported(level))
+                break;
+    } else if (!isa_supported(level)) {
+        return -1;
+    }
+    isa_level = level;
+    isa_current = &isa_table[level];
+    return level;
+}
+
+int isa_selected(void) {
+    if (isa_level < 0)
+        isa_select(-1);
+    return isa_level;
+}
+
+void isa_csr_integrate(const float *data, const int32_t *indices, const int32_t *indptr, int32_t nbins,
+                       const float *image, int do_dummy, float dummy,
+                       double *out_data, double *out_count, float *out_merge) {
+    if (isa_level < 0)
+        isa_select(-1);
+    isa_current->csr_integrate(data, indices, indptr, nbins, image, do_dummy, dummy, out_data, out_count, out_merge);
+}
+
+int isa_convolve(const float *img, int height, int width, const float *filter, int size,
+                 int vertical, float *output) {
+    if (isa_level < 0)
+        isa_select(-1);
+    if (vertical)
+        return isa_current->convolve_columns(img, height, width, filter, size, output);
+    return isa_current->convolve_rows(img, height, width, filter, size, output);
+}
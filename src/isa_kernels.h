@@ -0,0 +1,57 @@
+/*
+ *    Project: Fast Azimuthal integration
+ *             https://github.com/pyFAI/pyFAI
+ *
+ *    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+ *
+ *    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hot kernels compiled for several instruction set levels in a single
+ * translation unit, the best one is selected at run time.
+ *
+ * Levels are numbered from the most generic (0) to the most specific one,
+ * only levels built for the current compiler and architecture are available.
+ */
+#ifndef ISA_KERNELS_H
+#define ISA_KERNELS_H
+#include <stdint.h>
+
+#define ISA_GENERIC 0
+#define ISA_AVX2 1
+#define ISA_AVX512 2
+#define ISA_NLEVELS 3
+
+/* name of a level ("generic", "avx2", "avx512") */
+const char *isa_name(int level);
+/* 1 if the level was compiled in this build */
+int isa_compiled(int level);
+/* 1 if the processor (and operating system) support the level */
+int isa_supported(int level);
+/* level used by the dispatched kernels, -1 selects the best supported level */
+int isa_select(int level);
+int isa_selected(void);
+
+/* weighted and unweighted histograms of a CSR matrix-vector product, see csr_common.pxi */
+void isa_csr_integrate(const float *data, const int32_t *indices, const int32_t *indptr, int32_t nbins,
+                       const float *image, int do_dummy, float dummy,
+                       double *out_data, double *out_count, float *out_merge);
+/* 1D convolution of a C-contiguous image along its rows (or its columns if vertical),
+ * "reflect" boundary mode, returns -1 if a work buffer could not be allocated, see _convolution.pyx */
+int isa_convolve(const float *img, int height, int width, const float *filter, int size,
+                 int vertical, float *output);
+#endif
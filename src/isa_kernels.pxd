@@ -0,0 +1,35 @@
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+# 
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+# 
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+from libc.stdint cimport int32_t
+cdef extern from "isa_kernels.h":
+    int ISA_NLEVELS
+    const char *isa_name(int level)
+    int isa_compiled(int level)
+    int isa_supported(int level)
+    int isa_select(int level)
+    int isa_selected()
+    void isa_csr_integrate(const float *data, const int32_t *indices, const int32_t *indptr, int32_t nbins,
+                           const float *image, int do_dummy, float dummy,
+                           double *out_data, double *out_count, float *out_merge) nogil
+    int isa_convolve(const float *img, int height, int width, const float *filter, int size,
+                     int vertical, float *output) nogil
@@ -0,0 +1,101 @@
+/*
+ *    Project: Fast Azimuthal integration
+ *             https://github.com/pyFAI/pyFAI
+ *
+ *    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+ *
+ *    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * CPU affinity of the calling thread, for the NUMA placement of the CSR
+ * matrices. Only available on Linux, elsewhere all functions fail (-1) so
+ * that the caller can fall back explicitly.
+ */
+#ifndef NUMA_AFFINITY_H
+#define NUMA_AFFINITY_H
+
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+
+#define AFFINITY_SETSIZE CPU_SETSIZE
+typedef cpu_set_t affinity_t;
+
+/* copy the affinity of the calling thread into saved */
+static int affinity_save(affinity_t *saved){
+    return sched_getaffinity(0, sizeof(affinity_t), saved);
+}
+
+/* set the affinity of the calling thread back to saved */
+static int affinity_restore(const affinity_t *saved){
+    return sched_setaffinity(0, sizeof(affinity_t), saved);
+}
+
+/* 1 if the cpu is in the set */
+static int affinity_isset(const affinity_t *set, int cpu){
+    if ((cpu < 0) || (cpu >= CPU_SETSIZE))
+        return 0;
+    return CPU_ISSET(cpu, set) != 0;
+}
+
+/* restrict the calling thread to the n CPUs listed */
+static int affinity_pin(const int *cpus, int n){
+    cpu_set_t set;
+    int i;
+    CPU_ZERO(&set);
+    for (i = 0; i < n; i++){
+        if ((cpus[i] >= 0) && (cpus[i] < CPU_SETSIZE))
+            CPU_SET(cpus[i], &set);
+    }
+    if (CPU_COUNT(&set) == 0)
+        return -1;
+    return sched_setaffinity(0, sizeof(cpu_set_t), &set);
+}
+
+#else
+
+#define AFFINITY_SETSIZE 0
+typedef struct {
+    int unused;
+} affinity_t;
+
+static int affinity_save(affinity_t *saved){
+    (void) saved;
+    return -1;
+}
+
+static int affinity_restore(const affinity_t *saved){
+    (void) saved;
+    return -1;
+}
+
+static int affinity_isset(const affinity_t *set, int cpu){
+    (void) set;
+    (void) cpu;
+    return 0;
+}
+
+static int affinity_pin(const int *cpus, int n){
+    (void) cpus;
+    (void) n;
+    return -1;
+}
+
+#endif
+#endif
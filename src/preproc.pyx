@@ -0,0 +1,248 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Preprocessing of the frames: assembly of the mask of invalid pixels from
+the static mask and from the dummy value of the data, in a single pass.
+"""
+__author__ = "Jerome Kieffer"
+__date__ = "18/10/2015"
+__contact__ = "Jerome.kieffer@esrf.fr"
+__license__ = "GPLv3+"
+
+import cython
+cimport numpy
+import numpy
+from cython.parallel import prange
+from libc.math cimport fabs
+
+ctypedef fused data_t:
+    numpy.float32_t
+    numpy.float64_t
+    numpy.int8_t
+    numpy.uint8_t
+    numpy.int16_t
+    numpy.uint16_t
+    numpy.int32_t
+    numpy.uint32_t
+    numpy.int64_t
+
+SUPPORTED = [numpy.dtype(i) for i in (numpy.float32, numpy.float64, numpy.int8, numpy.uint8, numpy.int16,
+                                      numpy.uint16, numpy.int32, numpy.uint32, numpy.int64)]
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef ssize_t _fill_mask(data_t[::1] data, numpy.int8_t[::1] mask, numpy.int8_t[::1] out,
+                        bint do_mask, bint invert, bint do_dummy, double dummy, bint do_delta,
+                        double delta_dummy, bint valid) nogil:
+    """
+    Write the mask of invalid pixels (or of valid pixels if valid) in out
+
+    @return: number of non-zero pixels in the input mask
+    """
+    cdef:
+        ssize_t size = out.shape[0], i, b, n, block = 4096, count = 0
+        int masked
+        numpy.int8_t bad, flip = invert, last = valid
+        numpy.int8_t *pout
+        numpy.int8_t *pmask
+        data_t *pdata
+        float fdummy = <float> dummy, fdelta = <float> delta_dummy
+    if size == 0:
+        return 0
+    # Blocks of pixels: the bookkeeping of prange is paid once per block, not once per pixel.
+    # The block is addressed through private pointers (int8 stores may alias any shared
+    # variable) and the tests are combined without branches, so that the loops are vectorized.
+    for b in prange((size + block - 1) // block, schedule="static"):
+        n = min(block, size - b * block)
+        pout = &out[b * block]
+        if do_mask:
+            pmask = &mask[b * block]
+            masked = 0
+            for i in range(n):
+                bad = (pmask[i] != 0)
+                masked = masked + bad
+                pout[i] = bad ^ flip
+            count += masked
+        else:
+            for i in range(n):
+                pout[i] = 0
+        if do_dummy:
+            pdata = &data[b * block]
+            for i in range(n):
+                # same precision as numpy for float32 data and python scalars
+                if data_t is numpy.float32_t:
+                    if do_delta:
+                        bad = (fabs(pdata[i] - fdummy) <= fdelta)
+                    else:
+                        bad = (pdata[i] == fdummy)
+                else:
+                    if do_delta:
+                        bad = (fabs(<double> pdata[i] - dummy) <= delta_dummy)
+                    else:
+                        bad = (<double> pdata[i] == dummy)
+                pout[i] = pout[i] | bad
+        if last:
+            for i in range(n):
+                pout[i] = pout[i] ^ 1
+    return count
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def _where(numpy.int8_t[::1] valid, ssize_t width):
+    """
+    Indices of the valid pixels of an image of the given width, like
+    numpy.nonzero: per-block counts, prefix sum, then parallel fill.
+
+    @return: row and column indices
+    """
+    cdef:
+        ssize_t size = valid.shape[0], i, b, n, start, block = 4096, nblock, total = 0, c, r, q
+        ssize_t[::1] offset
+        ssize_t[::1] crow, ccol
+        numpy.int8_t *pvalid
+    nblock = (size + block - 1) // block
+    offset = numpy.zeros(nblock + 1, dtype=numpy.intp)
+    for b in prange(nblock, nogil=True, schedule="static"):
+        n = min(block, size - b * block)
+        pvalid = &valid[b * block]
+        c = 0
+        for i in range(n):
+            c = c + pvalid[i]
+        offset[b + 1] = c
+    for b in range(nblock):
+        total += offset[b + 1]
+        offset[b + 1] = total
+    row = numpy.empty(total, dtype=numpy.intp)
+    col = numpy.empty(total, dtype=numpy.intp)
+    crow = row
+    ccol = col
+    for b in prange(nblock, nogil=True, schedule="static"):
+        n = min(block, size - b * block)
+        start = b * block
+        pvalid = &valid[start]
+        c = offset[b]
+        r = start // width
+        q = start - r * width
+        for i in range(n):
+            if pvalid[i]:
+                crow[c] = r
+                ccol[c] = q
+                c = c + 1
+            q = q + 1
+            if q == width:
+                q = 0
+                r = r + 1
+    return row, col
+
+
+def _dispatch(data, numpy.int8_t[::1] mask, numpy.int8_t[::1] out, bint do_mask, bint invert,
+              bint do_dummy, double dummy, bint do_delta, double delta_dummy, bint valid):
+    """
+    Call the specialization of _fill_mask for the type of data
+    """
+    if data.dtype == numpy.float32:
+        return _fill_mask[numpy.float32_t](data, mask, out, do_mask, invert, do_dummy, dummy, do_delta, delta_dummy, valid)
+    elif data.dtype == numpy.float64:
+        return _fill_mask[numpy.float64_t](data, mask, out, do_mask, invert, do_dummy, dummy, do_delta, delta_dummy, valid)
+    elif data.dtype == numpy.int8:
+        return _fill_mask[numpy.int8_t](data, mask, out, do_mask, invert, do_dummy, dummy, do_delta, delta_dummy, valid)
+    elif data.dtype == numpy.uint8:
+        return _fill_mask[numpy.uint8_t](data, mask, out, do_mask, invert, do_dummy, dummy, do_delta, delta_dummy, valid)
+    elif data.dtype == numpy.int16:
+        return _fill_mask[numpy.int16_t](data, mask, out, do_mask, invert, do_dummy, dummy, do_delta, delta_dummy, valid)
+    elif data.dtype == numpy.uint16:
+        return _fill_mask[numpy.uint16_t](data, mask, out, do_mask, invert, do_dummy, dummy, do_delta, delta_dummy, valid)
+    elif data.dtype == numpy.int32:
+        return _fill_mask[numpy.int32_t](data, mask, out, do_mask, invert, do_dummy, dummy, do_delta, delta_dummy, valid)
+    elif data.dtype == numpy.uint32:
+        return _fill_mask[numpy.uint32_t](data, mask, out, do_mask, invert, do_dummy, dummy, do_delta, delta_dummy, valid)
+    else:
+        return _fill_mask[numpy.int64_t](data, mask, out, do_mask, invert, do_dummy, dummy, do_delta, delta_dummy, valid)
+
+
+def create_mask(data not None, mask=None, dummy=None, delta_dummy=None, mode="normal"):
+    """
+    Combine the static mask with the dynamic mask of the dummy pixels
+
+    Any non-zero value of the static mask is masked (this also covers masks
+    with valid=0 and masked<0). If more than half of the pixels are masked,
+    the static mask is considered as inverted.
+
+    @param data: array with the frame
+    @param mask: static mask, of the shape of data, or None
+    @param dummy: value of the dead pixels
+    @param delta_dummy: precision of the dummy value
+    @param mode: "normal" (True for bad pixels), "numpy" (True for valid pixels) or "where" (indices of valid pixels)
+    @return: the mask in the requested mode, True if the static mask was inverted
+    """
+    cdef:
+        ssize_t size
+        bint do_mask = mask is not None, do_dummy = dummy is not None, do_delta = delta_dummy is not None
+        bint valid = (mode != "normal")
+        double cdummy = 0.0, cdelta = 0.0
+        numpy.int8_t[::1] cmask
+        numpy.int8_t[::1] cout
+
+    shape = data.shape
+    data = numpy.ascontiguousarray(data).reshape(-1)
+    if data.dtype == bool:
+        data = data.view(numpy.int8)
+    elif data.dtype not in SUPPORTED:
+        data = data.astype(numpy.float64)
+    # memoryviews need writable buffers: read-only frames are copied, data is never modified
+    if not data.flags.writeable:
+        data = data.copy()
+    size = data.size
+    if do_mask:
+        mask = numpy.ascontiguousarray(mask).reshape(-1)
+        if mask.dtype.itemsize != 1:
+            mask = (mask != 0)
+        elif not mask.flags.writeable:
+            mask = mask.copy()
+        cmask = mask.view(numpy.int8)
+        assert cmask.shape[0] == size
+    else:
+        cmask = numpy.zeros(1, dtype=numpy.int8)
+    if do_dummy:
+        cdummy = float(dummy)
+        if do_delta:
+            cdelta = float(delta_dummy)
+    else:
+        do_delta = False
+    out = numpy.empty(size, dtype=numpy.int8)
+    cout = out
+
+    count = _dispatch(data, cmask, cout, do_mask, False, do_dummy, cdummy, do_delta, cdelta, valid)
+    inverted = do_mask and (count > size // 2)
+    if inverted:
+        # rare: the mask is written again, with the opposite convention
+        _dispatch(data, cmask, cout, do_mask, True, do_dummy, cdummy, do_delta, cdelta, valid)
+
+    if mode == "where":
+        if len(shape) == 2 and size > 0:
+            return _where(cout, shape[1]), inverted
+        return numpy.nonzero(out.view(bool).reshape(shape)), inverted
+    return out.view(bool).reshape(shape), inverted
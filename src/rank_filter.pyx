@@ -0,0 +1,445 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Rank filters (median, minimum, maximum, percentile) on rectangular windows,
+parallel over tiles of rows, with the same results as scipy.ndimage:
+
+* small windows (up to 5x5) are sorted with a network of comparators,
+  pruned to the requested rank, applied to a tile of pixels at once;
+* minimum and maximum are separable;
+* larger windows use a sliding histogram of the (quantized) values.
+"""
+__author__ = "Jerome Kieffer"
+__date__ = "18/10/2015"
+__contact__ = "Jerome.kieffer@esrf.fr"
+__license__ = "GPLv3+"
+
+import cython
+cimport numpy
+import numpy
+from cython.parallel import prange, parallel
+from libc.stdlib cimport malloc, calloc, free
+
+ctypedef fused real_t:
+    numpy.float32_t
+    numpy.float64_t
+
+# boundary modes of scipy.ndimage and their equivalent for numpy.pad
+MODES = {"reflect": "symmetric", "mirror": "reflect", "nearest": "edge", "wrap": "wrap", "constant": "constant"}
+# largest window sorted with a network
+NETWORK_SIZE = 25
+# number of pixels of a row processed at once
+cdef enum:
+    TILE = 256
+# maximum number of levels of the histogram
+MAX_LEVEL = 65536
+
+_networks = {}
+
+
+def sorting_network(n, rank=None):
+    """
+    Batcher's odd-even merge sort, as a list of comparators
+
+    @param n: number of elements
+    @param rank: if given, only the comparators needed to get this rank
+    @return: array of shape (ncomp, 2) with the positions compared, the lower one receives the minimum
+    """
+    key = (n, rank)
+    if key not in _networks:
+        pairs = []
+        p = 1
+        while p < n:
+            k = p
+            while k >= 1:
+                for j in range(k % p, n - k, 2 * k):
+                    for i in range(min(k, n - j - k)):
+                        if (i + j) // (2 * p) == (i + j + k) // (2 * p):
+                            pairs.append((i + j, i + j + k))
+                k //= 2
+            p *= 2
+        if rank is not None:
+            # keep only the comparators the rank depends on
+            needed = set([rank])
+            kept = []
+            for a, b in reversed(pairs):
+                if (a in needed) or (b in needed):
+                    kept.append((a, b))
+                    needed.add(a)
+                    needed.add(b)
+            pairs = kept[::-1]
+        _networks[key] = numpy.array(pairs, dtype=numpy.int32).reshape(-1, 2)
+    return _networks[key]
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef void _network(real_t[:, ::1] padded, real_t[:, ::1] out, ssize_t sy, ssize_t sx,
+                   numpy.int32_t[:, ::1] pairs, ssize_t rank, numpy.int8_t[::1] failed) nogil:
+    """
+    Rank filter with a sorting network: the window of each pixel of a tile
+    is spread over n rows of TILE values, every comparator is then a
+    branch-free min/max over the tile, which vectorizes.
+
+    @param failed: set to 1 for the rows not calculated because a buffer could not be allocated
+    """
+    cdef:
+        ssize_t height = out.shape[0], width = out.shape[1], npair = pairs.shape[0]
+        ssize_t ntile = (width + TILE - 1) // TILE
+        ssize_t t, y, x0, w, i, c, dy, dx
+        real_t a, b, lo, hi
+        real_t *buf
+        real_t *pa
+        real_t *pb
+        real_t *line
+        real_t *dst
+    with parallel():
+        # one buffer per thread, re-used for all its tiles
+        buf = <real_t *> malloc(sy * sx * TILE * sizeof(real_t))
+        for t in prange(height * ntile, schedule="static"):
+            y = t // ntile
+            if buf == NULL:
+                failed[y] = 1
+                continue
+            x0 = (t % ntile) * TILE
+            w = min(TILE, width - x0)
+            for dy in range(sy):
+                for dx in range(sx):
+                    line = &padded[y + dy, x0 + dx]
+                    pa = buf + (dy * sx + dx) * TILE
+                    for i in range(w):
+                        pa[i] = line[i]
+            for c in range(npair):
+                pa = buf + pairs[c, 0] * TILE
+                pb = buf + pairs[c, 1] * TILE
+                for i in range(w):
+                    # both selections before the stores, or the loop is not vectorized
+                    a = pa[i]
+                    b = pb[i]
+                    lo = a if a < b else b
+                    hi = b if b > a else a
+                    pa[i] = lo
+                    pb[i] = hi
+            dst = &out[y, x0]
+            pa = buf + rank * TILE
+            for i in range(w):
+                dst[i] = pa[i]
+        free(buf)
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef void _extremum(real_t[:, ::1] padded, real_t[:, ::1] out, ssize_t sy, ssize_t sx,
+                    bint maximum, numpy.int8_t[::1] failed) nogil:
+    """
+    Minimum or maximum filter, separable: over the rows of the window, then
+    over its columns
+
+    @param failed: set to 1 for the rows not calculated because a buffer could not be allocated
+    """
+    cdef:
+        ssize_t height = out.shape[0], width = out.shape[1]
+        ssize_t ntile = (width + TILE - 1) // TILE
+        ssize_t t, y, x0, w, i, dy, dx
+        real_t v, a
+        real_t *buf
+        real_t *line
+        real_t *dst
+    with parallel():
+        buf = <real_t *> malloc((TILE + sx) * sizeof(real_t))
+        for t in prange(height * ntile, schedule="static"):
+            y = t // ntile
+            if buf == NULL:
+                failed[y] = 1
+                continue
+            x0 = (t % ntile) * TILE
+            w = min(TILE, width - x0)
+            line = &padded[y, x0]
+            for i in range(w + sx - 1):
+                buf[i] = line[i]
+            for dy in range(1, sy):
+                line = &padded[y + dy, x0]
+                if maximum:
+                    for i in range(w + sx - 1):
+                        a = line[i]
+                        buf[i] = a if a > buf[i] else buf[i]
+                else:
+                    for i in range(w + sx - 1):
+                        a = line[i]
+                        buf[i] = a if a < buf[i] else buf[i]
+            dst = &out[y, x0]
+            for i in range(w):
+                v = buf[i]
+                for dx in range(1, sx):
+                    a = buf[i + dx]
+                    if maximum:
+                        v = a if a > v else v
+                    else:
+                        v = a if a < v else v
+                dst[i] = v
+        free(buf)
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+cdef void _histogram(real_t[:, ::1] padded, numpy.uint16_t[:, ::1] level, real_t[:, ::1] out,
+                    ssize_t sy, ssize_t sx, ssize_t rank, ssize_t nlev, int shift,
+                    numpy.int8_t[::1] pure, real_t[::1] value, numpy.int8_t[::1] failed) nogil:
+    """
+    Rank filter with a histogram of the levels of the window, updated by
+    one column when sliding along a row (the cost per pixel grows like the
+    height of the window, not like its area). The level holding the rank
+    is found with a coarse histogram (2**shift levels per coarse bin); if
+    several values share this level, they are sorted.
+
+    The histograms are empty again at the end of each row: each thread
+    allocates them once for all its blocks of rows.
+
+    @param failed: set to 1 for the rows not calculated because a buffer could not be allocated
+    """
+    cdef:
+        ssize_t height = out.shape[0], width = out.shape[1], n = sy * sx
+        ssize_t block = 16, nblock = (height + block - 1) // block
+        ssize_t ncoarse = (nlev >> shift) + 1
+        ssize_t b, y, x, dy, dx, cum, l, c, k, m, j
+        numpy.int32_t *hist
+        numpy.int32_t *coarse
+        real_t *gather
+        real_t v
+    with parallel():
+        hist = <numpy.int32_t *> calloc(nlev, sizeof(numpy.int32_t))
+        coarse = <numpy.int32_t *> calloc(ncoarse, sizeof(numpy.int32_t))
+        gather = <real_t *> malloc(n * sizeof(real_t))
+        for b in prange(nblock, schedule="dynamic"):
+            if (hist == NULL) or (coarse == NULL) or (gather == NULL):
+                for y in range(b * block, min(height, (b + 1) * block)):
+                    failed[y] = 1
+                continue
+            for y in range(b * block, min(height, (b + 1) * block)):
+                for dy in range(sy):
+                    for dx in range(sx):
+                        l = level[y + dy, dx]
+                        hist[l] = hist[l] + 1
+                        coarse[l >> shift] = coarse[l >> shift] + 1
+                for x in range(width):
+                    cum = 0
+                    c = 0
+                    while cum + coarse[c] <= rank:
+                        cum = cum + coarse[c]
+                        c = c + 1
+                    l = c << shift
+                    while cum + hist[l] <= rank:
+                        cum = cum + hist[l]
+                        l = l + 1
+                    if pure[l]:
+                        out[y, x] = value[l]
+                    else:
+                        # values of the level, k-th of them by insertion sort
+                        k = rank - cum
+                        m = 0
+                        for dy in range(sy):
+                            for dx in range(sx):
+                                if level[y + dy, x + dx] == l:
+                                    v = padded[y + dy, x + dx]
+                                    j = m
+                                    while (j > 0) and (gather[j - 1] > v):
+                                        gather[j] = gather[j - 1]
+                                        j = j - 1
+                                    gather[j] = v
+                                    m = m + 1
+                        out[y, x] = gather[k]
+                    # slide the window by one column, or empty it at the end of the row
+                    for dy in range(sy):
+                        l = level[y + dy, x]
+                        hist[l] = hist[l] - 1
+                        coarse[l >> shift] = coarse[l >> shift] - 1
+                        if x + 1 < width:
+                            l = level[y + dy, x + sx]
+                            hist[l] = hist[l] + 1
+                            coarse[l >> shift] = coarse[l >> shift] + 1
+                for dy in range(sy):
+                    for dx in range(width, width + sx - 1):
+                        l = level[y + dy, dx]
+                        hist[l] = hist[l] - 1
+                        coarse[l >> shift] = coarse[l >> shift] - 1
+        free(gather)
+        free(coarse)
+        free(hist)
+
+
+def _levels(padded):
+    """
+    Quantize the values on at most MAX_LEVEL levels, in increasing order
+
+    @return: level of each pixel, number of levels, pure (1 for levels with a single value), value of each pure level
+    """
+    uniq = numpy.unique(padded)
+    nuniq = uniq.size
+    nlev = min(nuniq, MAX_LEVEL)
+    ulev = (numpy.arange(nuniq, dtype=numpy.int64) * nlev) // nuniq
+    pure = (numpy.bincount(ulev, minlength=nlev) == 1).astype(numpy.int8)
+    value = uniq[numpy.searchsorted(ulev, numpy.arange(nlev))]
+    level = ulev[numpy.searchsorted(uniq, padded)].astype(numpy.uint16)
+    return level, nlev, pure, value
+
+
+def _size(size):
+    """
+    @return: 2-tuple with the size of the window
+    """
+    if numpy.isscalar(size):
+        size = (size, size)
+    sy, sx = (int(i) for i in size)
+    if sy < 1 or sx < 1:
+        raise ValueError("Invalid size of the window: %s" % (size,))
+    return sy, sx
+
+
+def rank_filter(data not None, ssize_t rank, size=3, mode="reflect", cval=0.0):
+    """
+    Rank filter on a rectangular window, like scipy.ndimage.rank_filter
+
+    @param data: 2D array
+    @param rank: rank of the value kept in the sorted window, negative values count from the end
+    @param size: size of the window, int or 2-tuple
+    @param mode: "reflect", "mirror", "nearest", "wrap" or "constant", as in scipy.ndimage
+    @param cval: value outside of the image for mode "constant"
+    @return: filtered array, of the type of data
+    """
+    cdef:
+        ssize_t sy, sx, n
+        int shift
+
+    sy, sx = _size(size)
+    n = sy * sx
+    if rank < 0:
+        rank += n
+    if not (0 <= rank < n):
+        raise ValueError("rank not within the size of the window")
+    if mode not in MODES:
+        raise ValueError("Unsupported mode: %s" % mode)
+    data = numpy.asarray(data)
+    assert data.ndim == 2
+    dtype = data.dtype
+    img = numpy.ascontiguousarray(data, dtype=numpy.float32 if dtype == numpy.float32 else numpy.float64)
+    pad = ((sy // 2, sy - sy // 2 - 1), (sx // 2, sx - sx // 2 - 1))
+    if mode == "constant":
+        padded = numpy.pad(img, pad, mode="constant", constant_values=cval)
+    else:
+        padded = numpy.pad(img, pad, mode=MODES[mode])
+    padded = numpy.ascontiguousarray(padded)
+    out = numpy.empty_like(img)
+    if img.size == 0:
+        return out.astype(dtype)
+    failed = numpy.zeros(img.shape[0], dtype=numpy.int8)
+
+    if (rank == 0) or (rank == n - 1):
+        if img.dtype == numpy.float32:
+            _extremum[numpy.float32_t](padded, out, sy, sx, rank > 0, failed)
+        else:
+            _extremum[numpy.float64_t](padded, out, sy, sx, rank > 0, failed)
+    elif n <= NETWORK_SIZE:
+        pairs = sorting_network(n, rank)
+        if img.dtype == numpy.float32:
+            _network[numpy.float32_t](padded, out, sy, sx, pairs, rank, failed)
+        else:
+            _network[numpy.float64_t](padded, out, sy, sx, pairs, rank, failed)
+    else:
+        level, nlev, pure, value = _levels(padded)
+        shift = 0
+        while (1 << (2 * shift)) < nlev:
+            shift += 1
+        if img.dtype == numpy.float32:
+            _histogram[numpy.float32_t](padded, level, out, sy, sx, rank, nlev, shift, pure, value, failed)
+        else:
+            _histogram[numpy.float64_t](padded, level, out, sy, sx, rank, nlev, shift, pure, value, failed)
+    if failed.any():
+        raise MemoryError("Unable to allocate the work buffers of the rank filter (%s rows failed)" % failed.sum())
+    if out.dtype != dtype:
+        out = out.astype(dtype)
+    return out
+
+
+def median_filter(data not None, size=3, mode="reflect", cval=0.0):
+    """
+    Median filter, like scipy.ndimage.median_filter
+
+    @param data: 2D array
+    @param size: size of the window, int or 2-tuple
+    @param mode: boundary mode, as in scipy.ndimage
+    @param cval: value outside of the image for mode "constant"
+    @return: filtered array
+    """
+    sy, sx = _size(size)
+    return rank_filter(data, (sy * sx) // 2, (sy, sx), mode, cval)
+
+
+def minimum_filter(data not None, size=3, mode="reflect", cval=0.0):
+    """
+    Minimum filter, like scipy.ndimage.minimum_filter
+
+    @param data: 2D array
+    @param size: size of the window, int or 2-tuple
+    @param mode: boundary mode, as in scipy.ndimage
+    @param cval: value outside of the image for mode "constant"
+    @return: filtered array
+    """
+    return rank_filter(data, 0, size, mode, cval)
+
+
+def maximum_filter(data not None, size=3, mode="reflect", cval=0.0):
+    """
+    Maximum filter, like scipy.ndimage.maximum_filter
+
+    @param data: 2D array
+    @param size: size of the window, int or 2-tuple
+    @param mode: boundary mode, as in scipy.ndimage
+    @param cval: value outside of the image for mode "constant"
+    @return: filtered array
+    """
+    return rank_filter(data, -1, size, mode, cval)
+
+
+def percentile_filter(data not None, percentile, size=3, mode="reflect", cval=0.0):
+    """
+    Percentile filter, like scipy.ndimage.percentile_filter
+
+    @param data: 2D array
+    @param percentile: percentile of the window to keep, negative values count from the end
+    @param size: size of the window, int or 2-tuple
+    @param mode: boundary mode, as in scipy.ndimage
+    @param cval: value outside of the image for mode "constant"
+    @return: filtered array
+    """
+    sy, sx = _size(size)
+    n = sy * sx
+    if percentile < 0.0:
+        percentile += 100.0
+    if not (0 <= percentile <= 100):
+        raise ValueError("Invalid percentile: %s" % percentile)
+    rank = int(float(n) * percentile / 100.0)
+    if rank == n:
+        rank = n - 1
+    return rank_filter(data, rank, (sy, sx), mode, cval)
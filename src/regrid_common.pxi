@@ -56,3 +56,26 @@ cdef inline floating  get_bin_number(floating x0, floating pos0_min, floating de
     @return: bin number as floating point.
     """
     return (x0 - pos0_min) / delta
+
+
+@cython.boundscheck(False)
+cdef inline int get_bin_index(double x0, double *edges, int bins) nogil:
+    """
+    calculate the bin number for any point with arbitrary (non uniform)
+    increasing bin edges, using a branch-free binary search
+
+    @param x0: current position
+    @param edges: pointer to the bins+1 edges, in increasing order
+    @param bins: number of bins
+    @return: bin number, -1 below the first edge and bins above the last one
+    """
+    cdef int base = 0, size = bins + 1, half
+    if x0 < edges[0]:
+        return -1
+    if x0 >= edges[bins]:
+        return bins
+    while size > 1:
+        half = size >> 1
+        base = base + half * (edges[base + half] <= x0)
+        size = size - half
+    return base
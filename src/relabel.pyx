@@ -23,7 +23,11 @@
 #
 
 __doc__ = """
-A module to relabel regions 
+A module to label and relabel regions
+
+label_components labels the connected components of a mask, in parallel
+over stripes of rows (union-find), and collects the statistics of each
+component in the same pass.
 """
 __author__ = "Jerome Kieffer"
 __contact__ = "Jerome.kieffer@esrf.fr"
@@ -33,6 +37,17 @@ __license__ = "GPLv3+"
 import cython
 import numpy
 cimport numpy
+from cython.parallel import prange
+from libc.stdlib cimport malloc, free, qsort
+from libc.math cimport INFINITY
+
+
+cdef struct stat_t:
+    numpy.int64_t count
+    numpy.int64_t argmax
+    double sum, sum_row, sum_col
+    float maximum, delta, max_blured
+    numpy.int32_t row_min, col_min, row_max, col_max
 
 
 @cython.boundscheck(False)
@@ -78,4 +93,432 @@ def countThem(numpy.ndarray label not None, \
     return count, maxData, maxBlured, maxDelta
 
 
+cdef inline numpy.int32_t _find(numpy.int32_t *parent, numpy.int32_t p) nogil:
+    "Root of p in the union-find forest, with path halving"
+    while parent[p] != p:
+        parent[p] = parent[parent[p]]
+        p = parent[p]
+    return p
+
+
+cdef inline void _union(numpy.int32_t *parent, numpy.int32_t a, numpy.int32_t b) nogil:
+    "Merge the trees of a and b, the root is the smallest index (first run in raster order)"
+    a = _find(parent, a)
+    b = _find(parent, b)
+    if a < b:
+        parent[b] = a
+    elif b < a:
+        parent[a] = b
+
+
+cdef inline numpy.int32_t _label(const numpy.int32_t *parent, numpy.int32_t p) nogil:
+    "Label of the tree of p, once the roots are numbered (parent of a root is -label)"
+    while parent[p] >= 0:
+        p = parent[p]
+    return -parent[p]
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef inline numpy.int32_t _runs(const numpy.int8_t *mask, ssize_t width, numpy.int32_t *start,
+                                numpy.int32_t *end) nogil:
+    """
+    Runs of consecutive pixels of a row in the mask
+
+    @return: number of runs, from start[i] to end[i] (excluded)
+    """
+    cdef:
+        ssize_t c = 0
+        numpy.int32_t n = 0
+    while c < width:
+        if mask[c]:
+            start[n] = c
+            c = c + 1
+            while (c < width) and mask[c]:
+                c = c + 1
+            end[n] = c
+            n = n + 1
+        else:
+            c = c + 1
+    return n
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef inline void _sweep(numpy.int32_t *parent, numpy.int32_t cur, numpy.int32_t ncur,
+                        numpy.int32_t prev, numpy.int32_t nprev, const numpy.int32_t *start,
+                        const numpy.int32_t *end, numpy.int32_t e, bint new) nogil:
+    """
+    Merge the runs of a row (ids cur to cur + ncur) with the overlapping runs
+    of the previous row (ids prev to prev + nprev); runs touching by a corner
+    overlap if e == 1 (8-connectivity). If new, the runs of the row are not
+    in the forest yet.
+    """
+    cdef numpy.int32_t i, j = prev, jj
+    for i in range(cur, cur + ncur):
+        if new:
+            parent[i] = i
+        while (j < prev + nprev) and (end[j] + e <= start[i]):
+            j = j + 1
+        jj = j
+        while (jj < prev + nprev) and (start[jj] < end[i] + e):
+            if new and parent[i] == i:
+                parent[i] = _find(parent, jj)
+            else:
+                _union(parent, i, jj)
+            jj = jj + 1
+
+
+cdef int _compare(const void *a, const void *b) nogil:
+    return (<numpy.int32_t *> a)[0] - (<numpy.int32_t *> b)[0]
+
+
+cdef inline ssize_t _search(const numpy.int32_t *sorted, ssize_t n, numpy.int32_t value) nogil:
+    "Position of value in the sorted array (value is present)"
+    cdef ssize_t lo = 0, hi = n - 1, mid
+    while lo < hi:
+        mid = (lo + hi) // 2
+        if sorted[mid] < value:
+            lo = mid + 1
+        else:
+            hi = mid
+    return lo
+
+
+cdef inline void _clear(stat_t *s) nogil:
+    s.count = 0
+    s.argmax = -1
+    s.sum = s.sum_row = s.sum_col = 0.0
+    s.maximum = s.max_blured = -INFINITY
+    s.delta = 0.0
+    s.row_min = s.col_min = 2147483647
+    s.row_max = s.col_max = -1
+
+
+cdef inline void _merge(stat_t *s, const stat_t *o) nogil:
+    "Add the statistics o of a later part of the component to s"
+    if o.count == 0:
+        return
+    s.count = s.count + o.count
+    s.sum = s.sum + o.sum
+    s.sum_row = s.sum_row + o.sum_row
+    s.sum_col = s.sum_col + o.sum_col
+    if o.maximum > s.maximum:
+        s.maximum = o.maximum
+        s.delta = o.delta
+        s.argmax = o.argmax
+    if o.max_blured > s.max_blured:
+        s.max_blured = o.max_blured
+    if o.row_min < s.row_min:
+        s.row_min = o.row_min
+    if o.col_min < s.col_min:
+        s.col_min = o.col_min
+    if o.row_max > s.row_max:
+        s.row_max = o.row_max
+    if o.col_max > s.col_max:
+        s.col_max = o.col_max
+
+
+cdef inline void _segment(stat_t *s, numpy.int32_t *labels, numpy.int32_t l, const float *data,
+                          const float *blured, ssize_t r, ssize_t width, ssize_t c0, ssize_t c1) nogil:
+    """
+    Write the label l of the pixels of row r from column c0 to c1 (excluded)
+    and add them to the statistics s. Missing data count as 1, missing
+    blurred data as 0.
+    """
+    cdef:
+        ssize_t p, first = r * width + c0, last = r * width + c1, pmax = -1
+        double sd = 0.0, sdc = 0.0
+        float d = 1.0, b = 0.0, dmax = -INFINITY, bmax = -INFINITY, delta = 0.0
+    for p in range(first, last):
+        labels[p] = l
+        if data != NULL:
+            d = data[p]
+        if blured != NULL:
+            b = blured[p]
+        sd = sd + d
+        sdc = sdc + d * (p - first)
+        if d > dmax:
+            dmax = d
+            delta = d - b
+            pmax = p
+        if b > bmax:
+            bmax = b
+    s.count = s.count + (c1 - c0)
+    s.sum = s.sum + sd
+    s.sum_row = s.sum_row + sd * r
+    s.sum_col = s.sum_col + sdc + sd * c0
+    if dmax > s.maximum:
+        s.maximum = dmax
+        s.delta = delta
+        s.argmax = pmax
+    if bmax > s.max_blured:
+        s.max_blured = bmax
+    if r < s.row_min:
+        s.row_min = r
+    if c0 < s.col_min:
+        s.col_min = c0
+    if r > s.row_max:
+        s.row_max = r
+    if c1 - 1 > s.col_max:
+        s.col_max = c1 - 1
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+def label_components(mask not None, data=None, blured=None, int connectivity=8):
+    """
+    Label the connected components of a mask, like scipy.ndimage.label
+    (same numbering, in raster order of the first pixel of each component),
+    and calculate the statistics of each component in the same pass.
+
+    The rows are cut in runs of pixels; the image is cut in stripes of rows,
+    whose runs are labelled in parallel with union-find; the trees are
+    merged across the borders of the stripes, then the roots are numbered
+    and the labels and statistics are written, in parallel.
+
+    @param mask: 2D array, non-zero for the pixels to label
+    @param data: 2D array with the intensity, weights of the centroid (1 if None)
+    @param blured: 2D array with the blurred intensity (background)
+    @param connectivity: 4 or 8
+    @return: label array (int32, 0 for the background), number of components,
+             dict of statistics per label (index 0 is the background):
+             "count", "sum", "max" (of data), "argmax" (flat index of the first maximum),
+             "delta" (data - blured at the maximum), "max_blured", "centroid" (row, col)
+             and "bbox" (row_min, col_min, row_max, col_max).
+             "max", "delta" and "max_blured" are the ones of countThem: the maxima
+             are at least 0 and delta is 0 if no pixel of data is positive;
+             "argmax" is the position of the maximum of data, even if it is negative.
+    """
+    cdef:
+        ssize_t height, width, size, nstripe, srows, cap, k, r, c, r0, r1, j, nf, lo, base
+        numpy.int32_t i, root, l, nlabel, start, e
+        numpy.int8_t[::1] cmask
+        float[::1] cdata, cblured
+        numpy.int32_t[::1] cparent, cstart, cend, cnrun, clist, clabels
+        numpy.int32_t[::1] croots, cnumber, coffset, cnforeign
+        numpy.int32_t *parent
+        numpy.int32_t *rstart
+        numpy.int32_t *rend
+        numpy.int32_t *nrun
+        numpy.int32_t *roots
+        numpy.int32_t *labels
+        numpy.int32_t *flabel
+        const numpy.int8_t *pmask
+        bint do_data = data is not None, do_blured = blured is not None
+        const float *pdata = NULL
+        const float *pblured = NULL
+        ssize_t c0, c1
+        stat_t *stats
+        stat_t *foreign
+        stat_t *s
+
+    assert connectivity in (4, 8)
+    e = 1 if connectivity == 8 else 0
+    mask = numpy.ascontiguousarray(mask)
+    assert mask.ndim == 2
+    height, width = mask.shape
+    size = height * width
+    if mask.dtype.itemsize != 1:
+        mask = (mask != 0)
+    cmask = mask.reshape(-1).view(numpy.int8)
+    if do_data:
+        cdata = numpy.ascontiguousarray(data, dtype=numpy.float32).reshape(-1)
+        assert cdata.shape[0] == size
+        if size > 0:
+            pdata = &cdata[0]
+    if do_blured:
+        cblured = numpy.ascontiguousarray(blured, dtype=numpy.float32).reshape(-1)
+        assert cblured.shape[0] == size
+        if size > 0:
+            pblured = &cblured[0]
+
+    # runs of row r have the ids r * cap to r * cap + nrun[r]: ids follow the raster order
+    cap = (width + 1) // 2
+    assert height * cap < 2 ** 31
+    # at most 64 stripes, of at least 16 rows
+    srows = max(16, (height + 63) // 64)
+    nstripe = max(1, (height + srows - 1) // srows)
+    labels_array = numpy.empty((height, width), dtype=numpy.int32)
+    if size == 0:
+        cmask = numpy.zeros(1, dtype=numpy.int8)
+    clabels = labels_array.reshape(-1) if size > 0 else numpy.zeros(1, dtype=numpy.int32)
+    cparent = numpy.empty(max(height * cap, 1), dtype=numpy.int32)
+    cstart = numpy.empty(max(height * cap, 1), dtype=numpy.int32)
+    cend = numpy.empty(max(height * cap, 1), dtype=numpy.int32)
+    clist = numpy.empty(max(height * cap, 1), dtype=numpy.int32)
+    cnrun = numpy.zeros(max(height, 1), dtype=numpy.int32)
+    croots = numpy.zeros(nstripe, dtype=numpy.int32)
+    cnumber = numpy.zeros(nstripe, dtype=numpy.int32)
+    coffset = numpy.zeros(nstripe + 1, dtype=numpy.int32)
+    cnforeign = numpy.zeros(nstripe, dtype=numpy.int32)
+    parent = &cparent[0]
+    rstart = &cstart[0]
+    rend = &cend[0]
+    nrun = &cnrun[0]
+    roots = &clist[0]
+    labels = &clabels[0]
+    pmask = &cmask[0]
+
+    # 1st pass: runs of each row, union-find of the runs within each stripe,
+    # then every run points to the root of its tree in the stripe, and these roots are listed
+    for k in prange(nstripe, nogil=True, schedule="dynamic"):
+        r0 = k * srows
+        r1 = min(height, r0 + srows)
+        for r in range(r0, r1):
+            nrun[r] = _runs(pmask + r * width, width, rstart + r * cap, rend + r * cap)
+            if r > r0:
+                _sweep(parent, r * cap, nrun[r], (r - 1) * cap, nrun[r - 1], rstart, rend, e, True)
+            else:
+                for i in range(r * cap, r * cap + nrun[r]):
+                    parent[i] = i
+        j = 0
+        for r in range(r0, r1):
+            for i in range(r * cap, r * cap + nrun[r]):
+                root = parent[parent[i]]
+                parent[i] = root
+                if root == i:
+                    roots[r0 * cap + j] = i
+                    j = j + 1
+        croots[k] = j
+    # merge the trees across the borders of the stripes
+    with nogil:
+        for k in range(1, nstripe):
+            r = k * srows
+            _sweep(parent, r * cap, nrun[r], (r - 1) * cap, nrun[r - 1], rstart, rend, e, False)
+
+    # number the roots left after the merge, in raster order: parent of a root becomes -label
+    for k in prange(nstripe, nogil=True, schedule="dynamic"):
+        j = 0
+        for lo in range(croots[k]):
+            i = roots[k * srows * cap + lo]
+            if parent[i] == i:
+                j = j + 1
+        cnumber[k] = j
+    coffset[0] = 1
+    for k in range(nstripe):
+        coffset[k + 1] = coffset[k] + cnumber[k]
+    nlabel = coffset[nstripe] - 1
+    for k in prange(nstripe, nogil=True, schedule="dynamic"):
+        l = coffset[k]
+        for lo in range(croots[k]):
+            i = roots[k * srows * cap + lo]
+            if parent[i] == i:
+                parent[i] = -l
+                l = l + 1
+
+    # labels and statistics: the labels rooted in the stripe are written in place,
+    # the others (rooted in an earlier stripe, so present in the first row) and
+    # the background are collected per stripe, then merged
+    stats = <stat_t *> malloc((nlabel + 1) * sizeof(stat_t))
+    foreign = <stat_t *> malloc(nstripe * (cap + 1) * sizeof(stat_t))
+    flabel = <numpy.int32_t *> malloc(nstripe * (cap + 1) * sizeof(numpy.int32_t))
+    try:
+        if (stats == NULL) or (foreign == NULL) or (flabel == NULL):
+            raise MemoryError("Unable to allocate the statistics of %s labels" % nlabel)
+        for k in prange(nstripe, nogil=True, schedule="dynamic"):
+            r0 = k * srows
+            r1 = min(height, r0 + srows)
+            start = coffset[k]
+            base = k * (cap + 1)
+            for l in range(start, coffset[k + 1]):
+                _clear(&stats[l])
+            # foreign labels, sorted, with the background first
+            flabel[base] = 0
+            nf = 1
+            if r0 < r1:
+                for i in range(r0 * cap, r0 * cap + nrun[r0]):
+                    l = _label(parent, i)
+                    if l < start:
+                        flabel[base + nf] = l
+                        nf = nf + 1
+            qsort(&flabel[base], nf, sizeof(numpy.int32_t), _compare)
+            j = 1
+            for lo in range(1, nf):
+                if flabel[base + lo] != flabel[base + j - 1]:
+                    flabel[base + j] = flabel[base + lo]
+                    j = j + 1
+            nf = j
+            cnforeign[k] = nf
+            for j in range(nf):
+                _clear(&foreign[base + j])
+
+            for r in range(r0, r1):
+                # background (label 0) before each run, then the run, then the background until the end of the row
+                c = 0
+                for j in range(nrun[r]):
+                    c0 = rstart[r * cap + j]
+                    c1 = rend[r * cap + j]
+                    if c0 > c:
+                        _segment(&foreign[base], labels, 0, pdata, pblured, r, width, c, c0)
+                    l = _label(parent, r * cap + j)
+                    if l >= start:
+                        s = &stats[l]
+                    else:
+                        s = &foreign[base + _search(&flabel[base], nf, l)]
+                    _segment(s, labels, l, pdata, pblured, r, width, c0, c1)
+                    c = c1
+                if width > c:
+                    _segment(&foreign[base], labels, 0, pdata, pblured, r, width, c, width)
+
+        # merge the parts collected by the stripes, in order
+        with nogil:
+            _clear(&stats[0])
+            for k in range(nstripe):
+                for j in range(cnforeign[k]):
+                    _merge(&stats[flabel[k * (cap + 1) + j]], &foreign[k * (cap + 1) + j])
+
+        result = {}
+        for key, dtype in (("count", numpy.int64), ("argmax", numpy.int64), ("sum", numpy.float64),
+                           ("max", numpy.float32), ("delta", numpy.float32), ("max_blured", numpy.float32)):
+            result[key] = numpy.empty(nlabel + 1, dtype=dtype)
+        result["centroid"] = numpy.empty((nlabel + 1, 2), dtype=numpy.float64)
+        result["bbox"] = numpy.empty((nlabel + 1, 4), dtype=numpy.int32)
+        _export(stats, nlabel + 1, result)
+    finally:
+        free(stats)
+        free(foreign)
+        free(flabel)
+    if not do_blured:
+        result.pop("delta")
+        result.pop("max_blured")
+    return labels_array, nlabel, result
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+cdef void _export(stat_t *stats, ssize_t n, dict result):
+    """
+    Copy the statistics in the arrays of result
+    """
+    cdef:
+        ssize_t i
+        numpy.int64_t[::1] count = result["count"], argmax = result["argmax"]
+        double[::1] total = result["sum"]
+        float[::1] maximum = result["max"], delta = result["delta"], max_blured = result["max_blured"]
+        double[:, ::1] centroid = result["centroid"]
+        numpy.int32_t[:, ::1] bbox = result["bbox"]
+    for i in range(n):
+        count[i] = stats[i].count
+        argmax[i] = stats[i].argmax
+        total[i] = stats[i].sum
+        # same conventions as countThem, whose maxima start at 0
+        if stats[i].maximum > 0:
+            maximum[i] = stats[i].maximum
+            delta[i] = stats[i].delta
+        else:
+            maximum[i] = 0.0
+            delta[i] = 0.0
+        max_blured[i] = stats[i].max_blured if stats[i].max_blured > 0 else 0.0
+        if stats[i].sum != 0:
+            centroid[i, 0] = stats[i].sum_row / stats[i].sum
+            centroid[i, 1] = stats[i].sum_col / stats[i].sum
+        else:
+            centroid[i, 0] = centroid[i, 1] = numpy.nan
+        bbox[i, 0] = stats[i].row_min
+        bbox[i, 1] = stats[i].col_min
+        bbox[i, 2] = stats[i].row_max
+        bbox[i, 3] = stats[i].col_max
 
@@ -0,0 +1,206 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Index of the pixels of an image by ring: the pixels falling in the window
+of each ring of a calibrant are grouped with a counting sort, and the
+statistics of the intensity are collected on the way.
+"""
+__author__ = "Jerome Kieffer"
+__date__ = "17/10/2015"
+__contact__ = "Jerome.kieffer@esrf.fr"
+__license__ = "GPLv3+"
+
+import cython
+cimport numpy
+import numpy
+from cython.parallel import prange
+
+
+class RingIndex(object):
+    """
+    Pixels of an image grouped by ring window, in CSR-like form: the pixels
+    of ring i are indices[indptr[i]:indptr[i + 1]] (flat indices, in
+    increasing order).
+
+    A pixel belongs to ring i if tth_min[i] <= tth < tth_max[i], the
+    windows must not overlap. Masked pixels belong to no ring.
+    """
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def __init__(self, tth, tth_min, tth_max, data=None, mask=None):
+        """
+        @param tth: array with the position of each pixel (like 2theta)
+        @param tth_min: lower bound of the window of each ring
+        @param tth_max: upper bound of the window of each ring
+        @param data: image, to calculate the mean and the standard deviation per ring
+        @param mask: array with non-zero for masked pixels
+        """
+        cdef:
+            double[::1] cpos = numpy.ascontiguousarray(tth, dtype=numpy.float64).ravel()
+            double[::1] edges
+            float[::1] cdata
+            numpy.int8_t[::1] cmask
+            numpy.int32_t[::1] bucket, cindices
+            numpy.int32_t[:, ::1] bcount
+            double[:, ::1] bsum, bsum2
+            numpy.int64_t[::1] cindptr
+            ssize_t size = cpos.shape[0], nring, nedge, nblock, block = 4096
+            ssize_t i, b, n, start, lo, hi, mid, r, pos, total
+            double x, v
+            bint do_data = data is not None, do_mask = mask is not None
+
+        tth_min = numpy.ascontiguousarray(tth_min, dtype=numpy.float64).ravel()
+        tth_max = numpy.ascontiguousarray(tth_max, dtype=numpy.float64).ravel()
+        nring = tth_min.size
+        assert tth_max.size == nring
+        # interleaved bounds: a pixel is in a window when an odd number of bounds are below it
+        edges = numpy.empty(2 * nring, dtype=numpy.float64)
+        for r in range(nring):
+            edges[2 * r] = tth_min[r]
+            edges[2 * r + 1] = tth_max[r]
+        nedge = 2 * nring
+        for r in range(1, nedge):
+            if edges[r] < edges[r - 1]:
+                raise ValueError("Windows of the rings overlap or are not sorted")
+        if do_data:
+            cdata = numpy.ascontiguousarray(data, dtype=numpy.float32).ravel()
+            assert cdata.shape[0] == size
+        if do_mask:
+            cmask = numpy.ascontiguousarray(mask).ravel().astype(bool).view(numpy.int8)
+            assert cmask.shape[0] == size
+
+        nblock = (size + block - 1) // block
+        bucket = numpy.empty(size, dtype=numpy.int32)
+        bcount = numpy.zeros((nblock, max(nring, 1)), dtype=numpy.int32)
+        bsum = numpy.zeros((nblock, max(nring, 1)), dtype=numpy.float64)
+        bsum2 = numpy.zeros((nblock, max(nring, 1)), dtype=numpy.float64)
+        # 1st pass: ring of each pixel, population and statistics of each (block, ring)
+        for b in prange(nblock, nogil=True, schedule="static"):
+            start = b * block
+            n = min(block, size - start)
+            for i in range(start, start + n):
+                x = cpos[i]
+                r = -1
+                if (not (do_mask and cmask[i])) and (nedge > 0) and (x >= edges[0]) and (x < edges[nedge - 1]):
+                    # number of bounds <= x
+                    lo = 0
+                    hi = nedge
+                    while lo < hi:
+                        mid = (lo + hi) // 2
+                        if edges[mid] <= x:
+                            lo = mid + 1
+                        else:
+                            hi = mid
+                    if lo % 2 == 1:
+                        r = lo // 2
+                        bcount[b, r] = bcount[b, r] + 1
+                        if do_data:
+                            v = cdata[i]
+                            bsum[b, r] = bsum[b, r] + v
+                            bsum2[b, r] = bsum2[b, r] + v * v
+                bucket[i] = r
+
+        # offsets of each (ring, block), so that pixels stay in increasing order within a ring
+        count = numpy.asarray(bcount).sum(axis=0, dtype=numpy.int64)[:nring]
+        indptr = numpy.zeros(nring + 1, dtype=numpy.int64)
+        numpy.cumsum(count, out=indptr[1:])
+        populations = numpy.asarray(bcount).T.ravel()  # ring-major
+        offset = numpy.zeros(populations.size, dtype=numpy.int64)
+        numpy.cumsum(populations[:-1], out=offset[1:])
+        cindptr = numpy.ascontiguousarray(offset.reshape(-1, nblock).T).ravel()
+        total = int(indptr[nring])
+        indices = numpy.empty(total, dtype=numpy.int32)
+        cindices = indices
+
+        # 2nd pass: scatter the pixels in their ring
+        for b in prange(nblock, nogil=True, schedule="static"):
+            start = b * block
+            n = min(block, size - start)
+            for i in range(start, start + n):
+                r = bucket[i]
+                if r >= 0:
+                    pos = cindptr[b * nring + r]
+                    cindices[pos] = i
+                    cindptr[b * nring + r] = pos + 1
+
+        self.nring = nring
+        self.shape = numpy.shape(tth)
+        self.indptr = indptr
+        self.indices = indices
+        self.count = count
+        self.mean = None
+        self.std = None
+        if do_data:
+            with numpy.errstate(invalid="ignore", divide="ignore"):
+                total_sum = numpy.asarray(bsum).sum(axis=0)[:nring]
+                total_sum2 = numpy.asarray(bsum2).sum(axis=0)[:nring]
+                self.mean = total_sum / count
+                self.std = numpy.sqrt(numpy.maximum(total_sum2 / count - self.mean ** 2, 0))
+
+    def __len__(self):
+        return self.nring
+
+    def __getitem__(self, ring):
+        """
+        @return: flat indices of the pixels of the ring
+        """
+        return self.indices[self.indptr[ring]:self.indptr[ring + 1]]
+
+    def mask(self, ring, out=None):
+        """
+        @param out: boolean array of the shape of the image, to be re-used
+        @return: boolean image with True for the pixels of the ring
+        """
+        if out is None:
+            out = numpy.zeros(self.shape, dtype=bool)
+        out.ravel()[self[ring]] = True
+        return out
+
+
+def contour_pixels(pixels, tth, value, shape):
+    """
+    Pixels of a ring closest to its iso-contour: where 2theta crosses the
+    value between a pixel and its right or lower neighbour, the pixel of the
+    pair closer to the value. Equivalent to rounding the points of the
+    marching squares, without going over the whole image.
+
+    @param pixels: flat indices of the pixels of the ring window
+    @param tth: flat array with 2theta of each pixel
+    @param value: 2theta of the ring
+    @param shape: shape of the image
+    @return: sorted flat indices of the pixels along the contour
+    """
+    height, width = shape
+    rows, cols = numpy.unravel_index(pixels, shape)
+    here = tth[pixels] - value
+    seeds = []
+    for step, valid in ((1, cols < width - 1), (width, rows < height - 1)):
+        first = pixels[valid]
+        second = first + step
+        d1 = here[valid]
+        d2 = tth[second] - value
+        crossing = (d1 * d2 <= 0)
+        first, second, d1, d2 = first[crossing], second[crossing], d1[crossing], d2[crossing]
+        seeds.append(numpy.where(abs(d1) <= abs(d2), first, second))
+    return numpy.unique(numpy.concatenate(seeds))
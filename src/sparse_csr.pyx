@@ -24,7 +24,8 @@
 #
 
 __doc__ = """
-Convertion between sparse matrix representations
+Convertion between sparse matrix representations and transformations of
+the CSR matrices (data, indices, indptr) used by the integrators.
 """
 __author__ = "Jerome Kieffer"
 __contact__ = "Jerome.kieffer@esrf.fr"
@@ -36,6 +37,32 @@ __license__ = "GPLv3+"
 import cython
 cimport numpy
 import numpy
+import threading
+try:
+    import queue
+except ImportError:
+    import Queue as queue
+import os
+import time
+import logging
+from cython.parallel import prange
+from openmp cimport omp_get_max_threads, omp_get_thread_num
+include "regrid_common.pxi"
+include "csr_common.pxi"
+try:
+    from fastcrc import crc32
+except:
+    from zlib import crc32
+logger = logging.getLogger("pyFAI.sparse_csr")
+
+cdef extern from "numa_affinity.h" nogil:
+    ctypedef struct affinity_t:
+        pass
+    int AFFINITY_SETSIZE
+    int affinity_save(affinity_t *saved)
+    int affinity_restore(affinity_t *saved)
+    int affinity_isset(affinity_t *set, int cpu)
+    int affinity_pin(int *cpus, int n)
 
 
 def LUT_to_CSR(lut):
@@ -62,4 +89,1951 @@ def LUT_to_CSR(lut):
                 indices[nelt] = idx[i, j]
                 nelt += 1
     indptr[nrow] = nelt
-    return data[:nelt], indices[:nelt], indptr
\ No newline at end of file
+    return data[:nelt], indices[:nelt], indptr
+
+def _normalize_roi(roi, shape):
+    """
+    Convert a region of interest into a 2-tuple of slices with unit step
+    within the image
+
+    @param roi: 2-tuple of slices (rows, columns) or 4-tuple (row_min, row_max, column_min, column_max), upper bounds excluded
+    @param shape: shape of the image
+    @return: 2-tuple of slices
+    """
+    if len(roi) == 4:
+        roi = (slice(roi[0], roi[1]), slice(roi[2], roi[3]))
+    res = []
+    for sl, size in zip(roi, shape):
+        start, stop, step = sl.indices(size)
+        if step != 1:
+            raise ValueError("Region of interest must have a unit step")
+        res.append(slice(start, max(start, stop)))
+    return tuple(res)
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def extract_roi(data, indices, indptr, shape, roi, rows=None):
+    """
+    Extract the sub-matrix corresponding to a rectangular region of interest
+    of the detector, without recalculating any geometry.
+
+    Columns of the new matrix are the (C-order) flat index of the pixel
+    within the region of interest.
+
+    @param data: coefficients of the CSR matrix
+    @param indices: column (i.e. pixel) index of each coefficient
+    @param indptr: row pointer of the CSR matrix
+    @param shape: shape of the image
+    @param roi: region of interest: 2-tuple of slices (rows, columns) or 4-tuple (row_min, row_max, column_min, column_max)
+    @param rows: slice of rows of the matrix (i.e. bins) to keep, all by default
+    @return: data, indices, indptr of the sub-matrix
+    """
+    cdef:
+        numpy.int32_t i, j, k, idx, r, c, nrow, width, roi_width
+        numpy.int32_t row_min, row_max, col_min, col_max, first_row
+        float[:] cdata = numpy.ascontiguousarray(data, dtype=numpy.float32)
+        numpy.int32_t[:] cindices = numpy.ascontiguousarray(indices, dtype=numpy.int32)
+        numpy.int32_t[:] cindptr = numpy.ascontiguousarray(indptr, dtype=numpy.int32)
+        numpy.ndarray[numpy.int32_t, ndim = 1] new_indptr
+        numpy.int32_t[:] count
+        float[:] new_data
+        numpy.int32_t[:] new_indices
+
+    roi = _normalize_roi(roi, shape)
+    width = shape[1]
+    row_min, row_max = roi[0].start, roi[0].stop
+    col_min, col_max = roi[1].start, roi[1].stop
+    roi_width = col_max - col_min
+    if rows is None:
+        rows = slice(0, cindptr.shape[0] - 1)
+    first_row, last_row, _ = rows.indices(cindptr.shape[0] - 1)
+    nrow = max(last_row - first_row, 0)
+    count = numpy.zeros(nrow, dtype=numpy.int32)
+
+    for i in prange(nrow, nogil=True, schedule="guided"):
+        k = 0
+        for j in range(cindptr[first_row + i], cindptr[first_row + i + 1]):
+            idx = cindices[j]
+            r = idx // width
+            c = idx - r * width
+            if (r >= row_min) and (r < row_max) and (c >= col_min) and (c < col_max):
+                k = k + 1
+        count[i] = k
+
+    new_indptr = numpy.zeros(nrow + 1, dtype=numpy.int32)
+    new_indptr[1:] = numpy.cumsum(count, dtype=numpy.int32)
+    new_data = numpy.empty(new_indptr[nrow], dtype=numpy.float32)
+    new_indices = numpy.empty(new_indptr[nrow], dtype=numpy.int32)
+
+    for i in prange(nrow, nogil=True, schedule="guided"):
+        k = new_indptr[i]
+        for j in range(cindptr[first_row + i], cindptr[first_row + i + 1]):
+            idx = cindices[j]
+            r = idx // width
+            c = idx - r * width
+            if (r >= row_min) and (r < row_max) and (c >= col_min) and (c < col_max):
+                new_data[k] = cdata[j]
+                new_indices[k] = (r - row_min) * roi_width + (c - col_min)
+                k = k + 1
+    return numpy.asarray(new_data), numpy.asarray(new_indices), new_indptr
+
+
+class CsrRoiIntegrator(CsrIntegratorMixin):
+    """
+    1D integrator restricted to a rectangular region of interest of the
+    detector, built by extracting a sub-matrix from the CSR matrix of an
+    existing integrator (see extract_roi).
+
+    Images (and correction arrays) can be provided either for the full
+    detector or for the region of interest only: full frames are sliced
+    without copy and only the pixels of the region are read.
+    """
+    def __init__(self, integrator, shape, roi, rows=None):
+        """
+        @param integrator: any CSR integrator with data, indices, indptr, outPos, unit and empty attributes
+        @param shape: shape of the full image
+        @param roi: region of interest: 2-tuple of slices (rows, columns) or 4-tuple (row_min, row_max, column_min, column_max)
+        @param rows: slice of rows of the matrix (i.e. bins) to keep, all by default
+        """
+        self.full_shape = tuple(shape)
+        self.roi = _normalize_roi(roi, shape)
+        self.shape = tuple(sl.stop - sl.start for sl in self.roi)
+        self.size = self.shape[0] * self.shape[1]
+        if rows is None:
+            rows = slice(0, integrator.indptr.size - 1)
+        self.rows = rows
+        self.data, self.indices, self.indptr = extract_roi(integrator.data, integrator.indices, integrator.indptr,
+                                                           shape, self.roi, rows)
+        self.nnz = self.indptr[-1]
+        self.outPos = numpy.ascontiguousarray(integrator.outPos[rows])
+        self.bins = self.outPos.size
+        self.unit = integrator.unit
+        self.empty = integrator.empty
+        self.parent_checksum = integrator.lut_checksum
+        self.lut = (self.data, self.indices, self.indptr)
+        self.lut_checksum = crc32(self.data)
+
+    def crop(self, array):
+        """
+        Return a view on the region of interest of a full frame, or the
+        array itself if it already has the shape of the region of interest.
+
+        @param array: full frame or region of interest
+        @return: 2D view with the shape of the region of interest
+        """
+        if array is None:
+            return None
+        if array.shape == self.full_shape:
+            return array[self.roi]
+        assert array.size == self.size
+        return array.reshape(self.shape)
+
+    def preprocess(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None):
+        """
+        Crop all arrays to the region of interest before the preprocessing,
+        see CsrIntegratorMixin.preprocess
+        """
+        return CsrIntegratorMixin.preprocess(self, self.crop(weights), dummy=dummy, delta_dummy=delta_dummy,
+                                             dark=self.crop(dark), flat=self.crop(flat),
+                                             solidAngle=self.crop(solidAngle), polarization=self.crop(polarization))
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def integrate(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None):
+        """
+        Integrate the region of interest: pixels are read directly from the
+        (possibly strided) view of the region and corrected on the fly.
+
+        @param weights: input image, full frame or region of interest
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @return: positions, pattern, weighted_histogram and unweighted_histogram
+        @rtype: 4-tuple of ndarrays
+        """
+        cdef:
+            numpy.int32_t i, j, idx, r, c, nbins = self.indptr.size - 1, width = self.shape[1]
+            numpy.int32_t[:] indices = self.indices, indptr = self.indptr
+            float[:] ccoef = self.data
+            float[:, :] cdata, cdark, cflat, csolidAngle, cpolarization
+            double sum_data, sum_count, epsilon = 1e-10
+            float data, coef, cdummy = 0, cddummy = 0
+            bint do_dummy = False, do_dark = False, do_flat = False, do_polarization = False, do_solidAngle = False
+            numpy.ndarray[numpy.float64_t, ndim = 1] outData = numpy.zeros(nbins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float64_t, ndim = 1] outCount = numpy.zeros(nbins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float32_t, ndim = 1] outMerge = numpy.zeros(nbins, dtype=numpy.float32)
+
+        # Only the region of interest is converted, if needed
+        cdata = numpy.asarray(self.crop(weights), dtype=numpy.float32)
+        if dummy is not None:
+            do_dummy = True
+            cdummy = <float> float(dummy)
+            if delta_dummy is not None:
+                cddummy = <float> float(delta_dummy)
+        else:
+            cdummy = <float> float(self.empty)
+        if dark is not None:
+            do_dark = True
+            cdark = numpy.asarray(self.crop(dark), dtype=numpy.float32)
+        if flat is not None:
+            do_flat = True
+            cflat = numpy.asarray(self.crop(flat), dtype=numpy.float32)
+        if solidAngle is not None:
+            do_solidAngle = True
+            csolidAngle = numpy.asarray(self.crop(solidAngle), dtype=numpy.float32)
+        if polarization is not None:
+            do_polarization = True
+            cpolarization = numpy.asarray(self.crop(polarization), dtype=numpy.float32)
+
+        for i in prange(nbins, nogil=True, schedule="guided"):
+            sum_data = 0.0
+            sum_count = 0.0
+            for j in range(indptr[i], indptr[i + 1]):
+                coef = ccoef[j]
+                if coef == 0.0:
+                    continue
+                idx = indices[j]
+                r = idx // width
+                c = idx - r * width
+                data = cdata[r, c]
+                if do_dummy and (((cddummy != 0) and (fabs(data - cdummy) <= cddummy)) or ((cddummy == 0) and (data == cdummy))):
+                    continue
+                if do_dark:
+                    data = data - cdark[r, c]
+                if do_flat:
+                    data = data / cflat[r, c]
+                if do_polarization:
+                    data = data / cpolarization[r, c]
+                if do_solidAngle:
+                    data = data / csolidAngle[r, c]
+                sum_data = sum_data + coef * data
+                sum_count = sum_count + coef
+            outData[i] = sum_data
+            outCount[i] = sum_count
+            if sum_count > epsilon:
+                outMerge[i] = sum_data / sum_count
+            else:
+                outMerge[i] = cdummy
+        return self.outPos, outMerge, outData, outCount
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def transpose_csr(data, indices, indptr, size):
+    """
+    Transpose a CSR matrix (bin-major) into the pixel-major representation:
+    for each pixel, the list of bins it contributes to and the coefficients.
+
+    @param data: coefficients of the CSR matrix
+    @param indices: column (i.e. pixel) index of each coefficient
+    @param indptr: row pointer of the CSR matrix
+    @param size: number of pixels of the image
+    @return: data, indices (i.e. bins), indptr of the transposed matrix
+    """
+    cdef:
+        numpy.int32_t i, j, pixel, nrow = indptr.size - 1, npix = size
+        float[:] cdata = numpy.ascontiguousarray(data, dtype=numpy.float32)
+        numpy.int32_t[:] cindices = numpy.ascontiguousarray(indices, dtype=numpy.int32)
+        numpy.int32_t[:] cindptr = numpy.ascontiguousarray(indptr, dtype=numpy.int32)
+        numpy.ndarray[numpy.int32_t, ndim = 1] tindptr = numpy.zeros(npix + 1, dtype=numpy.int32)
+        numpy.int32_t[:] position
+        float[:] tdata = numpy.empty(cdata.shape[0], dtype=numpy.float32)
+        numpy.int32_t[:] tindices = numpy.empty(cdata.shape[0], dtype=numpy.int32)
+
+    # counting sort on the pixel index, stable so bins remain ordered
+    tindptr[1:] = numpy.cumsum(numpy.bincount(indices, minlength=npix)[:npix], dtype=numpy.int32)
+    position = tindptr[:-1].copy()
+    with nogil:
+        for i in range(nrow):
+            for j in range(cindptr[i], cindptr[i + 1]):
+                pixel = cindices[j]
+                tdata[position[pixel]] = cdata[j]
+                tindices[position[pixel]] = i
+                position[pixel] += 1
+    return numpy.asarray(tdata), numpy.asarray(tindices), tindptr
+
+
+@cython.cdivision(True)
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def compact_frame(frame, threshold=None, max_density=None):
+    """
+    Convert a dense frame into its sparse form (index, value) in parallel.
+
+    Each thread counts the pixels to keep in its chunks, then writes them at
+    the offset given by the cumulative sum, so the output is ordered.
+
+    @param frame: dense image
+    @param threshold: only values strictly above are kept. If None, all non-zero values are kept
+    @param max_density: if the fraction of kept pixels exceeds this value, the frame is not compacted and None is returned
+    @return: indices (flat pixel index) and values (float32) of kept pixels, or None
+    """
+    cdef:
+        float[:] cdata = numpy.ascontiguousarray(frame, dtype=numpy.float32).ravel()
+        numpy.int32_t size = cdata.shape[0], chunk = 8192, nchunk, i, j, k, start, stop
+        bint do_threshold = threshold is not None
+        float value, cthreshold = threshold if threshold is not None else 0.0
+        numpy.int32_t[:] count, offset, out_indices
+        float[:] out_values
+
+    nchunk = (size + chunk - 1) // chunk
+    count = numpy.zeros(nchunk, dtype=numpy.int32)
+    for i in prange(nchunk, nogil=True, schedule="static"):
+        start = i * chunk
+        stop = min(start + chunk, size)
+        k = 0
+        for j in range(start, stop):
+            value = cdata[j]
+            if (do_threshold and value > cthreshold) or ((not do_threshold) and value != 0.0):
+                k = k + 1
+        count[i] = k
+
+    offset = numpy.concatenate(([0], numpy.cumsum(count))).astype(numpy.int32)
+    if (max_density is not None) and (offset[nchunk] > max_density * size):
+        return None
+    out_indices = numpy.empty(offset[nchunk], dtype=numpy.int32)
+    out_values = numpy.empty(offset[nchunk], dtype=numpy.float32)
+    for i in prange(nchunk, nogil=True, schedule="static"):
+        start = i * chunk
+        stop = min(start + chunk, size)
+        k = offset[i]
+        for j in range(start, stop):
+            value = cdata[j]
+            if (do_threshold and value > cthreshold) or ((not do_threshold) and value != 0.0):
+                out_indices[k] = j
+                out_values[k] = value
+                k = k + 1
+    return numpy.asarray(out_indices), numpy.asarray(out_values)
+
+
+class SparseFrameIntegrator(object):
+    """
+    1D integrator for sparse frames (i.e. mostly zeros, like low-flux frames
+    from photon counting detectors) using the transposed, pixel-major,
+    CSR matrix of an existing integrator: only non-zero pixels are scattered
+    into the bins.
+
+    Zero pixels contribute nothing to the signal but still to the
+    normalization, which is the coverage of each bin (sum of the
+    coefficients), precomputed once.
+    """
+    max_density = 0.1
+
+    def __init__(self, integrator, max_density=None):
+        """
+        @param integrator: any CSR integrator with data, indices, indptr, size, outPos, unit and empty attributes
+        @param max_density: above this fraction of non-zero pixels, frames are integrated with the dense integrator
+        """
+        self.integrator = integrator
+        self.size = integrator.size
+        self.bins = integrator.indptr.size - 1
+        self.outPos = integrator.outPos
+        self.unit = integrator.unit
+        self.empty = integrator.empty
+        if max_density is not None:
+            self.max_density = max_density
+        self.parent_checksum = integrator.lut_checksum
+        self.data, self.indices, self.indptr = transpose_csr(integrator.data, integrator.indices,
+                                                             integrator.indptr, self.size)
+        rows = numpy.repeat(numpy.arange(self.bins), numpy.diff(integrator.indptr))
+        self.coverage = numpy.bincount(rows, weights=integrator.data, minlength=self.bins)
+        self.density = None
+        self.lut = (self.data, self.indices, self.indptr)
+        self.lut_checksum = crc32(self.data)
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def integrate_sparse(self, indices, values, flat=None, solidAngle=None, polarization=None):
+        """
+        Integrate a frame given in sparse form
+
+        @param indices: flat index of non-zero pixels
+        @param values: value of non-zero pixels
+        @param flat: array with the flat-field value to be divided by (if any), full frame
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any), full frame
+        @param polarization: array with the polarization correction values to be divided by (if any), full frame
+        @return: positions, pattern, weighted_histogram and unweighted_histogram
+        @rtype: 4-tuple of ndarrays
+        """
+        cdef:
+            numpy.int32_t i, j, pixel, thread, bins = self.bins, size = self.size
+            numpy.int32_t nthread = omp_get_max_threads()
+            numpy.int32_t[:] cindices = numpy.ascontiguousarray(indices, dtype=numpy.int32).ravel()
+            float[:] cvalues = numpy.ascontiguousarray(values, dtype=numpy.float32).ravel()
+            numpy.int32_t[:] tindices = self.indices, tindptr = self.indptr
+            float[:] tcoef = self.data, cflat, csolidAngle, cpolarization
+            double[:] coverage = self.coverage
+            double[:, :] big_data = numpy.zeros((nthread, bins), dtype=numpy.float64)
+            double sum_data, epsilon = 1e-10
+            float value, cdummy = self.empty
+            bint do_flat = False, do_polarization = False, do_solidAngle = False
+            numpy.ndarray[numpy.float64_t, ndim = 1] outData = numpy.zeros(bins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float32_t, ndim = 1] outMerge = numpy.zeros(bins, dtype=numpy.float32)
+        assert cindices.shape[0] == cvalues.shape[0]
+
+        if flat is not None:
+            do_flat = True
+            assert flat.size == size
+            cflat = numpy.ascontiguousarray(flat.ravel(), dtype=numpy.float32)
+        if solidAngle is not None:
+            do_solidAngle = True
+            assert solidAngle.size == size
+            csolidAngle = numpy.ascontiguousarray(solidAngle.ravel(), dtype=numpy.float32)
+        if polarization is not None:
+            do_polarization = True
+            assert polarization.size == size
+            cpolarization = numpy.ascontiguousarray(polarization.ravel(), dtype=numpy.float32)
+
+        with nogil:
+            for i in prange(cindices.shape[0], schedule="guided"):
+                pixel = cindices[i]
+                if (pixel < 0) or (pixel >= size):
+                    continue
+                value = cvalues[i]
+                if do_flat:
+                    value = value / cflat[pixel]
+                if do_polarization:
+                    value = value / cpolarization[pixel]
+                if do_solidAngle:
+                    value = value / csolidAngle[pixel]
+                thread = omp_get_thread_num()
+                for j in range(tindptr[pixel], tindptr[pixel + 1]):
+                    big_data[thread, tindices[j]] += tcoef[j] * value
+
+            for i in prange(bins, schedule="static"):
+                sum_data = 0.0
+                for thread in range(nthread):
+                    sum_data = sum_data + big_data[thread, i]
+                outData[i] = sum_data
+                if coverage[i] > epsilon:
+                    outMerge[i] = sum_data / coverage[i]
+                else:
+                    outMerge[i] = cdummy
+        return self.outPos, outMerge, outData, numpy.array(self.coverage)
+
+    def integrate(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None,
+                  polarization=None, threshold=None):
+        """
+        Integrate a dense frame, choosing between the sparse and the dense
+        path from the measured density of non-zero pixels.
+
+        Dark-current subtraction and dynamic masking make all pixels
+        relevant: the dense integrator is then used.
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @param threshold: if set, pixels below or at this value are discarded and the sparse path is used (without dark nor dummy)
+        @return: positions, pattern, weighted_histogram and unweighted_histogram
+        @rtype: 4-tuple of ndarrays
+        """
+        assert weights.size == self.size
+        sparse = None
+        if (dummy is None) and (dark is None):
+            sparse = compact_frame(weights, threshold, None if threshold is not None else self.max_density)
+        if sparse is None:
+            self.density = None
+            return self.integrator.integrate(weights, dummy=dummy, delta_dummy=delta_dummy, dark=dark, flat=flat,
+                                             solidAngle=solidAngle, polarization=polarization)
+        self.density = sparse[0].size / float(self.size)
+        return self.integrate_sparse(sparse[0], sparse[1], flat=flat, solidAngle=solidAngle,
+                                     polarization=polarization)
+
+
+class StreamingIntegrator(object):
+    """
+    1D integrator fed with bands of rows of the image, in any order, as they
+    are read out from the detector: the full frame is never assembled.
+
+    Each band is scattered into partial per-bin sums using the rows of the
+    transposed (pixel-major) CSR matrix of an existing integrator, without
+    holding the GIL, so integration overlaps with the readout.
+    Bands may be provided from several threads: each concurrent add_band()
+    works on its own set of per-thread accumulators, kept from one band and
+    one frame to the next, which are only reduced by finalize().
+
+    Usage: set_corrections() once, then start() for each frame, add_band()
+    for each band and finalize() once complete.
+    """
+    def __init__(self, integrator, shape, pos0_scale=1.0):
+        """
+        @param integrator: any CSR integrator with data, indices, indptr, size, outPos, unit and empty attributes
+        @param shape: shape of the full image
+        @param pos0_scale: scale factor applied to the output positions
+        """
+        self.integrator = integrator
+        self.shape = tuple(shape)
+        self.size = self.shape[0] * self.shape[1]
+        assert self.size == integrator.size
+        self.bins = integrator.indptr.size - 1
+        self.outPos = integrator.outPos * pos0_scale
+        self.unit = integrator.unit
+        self.empty = integrator.empty
+        self.parent_checksum = integrator.lut_checksum
+        self.data, self.indices, self.indptr = transpose_csr(integrator.data, integrator.indices,
+                                                             integrator.indptr, self.size)
+        self._sem = threading.Semaphore()
+        self._received = numpy.zeros(self.shape[0], dtype=bool)
+        self._pending = 0  # number of bands being scattered
+        self._accumulators = []  # all (sum, count) pairs of shape (nthread, bins)
+        self._free = []  # accumulators not used by a running add_band
+        self.dummy = self.delta_dummy = None
+        self.dark = self.flat = self.solidAngle = self.polarization = None
+
+    def set_corrections(self, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None):
+        """
+        Define the corrections applied to all following frames: all arrays
+        refer to the full frame
+
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        """
+        def flatten(array):
+            if array is None:
+                return None
+            assert array.size == self.size
+            return numpy.ascontiguousarray(array.ravel(), dtype=numpy.float32)
+        with self._sem:
+            self.dummy = dummy
+            self.delta_dummy = delta_dummy
+            self.dark = flatten(dark)
+            self.flat = flatten(flat)
+            self.solidAngle = flatten(solidAngle)
+            self.polarization = flatten(polarization)
+
+    def start(self):
+        """
+        Start a new frame
+        """
+        with self._sem:
+            if self._pending:
+                raise RuntimeError("%s bands of the former frame are still being integrated" % self._pending)
+            self._received[:] = False
+            for big_data, big_count in self._accumulators:
+                big_data[:] = 0.0
+                big_count[:] = 0.0
+
+    @property
+    def complete(self):
+        """True when all rows of the frame have been received and integrated"""
+        with self._sem:
+            return bool(self._received.all()) and (self._pending == 0)
+
+    def _acquire(self, start, nrow):
+        """
+        Register the band as received and reserve a set of accumulators
+
+        @param start: index of the first row of the band
+        @param nrow: number of rows of the band
+        @return: accumulated weighted and unweighted histograms, one row per thread
+        """
+        with self._sem:
+            if self._received[start:start + nrow].any():
+                raise RuntimeError("Rows %s-%s have already been received" % (start, start + nrow))
+            self._received[start:start + nrow] = True
+            self._pending += 1
+            if self._free:
+                return self._free.pop()
+        nthread = omp_get_max_threads()
+        accumulator = (numpy.zeros((nthread, self.bins), dtype=numpy.float64),
+                       numpy.zeros((nthread, self.bins), dtype=numpy.float64))
+        with self._sem:
+            self._accumulators.append(accumulator)
+        return accumulator
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def add_band(self, band, start):
+        """
+        Integrate a band of rows of the current frame
+
+        @param band: 2D array with the rows [start, start + band.shape[0]) of the frame
+        @param start: index of the first row of the band in the frame
+        @return: True if the frame is complete
+        """
+        cdef:
+            numpy.int32_t i, j, r, c, pixel, bin, thread, nrow, npix, first
+            numpy.int32_t width = self.shape[1], nthread
+            float[:, :] cdata
+            numpy.int32_t[:] tindices = self.indices, tindptr = self.indptr
+            float[:] tcoef = self.data, cdark, cflat, csolidAngle, cpolarization
+            double[:, :] big_data, big_count
+            float value, coef, cdummy = 0, cddummy = 0
+            bint do_dummy = False, do_dark = False, do_flat = False, do_polarization = False, do_solidAngle = False
+
+        assert band.ndim == 2 and band.shape[1] == width
+        nrow = band.shape[0]
+        assert 0 <= start and start + nrow <= self.shape[0]
+        first = start * width
+        npix = nrow * width
+        # rows are read in place, even from a strided view
+        band = numpy.asarray(band, dtype=numpy.float32)
+        # memoryviews need writable buffers: read-only bands are copied, data is never modified
+        if not band.flags.writeable:
+            band = band.copy()
+        cdata = band
+        if self.dummy is not None:
+            do_dummy = True
+            cdummy = <float> float(self.dummy)
+            if self.delta_dummy is not None:
+                cddummy = <float> float(self.delta_dummy)
+        if self.dark is not None:
+            do_dark = True
+            cdark = self.dark
+        if self.flat is not None:
+            do_flat = True
+            cflat = self.flat
+        if self.solidAngle is not None:
+            do_solidAngle = True
+            csolidAngle = self.solidAngle
+        if self.polarization is not None:
+            do_polarization = True
+            cpolarization = self.polarization
+
+        accumulator = self._acquire(start, nrow)
+        big_data, big_count = accumulator
+        nthread = big_data.shape[0]
+        try:
+            with nogil:
+                for i in prange(npix, schedule="guided", num_threads=nthread):
+                    r = i // width
+                    c = i - r * width
+                    value = cdata[r, c]
+                    if do_dummy and (((cddummy != 0) and (fabs(value - cdummy) <= cddummy)) or ((cddummy == 0) and (value == cdummy))):
+                        continue
+                    pixel = first + i
+                    if do_dark:
+                        value = value - cdark[pixel]
+                    if do_flat:
+                        value = value / cflat[pixel]
+                    if do_polarization:
+                        value = value / cpolarization[pixel]
+                    if do_solidAngle:
+                        value = value / csolidAngle[pixel]
+                    thread = omp_get_thread_num()
+                    for j in range(tindptr[pixel], tindptr[pixel + 1]):
+                        coef = tcoef[j]
+                        bin = tindices[j]
+                        big_data[thread, bin] += coef * value
+                        big_count[thread, bin] += coef
+        finally:
+            with self._sem:
+                self._free.append(accumulator)
+                self._pending -= 1
+        with self._sem:
+            return bool(self._received.all()) and (self._pending == 0)
+
+    def finalize(self):
+        """
+        Finalize the integration of the current frame
+
+        @return: positions, pattern, weighted_histogram and unweighted_histogram
+        @rtype: 4-tuple of ndarrays
+        """
+        with self._sem:
+            if not self._received.all():
+                raise RuntimeError("Frame is incomplete: %s rows missing" % (self._received.size - self._received.sum()))
+            if self._pending:
+                raise RuntimeError("Frame is incomplete: %s bands are still being integrated" % self._pending)
+            sum_data = numpy.zeros(self.bins, dtype=numpy.float64)
+            sum_count = numpy.zeros(self.bins, dtype=numpy.float64)
+            for big_data, big_count in self._accumulators:
+                sum_data += big_data.sum(axis=0)
+                sum_count += big_count.sum(axis=0)
+        merged = numpy.zeros(self.bins, dtype=numpy.float32)
+        valid = sum_count > 1e-10
+        merged[valid] = sum_data[valid] / sum_count[valid]
+        if self.dummy is not None:
+            merged[~valid] = self.dummy
+        else:
+            merged[~valid] = self.empty
+        return self.outPos, merged, sum_data, sum_count
+
+
+def rows_sorted(indices, indptr):
+    """
+    Check that the column indices are strictly increasing within each row
+
+    @param indices: column index of each coefficient
+    @param indptr: row pointer of the CSR matrix
+    @return: True if all rows are sorted
+    """
+    indices = numpy.asarray(indices)
+    if indices.size < 2:
+        return True
+    increasing = numpy.diff(indices) > 0
+    # the last element of a row is not compared with the first of the next one
+    boundaries = numpy.asarray(indptr[1:-1]) - 1
+    increasing[boundaries[(boundaries >= 0) & (boundaries < increasing.size)]] = True
+    return bool(increasing.all())
+
+
+def sort_rows(data, indices, indptr):
+    """
+    Sort the coefficients of each row by column index
+
+    @param data: coefficients of the CSR matrix
+    @param indices: column index of each coefficient
+    @param indptr: row pointer of the CSR matrix
+    @return: data, indices, indptr with sorted rows
+    """
+    rows = numpy.repeat(numpy.arange(indptr.size - 1, dtype=numpy.int32), numpy.diff(indptr))
+    order = numpy.lexsort((indices, rows))
+    return numpy.ascontiguousarray(data[order]), numpy.ascontiguousarray(indices[order]), indptr
+
+
+cdef int merge_rows(float *data, numpy.int32_t *indices, numpy.int32_t *indptr, int first, int nrow,
+                    float *weights, int *cursor, float *out_data, numpy.int32_t *out_indices) nogil:
+    """
+    Weighted k-way merge of the sorted rows first ... first+nrow-1 of a CSR
+    matrix: coefficients of the same column are summed.
+
+    @param cursor: buffer of at least nrow integers
+    @param out_data, out_indices: output buffers, if NULL elements are only counted
+    @return: number of elements of the merged row
+    """
+    cdef:
+        int m, n = 0
+        numpy.int32_t best, pixel
+        float value
+    for m in range(nrow):
+        cursor[m] = indptr[first + m]
+    while True:
+        best = -1
+        for m in range(nrow):
+            if cursor[m] < indptr[first + m + 1]:
+                pixel = indices[cursor[m]]
+                if (best < 0) or (pixel < best):
+                    best = pixel
+        if best < 0:
+            break
+        value = 0.0
+        for m in range(nrow):
+            if (cursor[m] < indptr[first + m + 1]) and (indices[cursor[m]] == best):
+                value = value + weights[m] * data[cursor[m]]
+                cursor[m] = cursor[m] + 1
+        if value != 0.0:
+            if out_data != NULL:
+                out_data[n] = value
+                out_indices[n] = best
+            n = n + 1
+    return n
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def rebin_csr(data, indices, indptr, edges, new_edges):
+    """
+    Derive the CSR matrix of a new binning from the one of a fine binning,
+    without any geometry calculation.
+
+    Each new bin is the weighted sum of the fine bins it overlaps, the weight
+    being the overlapping fraction of the fine bin: coefficients of the fine
+    bins crossing a new edge are split proportionally.
+    Rows of the fine matrix have to be sorted (see sort_rows).
+
+    @param data: coefficients of the fine CSR matrix
+    @param indices: column (i.e. pixel) index of each coefficient
+    @param indptr: row pointer of the fine CSR matrix
+    @param edges: edges of the fine bins (size: number of rows + 1)
+    @param new_edges: edges of the new bins, increasing
+    @return: data, indices, indptr of the new matrix
+    """
+    cdef:
+        numpy.int32_t k, nbins, nfine, max_row
+        int *cursor
+        float[:] cdata, cweights, new_data
+        numpy.int32_t[:] cindices, cindptr, cfirst, cnrow, cwptr, count, new_indices
+        numpy.int32_t[:] new_indptr
+
+    edges = numpy.ascontiguousarray(edges, dtype=numpy.float64)
+    new_edges = numpy.ascontiguousarray(new_edges, dtype=numpy.float64)
+    nfine = indptr.size - 1
+    nbins = new_edges.size - 1
+    assert edges.size == nfine + 1
+
+    # fine rows overlapping each new bin and their weights
+    first = numpy.clip(numpy.searchsorted(edges, new_edges[:-1], "right") - 1, 0, nfine)
+    last = numpy.clip(numpy.searchsorted(edges, new_edges[1:], "left"), 0, nfine)
+    nrow = numpy.maximum(last - first, 0).astype(numpy.int32)
+    wptr = numpy.concatenate(([0], numpy.cumsum(nrow))).astype(numpy.int32)
+    bin_of = numpy.repeat(numpy.arange(nbins), nrow)
+    fine = first[bin_of] + numpy.arange(wptr[-1]) - wptr[:-1][bin_of]
+    overlap = numpy.minimum(edges[fine + 1], new_edges[1:][bin_of]) - numpy.maximum(edges[fine], new_edges[:-1][bin_of])
+    weights = numpy.clip(overlap / (edges[fine + 1] - edges[fine]), 0.0, 1.0)
+
+    # padding avoids taking the address of the first element of empty arrays
+    cdata = numpy.concatenate((numpy.asarray(data, dtype=numpy.float32), [0])).astype(numpy.float32)
+    cindices = numpy.concatenate((numpy.asarray(indices, dtype=numpy.int32), [0])).astype(numpy.int32)
+    cindptr = numpy.ascontiguousarray(indptr, dtype=numpy.int32)
+    cweights = numpy.concatenate((weights, [0])).astype(numpy.float32)
+    cfirst = first.astype(numpy.int32)
+    cnrow = nrow
+    cwptr = wptr
+    max_row = max(nrow.max() if nbins else 0, 1)
+    count = numpy.zeros(nbins, dtype=numpy.int32)
+
+    with nogil, parallel():
+        cursor = <int *> malloc(max_row * sizeof(int))
+        for k in prange(nbins, schedule="guided"):
+            if cursor == NULL:
+                count[k] = -1
+                continue
+            count[k] = merge_rows(&cdata[0], &cindices[0], &cindptr[0], cfirst[k], cnrow[k],
+                                  &cweights[cwptr[k]], cursor, NULL, NULL)
+        free(cursor)
+    if nbins and numpy.asarray(count).min() < 0:
+        raise MemoryError("Unable to allocate the cursors of rebin_csr (%s rows per thread)" % max_row)
+
+    new_indptr = numpy.concatenate(([0], numpy.cumsum(count))).astype(numpy.int32)
+    new_data = numpy.zeros(new_indptr[nbins] + 1, dtype=numpy.float32)
+    new_indices = numpy.zeros(new_indptr[nbins] + 1, dtype=numpy.int32)
+    # count is reused to flag the rows of threads without cursor
+    with nogil, parallel():
+        cursor = <int *> malloc(max_row * sizeof(int))
+        for k in prange(nbins, schedule="guided"):
+            if cursor == NULL:
+                count[k] = -1
+                continue
+            merge_rows(&cdata[0], &cindices[0], &cindptr[0], cfirst[k], cnrow[k],
+                       &cweights[cwptr[k]], cursor, &new_data[new_indptr[k]], &new_indices[new_indptr[k]])
+        free(cursor)
+    if nbins and numpy.asarray(count).min() < 0:
+        raise MemoryError("Unable to allocate the cursors of rebin_csr (%s rows per thread)" % max_row)
+    return (numpy.asarray(new_data)[:-1], numpy.asarray(new_indices)[:-1], numpy.asarray(new_indptr))
+
+
+class DerivedCsrIntegrator(CsrIntegratorMixin):
+    """
+    1D integrator derived from the CSR matrix of a fine-grained master
+    integrator (same geometry, mask, unit and azimuthal range) for another
+    number of bins or a sub-range, by merging and cropping its rows
+    (see rebin_csr). This takes milliseconds instead of a full setup_CSR.
+
+    Accuracy: the master distributes each pixel among its fine bins, the
+    derived matrix assumes this fraction is uniform within each fine bin.
+    When the new edges coincide with the master edges (no radial range and a
+    number of bins dividing the one of the master) the matrix is the one of a
+    direct build. Otherwise, the coefficient of a pixel in a new bin differs
+    from the direct build by at most its coefficients in the two fine bins
+    crossing the edges of the new bin, i.e. only pixels within one fine bin
+    of the edges are affected. With a radial range, the first and last bins
+    of a direct build also collect the pixels just outside the range, which
+    the derived integrator does not.
+    """
+    def __init__(self, master, bins, pos0Range=None, split=None):
+        """
+        @param master: fine HistoBBox1d or FullSplitCSR_1d integrator
+        @param bins: number of bins
+        @param pos0Range: radial range, as passed to the integrator (i.e. with the upper bound already multiplied by EPS32)
+        @param split: pixel splitting scheme of the master, for information
+        """
+        self.bins = bins
+        self.split = split
+        self.size = master.size
+        self.unit = master.unit
+        self.empty = master.empty
+        self.check_mask = master.check_mask
+        self.mask_checksum = master.mask_checksum
+        self.pos1Range = master.pos1Range
+        self.pos0Range = pos0Range
+        self.master_checksum = master.lut_checksum
+        self.master_bins = master.indptr.size - 1
+        if pos0Range is not None:
+            self.pos0_min = min(pos0Range)
+            self.pos0_maxin = max(pos0Range)
+            self.pos0_max = self.pos0_maxin * EPS32
+        else:
+            self.pos0_min = master.pos0_min
+            self.pos0_maxin = master.pos0_maxin
+            self.pos0_max = master.pos0_max
+        self.delta = (self.pos0_max - self.pos0_min) / bins
+        self.outPos = numpy.linspace(self.pos0_min + 0.5 * self.delta,
+                                     self.pos0_maxin - 0.5 * self.delta,
+                                     self.bins)
+        edges = self.pos0_min + self.delta * numpy.arange(bins + 1)
+        master_edges = master.pos0_min + master.delta * numpy.arange(master.indptr.size)
+        data, indices, indptr = master.data, master.indices, master.indptr
+        if not rows_sorted(indices, indptr):
+            data, indices, indptr = sort_rows(data, indices, indptr)
+        self.data, self.indices, self.indptr = rebin_csr(data, indices, indptr, master_edges, edges)
+        self.nnz = self.indptr[-1]
+        self.lut = (self.data, self.indices, self.indptr)
+        self.lut_checksum = crc32(self.data)
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def accumulate_tile(data, indices, indptr, rows, image, pixel_start, do_dummy, dummy, out_data, out_count,
+                    num_threads=None):
+    """
+    Accumulate the contribution of a tile of the matrix (i.e. of a band of
+    pixels) into the weighted and unweighted histograms.
+
+    @param data, indices, indptr: CSR representation of the non-empty rows of the tile, indices are relative to the band
+    @param rows: index of the non-empty rows in the full matrix
+    @param image: preprocessed image (float32, 1D) of the full frame
+    @param pixel_start: index of the first pixel of the band
+    @param do_dummy: skip pixels with the dummy value
+    @param dummy: value of dummy pixels
+    @param out_data: weighted histogram (float64), updated in place
+    @param out_count: unweighted histogram (float64), updated in place
+    @param num_threads: number of OpenMP threads, all of them by default
+    """
+    cdef:
+        numpy.int32_t i, j, nrow = rows.shape[0], offset = pixel_start
+        int cnum_threads = num_threads or omp_get_max_threads()
+        float[:] ccoef = data, cimage = image
+        numpy.int32_t[:] cindices = indices, cindptr = indptr, crows = rows
+        double[:] cout_data = out_data, cout_count = out_count
+        double sum_data, sum_count
+        float value, coef, cdummy = dummy
+        bint cdo_dummy = do_dummy
+    for i in prange(nrow, nogil=True, schedule="guided", num_threads=cnum_threads):
+        sum_data = 0.0
+        sum_count = 0.0
+        for j in range(cindptr[i], cindptr[i + 1]):
+            coef = ccoef[j]
+            if coef == 0.0:
+                continue
+            value = cimage[offset + cindices[j]]
+            if cdo_dummy and (value == cdummy):
+                continue
+            sum_data = sum_data + coef * value
+            sum_count = sum_count + coef
+        # rows are unique within a tile: no race condition
+        cout_data[crows[i]] += sum_data
+        cout_count[crows[i]] += sum_count
+
+
+class TiledCsrIntegrator(CsrIntegratorMixin):
+    """
+    Integration matrix (1D or 2D) stored as tiles, each of them holding the
+    contribution of a band of pixels (i.e. a block of columns) as a small CSR
+    matrix restricted to its non-empty rows.
+
+    Each tile uses 32 bits indices while the total number of elements and
+    the offsets of the tiles are 64 bits: the matrix is not limited to 2^31
+    elements. Tiles can be kept in memory or written to a file which is then
+    memory-mapped (out-of-core mode): integration streams over the tiles,
+    asking the kernel to read-ahead the next one, so matrices larger than the
+    physical memory are processed at disk or page-cache bandwidth.
+
+    Tiles are added with add_tile() and the matrix is made usable by
+    finalize().
+    """
+    alignment = 64
+
+    def __init__(self, size, bins, filename=None, temporary=False, unit="undefined", empty=0.0):
+        """
+        @param size: number of pixels of the image
+        @param bins: number of bins, int for 1D or 2-tuple (radial, azimuthal) for 2D
+        @param filename: name of the file where tiles are stored, None to keep them in memory
+        @param temporary: remove the file when the integrator is deleted
+        @param unit: unit of the radial dimension
+        @param empty: value for bins without contributing pixels
+        """
+        self.size = size
+        if "__len__" in dir(bins):
+            self.bins = tuple(int(i) for i in bins)
+        else:
+            self.bins = int(bins)
+        self.nbins = int(numpy.prod(self.bins))
+        self.filename = filename
+        self.temporary = temporary
+        self.unit = unit
+        self.empty = empty
+        self.tiles = []
+        self.nnz = 0
+        self.nbytes = 0
+        self.lut_checksum = None
+        self._checksums = []
+        self._memmap = None
+        self._fd = None
+        self._file = open(filename, "wb") if filename else None
+
+    def _store(self, array):
+        """
+        Keep an array of a tile in memory or append it to the file
+
+        @return: the array itself or its (offset, dtype, size) in the file
+        """
+        array = numpy.ascontiguousarray(array)
+        if self._file is None:
+            return array
+        offset = self.nbytes
+        self._file.write(array.tobytes())
+        padding = (-array.nbytes) % self.alignment
+        if padding:
+            self._file.write(b"\0" * padding)
+        self.nbytes += array.nbytes + padding
+        return (offset, array.dtype.str, array.size)
+
+    def add_tile(self, pixel_start, pixel_stop, data, indices, indptr):
+        """
+        Add the tile of the pixels [pixel_start, pixel_stop)
+
+        @param data, indices, indptr: CSR matrix of the band with all rows, indices relative to pixel_start
+        """
+        assert not self._memmap, "matrix is already finalized"
+        assert indptr.size == self.nbins + 1
+        counts = numpy.diff(indptr)
+        rows = numpy.where(counts > 0)[0].astype(numpy.int32)
+        tile_indptr = numpy.concatenate(([0], numpy.cumsum(counts[rows]))).astype(numpy.int32)
+        nnz = int(tile_indptr[-1])
+        first = int(indptr[0])
+        self.tiles.append({"start": int(pixel_start),
+                           "stop": int(pixel_stop),
+                           "nnz": nnz,
+                           "rows": self._store(rows),
+                           "indptr": self._store(tile_indptr),
+                           "indices": self._store(numpy.asarray(indices[first:first + nnz], dtype=numpy.int32)),
+                           "data": self._store(numpy.asarray(data[first:first + nnz], dtype=numpy.float32))})
+        self.nnz += nnz
+        self._checksums.append(crc32(numpy.ascontiguousarray(data[first:first + nnz], dtype=numpy.float32)))
+
+    def finalize(self):
+        """
+        Close the file and memory-map it
+        """
+        self.lut_checksum = crc32(numpy.array(self._checksums, dtype=numpy.uint32))
+        if self._file is not None:
+            self._file.close()
+            self._file = None
+            if self.nbytes:
+                # copy-on-write mapping provides writable buffers without modifying the file
+                self._memmap = numpy.memmap(self.filename, dtype=numpy.uint8, mode="c")
+                self._fd = os.open(self.filename, os.O_RDONLY)
+
+    def _get(self, tile, key):
+        """
+        @return: array of a tile, from memory or from the memory-mapped file
+        """
+        value = tile[key]
+        if self._memmap is None:
+            return value
+        offset, dtype, size = value
+        return numpy.ndarray(shape=(size,), dtype=numpy.dtype(dtype), buffer=self._memmap, offset=offset)
+
+    def _readahead(self, tile):
+        """
+        Ask the operating system to read the tile in advance
+        """
+        if (self._fd is None) or ("posix_fadvise" not in dir(os)):
+            return
+        start = tile["rows"][0]
+        end = tile["data"][0] + 4 * tile["data"][2]
+        try:
+            os.posix_fadvise(self._fd, start, end - start, os.POSIX_FADV_WILLNEED)
+        except OSError:
+            pass
+
+    def __del__(self):
+        if self._file is not None:
+            self._file.close()
+        self._memmap = None
+        if self._fd is not None:
+            os.close(self._fd)
+            self._fd = None
+        if self.temporary and self.filename and os.path.exists(self.filename):
+            os.unlink(self.filename)
+
+    def integrate(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None):
+        """
+        Integrate the image by streaming over the tiles
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @return: like HistoBBox1d (positions, pattern, sum, count) in 1D or
+                 like HistoBBox2d (pattern, pos0, pos1, sum, count) in 2D
+        """
+        cdata, do_dummy, cdummy = self.preprocess(weights, dummy=dummy, delta_dummy=delta_dummy, dark=dark,
+                                                  flat=flat, solidAngle=solidAngle, polarization=polarization)
+        outData = numpy.zeros(self.nbins, dtype=numpy.float64)
+        outCount = numpy.zeros(self.nbins, dtype=numpy.float64)
+        if self.tiles:
+            self._readahead(self.tiles[0])
+        for i, tile in enumerate(self.tiles):
+            if i + 1 < len(self.tiles):
+                self._readahead(self.tiles[i + 1])
+            if tile["nnz"] == 0:
+                continue
+            accumulate_tile(self._get(tile, "data"), self._get(tile, "indices"), self._get(tile, "indptr"),
+                            self._get(tile, "rows"), cdata, tile["start"], do_dummy, cdummy, outData, outCount)
+        outMerge = numpy.zeros(self.nbins, dtype=numpy.float32)
+        valid = outCount > 1e-10
+        outMerge[valid] = outData[valid] / outCount[valid]
+        outMerge[~valid] = cdummy
+        if "__len__" in dir(self.bins):
+            outData.shape = outCount.shape = outMerge.shape = self.bins
+            return outMerge.T, self.outPos0, self.outPos1, outData.T, outCount.T
+        return self.outPos, outMerge, outData, outCount
+
+
+def parse_cpulist(cpulist):
+    """
+    Parse a list of CPUs as found in /sys, like "0-3,8-11"
+
+    @param cpulist: string
+    @return: list of CPU indices
+    """
+    cpus = []
+    for block in cpulist.strip().split(","):
+        if not block:
+            continue
+        if "-" in block:
+            first, last = block.split("-")
+            cpus += list(range(int(first), int(last) + 1))
+        else:
+            cpus.append(int(block))
+    return cpus
+
+
+cdef class ThreadAffinity:
+    """
+    Pins the calling thread to a list of CPUs (Linux only, on all versions
+    of Python). The previous affinity is put back by restore().
+    """
+    cdef affinity_t previous
+    cdef readonly bint pinned
+
+    def __init__(self, cpus):
+        """
+        @param cpus: list of CPU indices
+        """
+        cdef int[::1] ccpus = numpy.ascontiguousarray(list(cpus) or [-1], dtype=numpy.intc)
+        self.pinned = False
+        if affinity_save(&self.previous) != 0:
+            return
+        self.pinned = (affinity_pin(&ccpus[0], ccpus.shape[0]) == 0)
+
+    def restore(self):
+        """
+        Put back the affinity of the thread before pinning
+        """
+        if self.pinned:
+            affinity_restore(&self.previous)
+            self.pinned = False
+
+
+def allowed_cpus():
+    """
+    @return: sorted list of the CPUs the calling thread may run on, None if unknown
+    """
+    cdef:
+        affinity_t current
+        int cpu
+    if affinity_save(&current) != 0:
+        return None
+    return [cpu for cpu in range(AFFINITY_SETSIZE) if affinity_isset(&current, cpu)]
+
+
+def numa_topology(root="/sys/devices/system/node"):
+    """
+    Read the NUMA topology of the computer from /sys
+
+    Only CPUs the process is allowed to run on are considered. Without
+    topology information the computer is seen as a single node.
+
+    @param root: directory describing the nodes
+    @return: dict with the list of CPUs of each NUMA node
+    """
+    available = allowed_cpus()
+    if available is not None:
+        available = set(available)
+    nodes = {}
+    if os.path.isdir(root):
+        for name in os.listdir(root):
+            if not (name.startswith("node") and name[4:].isdigit()):
+                continue
+            try:
+                with open(os.path.join(root, name, "cpulist")) as f:
+                    cpus = parse_cpulist(f.read())
+            except (IOError, ValueError):
+                continue
+            if available is not None:
+                cpus = [i for i in cpus if i in available]
+            if cpus:
+                nodes[int(name[4:])] = cpus
+    if not nodes:
+        nodes[0] = sorted(available) if available else list(range(omp_get_max_threads()))
+    return nodes
+
+
+class NodeWorker(object):
+    """
+    Thread pinned once to the CPUs of a NUMA node, running the tasks it is
+    given one after the other. Being persistent, the thread and the team of
+    OpenMP threads it drives are kept from one frame to the next.
+
+    The worker holds no reference to the tasks it has completed, so that the
+    integrator using it can be garbage collected, which stops the worker.
+    """
+    def __init__(self, cpus):
+        """
+        @param cpus: list of CPU indices of the node
+        """
+        self.cpus = list(cpus)
+        self.pinned = False
+        self._tasks = queue.Queue()
+        ready = threading.Event()
+        self._thread = threading.Thread(target=self._loop, args=(ready,))
+        self._thread.daemon = True
+        self._thread.start()
+        ready.wait()
+
+    def _loop(self, ready):
+        affinity = ThreadAffinity(self.cpus)
+        self.pinned = affinity.pinned
+        ready.set()
+        while True:
+            task = self._tasks.get()
+            if task is None:
+                break
+            func, args, done, result = task
+            try:
+                result.append(func(*args))
+            except Exception as error:
+                result.append(error)
+            done.set()
+            task = func = args = None
+        affinity.restore()
+
+    def submit(self, func, *args):
+        """
+        Run func(*args) in the pinned thread
+
+        @return: event set once done, list receiving the result (or the exception)
+        """
+        done = threading.Event()
+        result = []
+        self._tasks.put((func, args, done, result))
+        return done, result
+
+    def stop(self):
+        """
+        Terminate the thread once the pending tasks are done
+        """
+        if self._thread.is_alive():
+            self._tasks.put(None)
+
+
+class NumaCsrIntegrator(CsrIntegratorMixin):
+    """
+    NUMA-aware version of a 1D CSR integrator.
+
+    Rows of the matrix are split into one partition per NUMA node, balanced
+    on the number of elements. Each partition is copied, hence first-touched,
+    by a thread pinned to the CPUs of its node so the pages end up in the
+    memory of that node. At integration, each partition is processed by the
+    same thread, a NodeWorker pinned to its node driving its own team of
+    OpenMP threads, and the preprocessed image is copied into a buffer of
+    every node, allocated once (or shared when replicate is False).
+
+    The time spent by the kernel on each node during the last integration
+    is kept in timings, bandwidth() converts it into bytes read per second.
+
+    Threads are pinned with sched_setaffinity (Linux only). Elsewhere, or
+    if pinning fails, a warning is emitted, pinned is False and the
+    partitions are processed by unpinned threads.
+    """
+    def __init__(self, integrator, nodes=None, replicate=True):
+        """
+        @param integrator: 1D CSR integrator (HistoBBox1d, FullSplitCSR_1d, ...)
+        @param nodes: dict with the list of CPUs of each node, read from /sys by default
+        @param replicate: copy the image on each node
+        """
+        self.integrator = integrator
+        for key in ("size", "bins", "outPos", "unit", "empty", "check_mask", "mask_checksum",
+                    "pos0Range", "pos1Range", "lut_checksum"):
+            setattr(self, key, getattr(integrator, key, None))
+        if self.empty is None:
+            self.empty = 0.0
+        topology = numa_topology() if nodes is None else nodes
+        self.nodes = sorted(topology)
+        self.cpus = [list(topology[i]) for i in self.nodes]
+        self.replicate = replicate
+        indptr = numpy.asarray(integrator.indptr, dtype=numpy.int64)
+        nbins = indptr.size - 1
+        nnz = indptr[-1]
+        npart = len(self.nodes)
+        bounds = numpy.searchsorted(indptr, nnz * numpy.arange(1, npart) // npart)
+        self.row_bounds = [0] + [int(min(max(i, 0), nbins)) for i in bounds] + [nbins]
+        self.workers = [NodeWorker(cpus) for cpus in self.cpus]
+        self.pinned = all(worker.pinned for worker in self.workers)
+        if not self.pinned:
+            logger.warning("Unable to pin threads to the CPUs of their NUMA node: "
+                           "the matrix is not placed nor processed per node")
+        self.partitions = self._run_on_nodes(self._place)
+        self.timings = [0.0] * npart
+
+    def __del__(self):
+        self.close()
+
+    def close(self):
+        """
+        Stop the threads of the nodes
+        """
+        for worker in getattr(self, "workers", []):
+            worker.stop()
+
+    def _run_on_nodes(self, func, *args):
+        """
+        Run func(partition, *args) in the worker thread of each node, pinned to the CPUs of that node
+
+        @return: list with the result for each node
+        """
+        tasks = [worker.submit(func, i, *args) for i, worker in enumerate(self.workers)]
+        results = []
+        for done, result in tasks:
+            done.wait()
+            results.append(result[0])
+        for result in results:
+            if isinstance(result, Exception):
+                raise result
+        return results
+
+    def _place(self, i):
+        """
+        Copy the rows of partition i from the calling (pinned) thread
+
+        @return: dict with data, indices, indptr and rows of the non-empty rows
+        """
+        integrator = self.integrator
+        first, last = self.row_bounds[i], self.row_bounds[i + 1]
+        indptr = numpy.asarray(integrator.indptr[first:last + 1], dtype=numpy.int64)
+        counts = numpy.diff(indptr)
+        nonempty = numpy.where(counts > 0)[0]
+        start, stop = int(indptr[0]), int(indptr[-1])
+        partition = {"rows": numpy.empty(nonempty.size, dtype=numpy.int32),
+                     "indptr": numpy.empty(nonempty.size + 1, dtype=numpy.int32),
+                     "indices": numpy.empty(stop - start, dtype=numpy.int32),
+                     "data": numpy.empty(stop - start, dtype=numpy.float32)}
+        # writing the freshly allocated buffers places their pages on the node of this thread
+        partition["rows"][:] = nonempty + first
+        partition["indptr"][0] = 0
+        partition["indptr"][1:] = numpy.cumsum(counts[nonempty])
+        partition["indices"][:] = integrator.indices[start:stop]
+        partition["data"][:] = integrator.data[start:stop]
+        partition["nbytes"] = sum(partition[key].nbytes for key in ("rows", "indptr", "indices", "data"))
+        # CPUs the pages were first-touched from
+        partition["cpus"] = allowed_cpus()
+        return partition
+
+    def _integrate_partition(self, i, image, do_dummy, cdummy, outData, outCount):
+        partition = self.partitions[i]
+        if self.replicate:
+            # allocated and first-touched once by the thread of the node, then recycled
+            local = partition.get("image")
+            if (local is None) or (local.shape != image.shape) or (local.dtype != image.dtype):
+                local = partition["image"] = numpy.empty_like(image)
+            local[:] = image
+        else:
+            local = image
+        # only the kernel is timed: the copy of the image is not part of bandwidth()
+        t0 = time.time()
+        accumulate_tile(partition["data"], partition["indices"], partition["indptr"], partition["rows"],
+                        local, 0, do_dummy, cdummy, outData, outCount, len(self.cpus[i]))
+        self.timings[i] = time.time() - t0
+
+    def bandwidth(self):
+        """
+        @return: dict with the bandwidth (bytes/s) measured on each node during the last integration
+        """
+        res = {}
+        for node, partition, timing in zip(self.nodes, self.partitions, self.timings):
+            nbytes = partition["nbytes"] + 4 * self.size
+            res[node] = nbytes / timing if timing > 0 else 0.0
+        return res
+
+    def integrate(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None):
+        """
+        Integration with one partition of the matrix per NUMA node
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @return: positions, pattern, weighted_histogram and unweighted_histogram
+        @rtype: 4-tuple of ndarrays
+        """
+        cdata, do_dummy, cdummy = self.preprocess(weights, dummy=dummy, delta_dummy=delta_dummy, dark=dark,
+                                                  flat=flat, solidAngle=solidAngle, polarization=polarization)
+        nbins = self.row_bounds[-1]
+        outData = numpy.zeros(nbins, dtype=numpy.float64)
+        outCount = numpy.zeros(nbins, dtype=numpy.float64)
+        self._run_on_nodes(self._integrate_partition, numpy.asarray(cdata), do_dummy, cdummy, outData, outCount)
+        outMerge = numpy.zeros(nbins, dtype=numpy.float32)
+        valid = outCount > 1e-10
+        outMerge[valid] = outData[valid] / outCount[valid]
+        outMerge[~valid] = cdummy
+        return self.outPos, outMerge, outData, outCount
+
+
+def hilbert_order(shape):
+    """
+    Position of each pixel along a Hilbert space-filling curve covering the image
+
+    @param shape: shape of the image
+    @return: 1D array (int64) with the curve index of each pixel
+    """
+    n = 1
+    while n < max(shape):
+        n *= 2
+    y, x = numpy.indices(shape, dtype=numpy.int64)
+    x = x.ravel()
+    y = y.ravel()
+    d = numpy.zeros(x.size, dtype=numpy.int64)
+    s = n // 2
+    while s > 0:
+        rx = (x & s) > 0
+        ry = (y & s) > 0
+        d += s * s * ((3 * rx) ^ ry)
+        # rotate the quadrant
+        flip = (~ry) & rx
+        x[flip] = n - 1 - x[flip]
+        y[flip] = n - 1 - y[flip]
+        swap = ~ry
+        x[swap], y[swap] = y[swap], x[swap].copy()
+        s //= 2
+    return d
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def pixel_permutation(indices, indptr, size, order="bin", shape=None):
+    """
+    Calculate a renumbering of the pixels improving the locality of the
+    gather performed by the integration kernels
+
+    @param indices: column index of each coefficient of the CSR matrix
+    @param indptr: row pointer of the CSR matrix
+    @param size: number of pixels of the image
+    @param order: "bin": pixels are numbered in the order the matrix reads them (bin-major),
+                  "hilbert": pixels are numbered along a Hilbert curve over the image
+    @param shape: shape of the image, needed for the "hilbert" order
+    @return: permutation (int32): new pixel i is the pixel permutation[i] of the image
+    """
+    cdef:
+        numpy.int32_t[:] cindices = numpy.ascontiguousarray(indices, dtype=numpy.int32)
+        numpy.int32_t[::1] cpermutation, cinverse
+        numpy.int32_t j, p, n = 0, csize = size, nnz = indptr[indptr.size - 1]
+    if order == "hilbert":
+        assert shape is not None and shape[0] * shape[1] == size
+        return numpy.argsort(hilbert_order(shape), kind="mergesort").astype(numpy.int32)
+    elif order != "bin":
+        raise RuntimeError("Unknown pixel order %s" % order)
+    permutation = numpy.empty(size, dtype=numpy.int32)
+    inverse = numpy.empty(size, dtype=numpy.int32)
+    inverse[:] = -1
+    cpermutation = permutation
+    cinverse = inverse
+    with nogil:
+        for j in range(nnz):
+            p = cindices[j]
+            if cinverse[p] < 0:
+                cinverse[p] = n
+                cpermutation[n] = p
+                n = n + 1
+        # pixels not used by the matrix go at the end
+        for p in range(csize):
+            if cinverse[p] < 0:
+                cinverse[p] = n
+                cpermutation[n] = p
+                n = n + 1
+    return permutation
+
+
+class RenumberedCsrIntegrator(CsrIntegratorMixin):
+    """
+    Copy of a 1D CSR integrator with renumbered pixels.
+
+    Columns of the matrix are renumbered so that the pixels contributing to
+    a bin are close to each other in memory: the gather of the integration
+    kernel becomes almost sequential. The image is reordered by preprocess(),
+    within the pass applying the corrections, which reads every pixel anyway.
+    """
+    def __init__(self, integrator, order="bin", shape=None):
+        """
+        @param integrator: 1D CSR integrator (HistoBBox1d, FullSplitCSR_1d, ...)
+        @param order: "bin" or "hilbert", see pixel_permutation
+        @param shape: shape of the image, needed for the "hilbert" order
+        """
+        self.integrator = integrator
+        self.order = order
+        for key in ("size", "bins", "outPos", "unit", "empty", "check_mask", "mask_checksum",
+                    "pos0Range", "pos1Range", "lut_checksum"):
+            setattr(self, key, getattr(integrator, key, None))
+        if self.empty is None:
+            self.empty = 0.0
+        self.permutation = pixel_permutation(integrator.indices, integrator.indptr, self.size, order, shape)
+        inverse = numpy.empty_like(self.permutation)
+        inverse[self.permutation] = numpy.arange(self.size, dtype=numpy.int32)
+        self.data, self.indices, self.indptr = sort_rows(integrator.data, inverse[integrator.indices], integrator.indptr)
+        self.lut = (self.data, self.indices, self.indptr)
+
+
+@cython.cdivision(True)
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def subsample_csr(data, indices, indptr, factor, min_entries=8):
+    """
+    Deterministic stratified subset of the entries of each row of a CSR matrix.
+
+    The ceil(n/factor) entries kept from a row of n entries (all of them
+    if n <= min_entries) are taken one per stratum of factor consecutive
+    entries, at a position within the stratum which depends on the row only.
+    With rows sorted by pixel index, strata are compact groups of pixels.
+    Kept coefficients are rescaled so that the sum of the coefficients of
+    each row, i.e. the normalization of the bin, is preserved.
+
+    @param data: coefficients of the CSR matrix
+    @param indices: column index of each coefficient
+    @param indptr: row pointer of the CSR matrix
+    @param factor: subsampling factor, 1 keeps all entries
+    @param min_entries: rows with at most this number of entries are kept entirely
+    @return: data, indices, indptr of the subset and the fraction of the entries of each row kept
+    """
+    cdef:
+        float[:] cdata = numpy.ascontiguousarray(data, dtype=numpy.float32)
+        numpy.int32_t[:] cindices = numpy.ascontiguousarray(indices, dtype=numpy.int32)
+        numpy.int32_t[:] cindptr = numpy.ascontiguousarray(indptr, dtype=numpy.int32)
+        numpy.int32_t nrow = cindptr.shape[0] - 1, cfactor = factor, cmin = min_entries
+        numpy.int32_t i, j, k, n, keep, start, pos = 0
+        numpy.int32_t[:] new_indptr = numpy.zeros(nrow + 1, dtype=numpy.int32), new_indices
+        float[:] new_data
+        double[:] fraction = numpy.ones(nrow, dtype=numpy.float64)
+        double stride, phase, total, kept, scale
+    assert cfactor >= 1
+    for i in range(nrow):
+        n = cindptr[i + 1] - cindptr[i]
+        keep = (n + cfactor - 1) // cfactor
+        if n <= cmin:
+            keep = n
+        elif keep < cmin:
+            keep = cmin
+        new_indptr[i + 1] = new_indptr[i] + keep
+    new_data = numpy.empty(new_indptr[nrow], dtype=numpy.float32)
+    new_indices = numpy.empty(new_indptr[nrow], dtype=numpy.int32)
+    for i in range(nrow):
+        start = cindptr[i]
+        n = cindptr[i + 1] - start
+        keep = new_indptr[i + 1] - new_indptr[i]
+        if keep == 0:
+            continue
+        stride = <double> n / keep
+        # golden ratio sequence: the position within the strata varies from row to row
+        phase = i * 0.6180339887498949
+        phase = phase - <numpy.int64_t> phase
+        total = 0.0
+        for j in range(start, start + n):
+            total = total + cdata[j]
+        kept = 0.0
+        for k in range(keep):
+            j = start + <numpy.int32_t> ((k + phase) * stride)
+            new_data[pos + k] = cdata[j]
+            new_indices[pos + k] = cindices[j]
+            kept = kept + cdata[j]
+        scale = total / kept if kept > 0 else 1.0
+        for k in range(keep):
+            new_data[pos + k] = new_data[pos + k] * scale
+        fraction[i] = <double> keep / n
+        pos = pos + keep
+    return numpy.asarray(new_data), numpy.asarray(new_indices), numpy.asarray(new_indptr), numpy.asarray(fraction)
+
+
+class PreviewCsrIntegrator(object):
+    """
+    Fast preview of the 1D integration of a CSR integrator, for live display.
+
+    Only a stratified subset of the pixels of each bin is read and corrected
+    (see subsample_csr), the normalization of each bin being preserved. The
+    uncertainty due to the subsampling is estimated from the weighted spread
+    of the pixels read in each bin, with the finite population correction:
+    sigma = sqrt(M2 / count / n_eff * (1 - fraction)), n_eff being the
+    effective number of pixels read; it is 0 for bins read entirely.
+
+    The subsampling factor is either fixed or chosen at each frame among
+    powers of two so that the integration fits in a time budget, from the
+    measured cost per coefficient of the previous frames.
+    """
+    def __init__(self, integrator, factor=16, budget=None, max_factor=256, min_entries=8):
+        """
+        @param integrator: 1D CSR integrator (HistoBBox1d, FullSplitCSR_1d, ...)
+        @param factor: subsampling factor, used as long as no budget is given
+        @param budget: time budget per frame in seconds, None to use a fixed factor
+        @param max_factor: largest factor chosen to meet the budget
+        @param min_entries: bins with at most this number of coefficients are read entirely
+        """
+        self.integrator = integrator
+        for key in ("size", "bins", "outPos", "unit", "empty", "check_mask", "mask_checksum",
+                    "pos0Range", "pos1Range", "lut_checksum"):
+            setattr(self, key, getattr(integrator, key, None))
+        if self.empty is None:
+            self.empty = 0.0
+        self.parent_checksum = integrator.lut_checksum
+        self.factor = factor
+        self.budget = budget
+        self.min_entries = min_entries
+        self.factors = [1]
+        while self.factors[-1] < max_factor:
+            self.factors.append(self.factors[-1] * 2)
+        self.nnz = integrator.indptr[-1]
+        self.cost = None  # seconds per coefficient read, averaged over the frames
+        self._matrices = {}
+        self._sem = threading.Semaphore()
+        data, indices, indptr = integrator.data, integrator.indices, integrator.indptr
+        if not rows_sorted(indices, indptr):
+            data, indices, indptr = sort_rows(data, indices, indptr)
+        self._sorted = (data, indices, indptr)
+
+    def get_matrix(self, factor):
+        """
+        Subsampled matrix, built on first use and cached.
+        Columns index the pixels read, listed in the pixels array.
+
+        @return: data, indices, indptr, pixels, fraction of each row read
+        """
+        with self._sem:
+            if factor not in self._matrices:
+                data, indices, indptr, fraction = subsample_csr(*(self._sorted + (factor, self.min_entries)))
+                pixels, indices = numpy.unique(indices, return_inverse=True)
+                self._matrices[factor] = (data, indices.astype(numpy.int32), indptr,
+                                          pixels.astype(numpy.int32), fraction)
+            return self._matrices[factor]
+
+    def choose_factor(self, budget=None):
+        """
+        @param budget: time budget in seconds, by default the one of the integrator
+        @return: smallest factor expected to fit in the budget
+        """
+        if budget is None:
+            budget = self.budget
+        if (not budget) or (self.cost is None):
+            return self.factor
+        for factor in self.factors:
+            if self.cost * self.nnz / factor <= budget:
+                return factor
+        return self.factors[-1]
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def integrate(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None,
+                  budget=None):
+        """
+        Preview integration of a frame
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @param budget: time budget for this frame in seconds, by default the one of the integrator
+        @return: positions, pattern, its uncertainty, weighted_histogram and unweighted_histogram
+        @rtype: 5-tuple of ndarrays
+        """
+        cdef:
+            numpy.int32_t i, j, nbins = self.bins
+            numpy.int32_t[:] indices, indptr
+            float[:] ccoef, cdata
+            double[:] fraction
+            numpy.ndarray[numpy.float64_t, ndim = 1] outData = numpy.zeros(nbins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float64_t, ndim = 1] outCount = numpy.zeros(nbins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float32_t, ndim = 1] outMerge = numpy.zeros(nbins, dtype=numpy.float32)
+            numpy.ndarray[numpy.float32_t, ndim = 1] outSigma = numpy.zeros(nbins, dtype=numpy.float32)
+            double sum_data, sum_count, sum_count2, mean, M2, delta, epsilon = 1e-10
+            float data, coef, cdummy
+            bint do_dummy = dummy is not None
+
+        assert weights.size == self.size
+        factor = self.choose_factor(budget)
+        data_, indices_, indptr_, pixels, fraction_ = self.get_matrix(factor)
+        # building a subsampled matrix is paid once per factor: it is not part of the frame time
+        t0 = time.time()
+        ccoef = data_
+        indices = indices_
+        indptr = indptr_
+        fraction = fraction_
+
+        # corrections are applied to the pixels read only
+        image = numpy.ascontiguousarray(weights.ravel().take(pixels), dtype=numpy.float32)
+        if do_dummy:
+            cdummy = dummy
+            if delta_dummy:
+                invalid = abs(image - cdummy) <= delta_dummy
+            else:
+                invalid = (image == cdummy)
+        else:
+            cdummy = self.empty
+        if dark is not None:
+            image -= dark.ravel().take(pixels)
+        if flat is not None:
+            image /= flat.ravel().take(pixels)
+        if polarization is not None:
+            image /= polarization.ravel().take(pixels)
+        if solidAngle is not None:
+            image /= solidAngle.ravel().take(pixels)
+        if do_dummy:
+            image[invalid] = cdummy
+        cdata = image
+
+        for i in prange(nbins, nogil=True, schedule="guided"):
+            sum_data = 0.0
+            sum_count = 0.0
+            sum_count2 = 0.0
+            mean = 0.0
+            M2 = 0.0
+            for j in range(indptr[i], indptr[i + 1]):
+                coef = ccoef[j]
+                if coef == 0.0:
+                    continue
+                data = cdata[indices[j]]
+                if do_dummy and (data == cdummy):
+                    continue
+                sum_data = sum_data + coef * data
+                sum_count = sum_count + coef
+                sum_count2 = sum_count2 + coef * coef
+                delta = data - mean
+                mean = mean + delta * coef / sum_count
+                M2 = M2 + coef * delta * (data - mean)
+            outData[i] = sum_data
+            outCount[i] = sum_count
+            if sum_count > epsilon:
+                outMerge[i] = sum_data / sum_count
+                if (fraction[i] < 1.0) and (M2 > 0):
+                    outSigma[i] = sqrt(M2 / sum_count * sum_count2 / (sum_count * sum_count) * (1.0 - fraction[i]))
+            else:
+                outMerge[i] = cdummy
+
+        self.factor = factor
+        cost = (time.time() - t0) / max(1, indptr_[-1])
+        self.cost = cost if self.cost is None else 0.7 * self.cost + 0.3 * cost
+        return self.outPos, outMerge, outSigma, outData, outCount
+
+
+cdef inline numpy.int32_t _find_root(numpy.int32_t[:] parent, numpy.int32_t k) nogil:
+    "Root of k in the union-find forest, with path halving"
+    while parent[k] != k:
+        parent[k] = parent[parent[k]]
+        k = parent[k]
+    return k
+
+
+cdef inline void _union(numpy.int32_t[:] parent, numpy.int32_t a, numpy.int32_t b) nogil:
+    "Merge the trees of a and b, the smallest root being kept"
+    a = _find_root(parent, a)
+    b = _find_root(parent, b)
+    if a < b:
+        parent[b] = a
+    elif b < a:
+        parent[a] = b
+
+
+@cython.cdivision(True)
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def label_pixels(candidates, weights, shape, connectivity=8, slot=None):
+    """
+    Connected components of a sparse set of pixels, with union-find.
+
+    Only the candidate pixels are visited: the cost does not depend on the
+    size of the image.
+
+    @param candidates: flat index of the pixels, in increasing order
+    @param weights: weight of each pixel of the image (1D, float32), for the centroids
+    @param shape: shape of the image
+    @param connectivity: 4 or 8
+    @param slot: int32 work array of the size of the image filled with -1, restored on return
+    @return: label of each candidate, centroids (row, column), sum of the weights, number of pixels of each component
+    """
+    cdef:
+        numpy.int32_t[:] ccand = numpy.ascontiguousarray(candidates, dtype=numpy.int32)
+        float[:] cweights = weights
+        numpy.int32_t ncand = ccand.shape[0], width = shape[1], height = shape[0]
+        numpy.int32_t k, p, q, r, c, dc, root, nlabel = 0
+        bint diagonal = (connectivity == 8)
+        numpy.int32_t[:] cslot, parent = numpy.arange(ncand, dtype=numpy.int32)
+        numpy.int32_t[:] label = numpy.empty(ncand, dtype=numpy.int32)
+        numpy.ndarray[numpy.float64_t, ndim = 2] centroid
+        numpy.ndarray[numpy.float64_t, ndim = 1] intensity
+        numpy.ndarray[numpy.int32_t, ndim = 1] count
+        double w
+    assert connectivity in (4, 8)
+    if slot is None:
+        slot = numpy.zeros(height * width, dtype=numpy.int32) - 1
+    cslot = slot
+    with nogil:
+        for k in range(ncand):
+            cslot[ccand[k]] = k
+        # candidates are in raster order: neighbours above and on the left are already placed
+        for k in range(ncand):
+            p = ccand[k]
+            r = p // width
+            c = p - r * width
+            if c > 0 and cslot[p - 1] >= 0:
+                _union(parent, k, cslot[p - 1])
+            if r > 0:
+                for dc in range(-1, 2):
+                    if (dc != 0) and not diagonal:
+                        continue
+                    if (c + dc < 0) or (c + dc >= width):
+                        continue
+                    q = cslot[p - width + dc]
+                    if q >= 0:
+                        _union(parent, k, q)
+        # roots are the smallest member of each tree: labels follow the raster order
+        for k in range(ncand):
+            root = _find_root(parent, k)
+            if root == k:
+                label[k] = nlabel
+                nlabel = nlabel + 1
+            else:
+                label[k] = label[root]
+            cslot[ccand[k]] = -1
+    centroid = numpy.zeros((nlabel, 2), dtype=numpy.float64)
+    intensity = numpy.zeros(nlabel, dtype=numpy.float64)
+    count = numpy.zeros(nlabel, dtype=numpy.int32)
+    for k in range(ncand):
+        p = ccand[k]
+        r = p // width
+        c = p - r * width
+        w = cweights[p]
+        intensity[label[k]] += w
+        count[label[k]] += 1
+        centroid[label[k], 0] += w * r
+        centroid[label[k], 1] += w * c
+    for k in range(nlabel):
+        if intensity[k] != 0:
+            centroid[k, 0] /= intensity[k]
+            centroid[k, 1] /= intensity[k]
+    return numpy.asarray(label), centroid, intensity, count
+
+
+class CsrPeakFinder(object):
+    """
+    Bragg peak finder for serial crystallography, built on a 1D CSR integrator.
+
+    For each frame:
+    * the background of each ring is the sigma-clipped mean of its pixels,
+      with its standard deviation (see CsrIntegratorMixin.sigma_clip),
+    * in a single parallel pass, the background and its deviation are
+      projected back on every pixel with the transposed matrix and the
+      pixels exceeding the background by more than snr*std (and noise) are
+      flagged,
+    * flagged pixels are grouped in connected components (union-find, see
+      label_pixels), weighted by their excess over the background.
+    """
+    def __init__(self, integrator, shape):
+        """
+        @param integrator: 1D CSR integrator (HistoBBox1d, FullSplitCSR_1d, ...), without renumbered pixels
+        @param shape: shape of the images
+        """
+        assert integrator.permutation is None
+        self.integrator = integrator
+        self.shape = tuple(shape)
+        self.size = integrator.size
+        assert self.shape[0] * self.shape[1] == self.size
+        self.outPos = integrator.outPos
+        self.parent_checksum = integrator.lut_checksum
+        self.tdata, self.tindices, self.tindptr = transpose_csr(integrator.data, integrator.indices,
+                                                                integrator.indptr, self.size)
+        # work arrays, recycled from one frame to the next
+        self._flag = numpy.zeros(self.size, dtype=numpy.int8)
+        self._excess = numpy.zeros(self.size, dtype=numpy.float32)
+        self._slot = numpy.zeros(self.size, dtype=numpy.int32) - 1
+        self._sem = threading.Semaphore()
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def find_peaks(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None,
+                   thres=3.0, max_iter=5, snr=3.0, noise=0.0, min_pixels=1, connectivity=8):
+        """
+        Find the peaks of a frame
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the flat-field value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @param thres: cut-off of the sigma-clipping of the background
+        @param max_iter: maximum number of passes of the sigma-clipping
+        @param snr: a pixel is part of a peak if it exceeds the background by snr*std
+        @param noise: minimum excess over the background, in corrected intensity
+        @param min_pixels: smaller peaks are discarded
+        @param connectivity: 4 or 8 connected pixels
+        @return: positions, centroids (row, column), integrated excess intensity, number of pixels of each peak, background and its standard deviation per bin
+        @rtype: 6-tuple of ndarrays
+        """
+        cdef:
+            numpy.int32_t i, j, bin_, size = self.size
+            numpy.int32_t[:] tindices = self.tindices, tindptr = self.tindptr
+            float[:] tdata = self.tdata, cdata, cmean, cstd, excess = self._excess
+            numpy.int8_t[:] flag = self._flag
+            double sum_coef, sum_mean, sum_std, background, level
+            float data, cdummy, csnr = snr, cnoise = noise
+            bint do_dummy
+
+        integr = self.integrator
+        with self._sem:
+            cdata, do_dummy, cdummy = integr.preprocess(weights, dummy=dummy, delta_dummy=delta_dummy, dark=dark,
+                                                        flat=flat, solidAngle=solidAngle, polarization=polarization)
+            pos, mean, std, rejected = integr.sigma_clip(numpy.asarray(cdata), dummy=cdummy if do_dummy else None,
+                                                         thres=thres, max_iter=max_iter)
+            cmean = mean
+            cstd = std
+            for i in prange(size, nogil=True, schedule="static"):
+                data = cdata[i]
+                if (tindptr[i] == tindptr[i + 1]) or (do_dummy and (data == cdummy)):
+                    continue
+                sum_coef = 0.0
+                sum_mean = 0.0
+                sum_std = 0.0
+                for j in range(tindptr[i], tindptr[i + 1]):
+                    bin_ = tindices[j]
+                    sum_coef = sum_coef + tdata[j]
+                    sum_mean = sum_mean + tdata[j] * cmean[bin_]
+                    sum_std = sum_std + tdata[j] * cstd[bin_]
+                if sum_coef <= 0:
+                    continue
+                background = sum_mean / sum_coef
+                level = csnr * sum_std / sum_coef
+                if level < cnoise:
+                    level = cnoise
+                if data - background > level:
+                    flag[i] = 1
+                    excess[i] = data - background
+            candidates = numpy.flatnonzero(self._flag).astype(numpy.int32)
+            self._flag[candidates] = 0
+            label, centroid, intensity, count = label_pixels(candidates, self._excess, self.shape,
+                                                             connectivity, self._slot)
+        keep = (count >= min_pixels)
+        return pos, centroid[keep], intensity[keep], count[keep], mean, std
@@ -30,7 +30,7 @@ reverse implementation based on a sparse matrix multiplication
 """
 __author__ = "Jerome Kieffer"
 __contact__ = "Jerome.kieffer@esrf.fr"
-__date__ = "08/04/2015"
+__date__ = "18/10/2015"
 __status__ = "stable"
 __license__ = "GPLv3+"
 import cython
@@ -42,12 +42,13 @@ from cython.parallel import prange
 import numpy
 cimport numpy
 include "regrid_common.pxi"
+include "csr_common.pxi"
 try:
     from fastcrc import crc32
 except:
     from zlib import crc32
 
-class HistoBBox1d(object):
+class HistoBBox1d(CsrIntegratorMixin):
     """
     Now uses CSR (Compressed Sparse raw) with main attributes:
     * nnz: number of non zero elements
@@ -119,6 +120,9 @@ class HistoBBox1d(object):
 
         if pos1Range is not None and len(pos1Range) > 1:
             assert pos1.size == self.size
+            if delta_pos1 is None:
+                # no pixel splitting: only the center of the pixel is considered
+                delta_pos1 = numpy.zeros_like(pos1)
             assert delta_pos1.size == self.size
             self.check_pos1 = True
             self.cpos1_min = numpy.ascontiguousarray((pos1 - delta_pos1).ravel(), dtype=numpy.float32)
@@ -306,7 +310,7 @@ class HistoBBox1d(object):
                     for i in range(bin0_min, bin0_max + 1):
                         outMax[i] += 1
 
-        indptr[1:] = outMax.cumsum(dtype=numpy.int32)
+        indptr[1:] = calc_indptr(outMax)
         self.indptr = indptr
         self.nnz = nnz = indptr[bins]
 
@@ -324,8 +328,8 @@ class HistoBBox1d(object):
                     raise MemoryError("CSR Lookup-table (%i, %i) is %.3fGB whereas the memory of the system is only %.3fGB" %
                                       (bins, self.nnz, lut_nbytes / 2. ** 30, memsize / 2. ** 30))
         # else hope that enough memory is available
-        data = numpy.empty(nnz, dtype=numpy.float32)
-        indices = numpy.empty(nnz, dtype=numpy.int32)
+        data = memory.empty(nnz, dtype=numpy.float32)
+        indices = memory.empty(nnz, dtype=numpy.int32)
 
         with nogil:
             for idx in range(size):
@@ -432,7 +436,7 @@ class HistoBBox1d(object):
                 if (bin0 >= 0) and (bin0 < bins):
                     outMax[bin0] += 1
 
-        indptr[1:] = outMax.cumsum(dtype=numpy.int32)
+        indptr[1:] = calc_indptr(outMax)
         self.indptr = indptr
         self.nnz = nnz = indptr[bins]
 
@@ -450,8 +454,8 @@ class HistoBBox1d(object):
                     raise MemoryError("CSR Lookup-table (%i, %i) is %.3fGB whereas the memory of the system is only %.3fGB" %
                                       (bins, self.nnz, lut_nbytes / 2. ** 30, memsize / 2. ** 30))
         # else hope that enough memory is available
-        data = numpy.empty(nnz, dtype=numpy.float32)
-        indices = numpy.empty(nnz, dtype=numpy.int32)
+        data = memory.empty(nnz, dtype=numpy.float32)
+        indices = memory.empty(nnz, dtype=numpy.int32)
 
         with nogil:
             for idx in range(size):
@@ -502,15 +506,10 @@ class HistoBBox1d(object):
 
         """
         cdef:
-            numpy.int32_t i = 0, j = 0, idx = 0, bins = self.bins, size = self.size
-            double sum_data = 0.0, sum_count = 0.0, epsilon = 1e-10
-            float data = 0, coef = 0, cdummy = 0, cddummy = 0
+            numpy.int32_t i = 0, size = self.size
+            float data = 0, cdummy = 0, cddummy = 0
             bint do_dummy = False, do_dark = False, do_flat = False, do_polarization = False, do_solidAngle = False
-            numpy.ndarray[numpy.float64_t, ndim = 1] outData = numpy.zeros(self.bins, dtype=numpy.float64)
-            numpy.ndarray[numpy.float64_t, ndim = 1] outCount = numpy.zeros(self.bins, dtype=numpy.float64)
-            numpy.ndarray[numpy.float32_t, ndim = 1] outMerge = numpy.zeros(self.bins, dtype=numpy.float32)
-            float[:] ccoef = self.data, cdata, tdata, cflat, cdark, csolidAngle, cpolarization
-            numpy.int32_t[:] indices = self.indices, indptr = self.indptr
+            float[:] cdata, tdata, cflat, cdark, csolidAngle, cpolarization
         assert size == weights.size
 
         if dummy is not None:
@@ -543,7 +542,7 @@ class HistoBBox1d(object):
 
         if (do_dark + do_flat + do_polarization + do_solidAngle):
             tdata = numpy.ascontiguousarray(weights.ravel(), dtype=numpy.float32)
-            cdata = numpy.zeros(size, dtype=numpy.float32)
+            cdata = self.get_buffer("preprocess", size, zeros=True, exclude=tdata)
             if do_dummy:
                 for i in prange(size, nogil=True, schedule="static"):
                     data = tdata[i]
@@ -575,7 +574,7 @@ class HistoBBox1d(object):
         else:
             if do_dummy:
                 tdata = numpy.ascontiguousarray(weights.ravel(), dtype=numpy.float32)
-                cdata = numpy.zeros(size, dtype=numpy.float32)
+                cdata = self.get_buffer("preprocess", size, zeros=True, exclude=tdata)
                 for i in prange(size, nogil=True, schedule="static"):
                     data = tdata[i]
                     if ((cddummy != 0) and (fabs(data - cdummy) > cddummy)) or ((cddummy == 0) and (data != cdummy)):
@@ -585,26 +584,352 @@ class HistoBBox1d(object):
             else:
                 cdata = numpy.ascontiguousarray(weights.ravel(), dtype=numpy.float32)
 
-        for i in prange(bins, nogil=True, schedule="guided"):
-            sum_data = 0.0
-            sum_count = 0.0
-            for j in range(indptr[i], indptr[i + 1]):
-                idx = indices[j]
-                coef = ccoef[j]
-                if coef == 0.0:
+        # matrix-vector product with the kernel of the best instruction set
+        outData, outCount, outMerge = isa.csr_integrate(self.data, self.indices, self.indptr, numpy.asarray(cdata),
+                                                        do_dummy, cdummy)
+        return self.outPos, outMerge, outData, outCount
+
+class HistoBBox1dEdges(HistoBBox1d):
+    """
+    1D integrator with arbitrary (non uniform) increasing bin edges, like
+    logarithmic bins for SAXS.
+
+    The bin of each pixel is found by binary search in the edges and, with
+    pixel splitting, the coefficients are the fraction of the pixel's extent
+    (in radial space) overlapping each bin, which is correct for unequal bin
+    widths.
+    """
+    def __init__(self,
+                 pos0,
+                 delta_pos0,
+                 edges,
+                 pos1=None,
+                 delta_pos1=None,
+                 pos1Range=None,
+                 mask=None,
+                 mask_checksum=None,
+                 allow_pos0_neg=False,
+                 unit="undefined",
+                 empty=0.0
+                 ):
+        """
+        @param pos0: 1D array with pos0: tth or q_vect or r ...
+        @param delta_pos0: 1D array with delta pos0: max center-corner distance (None for no splitting)
+        @param edges: 1D array with the bins+1 edges of the bins, in increasing order
+        @param pos1: 1D array with pos1: chi
+        @param delta_pos1: 1D array with max pos1: max center-corner distance, unused !
+        @param pos1Range: minimum and maximum  of the chi range
+        @param mask: array (of int8) with masked pixels with 1 (0=not masked)
+        @param allow_pos0_neg: enforce the q<0 is usually not possible
+        @param unit: can be 2th_deg or r_nm^-1 ...
+        @param empty: value to be assigned to bins without contribution from any pixel
+        """
+        self.edges = numpy.ascontiguousarray(edges, dtype=numpy.float64).ravel()
+        assert self.edges.size > 1
+        assert (numpy.diff(self.edges) > 0).all(), "edges are increasing"
+        HistoBBox1d.__init__(self, pos0, delta_pos0, pos1, delta_pos1,
+                             bins=self.edges.size - 1,
+                             pos0Range=(self.edges[0], self.edges[-1]),
+                             pos1Range=pos1Range,
+                             mask=mask,
+                             mask_checksum=mask_checksum,
+                             allow_pos0_neg=allow_pos0_neg,
+                             unit=unit,
+                             empty=empty)
+        self.outPos = 0.5 * (self.edges[1:] + self.edges[:-1])
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def calc_lut(self):
+        """
+        calculate the max number of elements in the LUT and populate it
+        """
+        cdef:
+            double min0, max0, width, lower, upper
+            double[::1] cedges = self.edges
+            numpy.int32_t k, idx, i, bin0_min, bin0_max, bins = self.bins, size = self.size, nnz
+            bint check_mask = self.check_mask, check_pos1 = self.check_pos1, single
+            float pos1_min = 0, pos1_max = 0
+            numpy.ndarray[numpy.int32_t, ndim = 1] outMax = numpy.zeros(bins, dtype=numpy.int32)
+            numpy.ndarray[numpy.int32_t, ndim = 1] indptr = numpy.zeros(bins + 1, dtype=numpy.int32)
+            numpy.ndarray[numpy.int32_t, ndim = 1] indices
+            numpy.ndarray[numpy.float32_t, ndim = 1] data
+            float[:] cpos0_sup = self.cpos0_sup, cpos0_inf = self.cpos0_inf, cpos1_min, cpos1_max
+            numpy.int8_t[:] cmask
+
+        if check_mask:
+            cmask = self.cmask
+        if check_pos1:
+            cpos1_min = self.cpos1_min
+            cpos1_max = self.cpos1_max
+            pos1_max = self.pos1_max
+            pos1_min = self.pos1_min
+
+        with nogil:
+            for idx in range(size):
+                if (check_mask) and (cmask[idx]):
                     continue
-                data = cdata[idx]
-                if do_dummy and data == cdummy:
+                if check_pos1 and ((cpos1_max[idx] < pos1_min) or (cpos1_min[idx] > pos1_max)):
                     continue
-                sum_data = sum_data + coef * data
-                sum_count = sum_count + coef
-            outData[i] += sum_data
-            outCount[i] += sum_count
-            if sum_count > epsilon:
-                outMerge[i] += sum_data / sum_count
+                bin0_min = get_bin_index(cpos0_inf[idx], &cedges[0], bins)
+                bin0_max = get_bin_index(cpos0_sup[idx], &cedges[0], bins)
+                if (bin0_max < 0) or (bin0_min >= bins):
+                    continue
+                if bin0_max >= bins:
+                    bin0_max = bins - 1
+                if bin0_min < 0:
+                    bin0_min = 0
+                for i in range(bin0_min, bin0_max + 1):
+                    outMax[i] += 1
+
+        indptr[1:] = calc_indptr(outMax)
+        self.indptr = indptr
+        self.nnz = nnz = indptr[bins]
+        outMax[:] = 0
+        data = memory.empty(nnz, dtype=numpy.float32)
+        indices = memory.empty(nnz, dtype=numpy.int32)
+
+        with nogil:
+            for idx in range(size):
+                if (check_mask) and (cmask[idx]):
+                    continue
+                if check_pos1 and ((cpos1_max[idx] < pos1_min) or (cpos1_min[idx] > pos1_max)):
+                    continue
+                min0 = cpos0_inf[idx]
+                max0 = cpos0_sup[idx]
+                bin0_min = get_bin_index(min0, &cedges[0], bins)
+                bin0_max = get_bin_index(max0, &cedges[0], bins)
+                if (bin0_max < 0) or (bin0_min >= bins):
+                    continue
+                single = (bin0_min == bin0_max)
+                if bin0_max >= bins:
+                    bin0_max = bins - 1
+                if bin0_min < 0:
+                    bin0_min = 0
+                width = max0 - min0
+                for i in range(bin0_min, bin0_max + 1):
+                    k = outMax[i]
+                    indices[indptr[i] + k] = idx
+                    if single:
+                        data[indptr[i] + k] = onef
+                    else:
+                        # fraction of the pixel within the bin, in radial space
+                        lower = min0 if min0 > cedges[i] else cedges[i]
+                        upper = max0 if max0 < cedges[i + 1] else cedges[i + 1]
+                        data[indptr[i] + k] = <float> ((upper - lower) / width)
+                    outMax[i] += 1
+
+        self.data = data
+        self.indices = indices
+
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def calc_lut_nosplit(self):
+        """
+        calculate the max number of elements in the LUT and populate it
+        """
+        cdef:
+            double[::1] cedges = self.edges
+            numpy.int32_t k, idx, bin0, bins = self.bins, size = self.size, nnz
+            bint check_mask = self.check_mask, check_pos1 = self.check_pos1
+            float pos1_min = 0, pos1_max = 0
+            numpy.ndarray[numpy.int32_t, ndim = 1] outMax = numpy.zeros(bins, dtype=numpy.int32)
+            numpy.ndarray[numpy.int32_t, ndim = 1] indptr = numpy.zeros(bins + 1, dtype=numpy.int32)
+            numpy.ndarray[numpy.int32_t, ndim = 1] indices
+            numpy.ndarray[numpy.float32_t, ndim = 1] data
+            numpy.ndarray[numpy.int32_t, ndim = 1] pixel_bin = numpy.empty(size, dtype=numpy.int32)
+            float[:] cpos0 = self.cpos0, cpos1_min, cpos1_max
+            numpy.int8_t[:] cmask
+
+        if check_mask:
+            cmask = self.cmask
+        if check_pos1:
+            cpos1_min = self.cpos1_min
+            cpos1_max = self.cpos1_max
+            pos1_max = self.pos1_max
+            pos1_min = self.pos1_min
+
+        with nogil:
+            for idx in range(size):
+                pixel_bin[idx] = -1
+                if (check_mask) and (cmask[idx]):
+                    continue
+                if check_pos1 and ((cpos1_max[idx] < pos1_min) or (cpos1_min[idx] > pos1_max)):
+                    continue
+                bin0 = get_bin_index(cpos0[idx], &cedges[0], bins)
+                if (bin0 >= 0) and (bin0 < bins):
+                    pixel_bin[idx] = bin0
+                    outMax[bin0] += 1
+
+        indptr[1:] = calc_indptr(outMax)
+        self.indptr = indptr
+        self.nnz = nnz = indptr[bins]
+        outMax[:] = 0
+        data = numpy.ones(nnz, dtype=numpy.float32)
+        indices = memory.empty(nnz, dtype=numpy.int32)
+
+        with nogil:
+            for idx in range(size):
+                bin0 = pixel_bin[idx]
+                if bin0 < 0:
+                    continue
+                k = outMax[bin0]
+                indices[indptr[bin0] + k] = idx
+                outMax[bin0] += 1
+
+        self.data = data
+        self.indices = indices
+
+
+class HistoBBoxSectors(CsrIntegratorMixin):
+    """
+    Multi-sector 1D integrator: the azimuthal range is cut into sectors and
+    all radial profiles are obtained in a single pass over the image.
+
+    The CSR matrix is the stack of the matrices of the HistoBBox1d of each
+    sector, sharing the same radial bins: the row i*bins+j is the radial
+    bin j of sector i.
+    Since sectors may overlap, a pixel can contribute to several rows.
+    """
+    def __init__(self,
+                 pos0,
+                 delta_pos0,
+                 pos1,
+                 delta_pos1=None,
+                 int bins=100,
+                 sectors=8,
+                 pos0Range=None,
+                 pos1Range=None,
+                 mask=None,
+                 mask_checksum=None,
+                 allow_pos0_neg=False,
+                 unit="undefined",
+                 empty=0.0
+                 ):
+        """
+        @param pos0: 1D array with pos0: tth or q_vect or r ...
+        @param delta_pos0: 1D array with delta pos0: max center-corner distance (None for no splitting)
+        @param pos1: 1D array with pos1: chi
+        @param delta_pos1: 1D array with max pos1: max center-corner distance
+        @param bins: number of output radial bins, 100 by default
+        @param sectors: number of equal sectors within pos1Range or list of (pos1_min, pos1_max) for each sector
+        @param pos0Range: minimum and maximum  of the 2th range
+        @param pos1Range: minimum and maximum  of the chi range, to be cut into equal sectors
+        @param mask: array (of int8) with masked pixels with 1 (0=not masked)
+        @param allow_pos0_neg: enforce the q<0 is usually not possible
+        @param unit: can be 2th_deg or r_nm^-1 ...
+        @param empty: value to be assigned to bins without contribution from any pixel
+        """
+        self.size = pos0.size
+        assert pos1.size == self.size
+        if "size" not in dir(delta_pos0) or delta_pos0.size != self.size:
+            delta_pos0 = None
+        self.split = "no" if delta_pos0 is None else "bbox"
+        if delta_pos1 is None:
+            delta_pos1 = numpy.zeros_like(pos1)
+        self.bins = bins
+        self.allow_pos0_neg = allow_pos0_neg
+        self.empty = empty
+        self.unit = unit
+        self.pos1Range = pos1Range
+        if mask is not None:
+            assert mask.size == self.size
+            self.check_mask = True
+            if not mask_checksum:
+                mask_checksum = crc32(mask)
+        else:
+            self.check_mask = False
+            mask_checksum = None
+        self.mask_checksum = mask_checksum
+
+        if "__len__" in dir(sectors):
+            self.sectors = [(min(sector), max(sector)) for sector in sectors]
+        else:
+            if pos1Range is not None and len(pos1Range) > 1:
+                pos1_min = min(pos1Range)
+                pos1_max = max(pos1Range)
             else:
-                outMerge[i] += cdummy
-        return self.outPos, outMerge, outData, outCount
+                pos1_min = pos1.min()
+                pos1_max = pos1.max()
+            edges = numpy.linspace(pos1_min, pos1_max, int(sectors) + 1)
+            self.sectors = [(edges[i], edges[i + 1]) for i in range(int(sectors))]
+        self.nsectors = len(self.sectors)
+
+        # all sectors share the same radial bins
+        self.pos0Range = pos0Range
+        if pos0Range is None or len(pos0Range) < 2:
+            if mask is not None:
+                valid = numpy.logical_not(mask.ravel())
+            else:
+                valid = slice(None)
+            cpos0 = pos0.ravel()[valid]
+            if delta_pos0 is not None:
+                cdpos0 = delta_pos0.ravel()[valid]
+                pos0Range = ((cpos0 - cdpos0).min(), (cpos0 + cdpos0).max())
+            else:
+                pos0Range = (cpos0.min(), cpos0.max())
+            if not allow_pos0_neg:
+                pos0Range = (max(pos0Range[0], 0), max(pos0Range[1], 0))
+
+        data = []
+        indices = []
+        indptr = [numpy.zeros(1, dtype=numpy.int32)]
+        nnz = 0
+        for sector in self.sectors:
+            integr = HistoBBox1d(pos0, delta_pos0, pos1, delta_pos1,
+                                 bins=bins,
+                                 pos0Range=pos0Range,
+                                 pos1Range=sector,
+                                 mask=mask,
+                                 mask_checksum=mask_checksum,
+                                 allow_pos0_neg=allow_pos0_neg,
+                                 unit=unit,
+                                 empty=empty)
+            data.append(integr.data)
+            indices.append(integr.indices)
+            indptr.append(integr.indptr[1:] + nnz)
+            nnz += integr.nnz
+        self.pos0_min = integr.pos0_min
+        self.pos0_max = integr.pos0_max
+        self.delta = integr.delta
+        self.outPos = integr.outPos
+        self.nnz = nnz
+        self.data = numpy.concatenate(data)
+        self.indices = numpy.concatenate(indices)
+        self.indptr = numpy.concatenate(indptr).astype(numpy.int32)
+        self.lut_checksum = crc32(self.data)
+        self.lut = (self.data, self.indices, self.indptr)
+        self.lut_nbytes = sum([i.nbytes for i in self.lut])
+
+    def integrate(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None):
+        """
+        Integrate all sectors in a single pass over the image
+
+        @param weights: input image
+        @type weights: ndarray
+        @param dummy: value for dead pixels (optional)
+        @type dummy: float
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @type delta_dummy: float
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @type dark: ndarray
+        @param flat: array with the dark-current value to be divided by (if any)
+        @type flat: ndarray
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @type solidAngle: ndarray
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @type polarization: ndarray
+        @return : positions, pattern, weighted_histogram and unweighted_histogram, the last three with shape (nsectors, bins)
+        @rtype: 4-tuple of ndarrays
+        """
+        # the stacked matrix is integrated by the kernel of the mixin, dispatched on the instruction set
+        pos, outMerge, outData, outCount = CsrIntegratorMixin.integrate(self, weights, dummy=dummy,
+                                                                        delta_dummy=delta_dummy, dark=dark, flat=flat,
+                                                                        solidAngle=solidAngle, polarization=polarization)
+        shape = (self.nsectors, self.bins)
+        return pos, outMerge.reshape(shape), outData.reshape(shape), outCount.reshape(shape)
 
 ################################################################################
 # Bidimensionnal regrouping
@@ -920,7 +1245,7 @@ class HistoBBox2d(object):
                     for j in range(bin1_min, bin1_max + 1):
                         outMax[i, j] += 1
 
-        indptr[1:] = outMax.ravel().cumsum()
+        indptr[1:] = calc_indptr(outMax)
         self.nnz = nnz = indptr[bins0 * bins1]
         self.indptr = indptr
         # Just recycle the outMax array
@@ -936,8 +1261,8 @@ class HistoBBox2d(object):
                 if memsize < lut_nbytes:
                     raise MemoryError("CSR Matrix is %.3fGB whereas the memory of the system is only %s" % (lut_nbytes / 2. ** 30, memsize / 2. ** 30))
         # else hope that enough memory is available
-        data = numpy.zeros(nnz, dtype=numpy.float32)
-        indices = numpy.zeros(nnz, dtype=numpy.int32)
+        data = memory.zeros(nnz, dtype=numpy.float32)
+        indices = memory.zeros(nnz, dtype=numpy.int32)
         with nogil:
             for idx in range(size):
                 if (check_mask) and cmask[idx]:
@@ -1130,7 +1455,7 @@ class HistoBBox2d(object):
 
                 outMax[bin0, bin1] += 1
 
-        indptr[1:] = outMax.ravel().cumsum()
+        indptr[1:] = calc_indptr(outMax)
         self.nnz = nnz = indptr[bins0 * bins1]
         self.indptr = indptr
         # Just recycle the outMax array
@@ -1145,8 +1470,8 @@ class HistoBBox2d(object):
                 if memsize < lut_nbytes:
                     raise MemoryError("CSR Matrix is %.3fGB whereas the memory of the system is only %s" % (lut_nbytes / 2. ** 30, memsize / 2. ** 30))
         # else hope that enough memory is available
-        data = numpy.zeros(nnz, dtype=numpy.float32)
-        indices = numpy.zeros(nnz, dtype=numpy.int32)
+        data = memory.zeros(nnz, dtype=numpy.float32)
+        indices = memory.zeros(nnz, dtype=numpy.int32)
         with nogil:
             for idx in range(size):
                 if (check_mask) and cmask[idx]:
@@ -1306,3 +1631,56 @@ class HistoBBox2d(object):
                 outMerge_1d[i] += cdummy
         return outMerge.T, self.outPos0, self.outPos1, outData.T, outCount.T
 
+
+    def radial_mapping(self, bins):
+        """
+        Calculate the matrix distributing the radial bins of the 2D
+        integration into a different number of 1D bins spanning the same range.
+
+        @param bins: number of bins of the 1D pattern
+        @return: positions of the 1D bins, mapping matrix of shape (bins, radial bins of the 2D)
+        """
+        cdef int bins0 = self.bins[0]
+        edges2d = self.pos0_min + self.delta0 * numpy.arange(bins0 + 1)
+        edges1d = numpy.linspace(self.pos0_min, self.pos0_max, bins + 1)
+        lower = numpy.maximum(edges1d[:-1, None], edges2d[None, :-1])
+        upper = numpy.minimum(edges1d[1:, None], edges2d[None, 1:])
+        mapping = numpy.maximum(upper - lower, 0.0) / self.delta0
+        delta = (self.pos0_max - self.pos0_min) / bins
+        positions = numpy.linspace(self.pos0_min + 0.5 * delta, self.pos0_maxin - 0.5 * delta, bins)
+        return positions, mapping
+
+    def integrate_1d2d(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None,
+                       mapping=None):
+        """
+        Perform the 2D integration and derive the 1D radial pattern from the
+        same pass by summing the weighted and unweighted histograms along the
+        azimuthal axis.
+
+        @param weights: input image
+        @param dummy: value for dead pixels (optional)
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @param flat: array with the dark-current value to be divided by (if any)
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @param mapping: 2-tuple (positions, matrix) from radial_mapping when the 1D bins differ from the 2D ones
+        @return: (positions, I, weighted histogram, unweighted histogram) for the 1D and
+                 (I, edges0, edges1, weighted histogram, unweighted histogram) for the 2D
+        @rtype: 2-tuple of tuples
+        """
+        res2d = self.integrate(weights, dummy=dummy, delta_dummy=delta_dummy, dark=dark, flat=flat,
+                               solidAngle=solidAngle, polarization=polarization)
+        sum1d = res2d[3].sum(axis=0)
+        count1d = res2d[4].sum(axis=0)
+        if mapping is None:
+            positions = self.outPos0
+        else:
+            positions = mapping[0]
+            sum1d = numpy.dot(mapping[1], sum1d)
+            count1d = numpy.dot(mapping[1], count1d)
+        I1d = numpy.empty(sum1d.size, dtype=numpy.float32)
+        valid = count1d > 1e-10
+        I1d[valid] = sum1d[valid] / count1d[valid]
+        I1d[numpy.logical_not(valid)] = self.empty if dummy is None else dummy
+        return (positions, I1d, sum1d, count1d), res2d
@@ -518,6 +518,135 @@ class HistoBBox1d(object):
 
         return self.outPos, outMerge, outData, outCount
 
+    @cython.cdivision(True)
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def integrate_variance(self, weights, dummy=None, delta_dummy=None, dark=None, flat=None, solidAngle=None, polarization=None):
+        """
+        Perform the integration and calculate, in the same pass, the weighted
+        sum of squared deviations to the mean within each bin using the
+        incremental algorithm of West (1979).
+        The azimuthal error is then sqrt(M2)/count.
+
+        @param weights: input image
+        @type weights: ndarray
+        @param dummy: value for dead pixels (optional)
+        @type dummy: float
+        @param delta_dummy: precision for dead-pixel value in dynamic masking
+        @type delta_dummy: float
+        @param dark: array with the dark-current value to be subtracted (if any)
+        @type dark: ndarray
+        @param flat: array with the dark-current value to be divided by (if any)
+        @type flat: ndarray
+        @param solidAngle: array with the solid angle of each pixel to be divided by (if any)
+        @type solidAngle: ndarray
+        @param polarization: array with the polarization correction values to be divided by (if any)
+        @type polarization: ndarray
+        @return : positions, pattern, weighted_histogram, unweighted_histogram and sum of weighted squared deviations
+        @rtype: 5-tuple of ndarrays
+
+        """
+        cdef:
+            numpy.int32_t i = 0, j = 0, idx = 0, bins = self.bins, lut_size = self.lut_size, size = self.size
+            double sum_data = 0, sum_count = 0, mean = 0, M2 = 0, delta = 0, epsilon = 1e-10
+            float data = 0, coef = 0, cdummy = 0, cddummy = 0
+            bint do_dummy = False, do_dark = False, do_flat = False, do_polarization = False, do_solidAngle = False
+            numpy.ndarray[numpy.float64_t, ndim = 1] outData = numpy.zeros(self.bins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float64_t, ndim = 1] outCount = numpy.zeros(self.bins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float64_t, ndim = 1] outM2 = numpy.zeros(self.bins, dtype=numpy.float64)
+            numpy.ndarray[numpy.float32_t, ndim = 1] outMerge = numpy.zeros(self.bins, dtype=numpy.float32)
+            float[:] cdata, tdata, cflat, cdark, csolidAngle, cpolarization
+
+            #Ugly hack against bug #89: https://github.com/pyFAI/pyFAI/issues/89
+            int rc_before, rc_after
+        rc_before = sys.getrefcount(self._lut)
+        cdef lut_point[:, :] lut = self._lut
+        rc_after = sys.getrefcount(self._lut)
+        cdef bint need_decref = NEED_DECREF & ((rc_after - rc_before) >= 2)
+
+        assert size == weights.size
+
+        if dummy is not None:
+            do_dummy = True
+            cdummy = <float> float(dummy)
+            if delta_dummy is None:
+                cddummy = zerof
+            else:
+                cddummy = <float> float(delta_dummy)
+        else:
+            cdummy = self.empty
+
+        if flat is not None:
+            do_flat = True
+            assert flat.size == size
+            cflat = numpy.ascontiguousarray(flat.ravel(), dtype=numpy.float32)
+        if dark is not None:
+            do_dark = True
+            assert dark.size == size
+            cdark = numpy.ascontiguousarray(dark.ravel(), dtype=numpy.float32)
+        if solidAngle is not None:
+            do_solidAngle = True
+            assert solidAngle.size == size
+            csolidAngle = numpy.ascontiguousarray(solidAngle.ravel(), dtype=numpy.float32)
+        if polarization is not None:
+            do_polarization = True
+            assert polarization.size == size
+            cpolarization = numpy.ascontiguousarray(polarization.ravel(), dtype=numpy.float32)
+
+        if (do_dark + do_flat + do_polarization + do_solidAngle + do_dummy):
+            tdata = numpy.ascontiguousarray(weights.ravel(), dtype=numpy.float32)
+            cdata = numpy.zeros(size, dtype=numpy.float32)
+            for i in prange(size, nogil=True, schedule="static"):
+                data = tdata[i]
+                if do_dummy and (((cddummy != 0) and (fabs(data - cdummy) <= cddummy)) or ((cddummy == 0) and (data == cdummy))):
+                    # set all dummy_like values to cdummy. simplifies further processing
+                    cdata[i] += cdummy
+                else:
+                    if do_dark:
+                        data = data - cdark[i]
+                    if do_flat:
+                        data = data / cflat[i]
+                    if do_polarization:
+                        data = data / cpolarization[i]
+                    if do_solidAngle:
+                        data = data / csolidAngle[i]
+                    cdata[i] += data
+        else:
+            cdata = numpy.ascontiguousarray(weights.ravel(), dtype=numpy.float32)
+
+        for i in prange(bins, nogil=True, schedule="guided"):
+            sum_data = 0.0
+            sum_count = 0.0
+            mean = 0.0
+            M2 = 0.0
+            for j in range(lut_size):
+                idx = lut[i, j].idx
+                coef = lut[i, j].coef
+                if coef == 0.0:  # padding of the LUT
+                    continue
+                data = cdata[idx]
+                if do_dummy and (data == cdummy):
+                    continue
+                sum_data = sum_data + coef * data
+                sum_count = sum_count + coef
+                delta = data - mean
+                mean = mean + delta * coef / sum_count
+                M2 = M2 + coef * delta * (data - mean)
+            outData[i] += sum_data
+            outCount[i] += sum_count
+            outM2[i] += M2
+            if sum_count > epsilon:
+                outMerge[i] += sum_data / sum_count
+            else:
+                outMerge[i] += cdummy
+
+        # Ugly against bug#89
+        if need_decref and (sys.getrefcount(self._lut) >= rc_before + 2):
+            logger.warning("Decref needed")
+            Py_XDECREF(<PyObject *> self._lut)
+
+        return self.outPos, outMerge, outData, outCount, outM2
+
     @cython.cdivision(True)
     @cython.boundscheck(False)
     @cython.wraparound(False)
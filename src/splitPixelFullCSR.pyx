@@ -43,6 +43,7 @@ from libc.math cimport fabs, floor, sqrt
 from libc.stdio cimport printf, fflush, stdout
 
 include "regrid_common.pxi"
+include "csr_common.pxi"
 
 try:
     from fastcrc import crc32
@@ -160,7 +161,7 @@ cdef inline int on_boundary(float A, float B, float C, float D) nogil:
             ((A < -piover2) and (B > piover2) and (C > piover2) and (D < -piover2)))
 
 
-class FullSplitCSR_1d(object):
+class FullSplitCSR_1d(CsrIntegratorMixin):
     """
     Now uses CSR (Compressed Sparse raw) with main attributes:
     * nnz: number of non zero elements
@@ -303,15 +304,16 @@ class FullSplitCSR_1d(object):
                 bin0_min = < int > floor(min0)
                 bin0_max = < int > floor(max0)
 
-                for bin in range(bin0_min, bin0_max+1):
+                # pixels crossing the limits of the range only contribute to bins within the range
+                for bin in range(max(bin0_min, 0), min(bin0_max, bins - 1) + 1):
                     outMax[bin] += 1
 
-        indptr[1:] = outMax.cumsum()
+        indptr[1:] = calc_indptr(outMax)
         self.indptr = indptr
 
         cdef:
-            numpy.ndarray[numpy.int32_t, ndim = 1] indices = numpy.zeros(indptr[bins], dtype=numpy.int32)
-            numpy.ndarray[numpy.float32_t, ndim = 1] data = numpy.zeros(indptr[bins], dtype=numpy.float32)
+            numpy.ndarray[numpy.int32_t, ndim = 1] indices = memory.zeros(indptr[bins], dtype=numpy.int32)
+            numpy.ndarray[numpy.float32_t, ndim = 1] data = memory.zeros(indptr[bins], dtype=numpy.float32)
 
         #just recycle the outMax array
         outMax[:] = 0
@@ -379,7 +381,7 @@ class FullSplitCSR_1d(object):
 
                     oneOverPixelArea = 1.0 / areaPixel
 
-                    for bin in range(bin0_min, bin0_max+1):
+                    for bin in range(max(bin0_min, 0), min(bin0_max, bins - 1) + 1):
                         bin0 = bin - bin0_min
                         A_lim = (A0<=bin0)*(A0<=(bin0+1))*bin0 + (A0>bin0)*(A0<=(bin0+1))*A0 + (A0>bin0)*(A0>(bin0+1))*(bin0+1)
                         B_lim = (B0<=bin0)*(B0<=(bin0+1))*bin0 + (B0>bin0)*(B0<=(bin0+1))*B0 + (B0>bin0)*(B0>(bin0+1))*(bin0+1)
@@ -767,7 +769,7 @@ class FullSplitCSR_2d(object):
                             if tmp_i is not 0:
                                 outMax[i + bin0_min, j + bin1_min] += 1
 
-        indptr[1:] = outMax.ravel().cumsum()
+        indptr[1:] = calc_indptr(outMax)
         self.indptr = indptr
 
         cdef numpy.ndarray[numpy.int32_t, ndim = 1] indices = numpy.zeros(indptr[all_bins], dtype=numpy.int32)
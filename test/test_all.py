@@ -72,6 +72,27 @@ from .test_bispev import test_suite_all_bispev
 from .test_bug_regression import test_suite_bug_regression
 from .test_multi_geometry import test_suite_all_multi_geometry
 from .test_watershed import test_suite_all_watershed
+from .test_csr_stats import test_suite_all_csr_stats
+from .test_sectors import test_suite_all_sectors
+from .test_joint import test_suite_all_joint
+from .test_radial_bins import test_suite_all_radial_bins
+from .test_roi import test_suite_all_roi
+from .test_sparse_frame import test_suite_all_sparse_frame
+from .test_stream import test_suite_all_stream
+from .test_derived_csr import test_suite_all_derived_csr
+from .test_tiled_csr import test_suite_all_tiled_csr
+from .test_numa import test_suite_all_numa
+from .test_renumbering import test_suite_all_renumbering
+from .test_memory import test_suite_all_memory
+from .test_isa import test_suite_all_isa
+from .test_autotune import test_suite_all_autotune
+from .test_preview import test_suite_all_preview
+from .test_peak_finder import test_suite_all_peak_finder
+from .test_backprojection import test_suite_all_backprojection
+from .test_preproc import test_suite_all_preproc
+from .test_ring_index import test_suite_all_ring_index
+from .test_rank_filter import test_suite_all_rank_filter
+from .test_relabel import test_suite_all_relabel
 
 
 def test_suite_all():
@@ -105,6 +126,27 @@ def test_suite_all():
     testSuite.addTest(test_suite_bug_regression())
     testSuite.addTest(test_suite_all_watershed())
     testSuite.addTest(test_suite_all_multi_geometry())
+    testSuite.addTest(test_suite_all_csr_stats())
+    testSuite.addTest(test_suite_all_sectors())
+    testSuite.addTest(test_suite_all_joint())
+    testSuite.addTest(test_suite_all_radial_bins())
+    testSuite.addTest(test_suite_all_roi())
+    testSuite.addTest(test_suite_all_sparse_frame())
+    testSuite.addTest(test_suite_all_stream())
+    testSuite.addTest(test_suite_all_derived_csr())
+    testSuite.addTest(test_suite_all_tiled_csr())
+    testSuite.addTest(test_suite_all_numa())
+    testSuite.addTest(test_suite_all_renumbering())
+    testSuite.addTest(test_suite_all_memory())
+    testSuite.addTest(test_suite_all_isa())
+    testSuite.addTest(test_suite_all_autotune())
+    testSuite.addTest(test_suite_all_preview())
+    testSuite.addTest(test_suite_all_peak_finder())
+    testSuite.addTest(test_suite_all_backprojection())
+    testSuite.addTest(test_suite_all_preproc())
+    testSuite.addTest(test_suite_all_ring_index())
+    testSuite.addTest(test_suite_all_rank_filter())
+    testSuite.addTest(test_suite_all_relabel())
     return testSuite
 
 if __name__ == '__main__':
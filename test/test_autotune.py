@@ -0,0 +1,154 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the automatic selection of the integration method
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import json
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import autotune, isa
+
+
+class TestAutotune(IntegratorTestCase):
+    """
+    Trials, persistence of the decisions and method="auto"
+    """
+    def setUp(self):
+        IntegratorTestCase.setUp(self)
+        self.filename = os.path.join(UtilsTest.tempdir, "autotune_%s.json" % self.id().split(".")[-1])
+        if os.path.exists(self.filename):
+            os.unlink(self.filename)
+
+    def tearDown(self):
+        if os.path.exists(self.filename):
+            os.unlink(self.filename)
+
+    def test_thread_counts(self):
+        self.assertEqual(autotune.thread_counts(1), [1])
+        self.assertEqual(autotune.thread_counts(4), [1, 2, 4])
+        self.assertEqual(autotune.thread_counts(12), [1, 2, 4, 8, 12])
+
+    def test_tune(self):
+        tuner = autotune.Autotuner(self.filename, repeat=1)
+        decision = tuner.tune(self.ai, self.shape, 100, unit="2th_deg")
+        self.assert_(decision["method"] in autotune.CANDIDATES, "method is a candidate")
+        self.assert_(decision["errors"][decision["method"]] <= tuner.rtol, "method is accurate")
+        fastest = min(decision["timings"][m] for m in decision["timings"] if decision["errors"][m] <= tuner.rtol)
+        self.assertEqual(decision["timings"][decision["method"]], fastest, "method is the fastest")
+        self.assert_(1 <= decision["threads"] <= autotune.MAX_THREADS, "thread count")
+        self.assertEqual(self.ai._csr_integrator, None, "trials do not fill the caches of the integrator")
+
+        # the decision is persisted and re-used without new trials
+        self.assert_(os.path.exists(self.filename), "decisions saved")
+        with open(self.filename) as infile:
+            self.assertEqual(len(json.load(infile)), 1)
+        other = autotune.Autotuner(self.filename, repeat=1)
+        other._time = None  # any trial would fail
+        self.assertEqual(other.tune(self.ai, self.shape, 100, unit="2th_deg"), decision)
+        self.assertNotEqual(tuner.config_key(self.ai, self.shape, 100, "2th_deg"),
+                            tuner.config_key(self.ai, self.shape, 200, "2th_deg"), "npt is part of the key")
+
+    def test_key(self):
+        """the values of the ranges and of the mask are part of the key"""
+        tuner = autotune.Autotuner(self.filename)
+        key = lambda **kwargs: tuner.config_key(self.ai, self.shape, 100, "2th_deg", **kwargs)
+        self.assertNotEqual(key(radial_range=(1, 10)), key(radial_range=(1, 20)), "radial range")
+        self.assertEqual(key(radial_range=(1, 10)), key(radial_range=[1.0, 10.0]), "same radial range")
+        self.assertNotEqual(key(azimuth_range=(-90, 90)), key(azimuth_range=(0, 90)), "azimuth range")
+        mask = numpy.zeros(self.shape, dtype=numpy.int8)
+        other = mask.copy()
+        other[10, 10] = 1
+        self.assertNotEqual(key(mask=mask), key(mask=other), "mask")
+        self.assertEqual(key(mask=other), key(mask=other.astype(bool)), "same mask")
+
+    def test_apply(self):
+        """the number of threads of a decision is restored after the call"""
+        tuner = autotune.Autotuner(self.filename)
+        previous = isa.get_num_threads()
+        with tuner.apply({"method": "csr", "threads": previous + 1}) as method:
+            self.assertEqual(method, "csr")
+            self.assertEqual(isa.get_num_threads(), previous + 1, "threads of the decision")
+        self.assertEqual(isa.get_num_threads(), previous, "threads restored")
+
+        self.ai.autotuner = tuner
+        key = tuner.hardware_key() + "||" + tuner.config_key(self.ai, self.shape, 100, "2th_deg", mask=self.ai.mask)
+        tuner.load()[key] = {"method": "csr", "threads": previous + 1}
+        self.ai.integrate1d(self.data, 100, unit="2th_deg", method="auto")
+        self.assertEqual(isa.get_num_threads(), previous, "threads restored after integrate1d")
+
+    def test_strict(self):
+        """approximate engines are rejected with a tight tolerance"""
+        tuner = autotune.Autotuner(self.filename, candidates=("nosplit_csr", "full_csr"), rtol=0, repeat=1)
+        self.assertEqual(tuner.tune(self.ai, self.shape, 100, unit="2th_deg")["method"], "full_csr")
+
+    def test_fallback(self):
+        """the reference method is used when no candidate is accurate enough"""
+        tuner = autotune.Autotuner(self.filename, candidates=("nosplit_csr",), rtol=0, repeat=1)
+        decision = tuner.tune(self.ai, self.shape, 100, unit="2th_deg")
+        self.assertEqual(decision["method"], autotune.REFERENCE)
+        self.assertEqual(decision["errors"][autotune.REFERENCE], 0)
+
+    def test_auto(self):
+        self.ai.autotuner = autotune.Autotuner(self.filename, repeat=1)
+        data = numpy.random.random(self.shape).astype(numpy.float32)
+        res = self.ai.integrate1d(data, 100, unit="2th_deg", method="auto")
+        method = self.ai.autotune(self.shape, 100, "2th_deg")
+        ref = self.ai.integrate1d(data, 100, unit="2th_deg", method=method)
+        self.assert_(numpy.allclose(res[0], ref[0]), "same bins as %s" % method)
+        self.assert_(numpy.allclose(res[1], ref[1]), "same intensities as %s" % method)
+
+
+def test_suite_all_autotune():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestAutotune("test_thread_counts"))
+    testSuite.addTest(TestAutotune("test_tune"))
+    testSuite.addTest(TestAutotune("test_key"))
+    testSuite.addTest(TestAutotune("test_apply"))
+    testSuite.addTest(TestAutotune("test_strict"))
+    testSuite.addTest(TestAutotune("test_fallback"))
+    testSuite.addTest(TestAutotune("test_auto"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_autotune()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,191 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the back-projection of 1D and 2D profiles on the detector
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI.azimuthalIntegrator import AzimuthalIntegrator
+from pyFAI import _geometry
+from pyFAI import units
+
+
+class TestBackProjection(unittest.TestCase):
+    """
+    Images calculated from integrated profiles with cached interpolation weights
+    """
+    def setUp(self):
+        self.ai = AzimuthalIntegrator(dist=0.1, poni1=0.02, poni2=0.04, detector="Pilatus100k")
+        self.shape = self.ai.detector.shape
+        numpy.random.seed(0)
+
+    def test_interp(self):
+        xp = numpy.linspace(0, 10, 50)
+        fp = numpy.random.random(50).astype(numpy.float32)
+        pos = numpy.random.random(10000) * 14 - 2  # also beyond both ends
+        pos[:3] = xp[:3]  # exactly on the nodes
+        idx, frac = _geometry.calc_interp_weights(pos, xp)
+        self.assertEqual(idx.dtype, numpy.int32)
+        self.assertEqual(frac.dtype, numpy.float64)
+        res = _geometry.back_project(fp, idx, frac)
+        self.assertEqual(res.dtype, numpy.float64)
+        self.assert_(abs(res - numpy.interp(pos, xp, fp)).max() < 1e-5, "same as numpy.interp")
+
+        # a single node gives a constant image
+        idx, frac = _geometry.calc_interp_weights(pos, xp[:1])
+        self.assert_(numpy.all(_geometry.back_project(fp[:1], idx, frac) == fp[0]), "constant")
+
+    def test_correction(self):
+        xp = numpy.linspace(0, 1, 20)
+        fp = numpy.random.random(20)
+        pos = numpy.random.random(1000)
+        solid_angle = numpy.random.random(1000)
+        mask = numpy.zeros(1000, dtype=numpy.int8)
+        mask[::7] = 1
+        idx, frac = _geometry.calc_interp_weights(pos, xp)
+        res = _geometry.back_project(fp, idx, frac, solid_angle=solid_angle, mask=mask)
+        ref = numpy.interp(pos, xp, fp) * solid_angle
+        ref[mask != 0] = 0
+        self.assert_(abs(res - ref).max() < 1e-5, "solid angle and mask")
+        res = _geometry.back_project(fp, idx, frac, mask=mask.astype(bool))
+        self.assertEqual(res[0], 0, "boolean mask")
+
+    def test_calcfrom1d(self):
+        unit = units.to_unit("2th_deg")
+        tth = numpy.linspace(0.5, 40, 300)
+        I = numpy.cos(numpy.deg2rad(tth) * 20) ** 2 * 1000
+        mask = numpy.zeros(self.shape, dtype=numpy.int8)
+        mask[:, 200:220] = 1
+        res = self.ai.calcfrom1d(tth, I, self.shape, mask=mask, dim1_unit=unit)
+        ref = numpy.interp(self.ai.twoThetaArray(self.shape), tth / unit.scale, I) * self.ai.solidAngleArray(self.shape)
+        ref[mask != 0] = 0
+        self.assertEqual(res.shape, self.shape)
+        self.assertEqual(res.dtype, numpy.float64, "same type as numpy.interp")
+        self.assert_(abs(res - ref).max() < 1e-2, "same as the formula")
+
+        # the weights are re-used, then invalidated by a change of geometry
+        self.assertEqual(len(self.ai._interp_weights), 1)
+        self.ai.calcfrom1d(tth, 2 * I, self.shape, dim1_unit=unit)
+        self.assertEqual(len(self.ai._interp_weights), 1, "weights re-used with other intensities")
+        self.ai.rot1 = 0.01
+        self.assertEqual(len(self.ai._interp_weights), 0, "weights invalidated by the geometry")
+        res = self.ai.calcfrom1d(tth, I, self.shape, dim1_unit=unit, correctSolidAngle=False)
+        ref = numpy.interp(self.ai.twoThetaArray(self.shape), tth / unit.scale, I)
+        self.assert_(abs(res - ref).max() < 1e-2, "new geometry")
+
+    def test_calcfrom2d(self):
+        tth = self.ai.twoThetaArray(self.shape)
+        chi = self.ai.chiArray(self.shape)
+        img = (1000 + 100 * numpy.cos(chi) + 500 * numpy.exp(-5 * tth)).astype(numpy.float32)
+        I, radial, azimuthal = self.ai.integrate2d(img, 100, 360, unit="2th_deg", correctSolidAngle=False)
+        res = self.ai.calcfrom2d(I, radial, azimuthal, self.shape, dim1_unit="2th_deg", correctSolidAngle=False)
+        self.assertEqual(res.shape, self.shape)
+        # pixels next to empty bins of the 2D pattern are not reconstructed
+        error = abs(res - img) / img
+        self.assert_((error < 1e-2).mean() > 0.9, "most pixels are reconstructed")
+        self.assert_(numpy.median(error) < 1e-3, "smooth image reconstructed")
+
+        # same as a bilinear interpolation with numpy
+        unit = units.to_unit("2th_deg")
+        I = numpy.random.random((5, 7))
+        radial = numpy.linspace(tth.min(), tth.max(), 7) * unit.scale
+        azimuthal = numpy.linspace(-180, 180, 5)
+        res = self.ai.calcfrom2d(I, radial, azimuthal, self.shape, dim1_unit=unit, correctSolidAngle=False)
+        rows = numpy.array([numpy.interp(tth.ravel(), radial / unit.scale, line) for line in I])
+        x = numpy.interp(chi.ravel(), numpy.deg2rad(azimuthal), numpy.arange(5))
+        k = numpy.minimum(x.astype(int), 3)
+        g = x - k
+        cols = numpy.arange(rows.shape[1])
+        ref = rows[k, cols] * (1 - g) + rows[k + 1, cols] * g
+        ref.shape = self.shape
+        self.assert_(abs(res - ref).max() < 1e-5, "bilinear interpolation")
+
+        # chi changes with the position of its discontinuity
+        self.assert_(len(self.ai._interp_weights) > 0)
+        self.ai.setChiDiscAtZero()
+        self.assertEqual(len(self.ai._interp_weights), 0, "weights invalidated by the chi discontinuity")
+        self.ai.setChiDiscAtPi()
+
+        self.assertRaises(AssertionError, self.ai.calcfrom2d, I[:, :-1], radial, azimuthal, self.shape,
+                          dim1_unit=unit)
+        self.assertRaises(AssertionError, self.ai.calcfrom1d, radial, I[0, :-1], self.shape, dim1_unit=unit)
+
+    def test_fallback(self):
+        """without the _geometry extension, images are calculated with numpy"""
+        unit = units.to_unit("2th_deg")
+        tth = self.ai.twoThetaArray(self.shape)
+        I = numpy.random.random((5, 7))
+        radial = numpy.linspace(tth.min(), tth.max(), 7) * unit.scale
+        azimuthal = numpy.linspace(-180, 180, 5)
+        mask = numpy.zeros(self.shape, dtype=numpy.int8)
+        mask[:, 200:220] = 1
+        ref = self.ai.calcfrom2d(I, radial, azimuthal, self.shape, mask=mask, dim1_unit=unit)
+        ref1d = self.ai.calcfrom1d(radial, I[0], self.shape, mask=mask, dim1_unit=unit)
+        ai = AzimuthalIntegrator(dist=0.1, poni1=0.02, poni2=0.04, detector="Pilatus100k")
+        ai.solidAngleArray(self.shape)  # needs _geometry, cached
+        try:
+            pyFAI.geometry._geometry = None
+            res = ai.calcfrom2d(I, radial, azimuthal, self.shape, mask=mask, dim1_unit=unit)
+            res1d = ai.calcfrom1d(radial, I[0], self.shape, mask=mask, dim1_unit=unit)
+        finally:
+            pyFAI.geometry._geometry = _geometry
+        self.assertEqual(res.shape, self.shape)
+        self.assert_(abs(res - ref).max() < 1e-5 * abs(ref).max(), "same as the compiled version")
+        self.assert_(abs(res1d - ref1d).max() < 1e-5 * abs(ref1d).max(), "same 1D as the compiled version")
+        for ary in (ref, ref1d, res, res1d):
+            self.assertEqual(ary.dtype, numpy.float64, "same type in both versions")
+
+
+def test_suite_all_backprojection():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestBackProjection("test_interp"))
+    testSuite.addTest(TestBackProjection("test_correction"))
+    testSuite.addTest(TestBackProjection("test_calcfrom1d"))
+    testSuite.addTest(TestBackProjection("test_calcfrom2d"))
+    testSuite.addTest(TestBackProjection("test_fallback"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_backprojection()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -95,6 +95,57 @@ class TestBilinear(unittest.TestCase):
         logger.info("Success rate: %.1f" % (100. * ok / self.N))
         self.assertEqual(ok, self.N, "Maximum is always found")
 
+    def test_batch(self):
+        """batched search gives the same maxima as local_maxi"""
+        y, x = numpy.ogrid[:128, :96]
+        img = numpy.sin(y / 7.) * numpy.cos(x / 5.) + 1e-3 * x + 1e-4 * y
+        b = bilinear.Bilinear(img)
+        seeds = numpy.random.uniform(-5, 130, (1000, 2))
+        res = b.local_maxi_batch(seeds)
+        self.assertEqual(res.shape, (1000, 2))
+        for seed, found in zip(seeds, res):
+            if (0 <= round(seed[0]) < 128) and (0 <= round(seed[1]) < 96):
+                self.assertEqual(tuple(found), b.local_maxi(seed), "same maximum for %s" % seed)
+            else:
+                self.assertTrue(numpy.isnan(found).all(), "NaN outside of the image")
+
+    def test_nearest_peaks(self):
+        """selection of the peaks matches a loop over local_maxi"""
+        from pyFAI.utils import is_far_from_group
+        numpy.random.seed(0)
+        img = numpy.random.random((200, 300)).astype(numpy.float32)
+        b = bilinear.Bilinear(img)
+        region = numpy.zeros(img.shape, dtype=bool)
+        region[20:180, 30:250] = True
+        seeds = numpy.vstack(numpy.where(region)).T
+        numpy.random.shuffle(seeds)
+        known = [(100.2, 100.3)]
+        for dmin, keep, Imin in ((0, 300, None), (3.0, 200, 0.5), (10.0, 0, 0.2)):
+            ref = []
+            ref_origin = []
+            cnt = 0
+            for i, seed in enumerate(seeds):
+                cnt += 1
+                out = b.local_maxi(seed)
+                p0, p1 = int(round(out[0])), int(round(out[1]))
+                if region[p0, p1] and (Imin is None or img[p0, p1] > Imin) and \
+                        is_far_from_group(out, known + ref, dmin * dmin):
+                    ref.append(out)
+                    ref_origin.append(i)
+                    cnt = 0
+                if (keep and len(ref) + 1 >= keep) or cnt > 50:
+                    break
+            peaks, origin = b.nearest_peaks(seeds, dmin=dmin, keep=keep, region=region, Imin=Imin,
+                                            patience=50, peaks=known, block=97)
+            self.assertEqual(list(origin), ref_origin, "same seeds for dmin=%s" % dmin)
+            self.assertEqual([tuple(i) for i in peaks], ref, "same peaks for dmin=%s" % dmin)
+
+        # seeds outside of the image or not a number are skipped
+        odd = numpy.array([[numpy.nan, 5], [5, numpy.nan], [-3, 5], [5, 1e20], [numpy.inf, 5], [100, 100]])
+        peaks, origin = b.nearest_peaks(odd)
+        self.assertEqual(list(origin), [5], "only the seed in the image")
+        self.assertEqual([tuple(i) for i in peaks], [tuple(b.local_maxi((100, 100)))])
+
 
 class TestConversion(unittest.TestCase):
     """basic 2d -> 4d transformation and vice-versa"""
@@ -121,6 +172,8 @@ def test_suite_all_bilinear():
     testSuite = unittest.TestSuite()
     testSuite.addTest(TestBilinear("test_max_search_round"))
     testSuite.addTest(TestBilinear("test_max_search_half"))
+    testSuite.addTest(TestBilinear("test_batch"))
+    testSuite.addTest(TestBilinear("test_nearest_peaks"))
     testSuite.addTest(TestConversion("test4d"))
     return testSuite
 
@@ -0,0 +1,205 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for statistics calculated on top of the CSR matrices
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+
+
+class TestSigmaClip(IntegratorTestCase):
+    """
+    Sigma-clipping on a flat image with a few zingers
+    """
+
+    def setUp(self):
+        IntegratorTestCase.setUp(self)
+        self.zingers = (numpy.random.randint(0, self.shape[0], 50), numpy.random.randint(0, self.shape[1], 50))
+        self.data[self.zingers] = 1e5
+
+    def test_sigma_clip(self):
+        ref = self.ai.integrate1d(self.data, self.npt, method="csr", correctSolidAngle=False, unit="2th_deg")
+        self.assert_(ref[1].max() > 200, "zingers are visible without clipping")
+        res = self.ai.sigma_clip(self.data, self.npt, method="csr", correctSolidAngle=False, unit="2th_deg",
+                                 thres=3, max_iter=10, all=True)
+        self.assert_(numpy.allclose(res["radial"], ref[0]), "same radial positions")
+        valid = res["I"] != 0
+        logger.debug("sigma-clip max deviation: %s" % abs(res["I"][valid] - 100).max())
+        self.assert_(abs(res["I"][valid] - 100).max() < 5, "zingers are removed")
+        self.assert_(abs(res["sigma"][valid] - 5).max() < 3, "std is close to the noise level")
+        self.assert_(res["rejected"].sum() >= 50, "all zingers have been rejected")
+
+    def test_reference(self):
+        """each pass only uses the flags of the former passes, like a sequential implementation"""
+        res = self.ai.sigma_clip(self.data, self.npt, method="csr", correctSolidAngle=False, unit="2th_deg",
+                                 thres=2, max_iter=3, all=True)
+        integr = self.ai._csr_integrator
+        flat = self.data.ravel().astype(numpy.float64)
+        flag = numpy.zeros(flat.size, dtype=bool)
+        for it in range(4):
+            mean = numpy.zeros(self.npt)
+            std = numpy.zeros(self.npt)
+            for i in range(self.npt):
+                idx = integr.indices[integr.indptr[i]:integr.indptr[i + 1]]
+                coef = integr.data[integr.indptr[i]:integr.indptr[i + 1]]
+                valid = (coef != 0) & ~flag[idx]
+                idx, coef = idx[valid], coef[valid]
+                if coef.sum() > 1e-10:
+                    mean[i] = (coef * flat[idx]).sum() / coef.sum()
+                    std[i] = numpy.sqrt((coef * (flat[idx] - mean[i]) ** 2).sum() / coef.sum())
+            if it == 3:
+                break
+            outlier = numpy.zeros_like(flag)
+            for i in range(self.npt):
+                idx = integr.indices[integr.indptr[i]:integr.indptr[i + 1]]
+                coef = integr.data[integr.indptr[i]:integr.indptr[i + 1]]
+                if std[i] > 0:
+                    idx = idx[(coef != 0) & ~flag[idx]]
+                    outlier[idx[abs(flat[idx] - mean[i]) > 2 * std[i]]] = True
+            if not outlier.any():
+                break
+            flag |= outlier
+        rejected = numpy.array([(flag[integr.indices[integr.indptr[i]:integr.indptr[i + 1]]] &
+                                 (integr.data[integr.indptr[i]:integr.indptr[i + 1]] != 0)).sum()
+                                for i in range(self.npt)])
+        self.assert_(numpy.allclose(res["I"], mean, rtol=1e-4), "same mean as numpy")
+        self.assert_((res["rejected"] == rejected).all(), "same rejected pixels as numpy")
+
+    def test_no_clip(self):
+        """without any pass the result is the plain weighted average"""
+        ref = self.ai.integrate1d(self.data, self.npt, method="csr", correctSolidAngle=False, unit="2th_deg")
+        res = self.ai.sigma_clip(self.data, self.npt, method="csr", correctSolidAngle=False, unit="2th_deg",
+                                 max_iter=0)
+        self.assert_(numpy.allclose(res[1], ref[1], rtol=1e-4), "mean equals integrate1d")
+
+
+class TestMedfilt(IntegratorTestCase):
+    """
+    Median and percentile filters on a flat image with a few zingers
+    """
+
+    def setUp(self):
+        IntegratorTestCase.setUp(self)
+        self.zingers = (numpy.random.randint(0, self.shape[0], 50), numpy.random.randint(0, self.shape[1], 50))
+        self.data[self.zingers] = 1e5
+
+    def test_median(self):
+        """without pixel splitting, the median is the one of numpy"""
+        radial, median = self.ai.medfilt1d(self.data, self.npt, method="nosplit_csr", correctSolidAngle=False, unit="2th_deg")
+        integr = self.ai._csr_integrator
+        flat = self.data.ravel()
+        for i in range(self.npt):
+            values = numpy.sort(flat[integr.indices[integr.indptr[i]:integr.indptr[i + 1]]])
+            if values.size == 0:
+                continue
+            self.assertEqual(median[i], values[(values.size + 1) // 2 - 1], "median of bin %s" % i)
+
+    def test_percentile(self):
+        _, median = self.ai.medfilt1d(self.data, self.npt, method="full_csr", correctSolidAngle=False, unit="2th_deg")
+        _, low = self.ai.medfilt1d(self.data, self.npt, method="full_csr", correctSolidAngle=False, unit="2th_deg", percentile=10)
+        _, high = self.ai.medfilt1d(self.data, self.npt, method="full_csr", correctSolidAngle=False, unit="2th_deg", percentile=90)
+        valid = median != 0
+        self.assert_(abs(median[valid] - 100).max() < 5, "zingers have no influence on the median")
+        self.assert_((low[valid] <= median[valid]).all(), "10th percentile below median")
+        self.assert_((high[valid] >= median[valid]).all(), "90th percentile above median")
+
+    def test_trimmed_mean(self):
+        res = self.ai.medfilt1d(self.data, self.npt, method="full_csr", correctSolidAngle=False, unit="2th_deg",
+                                percentile=(10, 90), all=True)
+        valid = res["count"] > 0
+        self.assert_(abs(res["I"][valid] - 100).max() < 5, "zingers are trimmed out")
+        full = self.ai.medfilt1d(self.data, self.npt, method="full_csr", correctSolidAngle=False, unit="2th_deg",
+                                 percentile=(0, 100))
+        ref = self.ai.integrate1d(self.data, self.npt, method="full_csr", correctSolidAngle=False, unit="2th_deg")
+        self.assert_(numpy.allclose(full[1], ref[1], rtol=1e-3), "untrimmed mean equals integrate1d")
+
+    def test_separate(self):
+        bragg, amorphous = self.ai.separate(self.data, npt_rad=self.npt, unit="2th_deg")
+        self.assertEqual(bragg.shape, self.shape)
+        self.assert_(bragg[self.zingers].min() > 1e4, "zingers are in the Bragg part")
+
+
+class TestAzimuthalError(IntegratorTestCase):
+    """
+    Single pass azimuthal error model in CSR and LUT integrators
+    """
+
+    def test_csr(self):
+        """without pixel splitting, compare with numpy on the pixels of each bin"""
+        res = self.ai.integrate1d(self.data, self.npt, method="nosplit_csr", correctSolidAngle=False,
+                                  unit="2th_deg", error_model="azimuthal")
+        integr = self.ai._csr_integrator
+        flat = self.data.ravel().astype(numpy.float64)
+        for i in range(self.npt):
+            values = flat[integr.indices[integr.indptr[i]:integr.indptr[i + 1]]]
+            if values.size == 0:
+                continue
+            ref = numpy.sqrt(((values - values.mean()) ** 2).sum()) / values.size
+            self.assertAlmostEqual(res[2][i], ref, 5, "sigma of bin %s" % i)
+
+    def test_lut(self):
+        """LUT and CSR give the same errors"""
+        csr = self.ai.integrate1d(self.data, self.npt, method="csr", unit="2th_deg", error_model="azimuthal")
+        lut = self.ai.integrate1d(self.data, self.npt, method="lut", unit="2th_deg", error_model="azimuthal")
+        self.assert_(numpy.allclose(csr[1], lut[1], rtol=1e-4), "same intensity")
+        self.assert_(numpy.allclose(csr[2], lut[2], rtol=1e-3), "same error")
+        valid = csr[1] != 0
+        self.assert_((csr[2][valid] > 0).all(), "non null error")
+
+
+def test_suite_all_csr_stats():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestSigmaClip("test_sigma_clip"))
+    testSuite.addTest(TestSigmaClip("test_reference"))
+    testSuite.addTest(TestSigmaClip("test_no_clip"))
+    testSuite.addTest(TestMedfilt("test_median"))
+    testSuite.addTest(TestMedfilt("test_percentile"))
+    testSuite.addTest(TestMedfilt("test_trimmed_mean"))
+    testSuite.addTest(TestMedfilt("test_separate"))
+    testSuite.addTest(TestAzimuthalError("test_csr"))
+    testSuite.addTest(TestAzimuthalError("test_lut"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_csr_stats()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,121 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for CSR integrators derived from a fine master matrix
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import sparse_csr
+from pyFAI.utils import EPS32
+
+
+class TestDerivedCsr(IntegratorTestCase):
+    """
+    Comparison of derived integrators with the ones built by setup_CSR
+    """
+    master_bins = 1000
+
+    def setUp(self):
+        IntegratorTestCase.setUp(self)
+        self.masters = dict((split, self.ai.setup_CSR(self.shape, self.master_bins, unit="2th_deg", split=split))
+                            for split in ("no", "bbox", "full"))
+
+    def compare(self, split, npt, radial_range=None):
+        pos0Range = None if radial_range is None else (min(radial_range), max(radial_range) * EPS32)
+        derived = sparse_csr.DerivedCsrIntegrator(self.masters[split], npt, pos0Range, split)
+        direct = self.ai.setup_CSR(self.shape, npt, unit="2th_deg", split=split, pos0_range=radial_range)
+        self.assert_(numpy.allclose(derived.outPos, direct.outPos), "same positions")
+        return derived.integrate(self.data), direct.integrate(self.data)
+
+    def test_aligned(self):
+        """bins of the master fall exactly within the new bins: same matrix"""
+        for split in ("no", "bbox", "full"):
+            for npt in (100, 250):
+                derived, direct = self.compare(split, npt)
+                self.assert_(numpy.allclose(derived[1], direct[1], rtol=1e-5), "intensity with %s, %s" % (split, npt))
+                self.assert_(numpy.allclose(derived[3], direct[3], rtol=1e-4), "count with %s, %s" % (split, npt))
+
+    def test_unaligned(self):
+        """edges of the new bins cross the bins of the master"""
+        for split in ("no", "bbox", "full"):
+            derived, direct = self.compare(split, 77)
+            logger.debug("unaligned %s: %s" % (split, abs(derived[1] - direct[1]).max()))
+            self.assert_(abs(derived[1] - direct[1]).max() < 0.5, "intensity with %s" % split)
+            self.assert_(abs(derived[3].sum() / direct[3].sum() - 1) < 1e-3, "total count with %s" % split)
+
+    def test_range(self):
+        """sub-range: only the first and last bins of the direct build differ"""
+        for split in ("no", "bbox", "full"):
+            derived, direct = self.compare(split, 100, (0.1, 0.3))
+            self.assert_(abs(derived[1] - direct[1])[1:-1].max() < 0.5, "intensity with %s" % split)
+            self.assert_(abs(derived[3] / direct[3] - 1)[1:-1].max() < 0.05, "count with %s" % split)
+
+    def test_integrator(self):
+        """the azimuthal integrator builds the master only once"""
+        ref = self.ai.integrate1d(self.data, 100, method="csr", unit="2th_deg")
+        self.ai.csr_master_bins = self.master_bins
+        res = self.ai.integrate1d(self.data, 100, method="csr", unit="2th_deg")
+        self.assert_(isinstance(self.ai._csr_integrator, sparse_csr.DerivedCsrIntegrator), "derived integrator")
+        self.assert_(numpy.allclose(res[1], ref[1], rtol=1e-5), "same intensity")
+        master = self.ai._csr_master[1]
+        self.ai.integrate1d(self.data, 200, method="csr", unit="2th_deg", radial_range=(5, 15))
+        self.ai.integrate1d(self.data, 50, method="csr", unit="2th_deg")
+        self.assert_(self.ai._csr_master[1] is master, "master was not rebuilt")
+        self.assertEqual(self.ai._csr_integrator.bins, 50, "new integrator")
+        self.ai.csr_master_bins = 2 * self.master_bins
+        self.ai.integrate1d(self.data, 50, method="csr", unit="2th_deg")
+        self.assertEqual(self.ai._csr_integrator.master_bins, 2 * self.master_bins, "derived from the new master")
+        self.assert_(self.ai._csr_master[1] is not master, "master was rebuilt")
+
+
+def test_suite_all_derived_csr():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestDerivedCsr("test_aligned"))
+    testSuite.addTest(TestDerivedCsr("test_unaligned"))
+    testSuite.addTest(TestDerivedCsr("test_range"))
+    testSuite.addTest(TestDerivedCsr("test_integrator"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_derived_csr()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
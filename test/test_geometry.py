@@ -110,6 +110,30 @@ class TestBug88SolidAngle(unittest.TestCase):
         self.assertNotAlmostEqual(f, t, 1, "corrected and uncorrected flat data are different")
 
 
+class TestChiDisc(unittest.TestCase):
+    """
+    Azimuthal ranges crossing the discontinuity of chi are reported
+    """
+    def setUp(self):
+        self.ai = AzimuthalIntegrator(dist=0.1, poni1=0.02, poni2=0.04, detector="Pilatus100k")
+
+    def test_check(self):
+        self.assertFalse(self.ai.check_chi_disc((-3.0, 3.0)))
+        self.assert_(self.ai.check_chi_disc((3.0, 3.5)), "crosses pi")
+        self.ai.setChiDiscAtZero()
+        self.assertFalse(self.ai.check_chi_disc((3.0, 3.5)))
+        self.assert_(self.ai.check_chi_disc((-0.5, 0.5)), "crosses zero")
+
+    def test_integrate1d(self):
+        checked = []
+        check = self.ai.check_chi_disc
+        self.ai.check_chi_disc = lambda azimuth_range: checked.append(azimuth_range) or check(azimuth_range)
+        img = numpy.ones((195, 487), dtype=numpy.float32)
+        self.ai.integrate1d(img, 100, unit="2th_deg", method="csr", azimuth_range=(170, -170))
+        self.assertEqual(len(checked), 1, "integrate1d checks the azimuthal range")
+        self.assert_(check(checked[0]), "range across pi detected")
+
+
 
 class ParameterisedTestCase(unittest.TestCase):
     """ TestCase classes that want to be parameterised should
@@ -226,6 +250,8 @@ def test_suite_all_Geometry():
     testSuite = unittest.TestSuite()
     testSuite.addTest(TestSolidAngle("testSolidAngle"))
     testSuite.addTest(TestBug88SolidAngle("testSolidAngle"))
+    testSuite.addTest(TestChiDisc("test_check"))
+    testSuite.addTest(TestChiDisc("test_integrate1d"))
     for param in TESTCASES:
         testSuite.addTest(ParameterisedTestCase.parameterise(
                 TestGeometry, param))
@@ -28,7 +28,7 @@ __author__ = "Jérôme Kieffer"
 __contact__ = "Jerome.Kieffer@ESRF.eu"
 __license__ = "GPLv3+"
 __copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
-__date__ = "05/03/2015"
+__date__ = "18/10/2015"
 
 
 import unittest
@@ -223,11 +223,80 @@ class TestGeometryRefinement(unittest.TestCase):
                                    "%s is %s, I expected %s%s%s" % (key, r2.__getattribute__(key) , ref2[i], os.linesep, r2))
 #        assert abs(numpy.array(r2.param) - ref2).max() < 1e-3
 
+    def test_multistart(self):
+        """tests the multi-start refinement from a poor initial geometry"""
+        wavelength = 1e-10
+        calibrant = pyFAI.calibrant.Calibrant(dSpacing=[4.15695, 2.93940753, 2.4000162, 2.078475, 1.85904456],
+                                              wavelength=wavelength)
+        ref = pyFAI.geometry.Geometry(dist=0.1, poni1=0.05, poni2=0.06, rot1=0.02, rot2=-0.03, rot3=0,
+                                      pixel1=1e-4, pixel2=1e-4, wavelength=wavelength)
+        tth = ref.twoThetaArray((1000, 1000))
+        data = []
+        for ring, value in enumerate(calibrant.get_2th()):
+            y, x = numpy.nonzero(abs(tth - value) < 5e-4)
+            for i in numpy.linspace(0, y.size - 1, 20).astype(int):
+                data.append((y[i], x[i], ring))
+        expected = numpy.array([0.1, 0.05, 0.06, 0.02, -0.03, 0])
+        for method in ("slsqp", "simplex"):
+            r = GeometryRefinement(data, dist=0.12, poni1=0.04, poni2=0.07, pixel1=1e-4, pixel2=1e-4,
+                                   wavelength=wavelength, calibrant=calibrant)
+            r.set_tolerance(30)
+            param = numpy.array([r.dist, r.poni1, r.poni2, r.rot1, r.rot2, r.rot3])
+            if geometryRefinement._geometry is not None:
+                pos1, pos2, pos3 = r.detector.calc_cartesian_positions(r.data[:, 0], r.data[:, 1])
+                residu2 = geometryRefinement._geometry.calc_residu2(*(list(param) + [pos1, pos2, r.calc_2th(r.data[:, 2])]))
+                self.assertAlmostEqual(residu2 / r.chi2(param), 1.0, 10, "kernel matches the python residual")
+
+            # SLSQP is not reentrant: never two optimizations at once
+            running = []
+            overlap = []
+            fmin_slsqp = geometryRefinement.fmin_slsqp
+
+            def counting(*args, **kwargs):
+                running.append(1)
+                overlap.append(len(running))
+                try:
+                    return fmin_slsqp(*args, **kwargs)
+                finally:
+                    running.pop()
+            geometryRefinement.fmin_slsqp = counting
+            try:
+                result = r.refine_multistart(6, method=method, fix=["wavelength", "rot3"], threads=3)
+            finally:
+                geometryRefinement.fmin_slsqp = fmin_slsqp
+            if method == "slsqp":
+                self.assertEqual(max(overlap), 1, "SLSQP runs are serialized")
+            self.assertEqual(len(result["runs"]), 6, "one run per initial geometry")
+            if any(run["abandoned"] for run in result["runs"]):
+                self.assertTrue(any(run["converged"] for run in result["runs"]), "abandoned after a converged run")
+            self.assertEqual(result["chi2"], min(run["chi2"] for run in result["runs"]), "best run is kept")
+            self.assertTrue(result["chi2"] < 1e-6, "%s: chi2 is small: %s" % (method, result["chi2"]))
+            self.assertTrue(abs(numpy.array(r.param) - expected).max() < 5e-3, "%s: %s" % (method, r.param))
+            self.assertTrue(all(abs(run["start"][5]) == 0 for run in result["runs"]), "rot3 is not perturbed")
+            starts = numpy.array([run["start"] for run in result["runs"]])
+            self.assertTrue((starts[:, 0] >= 0.7 * 0.12 - 1e-12).all() and (starts[:, 0] <= 1.3 * 0.12 + 1e-12).all(), "starts within bounds")
+
+        # the wavelength is never refined, the default method runs concurrently
+        self.assertRaises(ValueError, r.refine_multistart, 2, fix=["rot3"])
+        fmin = geometryRefinement.fmin
+        used = []
+
+        def simplex(*args, **kwargs):
+            used.append(1)
+            return fmin(*args, **kwargs)
+        geometryRefinement.fmin = simplex
+        try:
+            r.refine_multistart(2, threads=2)
+        finally:
+            geometryRefinement.fmin = fmin
+        self.assertEqual(len(used), 2, "simplex by default")
+
 
 def test_suite_all_GeometryRefinement():
     testSuite = unittest.TestSuite()
     testSuite.addTest(TestGeometryRefinement("test_noSpline"))
     testSuite.addTest(TestGeometryRefinement("test_Spline"))
+    testSuite.addTest(TestGeometryRefinement("test_multistart"))
     return testSuite
 
 if __name__ == '__main__':
@@ -0,0 +1,146 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the run-time selection of the instruction set
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import subprocess
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import isa
+
+
+class TestIsa(IntegratorTestCase):
+    """
+    All instruction set levels give the same result as numpy
+    """
+    def setUp(self):
+        IntegratorTestCase.setUp(self)
+        self.initial = isa.selected()
+        self.integr = self.ai.setup_CSR(self.shape, 200, unit="2th_deg", split="bbox")
+        self.data = numpy.random.random(self.shape).astype(numpy.float32)
+
+    def tearDown(self):
+        isa.select(self.initial)
+
+    def reference(self, image, dummy=None):
+        """numpy version of the CSR kernel"""
+        integr = self.integr
+        rows = numpy.repeat(numpy.arange(integr.indptr.size - 1), numpy.diff(integr.indptr))
+        pixels = image.ravel()[integr.indices].astype(numpy.float64)
+        coef = integr.data.astype(numpy.float64)
+        if dummy is not None:
+            coef = coef * (pixels != dummy)
+            pixels = numpy.where(pixels != dummy, pixels, 0)
+        bins = integr.indptr.size - 1
+        signal = numpy.bincount(rows, coef * pixels, bins)
+        count = numpy.bincount(rows, coef, bins)
+        return signal, count
+
+    def test_levels(self):
+        self.assert_("generic" in isa.compiled(), "generic kernel always there")
+        self.assert_("generic" in isa.supported(), "generic kernel always supported")
+        self.assert_(set(isa.supported()) <= set(isa.compiled()), "supported levels are compiled")
+        self.assertRaises(RuntimeError, isa.select, "bogus")
+        for level in isa.compiled():
+            if level not in isa.supported():
+                self.assertRaises(RuntimeError, isa.select, level)
+        self.assertEqual(isa.select(), isa.supported()[-1], "best level by default")
+
+    def test_kernels(self):
+        image = self.data.copy()
+        image[10:20, 30:200] = -1
+        ref_signal, ref_count = self.reference(image, -1)
+        results = {}
+        for level in isa.supported():
+            isa.select(level)
+            signal, count, merge = isa.csr_integrate(self.integr.data, self.integr.indices,
+                                                     self.integr.indptr, image.ravel(), True, -1)
+            self.assert_(numpy.allclose(signal, ref_signal, rtol=1e-5), "signal with %s" % level)
+            self.assert_(numpy.allclose(count, ref_count, rtol=1e-5), "count with %s" % level)
+            empty = (count == 0)
+            self.assert_((merge[empty] == -1).all(), "empty bins are dummy with %s" % level)
+            self.assert_(numpy.allclose(merge[~empty], (signal / count)[~empty], rtol=1e-5),
+                         "merge with %s" % level)
+            results[level] = self.integr.integrate(self.data)
+        for level, res in results.items():
+            for a, b in zip(res, results["generic"]):
+                self.assert_(numpy.allclose(a, b, rtol=1e-5), "%s same as generic" % level)
+
+    def test_convolution(self):
+        """every level convolves as scipy.ndimage, also with images smaller than the filter"""
+        import scipy.ndimage
+        filter = numpy.random.random(9).astype(numpy.float32)
+        for image in (self.data, self.data[:3, :4]):
+            for axis, vertical in ((-1, False), (0, True)):
+                ref = scipy.ndimage.convolve1d(image.astype(numpy.float64), filter[::-1].astype(numpy.float64),
+                                               axis=axis, mode="reflect")
+                for level in isa.supported():
+                    isa.select(level)
+                    obt = isa.convolve(image, filter, vertical)
+                    self.assertEqual(obt.shape, image.shape, "shape with %s" % level)
+                    self.assert_(numpy.allclose(obt, ref, rtol=1e-5, atol=1e-5),
+                                 "axis %s with %s" % (axis, level))
+
+    def test_environment(self):
+        """PYFAI_ISA forces the level at import, invalid values are ignored"""
+        script = "import pyFAI.isa; print(pyFAI.isa.selected())"
+        for level, expected in (("generic", "generic"), ("bogus", isa.supported()[-1])):
+            env = os.environ.copy()
+            env["PYFAI_ISA"] = level
+            env["PYTHONPATH"] = os.pathsep.join([os.path.dirname(os.path.dirname(pyFAI.__file__))] +
+                                                [env.get("PYTHONPATH", "")])
+            out = subprocess.check_output([sys.executable, "-c", script], env=env)
+            self.assertEqual(out.decode().split()[-1], expected, "PYFAI_ISA=%s" % level)
+
+
+def test_suite_all_isa():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestIsa("test_levels"))
+    testSuite.addTest(TestIsa("test_kernels"))
+    testSuite.addTest(TestIsa("test_convolution"))
+    testSuite.addTest(TestIsa("test_environment"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_isa()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
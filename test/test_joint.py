@@ -0,0 +1,97 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the joint 1D and 2D integration
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+
+
+class TestJoint(IntegratorTestCase):
+    """
+    1D and 2D integration from a single pass compared to separate integrations
+    """
+
+    def test_same_bins(self):
+        (radial, I), (I2d, radial2d, azim2d) = self.ai.integrate1d2d(self.data, self.npt, 36, unit="2th_deg",
+                                                                     radial_range=(1, 30))
+        ref1d = self.ai.integrate1d(self.data, self.npt, unit="2th_deg", radial_range=(1, 30), method="csr")
+        ref2d = self.ai.integrate2d(self.data, self.npt, 36, unit="2th_deg", radial_range=(1, 30), method="csr")
+        self.assert_(numpy.allclose(ref1d[0], radial), "same radial positions")
+        self.assert_(numpy.allclose(ref1d[1], I, rtol=1e-4), "same 1D pattern")
+        self.assert_(numpy.allclose(ref2d[0], I2d), "same 2D image")
+        self.assert_(numpy.allclose(ref2d[1], radial2d), "same 2D radial positions")
+        self.assert_(numpy.allclose(ref2d[2], azim2d), "same 2D azimuthal positions")
+
+    def test_mapping(self):
+        """1D pattern with other bins than the 2D"""
+        (radial, I), _ = self.ai.integrate1d2d(self.data, self.npt, 36, npt_1d=40, unit="2th_deg",
+                                               radial_range=(1, 30))
+        ref = self.ai.integrate1d(self.data, 40, unit="2th_deg", radial_range=(1, 30), method="csr")
+        self.assert_(numpy.allclose(ref[0], radial), "same radial positions")
+        valid = ref[1] != 0
+        self.assert_(abs(ref[1][valid] - I[valid]).max() < 1, "similar 1D pattern")
+
+    def test_split(self):
+        """the 2D matrix is rebuilt when the pixel splitting scheme changes"""
+        nosplit = self.ai.integrate2d(self.data, self.npt, 36, unit="2th_deg", method="nosplit_csr")
+        self.assertEqual(self.ai._csr2d_integrator.split, "no")
+        _, (I2d, _, _) = self.ai.integrate1d2d(self.data, self.npt, 36, unit="2th_deg")
+        self.assertEqual(self.ai._csr2d_integrator.split, "bbox")
+        self.assertFalse(numpy.allclose(nosplit[0], I2d), "bounding-box splitting differs")
+        bbox = self.ai.integrate2d(self.data, self.npt, 36, unit="2th_deg", method="csr")
+        self.assert_(numpy.allclose(bbox[0], I2d), "same 2D image with the same splitting")
+        again = self.ai.integrate2d(self.data, self.npt, 36, unit="2th_deg", method="nosplit_csr")
+        self.assert_(numpy.allclose(again[0], nosplit[0]), "back to the matrix without splitting")
+
+
+def test_suite_all_joint():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestJoint("test_same_bins"))
+    testSuite.addTest(TestJoint("test_mapping"))
+    testSuite.addTest(TestJoint("test_split"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_joint()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
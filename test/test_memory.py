@@ -0,0 +1,131 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the aligned and huge-page backed allocations
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import threading
+import gc
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI.azimuthalIntegrator import AzimuthalIntegrator
+from pyFAI import memory
+
+
+class TestMemory(unittest.TestCase):
+    """
+    Aligned allocations and recycling of scratch buffers
+    """
+    def test_allocation(self):
+        for shape in (1, 17, (100, 7), (3000, 1000)):
+            for dtype in (numpy.int8, numpy.int32, numpy.float32, numpy.float64):
+                a = memory.empty(shape, dtype)
+                self.assertEqual(a.shape, numpy.empty(shape).shape)
+                self.assertEqual(a.dtype, numpy.dtype(dtype))
+                self.assert_(a.flags.c_contiguous and a.flags.writeable, "contiguous and writable")
+                self.assert_(memory.is_aligned(a), "aligned for %s %s" % (shape, dtype))
+                z = memory.zeros(shape, dtype)
+                self.assertEqual(abs(z).max(), 0, "zeroed for %s %s" % (shape, dtype))
+        self.assertEqual(memory.is_aligned(memory.empty(1000, numpy.int8, alignment=4096), 4096), True)
+
+    def test_ownership(self):
+        """the memory lives as long as any view on it"""
+        a = memory.zeros((4000, 1000), numpy.float32)
+        view = a[10:20]
+        view[:] = 5
+        del a
+        gc.collect()
+        self.assertEqual(view.sum(), 5 * 10 * 1000)
+
+    def test_arena(self):
+        arena = memory.Arena()
+        a = arena.empty("a", 100, numpy.float32)
+        self.assert_(arena.empty("a", 100, numpy.float32) is a, "recycled")
+        self.assert_(arena.empty("b", 100, numpy.float32) is not a, "other key")
+        self.assert_(arena.empty("a", 200, numpy.float32) is not a, "other shape")
+        self.assertEqual(arena.nbytes, 1200)
+        other = []
+        thread = threading.Thread(target=lambda: other.append(arena.empty("a", 200, numpy.float32)))
+        thread.start()
+        thread.join()
+        self.assert_(other[0] is not arena.empty("a", 200, numpy.float32), "one buffer per thread")
+        arena.clear()
+        self.assertEqual(arena.nbytes, 0)
+
+    def test_integrator(self):
+        """matrices and geometry caches are aligned, preprocessing buffers are recycled"""
+        ai = AzimuthalIntegrator(dist=0.1, poni1=0.02, poni2=0.04, detector="Pilatus100k")
+        shape = ai.detector.shape
+        data = numpy.random.random(shape).astype(numpy.float32)
+        solid_angle = ai.solidAngleArray(shape)
+        self.assert_(memory.is_aligned(solid_angle), "aligned solid angle")
+        self.assert_(memory.is_aligned(ai.polarization(shape, 0.9)), "aligned polarization")
+        for split in ("no", "bbox", "full"):
+            integr = ai.setup_CSR(shape, 100, unit="2th_deg", split=split)
+            self.assert_(memory.is_aligned(integr.data) and memory.is_aligned(integr.indices), "aligned matrix")
+            ref = integr.integrate(data, solidAngle=solid_angle)
+            first = integr.preprocess(data, solidAngle=solid_angle)[0]
+            second = integr.preprocess(data, solidAngle=solid_angle)[0]
+            self.assert_(integr.arena is not None, "default arena")
+            self.assertEqual(first.ctypes.data, second.ctypes.data, "recycled buffer")
+            # a former result fed back is not overwritten while being read
+            expected = first / solid_angle.ravel()
+            again = integr.preprocess(first, solidAngle=solid_angle)[0]
+            self.assert_(again is not first, "new buffer for a fed back result")
+            self.assert_(numpy.allclose(again, expected), "fed back result with %s" % split)
+            for i in range(2):
+                res = integr.integrate(data, solidAngle=solid_angle)
+                for a, b in zip(ref, res):
+                    self.assert_(numpy.allclose(a, b), "same result with %s" % split)
+
+
+def test_suite_all_memory():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestMemory("test_allocation"))
+    testSuite.addTest(TestMemory("test_ownership"))
+    testSuite.addTest(TestMemory("test_arena"))
+    testSuite.addTest(TestMemory("test_integrator"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_memory()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,146 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the NUMA-aware CSR integration
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import shutil
+import tempfile
+import threading
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import sparse_csr
+
+
+class TestNuma(IntegratorTestCase):
+    """
+    Integration with one partition of the CSR matrix per NUMA node
+    """
+
+    def test_topology(self):
+        self.assertEqual(sparse_csr.parse_cpulist("0-3,8,10-11\n"), [0, 1, 2, 3, 8, 10, 11])
+        cpus = sparse_csr.numa_topology(root="/nonexistent")[0]
+        self.assert_(len(cpus) > 0, "at least one CPU without topology")
+        root = tempfile.mkdtemp()
+        try:
+            for node, cpulist in (("node0", ",".join(str(i) for i in cpus)), ("node1", "100000-100003")):
+                os.mkdir(os.path.join(root, node))
+                with open(os.path.join(root, node, "cpulist"), "w") as f:
+                    f.write(cpulist + "\n")
+            self.assertEqual(sparse_csr.numa_topology(root), {0: cpus}, "unavailable CPUs are discarded")
+        finally:
+            shutil.rmtree(root)
+        for node, cpus in sparse_csr.numa_topology().items():
+            logger.info("NUMA node %s: %s" % (node, cpus))
+
+    def test_partitions(self):
+        """several (fake) nodes give the same result as the plain integrator"""
+        cpus = sorted(sparse_csr.numa_topology(root="/nonexistent")[0])
+        for split in ("no", "bbox", "full"):
+            integr = self.ai.setup_CSR(self.shape, self.npt, unit="2th_deg", split=split)
+            ref = integr.integrate(self.data, dummy=-1, solidAngle=self.ai.solidAngleArray(self.shape))
+            for nodes in (1, 3):
+                for replicate in (True, False):
+                    numa = sparse_csr.NumaCsrIntegrator(integr, dict((i, cpus) for i in range(nodes)), replicate)
+                    self.assertEqual(len(numa.partitions), nodes)
+                    self.assertEqual(sum(i["data"].size for i in numa.partitions), integr.data.size, "all elements")
+                    res = numa.integrate(self.data, dummy=-1, solidAngle=self.ai.solidAngleArray(self.shape))
+                    for a, b in zip(ref, res):
+                        self.assert_(numpy.allclose(a, b), "%s with %s nodes" % (split, nodes))
+                    self.assertEqual(sorted(numa.bandwidth().keys()), list(range(nodes)), "bandwidth of each node")
+
+    def test_placement(self):
+        """partitions are first-touched by threads pinned to their node"""
+        integr = self.ai.setup_CSR(self.shape, self.npt, unit="2th_deg")
+        topology = sparse_csr.numa_topology()
+        before = sparse_csr.allowed_cpus()
+        numa = sparse_csr.NumaCsrIntegrator(integr, topology)
+        if sparse_csr.allowed_cpus() is None:
+            self.assertFalse(numa.pinned, "no pinning without affinity support")
+            return
+        self.assert_(numa.pinned, "threads are pinned")
+        for node, partition in zip(numa.nodes, numa.partitions):
+            self.assert_(set(partition["cpus"]) <= set(topology[node]), "node %s placed from its CPUs" % node)
+        self.assertEqual(sparse_csr.allowed_cpus(), before, "affinity of the calling thread is untouched")
+        # unreachable CPUs: explicit fall-back on unpinned threads
+        numa = sparse_csr.NumaCsrIntegrator(integr, {0: [100000]})
+        self.assertFalse(numa.pinned, "unable to pin")
+        ref = integr.integrate(self.data)
+        self.assert_(numpy.allclose(ref[1], numa.integrate(self.data)[1]), "same result without pinning")
+
+    def test_workers(self):
+        """nodes are processed by persistent threads, replicated images are recycled"""
+        cpus = sorted(sparse_csr.numa_topology(root="/nonexistent")[0])
+        integr = self.ai.setup_CSR(self.shape, self.npt, unit="2th_deg")
+        numa = sparse_csr.NumaCsrIntegrator(integr, {0: cpus, 1: cpus})
+        threads = numa._run_on_nodes(lambda i: threading.current_thread())
+        self.assertEqual(len(set(threads)), 2, "one thread per node")
+        numa.integrate(self.data)
+        images = [partition["image"] for partition in numa.partitions]
+        res = numa.integrate(self.data * 2)
+        self.assert_(numpy.allclose(res[1], 2 * integr.integrate(self.data)[1], rtol=1e-5), "new frame is integrated")
+        self.assert_(all(partition["image"] is image for partition, image in zip(numa.partitions, images)), "same buffers")
+        self.assertEqual(numa._run_on_nodes(lambda i: threading.current_thread()), threads, "same threads")
+        numa.close()
+        for thread in threads:
+            thread.join(10)
+            self.assertFalse(thread.is_alive(), "thread stopped")
+
+    def test_integrator(self):
+        ref = self.ai.integrate1d(self.data, self.npt, method="csr", unit="2th_deg")
+        res = self.ai.integrate1d(self.data, self.npt, method="csr_numa", unit="2th_deg")
+        self.assert_(self.ai._numa_integrator.integrator is self.ai._csr_integrator, "same matrix")
+        self.assert_(numpy.allclose(ref[1], res[1]), "same result")
+
+
+def test_suite_all_numa():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestNuma("test_topology"))
+    testSuite.addTest(TestNuma("test_partitions"))
+    testSuite.addTest(TestNuma("test_placement"))
+    testSuite.addTest(TestNuma("test_workers"))
+    testSuite.addTest(TestNuma("test_integrator"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_numa()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,119 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the Bragg peak finder based on the radial background
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "17/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+import scipy.ndimage
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import sparse_csr
+
+
+class TestPeakFinder(IntegratorTestCase):
+    """
+    Connected components and peak finding against the radial background
+    """
+    def setUp(self):
+        IntegratorTestCase.setUp(self)
+        self.data = numpy.random.poisson(100, self.shape).astype(numpy.float32)
+        self.peaks = [(20, 30), (100, 200), (150, 400)]
+        for r, c in self.peaks:
+            self.data[r - 1:r + 2, c - 1:c + 2] += 1000
+        # a single hot pixel
+        self.data[50, 50] += 1000
+
+    def test_label(self):
+        mask = numpy.random.random((60, 80)) > 0.7
+        weights = numpy.random.random(mask.size).astype(numpy.float32)
+        candidates = numpy.flatnonzero(mask)
+        for connectivity, structure in ((4, None), (8, numpy.ones((3, 3)))):
+            ref, nref = scipy.ndimage.label(mask, structure)
+            label, centroid, intensity, count = sparse_csr.label_pixels(candidates, weights, mask.shape, connectivity)
+            self.assertEqual(len(count), nref, "number of components with connectivity %s" % connectivity)
+            # labels follow the raster order, as the ones of scipy
+            self.assertEqual((label + 1).tolist(), ref.ravel()[candidates].tolist())
+            self.assertEqual(count.tolist(), numpy.bincount(label).tolist())
+            w = weights[candidates]
+            rows, cols = numpy.unravel_index(candidates, mask.shape)
+            self.assert_(numpy.allclose(intensity, numpy.bincount(label, w)))
+            self.assert_(numpy.allclose(centroid[:, 0], numpy.bincount(label, w * rows) / intensity))
+            self.assert_(numpy.allclose(centroid[:, 1], numpy.bincount(label, w * cols) / intensity))
+
+    def test_find_peaks(self):
+        centroid, intensity, count = self.ai.find_peaks(self.data, 100, unit="r_mm", snr=5)
+        self.assertEqual(len(count), 4, "3 peaks and the hot pixel")
+        centroid, intensity, count = self.ai.find_peaks(self.data, 100, unit="r_mm", snr=5, min_pixels=2)
+        self.assertEqual(count.tolist(), [9, 9, 9])
+        self.assert_(abs(centroid - numpy.array(self.peaks)).max() < 0.05, "centroids")
+        self.assert_((intensity > 0).all())
+        # intensities are in corrected units: compare without solid angle correction
+        res = self.ai.find_peaks(self.data, 100, unit="r_mm", snr=5, min_pixels=2, correctSolidAngle=False, all=True)
+        self.assert_(numpy.allclose(res["intensity"], 9000, rtol=0.05), "excess intensity %s" % res["intensity"])
+        self.assert_(abs(res["background"][res["background"] > 0].mean() - 100) < 2, "background level")
+        self.assert_(abs(res["sigma"][res["sigma"] > 0].mean() - 10) < 2, "background deviation")
+
+    def test_dummy(self):
+        data = self.data.copy()
+        data[90:110, 190:210] = -1
+        data[140:160, 390:410] = 1e6
+        centroid, intensity, count = self.ai.find_peaks(data, 100, unit="r_mm", snr=5, min_pixels=2, dummy=-1)
+        self.assertEqual(len(count), 2, "peak under dummy pixels ignored")
+        self.assertEqual(count[1], 400, "saturated block is one component")
+
+    def test_background(self):
+        centroid, intensity, count = self.ai.find_peaks(numpy.random.poisson(100, self.shape), 100,
+                                                        unit="r_mm", snr=6)
+        self.assertEqual(len(count), 0, "no peak in pure noise")
+
+
+def test_suite_all_peak_finder():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestPeakFinder("test_label"))
+    testSuite.addTest(TestPeakFinder("test_find_peaks"))
+    testSuite.addTest(TestPeakFinder("test_dummy"))
+    testSuite.addTest(TestPeakFinder("test_background"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_peak_finder()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,149 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the assembly of masks in pyFAI.preproc
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import azimuthalIntegrator
+from pyFAI.azimuthalIntegrator import AzimuthalIntegrator
+from pyFAI import preproc
+
+
+class TestCreateMask(unittest.TestCase):
+    """
+    The single pass kernel against the numpy implementation of create_mask
+    """
+    def setUp(self):
+        self.ai = AzimuthalIntegrator(dist=0.1, detector="Pilatus100k")
+        self.shape = self.ai.detector.shape
+        numpy.random.seed(0)
+        data = numpy.random.randint(0, 100, self.shape)
+        data[::5, ::3] = -1
+        data[::7, ::2] = -2
+        self.data = data
+        mask = numpy.zeros(self.shape, dtype=numpy.int8)
+        mask[:, 100:120] = 1
+        mask[50:60] = 1
+        self.mask = mask
+
+    def reference(self, *args, **kwargs):
+        """
+        create_mask with numpy
+        """
+        saved = azimuthalIntegrator.preproc
+        azimuthalIntegrator.preproc = None
+        try:
+            return self.ai.create_mask(*args, **kwargs)
+        finally:
+            azimuthalIntegrator.preproc = saved
+
+    def check(self, data, mask, dummy, delta_dummy):
+        for mode in ("normal", "numpy", "where"):
+            ref = self.reference(data, mask, dummy, delta_dummy, mode=mode)
+            res = self.ai.create_mask(data, mask, dummy, delta_dummy, mode=mode)
+            msg = "mode %s, data %s, mask %s, dummy %s, delta_dummy %s" % \
+                  (mode, data.dtype, None if mask is None else mask.dtype, dummy, delta_dummy)
+            if mode == "where":
+                self.assertEqual(len(res), len(ref), msg)
+                for i, j in zip(res, ref):
+                    self.assert_(numpy.array_equal(i, j), msg)
+            else:
+                self.assertEqual(res.dtype, bool, msg)
+                self.assertEqual(res.shape, self.shape, msg)
+                self.assert_(numpy.array_equal(res, ref), msg)
+
+    def test_conventions(self):
+        data = self.data.astype(numpy.float32)
+        for mask in (None, self.mask, self.mask.astype(bool), self.mask.astype(numpy.uint8) * 255,
+                     -self.mask.astype(numpy.int32), self.mask.astype(numpy.float64) / 2,
+                     1 - self.mask):  # the last one is inverted
+            self.check(data, mask, None, None)
+            self.check(data, mask, -1, None)
+            self.check(data, mask, -2, 1.5)
+
+    def test_dtypes(self):
+        for dtype in (numpy.float32, numpy.float64, numpy.int8, numpy.int16, numpy.uint16,
+                      numpy.int32, numpy.uint32, numpy.int64, numpy.uint64):
+            data = self.data.astype(dtype)
+            self.check(data, self.mask, -1, None)
+            self.check(data, self.mask, 99, 0.5)
+        data = self.data.astype(numpy.float32) / 10
+        self.check(data, self.mask, 0.1, None)  # compared in float32, as numpy does
+        self.check(data, None, 0.1, 0.0)
+
+    def test_kernel(self):
+        res, inverted = preproc.create_mask(self.data, 1 - self.mask, -1)
+        self.assertTrue(inverted, "inverted mask detected")
+        res, inverted = preproc.create_mask(self.data, self.mask, -1)
+        self.assertFalse(inverted, "mask not inverted")
+        self.assertEqual(res.sum(), ((self.mask != 0) | (self.data == -1)).sum())
+        self.mask.setflags(write=False)
+        res, inverted = preproc.create_mask(self.data, self.mask)
+        self.assertEqual(res.sum(), self.mask.sum(), "read-only mask")
+        self.data.setflags(write=False)
+        res, inverted = preproc.create_mask(self.data, None, -1)
+        self.assertEqual(res.sum(), (self.data == -1).sum(), "read-only frame")
+        empty = numpy.zeros((0, 5), dtype=numpy.float32)
+        res, inverted = preproc.create_mask(empty, None, 0)
+        self.assertEqual(res.shape, (0, 5), "empty frame")
+
+    def test_shape(self):
+        larger = numpy.zeros((self.shape[0] + 5, self.shape[1] + 7), dtype=numpy.int8)
+        larger[:self.shape[0], :self.shape[1]] = self.mask
+        res = self.ai.create_mask(self.data, larger, -1)
+        self.assert_(numpy.array_equal(res, self.reference(self.data, self.mask, -1)), "mask cropped")
+
+
+def test_suite_all_preproc():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestCreateMask("test_conventions"))
+    testSuite.addTest(TestCreateMask("test_dtypes"))
+    testSuite.addTest(TestCreateMask("test_kernel"))
+    testSuite.addTest(TestCreateMask("test_shape"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_preproc()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,136 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the subsampled preview integration
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import sparse_csr
+
+
+class TestPreview(IntegratorTestCase):
+    """
+    Stratified subsampling of the CSR matrix and preview integration
+    """
+    def setUp(self):
+        IntegratorTestCase.setUp(self)
+        tth = self.ai.twoThetaArray(self.shape)
+        self.data = (1000 * numpy.exp(-5 * tth) + 100 * numpy.cos(80 * tth) ** 2 +
+                     numpy.random.normal(0, 30, self.shape)).astype(numpy.float32)
+
+    def test_subsample(self):
+        integr = self.ai.setup_CSR(self.shape, 100, unit="2th_deg", split="bbox")
+        data, indices, indptr = integr.data, integr.indices, integr.indptr
+        full = numpy.add.reduceat(data.astype(numpy.float64), indptr[:-1]) * (numpy.diff(indptr) > 0)
+        for factor in (1, 4, 16):
+            sdata, sindices, sindptr, fraction = sparse_csr.subsample_csr(data, indices, indptr, factor)
+            counts = numpy.diff(indptr)
+            expected = numpy.where(counts <= 8, counts, numpy.maximum(8, (counts + factor - 1) // factor))
+            self.assertEqual(numpy.diff(sindptr).tolist(), expected.tolist(), "entries per row, factor %s" % factor)
+            self.assert_(numpy.allclose(fraction[counts > 0], (expected / numpy.maximum(counts, 1))[counts > 0]))
+            kept = numpy.add.reduceat(sdata.astype(numpy.float64), sindptr[:-1]) * (numpy.diff(sindptr) > 0)
+            self.assert_(numpy.allclose(kept, full, rtol=1e-5), "normalization preserved, factor %s" % factor)
+            for i in range(0, 100, 7):
+                row = set(indices[indptr[i]:indptr[i + 1]])
+                self.assert_(set(sindices[sindptr[i]:sindptr[i + 1]]) <= row, "subset of the row %s" % i)
+            again = sparse_csr.subsample_csr(data, indices, indptr, factor)
+            self.assert_((again[1] == sindices).all(), "deterministic")
+            if factor == 1:
+                self.assert_((sdata == data).all() and (sindices == indices).all(), "factor 1 is the identity")
+
+    def test_preview(self):
+        ref = self.ai.integrate1d(self.data, 100, unit="2th_deg", method="csr", all=True)
+        res = self.ai.integrate_preview(self.data, 100, unit="2th_deg", factor=1, all=True)
+        self.assert_(numpy.allclose(res["I"], ref["I"], rtol=1e-4), "factor 1 is the full integration")
+        self.assertEqual(abs(res["sigma"]).max(), 0, "no uncertainty with all pixels")
+        res = self.ai.integrate_preview(self.data, 100, unit="2th_deg", factor=8, all=True)
+        self.assert_(numpy.allclose(res["count"], ref["count"], rtol=1e-4), "same normalization")
+        self.assertEqual(res["factor"], 8)
+        valid = res["sigma"] > 0
+        self.assert_(valid.sum() > 50, "uncertainty estimated")
+        z = (res["I"] - ref["I"])[valid] / res["sigma"][valid]
+        self.assert_(0.5 < z.std() < 2, "uncertainty consistent with the deviation: %s" % z.std())
+        # dummy pixels are skipped
+        data = self.data.copy()
+        data[:, :50] = -1
+        ref = self.ai.integrate1d(data, 100, unit="2th_deg", method="csr", dummy=-1)[1]
+        res = self.ai.integrate_preview(data, 100, unit="2th_deg", factor=1, dummy=-1)[1]
+        self.assert_(numpy.allclose(res, ref, rtol=1e-4), "dummy pixels")
+
+    def test_chi_disc(self):
+        """ranges across the discontinuity of chi are reported, as by integrate1d"""
+        checked = []
+        check = self.ai.check_chi_disc
+        self.ai.check_chi_disc = lambda azimuth_range: checked.append(azimuth_range) or check(azimuth_range)
+        self.ai.integrate_preview(self.data, 100, unit="2th_deg", factor=4, azimuth_range=(170, -170))
+        self.assertEqual(len(checked), 1, "integrate_preview checks the azimuthal range")
+        self.assert_(check(checked[0]), "range across pi detected")
+
+    def test_budget(self):
+        master = self.ai.setup_CSR(self.shape, 100, unit="2th_deg", split="bbox")
+        integr = sparse_csr.PreviewCsrIntegrator(master, factor=1)
+        self.assertEqual(integr.choose_factor(1e-3), 1, "no cost known yet")
+        integr.cost = 1e-6
+        nnz = master.indptr[-1]
+        self.assertEqual(integr.choose_factor(nnz * 1e-6), 1, "enough time for all pixels")
+        self.assertEqual(integr.choose_factor(nnz * 1e-6 / 3), 4)
+        self.assertEqual(integr.choose_factor(1e-12), integr.factors[-1], "largest factor at most")
+        integr.cost = None
+        for i in range(3):
+            integr.integrate(self.data, budget=1e-9)
+        self.assertEqual(integr.factor, integr.factors[-1], "adapted to a tiny budget")
+        integr.integrate(self.data, budget=1e3)
+        self.assertEqual(integr.factor, 1, "adapted to a large budget")
+
+
+def test_suite_all_preview():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestPreview("test_subsample"))
+    testSuite.addTest(TestPreview("test_preview"))
+    testSuite.addTest(TestPreview("test_chi_disc"))
+    testSuite.addTest(TestPreview("test_budget"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_preview()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
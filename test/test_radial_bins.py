@@ -0,0 +1,95 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for non uniform radial bins
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "17/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+
+
+class TestRadialBins(IntegratorTestCase):
+    """
+    Integration with arbitrary radial bin edges
+    """
+    geometry = dict(IntegratorTestCase.geometry, wavelength=1e-10)
+
+    def test_uniform_edges(self):
+        """regular edges give the same result as the uniform integrator (but on the first bin)"""
+        edges = numpy.linspace(1, 30, self.npt + 1)
+        for method in ("csr", "nosplit_csr"):
+            ref = self.ai.integrate1d(self.data, self.npt, unit="2th_deg", radial_range=(1, 30), method=method, all=True)
+            res = self.ai.integrate1d(self.data, self.npt, unit="2th_deg", radial_edges=edges, method=method, all=True)
+            self.assert_(numpy.allclose(ref["radial"], res["radial"]), "%s: same positions" % method)
+            self.assert_(numpy.allclose(ref["count"][1:], res["count"][1:], atol=1e-3), "%s: same count" % method)
+            self.assert_(numpy.allclose(ref["I"][1:], res["I"][1:], rtol=1e-4), "%s: same intensity" % method)
+        self.assertRaises(ValueError, self.ai.integrate1d, self.data, self.npt, unit="2th_deg",
+                          radial_range=(1, 30), radial_edges=edges)
+
+    def test_log(self):
+        res = self.ai.integrate1d(self.data, self.npt, unit="q_nm^-1", radial_scale="log", method="csr",
+                                  correctSolidAngle=False, all=True)
+        ratio = res["radial"][1:] / res["radial"][:-1]
+        self.assert_(abs(ratio - ratio.mean()).max() < 1e-3 * ratio.mean(), "log-spaced positions")
+        ref = self.ai.integrate1d(self.data, self.npt, unit="q_nm^-1", method="csr", all=True)
+        self.assert_(abs(res["count"].sum() - ref["count"].sum()) < 1e-3 * ref["count"].sum(), "all pixels are integrated")
+        valid = res["count"] > 0
+        self.assert_(abs(res["I"][valid] - 100).max() < 10, "flat signal")
+
+    def test_sqrt(self):
+        res = self.ai.integrate1d(self.data, self.npt, unit="2th_deg", radial_scale="sqrt", method="nosplit_csr",
+                                  error_model="azimuthal", all=True)
+        self.assertEqual(res["sigma"].shape, (self.npt,))
+        width = numpy.diff(numpy.sqrt(res["radial"]))
+        self.assert_(abs(width[1:] - width[:-1]).max() < 1e-2 * width.mean(), "sqrt-spaced positions")
+
+
+def test_suite_all_radial_bins():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestRadialBins("test_uniform_edges"))
+    testSuite.addTest(TestRadialBins("test_log"))
+    testSuite.addTest(TestRadialBins("test_sqrt"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_radial_bins()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
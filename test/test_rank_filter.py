@@ -0,0 +1,125 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the rank filters (median, minimum, maximum, percentile)
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+import scipy.ndimage
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import rank_filter
+
+
+class TestRankFilter(unittest.TestCase):
+    """
+    Rank filters against scipy.ndimage
+    """
+    def setUp(self):
+        numpy.random.seed(0)
+        self.data = (numpy.random.random((67, 301)) * 1000).astype(numpy.float32)
+
+    def test_network(self):
+        """small windows, sorted with a network"""
+        for dtype in (numpy.float32, numpy.float64, numpy.int32):
+            data = self.data.astype(dtype)
+            for size in (2, 3, 4, 5, (3, 5), (1, 7)):
+                for mode in ("reflect", "mirror", "nearest", "wrap", "constant"):
+                    res = rank_filter.median_filter(data, size, mode)
+                    ref = scipy.ndimage.median_filter(data, size, mode=mode)
+                    self.assertEqual(res.dtype, ref.dtype)
+                    self.assert_((res == ref).all(), "median %s %s %s" % (dtype, size, mode))
+                for percentile in (10, 80, -20):
+                    res = rank_filter.percentile_filter(data, percentile, size)
+                    ref = scipy.ndimage.percentile_filter(data, percentile, size)
+                    self.assert_((res == ref).all(), "percentile %s %s %s" % (dtype, size, percentile))
+
+    def test_extremum(self):
+        """minimum and maximum filters"""
+        for size in (2, 3, 7, (3, 11)):
+            for mode in ("reflect", "nearest", "constant"):
+                res = rank_filter.minimum_filter(self.data, size, mode, cval=5)
+                ref = scipy.ndimage.minimum_filter(self.data, size, mode=mode, cval=5)
+                self.assert_((res == ref).all(), "minimum %s %s" % (size, mode))
+                res = rank_filter.maximum_filter(self.data, size, mode, cval=5)
+                ref = scipy.ndimage.maximum_filter(self.data, size, mode=mode, cval=5)
+                self.assert_((res == ref).all(), "maximum %s %s" % (size, mode))
+
+    def test_histogram(self):
+        """larger windows, with a sliding histogram"""
+        counts = numpy.random.poisson(100, self.data.shape).astype(numpy.float32)
+        # all values distinct: several values per level of the histogram
+        many = numpy.random.random((300, 250))
+        for data in (self.data, counts, many):
+            for size in (7, (6, 9)):
+                res = rank_filter.median_filter(data, size)
+                ref = scipy.ndimage.median_filter(data, size)
+                self.assert_((res == ref).all(), "median %s %s" % (data.dtype, size))
+                res = rank_filter.percentile_filter(data, 30, size, "wrap")
+                ref = scipy.ndimage.percentile_filter(data, 30, size, mode="wrap")
+                self.assert_((res == ref).all(), "percentile %s %s" % (data.dtype, size))
+
+    def test_network_rank(self):
+        """the pruned networks find the rank of any permutation"""
+        for n in (9, 25):
+            values = numpy.arange(n, dtype=numpy.float32)
+            for rank in (1, n // 2, n - 2):
+                pairs = rank_filter.sorting_network(n, rank)
+                self.assert_(len(pairs) <= len(rank_filter.sorting_network(n)))
+                for i in range(200):
+                    work = numpy.random.permutation(values)
+                    for a, b in pairs:
+                        if work[b] < work[a]:
+                            work[a], work[b] = work[b], work[a]
+                    self.assertEqual(work[rank], rank)
+
+
+def test_suite_all_rank_filter():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestRankFilter("test_network"))
+    testSuite.addTest(TestRankFilter("test_extremum"))
+    testSuite.addTest(TestRankFilter("test_histogram"))
+    testSuite.addTest(TestRankFilter("test_network_rank"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_rank_filter()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,142 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the parallel labelling of connected components
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+import scipy.ndimage
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI.relabel import label_components, countThem
+from pyFAI.utils import relabel
+
+
+class TestLabel(unittest.TestCase):
+    """
+    Labels and statistics against scipy.ndimage
+    """
+    def setUp(self):
+        numpy.random.seed(0)
+        # several stripes of rows, with components crossing them
+        self.shape = (1100, 97)
+        self.data = numpy.random.random(self.shape).astype(numpy.float32)
+        self.blured = scipy.ndimage.gaussian_filter(self.data, 2)
+
+    def test_labels(self):
+        structures = {8: numpy.ones((3, 3)), 4: None}
+        for mask in (self.data > 0.55, scipy.ndimage.gaussian_filter(self.data, 2) > 0.5):
+            for connectivity in (4, 8):
+                labels, nlabel, stats = label_components(mask, connectivity=connectivity)
+                ref, nref = scipy.ndimage.label(mask, structures[connectivity])
+                self.assertEqual(nlabel, nref, "number of labels")
+                self.assert_((labels == ref).all(), "same labels with connectivity %s" % connectivity)
+                self.assert_((stats["count"] == numpy.bincount(ref.ravel(), minlength=nref + 1)).all(), "count")
+                self.assertFalse("delta" in stats)
+        labels, nlabel, stats = label_components(numpy.zeros((0, 5)))
+        self.assertEqual(nlabel, 0)
+
+    def test_statistics(self):
+        mask = scipy.ndimage.gaussian_filter(self.data, 1) > 0.52
+        labels, nlabel, stats = label_components(mask, self.data, self.blured)
+        index = numpy.arange(1, nlabel + 1)
+        self.assert_(numpy.allclose(stats["sum"][1:], scipy.ndimage.sum(self.data, labels, index)), "sum")
+        self.assert_((stats["max"][1:] == scipy.ndimage.maximum(self.data, labels, index)).all(), "max")
+        self.assert_((self.data.ravel()[stats["argmax"]] == stats["max"]).all(), "argmax")
+        centroid = numpy.array(scipy.ndimage.center_of_mass(self.data, labels, index))
+        self.assert_(numpy.allclose(stats["centroid"][1:], centroid), "centroid")
+        bbox = numpy.array([(i[0].start, i[1].start, i[0].stop - 1, i[1].stop - 1)
+                            for i in scipy.ndimage.find_objects(labels)])
+        self.assert_((stats["bbox"][1:] == bbox).all(), "bounding box")
+        # the background and the quantities used by relabel
+        count, max_data, max_blured, delta = countThem(labels, self.data, self.blured)
+        self.assert_((stats["count"] == count).all(), "count")
+        self.assert_((stats["max_blured"] == max_blured).all(), "max of blured")
+        self.assert_((stats["delta"] == delta).all(), "delta")
+        self.assert_((relabel(labels, self.data, self.blured, 100, delta=stats["delta"]) ==
+                      relabel(labels, self.data, self.blured, 100)).all(), "relabel")
+
+        # non-positive data: same conventions as countThem
+        data = self.data - 2
+        blured = self.blured - 2
+        labels, nlabel, stats = label_components(mask, data, blured)
+        count, max_data, max_blured, delta = countThem(labels, data, blured)
+        self.assert_((stats["max"] == max_data).all(), "max of negative data")
+        self.assert_((stats["max_blured"] == max_blured).all(), "max of negative blured")
+        self.assert_((stats["delta"] == delta).all(), "delta of negative data")
+        self.assert_((data.ravel()[stats["argmax"][1:]] == scipy.ndimage.maximum(data, labels, index)).all(),
+                     "argmax of negative data")
+
+    def test_relabel(self):
+        """without delta, relabel re-uses the parallel labelling when it gives the same labels"""
+        mask = scipy.ndimage.gaussian_filter(self.data, 1) > 0.52
+        calls = []
+
+        def counted(*args):
+            calls.append(args)
+            return countThem(*args)
+        pyFAI.relabel.countThem = counted
+        try:
+            for structure in (numpy.ones((3, 3)), None):
+                labels, nlabel = scipy.ndimage.label(mask, structure)
+                ref = relabel(labels, self.data, self.blured, 100, delta=countThem(labels, self.data, self.blured)[3])
+                self.assert_((relabel(labels, self.data, self.blured, 100) == ref).all(), "relabel")
+            self.assertEqual(len(calls), 0, "statistics of the labelling")
+            # labels in another order are not those of label_components
+            order = numpy.concatenate(([0], numpy.random.permutation(nlabel) + 1))
+            labels = order[labels]
+            ref = relabel(labels, self.data, self.blured, 100, delta=countThem(labels, self.data, self.blured)[3])
+            self.assert_((relabel(labels, self.data, self.blured, 100) == ref).all(), "relabel shuffled")
+            self.assertEqual(len(calls), 1, "countThem for other labels")
+        finally:
+            pyFAI.relabel.countThem = countThem
+
+
+def test_suite_all_relabel():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestLabel("test_labels"))
+    testSuite.addTest(TestLabel("test_statistics"))
+    testSuite.addTest(TestLabel("test_relabel"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_relabel()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
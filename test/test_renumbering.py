@@ -0,0 +1,113 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the renumbering of pixels in CSR matrices
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "17/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import sparse_csr
+
+
+class TestRenumbering(IntegratorTestCase):
+    """
+    Integration with pixels renumbered for a better locality
+    """
+
+    def test_hilbert(self):
+        """the curve visits neighbouring pixels"""
+        d = sparse_csr.hilbert_order((4, 4))
+        self.assertEqual(sorted(d), list(range(16)), "all positions of the curve")
+        y, x = numpy.unravel_index(numpy.argsort(d), (4, 4))
+        self.assertEqual((abs(numpy.diff(y)) + abs(numpy.diff(x))).max(), 1, "consecutive pixels are neighbours")
+        d = sparse_csr.hilbert_order((3, 5))
+        self.assertEqual(numpy.unique(d).size, 15, "non square images")
+
+    def test_permutation(self):
+        integr = self.ai.setup_CSR(self.shape, self.npt, unit="2th_deg")
+        for order in ("bin", "hilbert"):
+            perm = sparse_csr.pixel_permutation(integr.indices, integr.indptr, integr.size, order, self.shape)
+            self.assert_(numpy.all(numpy.sort(perm) == numpy.arange(integr.size)), "%s is a permutation" % order)
+        renum = sparse_csr.RenumberedCsrIntegrator(integr, "bin")
+        jumps = lambda indices: abs(numpy.diff(indices.astype(numpy.int64))).mean()
+        logger.info("mean jump between pixels: %s -> %s" % (jumps(integr.indices), jumps(renum.indices)))
+        self.assert_(jumps(renum.indices) < jumps(integr.indices) / 10, "gather is almost sequential")
+
+    def test_integrate(self):
+        """same results whatever the order of pixels, with all corrections"""
+        dark = numpy.random.random(self.shape).astype(numpy.float32)
+        flat = 1 + numpy.random.random(self.shape).astype(numpy.float32)
+        solid_angle = self.ai.solidAngleArray(self.shape)
+        data = self.data.copy()
+        data[10:20, 30:40] = -1
+        for split in ("no", "bbox", "full"):
+            integr = self.ai.setup_CSR(self.shape, self.npt, unit="2th_deg", split=split)
+            ref = integr.integrate(data, dummy=-1, dark=dark, flat=flat, solidAngle=solid_angle)
+            ref_var = integr.integrate_variance(data)
+            for order in ("bin", "hilbert"):
+                renum = sparse_csr.RenumberedCsrIntegrator(integr, order, self.shape)
+                res = renum.integrate(data, dummy=-1, dark=dark, flat=flat, solidAngle=solid_angle)
+                for a, b in zip(ref, res):
+                    self.assert_(numpy.allclose(a, b, rtol=1e-5), "%s with %s" % (split, order))
+                res_var = renum.integrate_variance(data)
+                self.assert_(numpy.allclose(ref_var[4], res_var[4], rtol=1e-4), "variance %s with %s" % (split, order))
+
+    def test_integrator(self):
+        ref = self.ai.integrate1d(self.data, self.npt, method="csr", unit="2th_deg", error_model="azimuthal")
+        self.ai.csr_pixel_order = "hilbert"
+        res = self.ai.integrate1d(self.data, self.npt, method="csr", unit="2th_deg", error_model="azimuthal")
+        self.assertEqual(self.ai._renumbered_integrator.order, "hilbert")
+        self.assert_(numpy.allclose(ref[1], res[1]), "same intensity")
+        self.assert_(numpy.allclose(ref[2], res[2], rtol=1e-4), "same error")
+
+
+def test_suite_all_renumbering():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestRenumbering("test_hilbert"))
+    testSuite.addTest(TestRenumbering("test_permutation"))
+    testSuite.addTest(TestRenumbering("test_integrate"))
+    testSuite.addTest(TestRenumbering("test_integrator"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_renumbering()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the index of pixels by ring used to extract control points
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "17/10/2015"
+
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI.ring_index import RingIndex, contour_pixels
+from pyFAI.marchingsquares import isocontour
+
+
+class TestRingIndex(unittest.TestCase):
+    """
+    Index of the pixels by ring window against full-frame masks
+    """
+    def setUp(self):
+        numpy.random.seed(0)
+        self.shape = (300, 400)
+        y, x = numpy.ogrid[:self.shape[0], :self.shape[1]]
+        self.tth = numpy.sqrt((y - 100.5) ** 2 + (x - 150.3) ** 2) * 1e-4
+        self.data = numpy.random.random(self.shape).astype(numpy.float32)
+        self.mask = numpy.zeros(self.shape, dtype=numpy.int8)
+        self.mask[::3, ::7] = 1
+        # windows as in extract_cpt, the last ones are partly or totally outside of the image
+        tth = numpy.linspace(0.002, 0.05, 30)
+        delta = (tth[1:] - tth[:-1]) / 4.0
+        self.tth_min = tth.copy()
+        self.tth_max = tth.copy()
+        self.tth_max[:-1] += delta
+        self.tth_max[-1] += delta[-1]
+        self.tth_min[1:] -= delta
+        self.tth_min[0] -= delta[0]
+        self.rings = tth
+
+    def test_index(self):
+        index = RingIndex(self.tth, self.tth_min, self.tth_max, self.data, self.mask)
+        self.assertEqual(len(index), self.rings.size)
+        flat = self.data.ravel()
+        for i in range(len(index)):
+            ref = numpy.logical_and(self.tth >= self.tth_min[i], self.tth < self.tth_max[i])
+            ref = numpy.logical_and(ref, numpy.logical_not(self.mask))
+            pixels = numpy.flatnonzero(ref)
+            self.assert_(numpy.array_equal(index[i], pixels), "pixels of ring %s" % i)
+            self.assertEqual(index.count[i], pixels.size)
+            self.assert_(numpy.array_equal(index.mask(i), ref), "mask of ring %s" % i)
+            if pixels.size:
+                self.assertAlmostEqual(index.mean[i], flat[pixels].mean(dtype=numpy.float64), 6)
+                self.assertAlmostEqual(index.std[i], flat[pixels].std(dtype=numpy.float64), 6)
+        self.assertEqual(index.count[-1], 0, "ring outside of the image")
+
+        index = RingIndex(self.tth, self.tth_min, self.tth_max)
+        self.assertEqual(index.mean, None, "no statistics without data")
+        self.assertEqual(index.count.sum(), ((self.tth >= self.tth_min[0]) & (self.tth < self.tth_max[-1])).sum() -
+                         sum(((self.tth >= self.tth_max[i]) & (self.tth < self.tth_min[i + 1])).sum()
+                             for i in range(self.rings.size - 1)), "gaps between windows")
+
+    def test_overlap(self):
+        self.assertRaises(ValueError, RingIndex, self.tth, self.tth_min, self.tth_max + 1e-2)
+
+    def test_contour(self):
+        index = RingIndex(self.tth, self.tth_min, self.tth_max)
+        flat = self.tth.ravel()
+        for i in (2, 10, 16):  # the last one is cut by the border
+            contour = contour_pixels(index[i], flat, self.rings[i], self.shape)
+            rows, cols = numpy.unravel_index(contour, self.shape)
+            points = isocontour(self.tth, self.rings[i])  # x, y
+            # every pixel is next to the iso-contour, and the contour is covered
+            d2 = (rows[:, None] - points[None, :, 1]) ** 2 + (cols[:, None] - points[None, :, 0]) ** 2
+            self.assert_(d2.min(axis=1).max() <= 1.0, "pixels on the contour of ring %s" % i)
+            self.assert_(d2.min(axis=0).max() <= 1.0, "contour of ring %s covered" % i)
+
+
+def test_suite_all_ring_index():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestRingIndex("test_index"))
+    testSuite.addTest(TestRingIndex("test_overlap"))
+    testSuite.addTest(TestRingIndex("test_contour"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_ring_index()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
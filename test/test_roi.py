@@ -0,0 +1,99 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the integration of a region of interest of the detector
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "17/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+
+
+class TestRoi(IntegratorTestCase):
+    """
+    Integration of a rectangular region of interest from a sub-matrix
+    """
+    roi = (slice(50, 120), slice(100, 300))
+
+    def test_full_detector(self):
+        """a region of interest covering the detector gives integrate1d"""
+        ref = self.ai.integrate1d(self.data, self.npt, method="csr", unit="2th_deg")
+        res = self.ai.integrate_roi(self.data, self.npt, (0, self.shape[0], 0, self.shape[1]), method="csr", unit="2th_deg")
+        self.assert_(numpy.allclose(res[0], ref[0]), "same radial positions")
+        self.assert_(numpy.allclose(res[1], ref[1], rtol=1e-4), "same intensity")
+
+    def test_conservation(self):
+        """all pixels of the region are accounted for, and only them"""
+        roi_data = self.data[self.roi]
+        for method in ("csr", "nosplit_csr", "full_csr"):
+            res = self.ai.integrate_roi(self.data, self.npt, self.roi, method=method, unit="2th_deg",
+                                        correctSolidAngle=False, all=True)
+            self.assertAlmostEqual(res["count"].sum() / roi_data.size, 1.0, 4, "count with %s" % method)
+            self.assertAlmostEqual(res["sum"].sum() / roi_data.sum(dtype=numpy.float64), 1.0, 4, "sum with %s" % method)
+            valid = res["count"] > 0
+            self.assert_(abs(res["I"][valid] - 100).max() < 20, "flat signal with %s" % method)
+
+    def test_roi_data(self):
+        """the image can be provided for the region of interest only"""
+        full = self.ai.integrate_roi(self.data, self.npt, self.roi, method="csr", unit="2th_deg")
+        part = self.ai.integrate_roi(self.data[self.roi].copy(), self.npt, self.roi, method="csr", unit="2th_deg")
+        self.assert_(numpy.allclose(full[1], part[1]), "same intensity")
+
+    def test_radial_range(self):
+        """the radial range selects a subset of the bins"""
+        full = self.ai.integrate_roi(self.data, self.npt, self.roi, method="csr", unit="2th_deg")
+        res = self.ai.integrate_roi(self.data, self.npt, self.roi, method="csr", unit="2th_deg", radial_range=(5, 20))
+        self.assert_(res[0].min() >= 5 and res[0].max() <= 20, "positions within range")
+        start = numpy.where(full[0] == res[0][0])[0][0]
+        self.assert_(numpy.allclose(full[1][start:start + res[1].size], res[1]), "same intensity")
+
+
+def test_suite_all_roi():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestRoi("test_full_detector"))
+    testSuite.addTest(TestRoi("test_conservation"))
+    testSuite.addTest(TestRoi("test_roi_data"))
+    testSuite.addTest(TestRoi("test_radial_range"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_roi()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,104 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the multi-sector integration
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+
+
+class TestSectors(IntegratorTestCase):
+    """
+    Multi-sector integration compared to integrate1d on each sector
+    """
+
+    def test_sectors(self):
+        """overlapping sectors give the same profiles as integrate1d"""
+        sectors = [(0, 30), (20, 60), (-170, -120)]
+        for method in ("csr", "nosplit_csr"):
+            radial, I = self.ai.integrate_sectors(self.data, self.npt, sectors=sectors, method=method,
+                                                  unit="2th_deg", radial_range=(1, 30))
+            self.assertEqual(I.shape, (len(sectors), self.npt))
+            for i, sector in enumerate(sectors):
+                ref = self.ai.integrate1d(self.data, self.npt, method=method, unit="2th_deg",
+                                          radial_range=(1, 30), azimuth_range=sector)
+                self.assert_(numpy.allclose(ref[0], radial), "same radial positions")
+                self.assert_(numpy.allclose(ref[1], I[i]), "%s: same profile for sector %s" % (method, sector))
+
+    def test_equal_sectors(self):
+        """equal sectors cover the whole detector"""
+        res = self.ai.integrate_sectors(self.data, self.npt, sectors=4, unit="2th_deg", all=True)
+        self.assertEqual(res["I"].shape, (4, self.npt))
+        self.assertEqual(res["sectors"].shape, (4, 2))
+        chi = numpy.degrees(self.ai.chiArray(self.shape))
+        self.assertAlmostEqual(res["sectors"].min(), chi.min(), 4)
+        self.assertAlmostEqual(res["sectors"].max(), chi.max(), 4)
+        ref = self.ai.integrate1d(self.data, self.npt, method="csr", unit="2th_deg", all=True)
+        self.assert_(numpy.allclose(ref["radial"], res["radial"]), "same radial positions")
+        self.assert_(res["count"].sum() >= ref["count"].sum() * 0.999, "all pixels are in a sector")
+
+    def test_reset(self):
+        """the matrix is rebuilt when the radial range is removed, and only then"""
+        sectors = [(0, 30), (20, 60)]
+        ranged = self.ai.integrate_sectors(self.data, self.npt, sectors=sectors, unit="2th_deg", radial_range=(1, 30))
+        integr = self.ai._sector_integrator
+        self.ai.integrate_sectors(self.data, self.npt, sectors=sectors, unit="2th_deg", radial_range=(1, 30))
+        self.assert_(self.ai._sector_integrator is integr, "same matrix for the same range")
+        full = self.ai.integrate_sectors(self.data, self.npt, sectors=sectors, unit="2th_deg")
+        self.assert_(self.ai._sector_integrator is not integr, "matrix rebuilt without radial range")
+        self.assert_(full[0][0] < ranged[0][0], "radial range covers the whole detector")
+        integr = self.ai._sector_integrator
+        self.ai.integrate_sectors(self.data, self.npt, sectors=sectors, unit="2th_deg")
+        self.assert_(self.ai._sector_integrator is integr, "same matrix without radial range")
+
+
+def test_suite_all_sectors():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestSectors("test_sectors"))
+    testSuite.addTest(TestSectors("test_equal_sectors"))
+    testSuite.addTest(TestSectors("test_reset"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_sectors()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,108 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the integration of sparse frames
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "17/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import sparse_csr
+
+
+class TestSparseFrame(IntegratorTestCase):
+    """
+    Integration of mostly empty frames with the transposed CSR matrix
+    """
+
+    def setUp(self):
+        IntegratorTestCase.setUp(self)
+        self.data = numpy.random.poisson(3, self.shape).astype(numpy.float32)
+        self.data[numpy.random.random(self.shape) > 0.01] = 0
+
+    def test_compact(self):
+        indices, values = sparse_csr.compact_frame(self.data)
+        flat = self.data.ravel()
+        self.assert_(numpy.all(indices == numpy.where(flat != 0)[0]), "indices of non-zero pixels")
+        self.assert_(numpy.all(values == flat[indices]), "values of non-zero pixels")
+        indices, values = sparse_csr.compact_frame(self.data, threshold=3)
+        self.assert_(numpy.all(indices == numpy.where(flat > 3)[0]), "indices above threshold")
+        self.assertEqual(sparse_csr.compact_frame(self.data, max_density=1e-3), None, "frame too dense")
+
+    def test_transpose(self):
+        integr = self.ai.setup_CSR(self.shape, self.npt, unit="2th_deg")
+        data, bins, indptr = sparse_csr.transpose_csr(integr.data, integr.indices, integr.indptr, integr.size)
+        for pixel in (0, 1000, 50000, integr.size - 1):
+            rows = [i for i in range(self.npt) if pixel in integr.indices[integr.indptr[i]:integr.indptr[i + 1]]]
+            self.assertEqual(list(bins[indptr[pixel]:indptr[pixel + 1]]), rows, "bins of pixel %s" % pixel)
+
+    def test_integrate(self):
+        """sparse and dense frames give the result of integrate1d"""
+        sparse = sparse_csr.compact_frame(self.data)
+        for method in ("csr", "nosplit_csr", "full_csr"):
+            ref = self.ai.integrate1d(self.data, self.npt, method=method, unit="2th_deg", polarization_factor=0.9, all=True)
+            res = self.ai.integrate_sparse(self.data, self.npt, method=method, unit="2th_deg", polarization_factor=0.9, all=True)
+            self.assert_(res["density"] < 0.02, "sparse path used with %s" % method)
+            self.assert_(numpy.allclose(res["I"], ref["I"], rtol=1e-4, atol=1e-6), "dense frame with %s" % method)
+            self.assert_(numpy.allclose(res["count"], ref["count"], rtol=1e-4), "coverage with %s" % method)
+            res = self.ai.integrate_sparse(sparse, self.npt, method=method, unit="2th_deg", polarization_factor=0.9)
+            self.assert_(numpy.allclose(res[1], ref["I"], rtol=1e-4, atol=1e-6), "sparse frame with %s" % method)
+
+    def test_dense(self):
+        """dense frames fall back on the CSR integrator"""
+        data = numpy.random.random(self.shape).astype(numpy.float32)
+        ref = self.ai.integrate1d(data, self.npt, method="csr", unit="2th_deg")
+        res = self.ai.integrate_sparse(data, self.npt, method="csr", unit="2th_deg", all=True)
+        self.assertEqual(res["density"], None, "dense path used")
+        self.assert_(numpy.allclose(res["I"], ref[1]), "same result")
+
+
+def test_suite_all_sparse_frame():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestSparseFrame("test_compact"))
+    testSuite.addTest(TestSparseFrame("test_transpose"))
+    testSuite.addTest(TestSparseFrame("test_integrate"))
+    testSuite.addTest(TestSparseFrame("test_dense"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_sparse_frame()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
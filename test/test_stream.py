@@ -0,0 +1,131 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for the streaming integration of bands of rows
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+import threading
+
+
+class TestStream(IntegratorTestCase):
+    """
+    Integration of frames provided as bands of rows, in any order
+    """
+    band = 20
+
+    def setUp(self):
+        IntegratorTestCase.setUp(self)
+        self.data[::7, ::11] = -1
+        self.dark = numpy.random.random(self.shape).astype(numpy.float32)
+        self.starts = list(range(0, self.shape[0], self.band))
+        numpy.random.shuffle(self.starts)
+
+    def test_bands(self):
+        """shuffled bands give the result of integrate1d"""
+        for method in ("csr", "nosplit_csr", "full_csr"):
+            ref = self.ai.integrate1d(self.data, self.npt, method=method, unit="2th_deg", all=True,
+                                      dummy=-1, dark=self.dark, polarization_factor=0.95)
+            stream = self.ai.setup_stream(self.npt, method=method, unit="2th_deg",
+                                          dummy=-1, dark=self.dark, polarization_factor=0.95)
+            for start in self.starts:
+                self.assertFalse(stream.complete, "incomplete frame with %s" % method)
+                stream.add_band(self.data[start:start + self.band], start)
+            self.assert_(stream.complete, "complete frame with %s" % method)
+            res = stream.finalize()
+            self.assert_(numpy.allclose(res[0], ref["radial"]), "same positions with %s" % method)
+            self.assert_(numpy.allclose(res[1], ref["I"], rtol=1e-4), "same intensity with %s" % method)
+            self.assert_(numpy.allclose(res[3], ref["count"], rtol=1e-4), "same count with %s" % method)
+
+    def test_threads(self):
+        """bands are provided concurrently, for several frames"""
+        ref = self.ai.integrate1d(self.data, self.npt, method="csr", unit="2th_deg")
+        stream = self.ai.setup_stream(self.npt, method="csr", unit="2th_deg")
+        for frame in range(2):
+            stream.start()
+            threads = [threading.Thread(target=stream.add_band, args=(self.data[start:start + self.band], start))
+                       for start in self.starts]
+            for thread in threads:
+                thread.start()
+            for thread in threads:
+                thread.join()
+            res = stream.finalize()
+            self.assert_(numpy.allclose(res[1], ref[1], rtol=1e-4), "same intensity for frame %s" % frame)
+
+    def test_read_only(self):
+        """read-only bands are accepted and accumulators are recycled between frames"""
+        ref = self.ai.integrate1d(self.data, self.npt, method="csr", unit="2th_deg")
+        stream = self.ai.setup_stream(self.npt, method="csr", unit="2th_deg")
+        data = self.data.copy()
+        data.setflags(write=False)
+        for frame in range(2):
+            stream.start()
+            for start in self.starts:
+                stream.add_band(data[start:start + self.band], start)
+            res = stream.finalize()
+            self.assert_(numpy.allclose(res[1], ref[1], rtol=1e-4), "same intensity for frame %s" % frame)
+        self.assertEqual(len(stream._accumulators), 1, "a single set of accumulators without concurrency")
+
+    def test_errors(self):
+        stream = self.ai.setup_stream(self.npt, method="csr", unit="2th_deg")
+        stream.add_band(self.data[:self.band], 0)
+        self.assertRaises(RuntimeError, stream.add_band, self.data[:self.band], 0)
+        self.assertRaises(RuntimeError, stream.finalize)
+        for start in self.starts:
+            if start:
+                stream.add_band(self.data[start:start + self.band], start)
+        ref = self.ai.integrate1d(self.data, self.npt, method="csr", unit="2th_deg")
+        self.assert_(numpy.allclose(stream.finalize()[1], ref[1], rtol=1e-4), "rejected band is not accumulated")
+
+
+def test_suite_all_stream():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestStream("test_bands"))
+    testSuite.addTest(TestStream("test_threads"))
+    testSuite.addTest(TestStream("test_read_only"))
+    testSuite.addTest(TestStream("test_errors"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_stream()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -0,0 +1,132 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+#    Project: Fast Azimuthal Integration
+#             https://github.com/pyFAI/pyFAI
+#
+#    Copyright (C) European Synchrotron Radiation Facility, Grenoble, France
+#
+#    Principal author:       Jérôme Kieffer (Jerome.Kieffer@ESRF.eu)
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Test suites for tiled (64 bits, out-of-core) CSR integration matrices
+"""
+from __future__ import absolute_import, print_function, division
+
+__author__ = "Jérôme Kieffer"
+__contact__ = "Jerome.Kieffer@ESRF.eu"
+__license__ = "GPLv3+"
+__copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
+__date__ = "18/10/2015"
+
+import unittest
+import numpy
+import os
+import tempfile
+import sys
+if __name__ == '__main__':
+    import pkgutil
+    __path__ = pkgutil.extend_path([os.path.dirname(__file__)], "pyFAI.test")
+from .utilstest import UtilsTest, getLogger, IntegratorTestCase
+logger = getLogger(__file__)
+pyFAI = sys.modules["pyFAI"]
+from pyFAI import sparse_csr
+
+
+class TestTiledCsr(IntegratorTestCase):
+    """
+    Comparison of tiled integrators with the ones built by setup_CSR
+    """
+    radial_range = (1.0, 25.0)
+    azimuth_range = (-3.0, 3.0)
+
+    def setUp(self):
+        IntegratorTestCase.setUp(self)
+        self.mask = numpy.zeros(self.shape, dtype=numpy.int8)
+        self.mask[50:60, 100:300] = 1
+        fd, self.filename = tempfile.mkstemp(".csr", "pyfai-test-")
+        os.close(fd)
+
+    def tearDown(self):
+        if os.path.exists(self.filename):
+            os.unlink(self.filename)
+
+    def compare(self, npt, split, filename=None, **kwargs):
+        direct = self.ai.setup_CSR(self.shape, npt, unit="2th_deg", split=split, **kwargs)
+        tiled = self.ai.setup_tiled_CSR(self.shape, npt, unit="2th_deg", split=split,
+                                        filename=filename, tile_pixels=10000, **kwargs)
+        self.assert_(len(tiled.tiles) > 1, "several tiles")
+        self.assertEqual(tiled.nnz, direct.indptr[-1], "same number of elements")
+        return tiled.integrate(self.data), direct.integrate(self.data)
+
+    def test_1d(self):
+        """all splitting schemes, in memory and in a file"""
+        for split in ("no", "bbox", "full"):
+            for filename in (None, self.filename):
+                tiled, direct = self.compare(100, split, filename, pos0_range=self.radial_range, mask=self.mask)
+                self.assert_(numpy.allclose(tiled[0], direct[0]), "same positions with %s" % split)
+                self.assert_(numpy.allclose(tiled[1], direct[1], rtol=1e-5), "intensity with %s" % split)
+                self.assert_(numpy.allclose(tiled[3], direct[3], rtol=1e-4), "count with %s" % split)
+
+    def test_2d(self):
+        """2D, with and without explicit ranges"""
+        for split in ("no", "bbox"):
+            tiled, direct = self.compare((100, 360), split, self.filename, pos0_range=self.radial_range,
+                                         pos1_range=self.azimuth_range)
+            for i in range(5):
+                self.assert_(numpy.allclose(tiled[i], direct[i], rtol=1e-4, atol=1e-4), "item %s with %s" % (i, split))
+        tiled, direct = self.compare((100, 360), "bbox")
+        self.assert_(numpy.allclose(tiled[1], direct[1]), "same radial positions")
+        self.assert_(numpy.allclose(tiled[3].sum(), direct[3].sum(), rtol=1e-5), "same total signal")
+        # full pixel splitting is refused in 2D, tiled or not
+        self.assertRaises(NotImplementedError, self.ai.setup_tiled_CSR, self.shape, (100, 360), split="full")
+        self.assertRaises(NotImplementedError, self.ai.integrate2d, self.data, 100, 36, method="full_csr", unit="2th_deg")
+
+    def test_integrator(self):
+        """integrate2d with the tiled method and cleaning of the temporary file"""
+        ref = self.ai.integrate2d(self.data, 100, 36, method="csr", unit="2th_deg")
+        res = self.ai.integrate2d(self.data, 100, 36, method="tiled_csr", unit="2th_deg")
+        integr = self.ai._csr2d_integrator
+        self.assert_(isinstance(integr, sparse_csr.TiledCsrIntegrator), "tiled integrator")
+        self.assert_(numpy.allclose(res[0], ref[0], rtol=1e-4, atol=1e-3), "same intensity")
+        filename = integr.filename
+        self.assert_(os.path.exists(filename), "matrix in a temporary file")
+        del integr
+        self.ai.reset()
+        self.assertFalse(os.path.exists(filename), "temporary file removed")
+
+    def test_overflow(self):
+        """too many elements for int32 indices is reported as a MemoryError"""
+        outMax = numpy.zeros(100, dtype=numpy.int32) + (1 << 24)
+        self.assertEqual(sparse_csr.calc_indptr(outMax)[-1], 100 << 24)
+        outMax[:] = 1 << 26
+        self.assertRaises(MemoryError, sparse_csr.calc_indptr, outMax)
+
+
+def test_suite_all_tiled_csr():
+    testSuite = unittest.TestSuite()
+    testSuite.addTest(TestTiledCsr("test_1d"))
+    testSuite.addTest(TestTiledCsr("test_2d"))
+    testSuite.addTest(TestTiledCsr("test_integrator"))
+    testSuite.addTest(TestTiledCsr("test_overflow"))
+    return testSuite
+
+
+if __name__ == '__main__':
+    mysuite = test_suite_all_tiled_csr()
+    runner = unittest.TextTestRunner()
+    runner.run(mysuite)
@@ -28,7 +28,7 @@ __author__ = "Jérôme Kieffer"
 __contact__ = "jerome.kieffer@esrf.eu"
 __license__ = "LGPLv3+"
 __copyright__ = "European Synchrotron Radiation Facility, Grenoble, France"
-__date__ = "02/02/2015"
+__date__ = "18/10/2015"
 
 PACKAGE = "pyFAI"
 SOURCES = PACKAGE + "-src"
@@ -53,6 +53,7 @@ import numpy
 import shutil
 import json
 import tempfile
+import unittest
 logging.basicConfig(level=logging.WARNING)
 logger = logging.getLogger("%s.utilstest" % PACKAGE)
 
@@ -385,6 +386,25 @@ def recursive_delete(dirname):
 getLogger = UtilsTest.get_logger
 
 
+class IntegratorTestCase(unittest.TestCase):
+    """
+    Common fixture of the tests of the integration engines: a Pilatus 100k
+    close to the sample and a flat image with a gaussian noise (100 +/- 5).
+
+    Sub-classes calling setUp may modify the geometry or replace the data.
+    """
+    npt = 100
+    shape = (195, 487)
+    geometry = {"dist": 0.1, "poni1": 0.02, "poni2": 0.04, "detector": "Pilatus100k"}
+
+    def setUp(self):
+        unittest.TestCase.setUp(self)
+        from pyFAI.azimuthalIntegrator import AzimuthalIntegrator
+        self.ai = AzimuthalIntegrator(**self.geometry)
+        numpy.random.seed(0)
+        self.data = numpy.random.normal(100, 5, self.shape).astype(numpy.float32)
+
+
 def diff_img(ref, obt, comment=""):
     """
     Highlight the difference in images